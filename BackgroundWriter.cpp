@@ -0,0 +1,108 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "BackgroundWriter.h"
+
+// STL
+#include <algorithm>
+
+BackgroundWriter::BackgroundWriter(const size_t maximumQueueLength) :
+  MaximumQueueLength(std::max<size_t>(maximumQueueLength, 1)), Writer(&BackgroundWriter::WriterLoop, this)
+{
+}
+
+BackgroundWriter::~BackgroundWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Stop = true;
+  }
+  this->JobAvailable.notify_one();
+
+  this->Writer.join();
+}
+
+void BackgroundWriter::Enqueue(const std::function<void()>& job)
+{
+  {
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    RethrowError();
+    this->JobTaken.wait(lock, [this]() { return this->Jobs.size() < this->MaximumQueueLength; });
+    this->Jobs.push_back(job);
+  }
+  this->JobAvailable.notify_one();
+}
+
+void BackgroundWriter::Flush()
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  this->Idle.wait(lock, [this]() { return this->Jobs.empty() && !this->Busy; });
+  RethrowError();
+}
+
+void BackgroundWriter::RethrowError()
+{
+  if(this->Error)
+  {
+    std::exception_ptr error = this->Error;
+    this->Error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void BackgroundWriter::WriterLoop()
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  while(true)
+  {
+    this->JobAvailable.wait(lock, [this]() { return this->Stop || !this->Jobs.empty(); });
+
+    if(this->Jobs.empty()) // Only stop once every queued job has run
+    {
+      return;
+    }
+
+    std::function<void()> job = this->Jobs.front();
+    this->Jobs.pop_front();
+    this->Busy = true;
+    this->JobTaken.notify_all();
+
+    lock.unlock();
+    std::exception_ptr error;
+    try
+    {
+      job();
+    }
+    catch(...)
+    {
+      error = std::current_exception();
+    }
+    lock.lock();
+
+    if(error && !this->Error) // Keep the first error, the later ones are usually its consequences
+    {
+      this->Error = error;
+    }
+
+    this->Busy = false;
+    if(this->Jobs.empty())
+    {
+      this->Idle.notify_all();
+    }
+  }
+}
@@ -0,0 +1,96 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef BackgroundWriter_H
+#define BackgroundWriter_H
+
+// STL
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/** A thread that runs queued jobs (typically writing a snapshot to a file) one at a time in the
+  * order in which they were queued. Queueing only waits when the queue is full, so a compute loop
+  * can hand off its output without blocking on I/O unless the I/O falls behind. The jobs should own
+  * (copies of) everything that they use, since the queueing thread goes on to modify its own data.
+  * An exception thrown by a job (e.g. a full disk) is kept and rethrown on the queueing thread by
+  * the next Enqueue() or Flush(), instead of terminating the program. */
+class BackgroundWriter
+{
+public:
+  /** Constructor. Starts the writer thread. At most 'maximumQueueLength' jobs wait to be run, which
+    * bounds the memory held by queued snapshots when the disk is slower than the computation. */
+  explicit BackgroundWriter(const size_t maximumQueueLength = 2);
+
+  /** Destructor. Runs the remaining jobs and joins the writer thread. Errors that have not been
+    * rethrown are lost. */
+  ~BackgroundWriter();
+
+  BackgroundWriter(const BackgroundWriter&) = delete;
+  BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+  /** Queue 'job' to be run on the writer thread, waiting first if the queue is full. Rethrows the
+    * exception of a job that failed since the last Enqueue() or Flush(). */
+  void Enqueue(const std::function<void()>& job);
+
+  /** Block until every job queued so far has finished. Rethrows the exception of a job that failed
+    * since the last Enqueue() or Flush(). */
+  void Flush();
+
+private:
+  /** The function that the writer thread runs until the writer is destroyed. */
+  void WriterLoop();
+
+  /** Rethrow (and forget) the exception of a failed job, if there is one. The mutex must be held. */
+  void RethrowError();
+
+  /** The jobs that have not started yet. */
+  std::deque<std::function<void()> > Jobs;
+
+  /** The largest number of jobs that can wait in the queue. */
+  size_t MaximumQueueLength;
+
+  /** The first exception thrown by a job that has not been rethrown yet. */
+  std::exception_ptr Error;
+
+  /** A flag indicating whether the writer thread is running a job. */
+  bool Busy = false;
+
+  /** A flag telling the writer thread to exit once the queue is empty. */
+  bool Stop = false;
+
+  /** Protects the queue and the flags. */
+  std::mutex Mutex;
+
+  /** Signaled when a job is queued or the writer is stopped. */
+  std::condition_variable JobAvailable;
+
+  /** Signaled when the writer thread takes a job off the queue. */
+  std::condition_variable JobTaken;
+
+  /** Signaled when the queue becomes empty and no job is running. */
+  std::condition_variable Idle;
+
+  /** The writer thread. It is declared last so that it starts after the members above exist. */
+  std::thread Writer;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "BatchPatchMatch.h"
+
+// STL
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+std::vector<BatchJob> ReadBatchManifest(const std::string& fileName)
+{
+  std::ifstream manifest(fileName.c_str());
+  if(!manifest)
+  {
+    throw std::runtime_error("ReadBatchManifest: cannot open " + fileName);
+  }
+
+  std::vector<BatchJob> jobs;
+
+  std::string line;
+  unsigned int lineNumber = 0;
+  while(std::getline(manifest, line))
+  {
+    lineNumber++;
+
+    std::stringstream lineStream(line);
+    BatchJob job;
+    if(!(lineStream >> job.ImageFileName) || job.ImageFileName[0] == '#')
+    {
+      continue;
+    }
+
+    if(!(lineStream >> job.OutputFileName))
+    {
+      std::stringstream error;
+      error << "ReadBatchManifest: line " << lineNumber << " of " << fileName << " has no output file";
+      throw std::runtime_error(error.str());
+    }
+
+    lineStream >> job.MaskFileName;
+
+    jobs.push_back(job);
+  }
+
+  return jobs;
+}
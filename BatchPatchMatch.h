@@ -0,0 +1,205 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef BatchPatchMatch_H
+#define BatchPatchMatch_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+// STL
+#include <memory>
+#include <string>
+#include <vector>
+
+// Custom
+#include "BackgroundWriter.h"
+#include "PatchMatch.h"
+#include "Propagator.h"
+#include "RandomSearch.h"
+#include "ThreadPool.h"
+#include "VectorizedSSD.h"
+
+/** An image of which to compute the NN field in a batch. */
+struct BatchJob
+{
+  /** The image file. */
+  std::string ImageFileName;
+
+  /** The file to which the NN field is written. An .nnf file (see NNFieldFile) keeps the scores,
+    * other formats only get the patch centers (see PatchMatchHelpers::WriteNNField). */
+  std::string OutputFileName;
+
+  /** An optional image file that is nonzero in the known part of the image and zero in the part to
+    * fill (the hole). The NN field is then computed at the pixels of the hole, and the patches are
+    * centered in the known part. If it is empty, the NN field is computed at every pixel, and every
+    * fully defined patch is a valid match. */
+  std::string MaskFileName;
+};
+
+/** The outcome of a BatchJob. */
+struct BatchJobResult
+{
+  /** A flag indicating whether the NN field was computed and written. */
+  bool Succeeded = false;
+
+  /** What went wrong if the job did not succeed. */
+  std::string Error;
+
+  /** The time spent computing and writing the NN field (not reading the image). */
+  double Seconds = 0;
+};
+
+/** Read a manifest of batch jobs. Every line is "image output [mask]". Empty lines and
+  * lines that start with '#' are skipped. A manifest that cannot be read (or a line without an output)
+  * throws std::runtime_error. */
+std::vector<BatchJob> ReadBatchManifest(const std::string& fileName);
+
+/** This class computes the NN fields of many images in one process. The jobs run one after the other,
+  * each on the whole thread pool, so a job is as fast as a single run of PatchMatch and the process
+  * and the pool are only started once. While a job is computed, the image (and mask) of the next job
+  * is read on a background thread. The NN field, the valid patch centers image and the buffers of the
+  * readers are kept from one job to the next, so a job of the same size as (or a smaller size than)
+  * the one before does not allocate them again. A job that fails (e.g. an unreadable image) is
+  * reported in its result and does not stop the batch. Every job starts from a random field, so its
+  * result is the same as that of a standalone PatchMatch with the same settings. */
+template <typename TImage, typename TPatchDistanceFunctor = VectorizedSSD<TImage> >
+class BatchPatchMatch
+{
+public:
+  typedef Propagator<TPatchDistanceFunctor> PropagatorType;
+  typedef RandomSearch<TImage, TPatchDistanceFunctor> RandomSearchType;
+  typedef PatchMatch<TImage, PropagatorType, RandomSearchType> PatchMatchType;
+
+  typedef itk::Image<bool, 2> BoolImageType;
+
+  /** The type of the masks that are read. */
+  typedef itk::Image<unsigned char, 2> MaskImageType;
+
+  /** Compute and write the NN fields of 'jobs'. The results are in the order of the jobs. */
+  std::vector<BatchJobResult> Compute(const std::vector<BatchJob>& jobs);
+
+  /** Set the patch radius. */
+  void SetPatchRadius(const unsigned int patchRadius)
+  {
+    this->PatchRadius = patchRadius;
+  }
+
+  /** Set the number of iterations of every job. */
+  void SetIterations(const unsigned int iterations)
+  {
+    this->Iterations = iterations;
+  }
+
+  /** Set the pool on which every job runs. If none is set, a pool with a thread per core is created
+    * for the batch. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the tile size of the tiled engine (see PatchMatch::SetTileSize). */
+  void SetTileSize(const unsigned int tileSize)
+  {
+    this->TileSize = tileSize;
+  }
+
+  /** Set if propagation candidates are scored incrementally (see Propagator::SetIncremental). */
+  void SetIncremental(const bool incremental)
+  {
+    this->Incremental = incremental;
+  }
+
+  /** Set if the results are truly randomized. This should only be false for testing purposes. */
+  void SetRandom(const bool random)
+  {
+    this->Random = random;
+  }
+
+  /** Set if the progress of the jobs is printed to std::cout. */
+  void SetVerbose(const bool verbose)
+  {
+    this->Verbose = verbose;
+  }
+
+private:
+  typedef itk::ImageFileReader<TImage> ImageReaderType;
+  typedef itk::ImageFileReader<MaskImageType> MaskReaderType;
+
+  /** The readers of a job. There are two of them, so that the next job is read while the images
+    * of the current one are in use. */
+  struct ReaderSlot
+  {
+    typename ImageReaderType::Pointer ImageReader = ImageReaderType::New();
+    typename MaskReaderType::Pointer MaskReader = MaskReaderType::New();
+
+    /** What went wrong reading the job, or empty if it was read. */
+    std::string Error;
+  };
+
+  /** Read the images of 'job' into 'slot'. This runs on the background thread. */
+  static void ReadJob(const BatchJob& job, ReaderSlot& slot);
+
+  /** Compute and write the NN field of 'job', whose images are in 'slot'. */
+  void ComputeJob(const BatchJob& job, ReaderSlot& slot);
+
+  /** Set the valid patch centers image and the target pixels from the mask of 'slot' (or to the
+    * whole image if the job has none). */
+  void ApplyMask(const BatchJob& job, ReaderSlot& slot);
+
+  /** The radius of patches to compare. (Patch side length = 2*radius + 1)*/
+  unsigned int PatchRadius = 5;
+
+  /** The number of iterations of every job. */
+  unsigned int Iterations = 5;
+
+  /** The pool on which every job runs. */
+  ThreadPool* Pool = nullptr;
+
+  /** The tile size of the tiled engine. */
+  unsigned int TileSize = 0;
+
+  /** A flag indicating whether propagation candidates are scored incrementally. */
+  bool Incremental = true;
+
+  /** Determine if the result should be randomized. */
+  bool Random = true;
+
+  /** A flag indicating whether the progress of the jobs is printed. */
+  bool Verbose = false;
+
+  /** The readers of the current and of the next job. */
+  ReaderSlot ReaderSlots[2];
+
+  /** The functors and the PatchMatch object, which are kept so that their buffers are reused. */
+  TPatchDistanceFunctor PatchDistanceFunctor;
+  PropagatorType PropagationFunctor;
+  RandomSearchType RandomSearchFunctor;
+  PatchMatchType PatchMatchObject;
+
+  /** The valid patch centers of the current job. */
+  BoolImageType::Pointer ValidPatchCentersImage = BoolImageType::New();
+
+  /** The pixels at which the NN field of the current job is computed. */
+  std::vector<itk::Index<2> > TargetPixels;
+};
+
+#include "BatchPatchMatch.hpp"
+
+#endif
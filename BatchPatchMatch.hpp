@@ -0,0 +1,238 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef BatchPatchMatch_HPP
+#define BatchPatchMatch_HPP
+
+#include "BatchPatchMatch.h"
+
+// ITK
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+
+// STL
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// Custom
+#include "NNFieldFile.h"
+#include "PatchMatchHelpers.h"
+
+template <typename TImage, typename TPatchDistanceFunctor>
+std::vector<BatchJobResult> BatchPatchMatch<TImage, TPatchDistanceFunctor>::Compute(const std::vector<BatchJob>& jobs)
+{
+  assert(this->PatchRadius > 0);
+
+  std::vector<BatchJobResult> results(jobs.size());
+  if(jobs.empty())
+  {
+    return results;
+  }
+
+  // Without a pool of the caller, the batch brings its own (which is still only started once)
+  std::unique_ptr<ThreadPool> batchPool;
+  ThreadPool* pool = this->Pool;
+  if(!pool)
+  {
+    batchPool.reset(new ThreadPool);
+    pool = batchPool.get();
+  }
+
+  this->PropagationFunctor.SetPatchDistanceFunctor(&this->PatchDistanceFunctor);
+  this->PropagationFunctor.SetPatchRadius(this->PatchRadius);
+  this->PropagationFunctor.SetThreadPool(pool);
+  this->PropagationFunctor.SetIncremental(this->Incremental);
+
+  this->RandomSearchFunctor.SetPatchDistanceFunctor(&this->PatchDistanceFunctor);
+  this->RandomSearchFunctor.SetPatchRadius(this->PatchRadius);
+  this->RandomSearchFunctor.SetThreadPool(pool);
+
+  this->PatchMatchObject.SetPatchRadius(this->PatchRadius);
+  this->PatchMatchObject.SetIterations(this->Iterations);
+  this->PatchMatchObject.SetPropagationFunctor(&this->PropagationFunctor);
+  this->PatchMatchObject.SetRandomSearchFunctor(&this->RandomSearchFunctor);
+  this->PatchMatchObject.SetThreadPool(pool);
+  this->PatchMatchObject.SetTileSize(this->TileSize);
+  this->PatchMatchObject.SetVerbose(false);
+
+  // The images of job i+1 are read into the other slot while job i is computed
+  BackgroundWriter jobReader;
+  jobReader.Enqueue([&jobs, this]() { ReadJob(jobs[0], this->ReaderSlots[0]); });
+
+  for(size_t jobId = 0; jobId < jobs.size(); ++jobId)
+  {
+    jobReader.Flush();
+
+    if(jobId + 1 < jobs.size())
+    {
+      ReaderSlot& nextSlot = this->ReaderSlots[(jobId + 1) % 2];
+      const BatchJob& nextJob = jobs[jobId + 1];
+      jobReader.Enqueue([&nextJob, &nextSlot]() { ReadJob(nextJob, nextSlot); });
+    }
+
+    ReaderSlot& slot = this->ReaderSlots[jobId % 2];
+    BatchJobResult& result = results[jobId];
+
+    if(!slot.Error.empty())
+    {
+      result.Error = slot.Error;
+    }
+    else
+    {
+      try
+      {
+        auto start = std::chrono::steady_clock::now();
+        ComputeJob(jobs[jobId], slot);
+        result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.Succeeded = true;
+      }
+      catch(const std::exception& e)
+      {
+        result.Error = e.what();
+      }
+    }
+
+    if(this->Verbose)
+    {
+      std::cout << "Batch job " << jobId + 1 << " of " << jobs.size() << " (" << jobs[jobId].ImageFileName << "): ";
+      if(result.Succeeded)
+      {
+        std::cout << result.Seconds << " s" << std::endl;
+      }
+      else
+      {
+        std::cout << "failed: " << result.Error << std::endl;
+      }
+    }
+  }
+
+  return results;
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+void BatchPatchMatch<TImage, TPatchDistanceFunctor>::ReadJob(const BatchJob& job, ReaderSlot& slot)
+{
+  slot.Error.clear();
+
+  try
+  {
+    slot.ImageReader->SetFileName(job.ImageFileName);
+    slot.ImageReader->Update();
+
+    if(!job.MaskFileName.empty())
+    {
+      slot.MaskReader->SetFileName(job.MaskFileName);
+      slot.MaskReader->Update();
+    }
+  }
+  catch(const std::exception& e)
+  {
+    slot.Error = e.what();
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+void BatchPatchMatch<TImage, TPatchDistanceFunctor>::ComputeJob(const BatchJob& job, ReaderSlot& slot)
+{
+  TImage* image = slot.ImageReader->GetOutput();
+
+  ApplyMask(job, slot);
+
+  this->PatchDistanceFunctor.SetImage(image);
+
+  // The functors are reset, so the job does not depend on the jobs before it
+  this->PropagationFunctor.SetForward(true);
+  this->RandomSearchFunctor.SetImage(image);
+  this->RandomSearchFunctor.SetRandom(this->Random);
+
+  // The image has to be set before the valid patch centers, which are corrected for it
+  this->PatchMatchObject.SetImage(image);
+  this->PatchMatchObject.SetValidPatchCentersImage(this->ValidPatchCentersImage);
+  this->PatchMatchObject.SetTargetPixels(this->TargetPixels);
+  this->PatchMatchObject.ResetNNField();
+  this->PatchMatchObject.Compute();
+
+  const std::string& outputFileName = job.OutputFileName;
+  if(outputFileName.size() > 4 && outputFileName.substr(outputFileName.size() - 4) == ".nnf")
+  {
+    NNFieldFile::Write(this->PatchMatchObject.GetNNField(), this->PatchRadius, outputFileName);
+  }
+  else
+  {
+    PatchMatchHelpers::WriteNNField(this->PatchMatchObject.GetNNField(), outputFileName);
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+void BatchPatchMatch<TImage, TPatchDistanceFunctor>::ApplyMask(const BatchJob& job, ReaderSlot& slot)
+{
+  const itk::ImageRegion<2> region = slot.ImageReader->GetOutput()->GetLargestPossibleRegion();
+
+  // Allocating a region of the same size as before keeps the buffer
+  this->ValidPatchCentersImage->SetRegions(region);
+  this->ValidPatchCentersImage->Allocate();
+  this->TargetPixels.clear();
+
+  if(job.MaskFileName.empty())
+  {
+    this->ValidPatchCentersImage->FillBuffer(true);
+    return;
+  }
+
+  MaskImageType* mask = slot.MaskReader->GetOutput();
+  if(mask->GetLargestPossibleRegion() != region)
+  {
+    throw std::runtime_error("BatchPatchMatch: " + job.MaskFileName + " does not have the size of " +
+                             job.ImageFileName);
+  }
+
+  itk::ImageRegionConstIterator<MaskImageType> maskIterator(mask, region);
+  itk::ImageRegionIterator<BoolImageType> validIterator(this->ValidPatchCentersImage, region);
+
+  while(!maskIterator.IsAtEnd())
+  {
+    validIterator.Set(maskIterator.Get() != 0);
+    ++maskIterator;
+    ++validIterator;
+  }
+
+  // The hole pixels whose patches are inside of the image are the target pixels
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(region, this->PatchRadius);
+  itk::ImageRegionConstIteratorWithIndex<MaskImageType> holeIterator(mask, internalRegion);
+
+  while(!holeIterator.IsAtEnd())
+  {
+    if(holeIterator.Get() == 0)
+    {
+      this->TargetPixels.push_back(holeIterator.GetIndex());
+    }
+    ++holeIterator;
+  }
+
+  if(this->TargetPixels.empty())
+  {
+    throw std::runtime_error("BatchPatchMatch: " + job.MaskFileName + " has no hole");
+  }
+}
+
+#endif
@@ -0,0 +1,445 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program times the hot paths of PatchMatch (the patch distance functors, propagation,
+  * random search, random initialization and NN field IO) on synthetic images of several sizes
+  * and on the images given on the command line, for several patch radii. The distance functor
+  * is also timed on synthetic float images of 8, 16 and 64 channels.
+  * It prints one CSV row per measurement:
+  *   benchmark,input,width,height,patchRadius,threads,nsPerPixel,evaluationsPerSecond,peakMemoryKB
+  * where a "pixel" is a compared patch pixel for the distance functors and a target pixel for
+  * everything else. The time is the fastest of several repetitions, and the memory is the largest
+  * peak resident set size of the process during one repetition, including the memory that the
+  * repetition only allocated temporarily. The peak is reset before every repetition (by writing to
+  * /proc/self/clear_refs), so it does not carry over from one benchmark to the next. */
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ITK
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkCovariantVector.h"
+#include "itkVectorImage.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+#include <PatchComparison/SSD.h>
+
+// Custom
+#include "NNField.h"
+#include "NNFieldFile.h"
+#include "PatchMatch.h"
+#include "PatchMatchHelpers.h"
+#include "Propagator.h"
+#include "RandomSearch.h"
+#include "ThreadPool.h"
+#include "VectorizedSSD.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef VectorizedSSD<ImageType> PatchDistanceFunctorType;
+typedef Propagator<PatchDistanceFunctorType> PropagatorType;
+typedef RandomSearch<ImageType, PatchDistanceFunctorType> RandomSearchType;
+
+/** The image of the multi-channel distance benchmarks (e.g. features), whose number of channels is set at run time. */
+typedef itk::VectorImage<float, 2> VectorImageType;
+
+/** PatchMatch with the random initialization exposed, so that it can be timed on its own. */
+class BenchmarkPatchMatch : public PatchMatch<ImageType, PropagatorType, RandomSearchType>
+{
+public:
+  using PatchMatch<ImageType, PropagatorType, RandomSearchType>::RandomlyInitializeNNField;
+};
+
+/** The number of times that every measurement is repeated. */
+const unsigned int Repetitions = 3;
+
+/** The number of random patch pairs that the distance functors are timed on. */
+const unsigned int NumberOfPatchPairs = 20000;
+
+/** The name of the file that the NN field IO is timed with. */
+const std::string NNFieldFileName = "PatchMatchBenchmarks.mha";
+
+/** The NN field file that the binary IO benchmarks write and read. */
+const std::string BinaryNNFieldFileName = "PatchMatchBenchmarks.nnf";
+
+/** The time and memory of a benchmark. */
+struct Measurement
+{
+  /** The shortest time of a repetition in seconds. */
+  double Seconds = std::numeric_limits<double>::max();
+
+  /** The largest peak resident set size of a repetition in kilobytes. */
+  long PeakMemoryKB = 0;
+};
+
+/** Reset the peak resident set size of the process to its current resident set size (Linux only). */
+void ResetPeakMemory()
+{
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5";
+}
+
+/** Get the peak resident set size of the process since the last ResetPeakMemory() in kilobytes,
+  * or zero where /proc/self/status does not exist. */
+long GetPeakMemoryKB()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while(std::getline(status, line))
+  {
+    if(line.compare(0, 6, "VmHWM:") == 0)
+    {
+      return std::stol(line.substr(6));
+    }
+  }
+  return 0;
+}
+
+/** Measure 'Repetitions' calls of 'run', each preceded by an untimed call of 'setup'. */
+template <typename TSetup, typename TRun>
+Measurement TimeFastest(TSetup setup, TRun run)
+{
+  typedef std::chrono::steady_clock ClockType;
+
+  Measurement measurement;
+  for(unsigned int repetition = 0; repetition < Repetitions; ++repetition)
+  {
+    setup();
+    ResetPeakMemory();
+    ClockType::time_point start = ClockType::now();
+    run();
+    const double seconds = std::chrono::duration<double>(ClockType::now() - start).count();
+    measurement.Seconds = std::min(measurement.Seconds, seconds);
+    measurement.PeakMemoryKB = std::max(measurement.PeakMemoryKB, GetPeakMemoryKB());
+  }
+  return measurement;
+}
+
+/** Print a CSV row. 'evaluations' is the number of distance computations of one run. */
+template <typename TImage>
+void Report(const std::string& benchmark, const std::string& input, const TImage* const image,
+            const unsigned int patchRadius, const unsigned int threads, const Measurement& measurement,
+            const unsigned long long pixels, const unsigned long long evaluations)
+{
+  std::cout << benchmark << "," << input << ","
+            << image->GetLargestPossibleRegion().GetSize()[0] << ","
+            << image->GetLargestPossibleRegion().GetSize()[1] << ","
+            << patchRadius << "," << threads << ","
+            << measurement.Seconds * 1e9 / pixels << ","
+            << evaluations / measurement.Seconds << ","
+            << measurement.PeakMemoryKB << std::endl;
+}
+
+/** Create a square image of smooth waves with a little noise, so that it has both coherent
+  * regions and no exact repeats. */
+ImageType::Pointer CreateSyntheticImage(const unsigned int sideLength)
+{
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{sideLength, sideLength}};
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(itk::ImageRegion<2>(corner, size));
+  image->Allocate();
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(0, 0, 0);
+
+  itk::ImageRegionIteratorWithIndex<ImageType> imageIterator(image, image->GetLargestPossibleRegion());
+  while(!imageIterator.IsAtEnd())
+  {
+    const itk::Index<2>& index = imageIterator.GetIndex();
+    ImageType::PixelType pixel;
+    for(unsigned int component = 0; component < 3; ++component)
+    {
+      double wave = std::sin(index[0] * 0.07 * (component + 1) + index[1] * 0.05 * (3 - component));
+      pixel[component] = static_cast<unsigned char>(120 + 100 * wave +
+                                                    PatchMatchHelpers::RandomInt(0, 20, randomGenerator));
+    }
+    imageIterator.Set(pixel);
+    ++imageIterator;
+  }
+
+  return image;
+}
+
+/** Create a square image of 'numberOfChannels' channels of uniform noise in [0, 255]. */
+VectorImageType::Pointer CreateSyntheticVectorImage(const unsigned int sideLength, const unsigned int numberOfChannels)
+{
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{sideLength, sideLength}};
+
+  VectorImageType::Pointer image = VectorImageType::New();
+  image->SetRegions(itk::ImageRegion<2>(corner, size));
+  image->SetNumberOfComponentsPerPixel(numberOfChannels);
+  image->Allocate();
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(0, 0, numberOfChannels);
+  std::uniform_real_distribution<float> distribution(0, 255);
+
+  float* const buffer = image->GetBufferPointer();
+  const size_t bufferLength = image->GetLargestPossibleRegion().GetNumberOfPixels() * numberOfChannels;
+  for(size_t component = 0; component < bufferLength; ++component)
+  {
+    buffer[component] = distribution(randomGenerator);
+  }
+
+  return image;
+}
+
+/** Time 'patchDistanceFunctor' on random pairs of patches of 'image'. */
+template <typename TImage, typename TPatchDistanceFunctor>
+void BenchmarkDistance(const std::string& benchmark, const std::string& input, TImage* const image,
+                       const unsigned int patchRadius, TPatchDistanceFunctor& patchDistanceFunctor)
+{
+  patchDistanceFunctor.SetImage(image);
+
+  const itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(image->GetLargestPossibleRegion(), patchRadius);
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(0, 1, 0);
+  std::vector<itk::ImageRegion<2> > regions(2 * NumberOfPatchPairs);
+  for(size_t regionId = 0; regionId < regions.size(); ++regionId)
+  {
+    regions[regionId] = ITKHelpers::GetRegionInRadiusAroundPixel(
+                          PatchMatchHelpers::GetRandomPixelInRegion(internalRegion, randomGenerator), patchRadius);
+  }
+
+  // Keep the sum, so that the distances can not be optimized away
+  float sum = 0;
+  Measurement measurement = TimeFastest([](){},
+                                        [&]()
+                                        {
+                                          for(size_t pairId = 0; pairId < NumberOfPatchPairs; ++pairId)
+                                          {
+                                            sum += patchDistanceFunctor.Distance(regions[2 * pairId], regions[2 * pairId + 1]);
+                                          }
+                                        });
+
+  const unsigned long long patchPixels = (2 * patchRadius + 1) * (2 * patchRadius + 1);
+  Report(benchmark, input, image, patchRadius, 1, measurement, NumberOfPatchPairs * patchPixels, NumberOfPatchPairs);
+
+  if(sum < 0)
+  {
+    std::cerr << "Negative sum of distances" << std::endl;
+  }
+}
+
+/** Time the random initialization, propagation and random search of a nearest neighbor field of
+  * 'image', and the writing and reading of the field. 'threadPool' is not used if it is null. */
+void BenchmarkNNField(const std::string& input, ImageType* const image, const unsigned int patchRadius,
+                      ThreadPool* const threadPool)
+{
+  const unsigned int threads = threadPool ? threadPool->GetNumberOfThreads() : 1;
+
+  const itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(image->GetLargestPossibleRegion(), patchRadius);
+  const unsigned long long targetPixels = internalRegion.GetNumberOfPixels();
+
+  PatchDistanceFunctorType patchDistanceFunctor;
+  patchDistanceFunctor.SetImage(image);
+
+  PropagatorType propagationFunctor;
+  propagationFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  propagationFunctor.SetPatchRadius(patchRadius);
+  propagationFunctor.SetThreadPool(threadPool);
+  propagationFunctor.SetIncremental(true);
+
+  // Every fully defined patch can be matched to
+  typedef itk::Image<bool, 2> BoolImageType;
+  BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+  validPatchCentersImage->SetRegions(image->GetLargestPossibleRegion());
+  validPatchCentersImage->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> validIterator(validPatchCentersImage,
+                                                                 validPatchCentersImage->GetLargestPossibleRegion());
+  while(!validIterator.IsAtEnd())
+  {
+    validIterator.Set(internalRegion.IsInside(validIterator.GetIndex()));
+    ++validIterator;
+  }
+
+  RandomSearchType randomSearchFunctor;
+  randomSearchFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  randomSearchFunctor.SetPatchRadius(patchRadius);
+  randomSearchFunctor.SetImage(image);
+  randomSearchFunctor.SetValidPatchCentersImage(validPatchCentersImage);
+  randomSearchFunctor.SetThreadPool(threadPool);
+  randomSearchFunctor.SetRandom(false);
+
+  BenchmarkPatchMatch patchMatch;
+  patchMatch.SetImage(image);
+  patchMatch.SetPatchRadius(patchRadius);
+  patchMatch.SetPropagationFunctor(&propagationFunctor);
+  patchMatch.SetRandomSearchFunctor(&randomSearchFunctor);
+  patchMatch.SetValidPatchCentersImage(validPatchCentersImage);
+  patchMatch.SetThreadPool(threadPool);
+  patchMatch.SetVerbose(false);
+
+  Measurement measurement = TimeFastest([](){}, [&patchMatch](){ patchMatch.RandomlyInitializeNNField(); });
+  Report("RandomlyInitializeNNField", input, image, patchRadius, threads, measurement, targetPixels, targetPixels);
+
+  // Propagation and random search are timed from the random field, where they do the most work
+  NNFieldType::Pointer randomNNField = NNFieldType::New();
+  ITKHelpers::DeepCopy(patchMatch.GetNNField(), randomNNField.GetPointer());
+
+  NNFieldType::Pointer nnField = NNFieldType::New();
+  auto resetNNField = [&randomNNField, &nnField](){ ITKHelpers::DeepCopy(randomNNField.GetPointer(), nnField.GetPointer()); };
+
+  measurement = TimeFastest(resetNNField, [&](){ propagationFunctor.Propagate(nnField); });
+  Report("Propagate", input, image, patchRadius, threads, measurement, targetPixels,
+         propagationFunctor.GetStatistics().DistanceEvaluations);
+
+  measurement = TimeFastest(resetNNField, [&](){ randomSearchFunctor.Search(nnField); });
+  Report("Search", input, image, patchRadius, threads, measurement, targetPixels,
+         randomSearchFunctor.GetStatistics().DistanceEvaluations);
+
+  // The IO does not depend on the number of threads
+  if(threadPool)
+  {
+    return;
+  }
+
+  measurement = TimeFastest([](){}, [&nnField](){ PatchMatchHelpers::WriteNNField(nnField.GetPointer(), NNFieldFileName); });
+  Report("WriteNNField", input, image, patchRadius, 1, measurement, targetPixels, 0);
+
+  measurement = TimeFastest([](){},
+                            [&nnField, patchRadius]()
+                            {
+                              PatchMatchHelpers::ReadNNField(NNFieldFileName, patchRadius, nnField.GetPointer());
+                            });
+  Report("ReadNNField", input, image, patchRadius, 1, measurement, targetPixels, 0);
+
+  std::remove(NNFieldFileName.c_str());
+
+  measurement = TimeFastest([](){}, [&nnField, patchRadius]()
+                            {
+                              NNFieldFile::Write(nnField.GetPointer(), patchRadius, BinaryNNFieldFileName);
+                            });
+  Report("WriteNNFieldFile", input, image, patchRadius, 1, measurement, targetPixels, 0);
+
+  measurement = TimeFastest([](){}, [&nnField](){ NNFieldFile::Read(BinaryNNFieldFileName, nnField.GetPointer()); });
+  Report("ReadNNFieldFile", input, image, patchRadius, 1, measurement, targetPixels, 0);
+
+  // The compact field is used in place, so opening it only maps the file
+  measurement = TimeFastest([](){}, []()
+                            {
+                              NNFieldFile file;
+                              file.Open(BinaryNNFieldFileName, MappingModeEnum::READ_ONLY);
+                              file.GetNNField();
+                            });
+  Report("OpenNNFieldFile", input, image, patchRadius, 1, measurement, targetPixels, 0);
+
+  std::remove(BinaryNNFieldFileName.c_str());
+}
+
+void BenchmarkImage(const std::string& input, ImageType* const image, ThreadPool* const threadPool)
+{
+  const unsigned int patchRadii[] = {3, 5, 7};
+  for(unsigned int patchRadius : patchRadii)
+  {
+    // Every patch size must fit into the image with room to search
+    if(std::min(image->GetLargestPossibleRegion().GetSize()[0],
+                image->GetLargestPossibleRegion().GetSize()[1]) < 4 * (2 * patchRadius + 1))
+    {
+      continue;
+    }
+
+    SSD<ImageType> ssd;
+    BenchmarkDistance("SSD::Distance", input, image, patchRadius, ssd);
+
+    PatchDistanceFunctorType vectorizedSSD;
+    BenchmarkDistance("VectorizedSSD::Distance", input, image, patchRadius, vectorizedSSD);
+
+    BenchmarkNNField(input, image, patchRadius, nullptr);
+    if(threadPool->GetNumberOfThreads() > 1)
+    {
+      BenchmarkNNField(input, image, patchRadius, threadPool);
+    }
+  }
+}
+
+/** Time the distance of multi-channel images, whose pixels are whole SIMD vectors of floats. */
+void BenchmarkVectorImages()
+{
+  const unsigned int numbersOfChannels[] = {8, 16, 64};
+  const unsigned int patchRadii[] = {3, 5, 7};
+  for(unsigned int numberOfChannels : numbersOfChannels)
+  {
+    VectorImageType::Pointer image = CreateSyntheticVectorImage(256, numberOfChannels);
+    const std::string input = "synthetic" + std::to_string(numberOfChannels) + "channels";
+    for(unsigned int patchRadius : patchRadii)
+    {
+      VectorizedSSD<VectorImageType> vectorizedSSD;
+      BenchmarkDistance("VectorizedSSD::Distance", input, image.GetPointer(), patchRadius, vectorizedSSD);
+    }
+  }
+}
+
+int main(int argc, char*argv[])
+{
+  std::vector<std::string> imageFileNames(argv + 1, argv + argc);
+#ifdef PatchMatch_BENCHMARK_IMAGE
+  if(imageFileNames.empty())
+  {
+    imageFileNames.push_back(PatchMatch_BENCHMARK_IMAGE);
+  }
+#endif
+
+  ThreadPool threadPool(std::max(std::thread::hardware_concurrency(), 1u));
+
+  std::cout << "benchmark,input,width,height,patchRadius,threads,nsPerPixel,evaluationsPerSecond,peakMemoryKB" << std::endl;
+
+  const unsigned int sideLengths[] = {128, 256, 512};
+  for(unsigned int sideLength : sideLengths)
+  {
+    ImageType::Pointer image = CreateSyntheticImage(sideLength);
+    BenchmarkImage("synthetic", image, &threadPool);
+  }
+
+  BenchmarkVectorImages();
+
+  for(const std::string& imageFileName : imageFileNames)
+  {
+    typedef itk::ImageFileReader<ImageType> ImageReaderType;
+    ImageReaderType::Pointer imageReader = ImageReaderType::New();
+    imageReader->SetFileName(imageFileName);
+    try
+    {
+      imageReader->Update();
+    }
+    catch(const std::exception& exception)
+    {
+      std::cerr << "Could not read " << imageFileName << ": " << exception.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    BenchmarkImage(imageFileName, imageReader->GetOutput(), &threadPool);
+  }
+
+  return EXIT_SUCCESS;
+}
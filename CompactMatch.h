@@ -0,0 +1,127 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CompactMatch_H
+#define CompactMatch_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+/** A match that stores the offset from the pixel that it is the match of to the center of the
+  * matching patch, along with the score. The patch region is only formed (from the patch radius)
+  * when it is needed. With 16 bit offsets (enough for images up to 32767 pixels wide and high)
+  * this is 8 bytes, compared to the 40 bytes of Match. Unlike Match it is not limited to 2D:
+  * VDimension is the dimension of the images (3 for volumes).
+  */
+template <typename TOffset, unsigned int VDimension = 2>
+class CompactMatch
+{
+public:
+  typedef itk::Index<VDimension> IndexType;
+  typedef itk::ImageRegion<VDimension> RegionType;
+
+  /** Get the center of the matching region, which is the match of 'pixel'. */
+  IndexType GetCenter(const IndexType& pixel) const
+  {
+    IndexType center;
+    for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+    {
+      center[dimension] = pixel[dimension] + this->Offset[dimension];
+    }
+    return center;
+  }
+
+  /** Set the matching region of 'pixel' to the patch around 'center'. The patch radius is not
+    * stored, so it is not used. The offset has to fit in TOffset, which is only asserted here: the
+    * engines check the whole images once with CanStoreOffsets(). */
+  void SetCenter(const IndexType& pixel, const IndexType& center, const unsigned int /* patchRadius */)
+  {
+    for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+    {
+      itk::OffsetValueType offset = center[dimension] - pixel[dimension];
+      assert(offset >= std::numeric_limits<TOffset>::min() && offset <= std::numeric_limits<TOffset>::max());
+      this->Offset[dimension] = static_cast<TOffset>(offset);
+    }
+  }
+
+  /** Determine if the offset from every pixel of 'targetRegion' to every pixel of 'sourceRegion'
+    * fits in TOffset. */
+  static bool CanStoreOffsets(const RegionType& sourceRegion, const RegionType& targetRegion)
+  {
+    if(sourceRegion.GetNumberOfPixels() == 0 || targetRegion.GetNumberOfPixels() == 0)
+    {
+      return true;
+    }
+
+    for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+    {
+      const itk::OffsetValueType sourceStart = sourceRegion.GetIndex()[dimension];
+      const itk::OffsetValueType sourceEnd = sourceStart + static_cast<itk::OffsetValueType>(sourceRegion.GetSize()[dimension]) - 1;
+      const itk::OffsetValueType targetStart = targetRegion.GetIndex()[dimension];
+      const itk::OffsetValueType targetEnd = targetStart + static_cast<itk::OffsetValueType>(targetRegion.GetSize()[dimension]) - 1;
+      if(sourceStart - targetEnd < std::numeric_limits<TOffset>::min() ||
+         sourceEnd - targetStart > std::numeric_limits<TOffset>::max())
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Get the patch of 'patchRadius' around the center of the match of 'pixel'. */
+  RegionType GetRegion(const IndexType& pixel, const unsigned int patchRadius) const
+  {
+    IndexType corner = GetCenter(pixel);
+    itk::Size<VDimension> size;
+    for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+    {
+      corner[dimension] -= static_cast<itk::IndexValueType>(patchRadius);
+      size[dimension] = 2 * patchRadius + 1;
+    }
+    return RegionType(corner, size);
+  }
+
+  void SetScore(const float& score)
+  {
+    this->Score = score;
+  }
+
+  float GetScore() const
+  {
+    return this->Score;
+  }
+
+  bool operator==(const CompactMatch &other) const
+  {
+    return std::equal(this->Offset, this->Offset + VDimension, other.Offset) && this->Score == other.Score;
+  }
+
+private:
+  /** The offset from the pixel to the center of the matching patch. */
+  TOffset Offset[VDimension] = {};
+
+  /** The score according to which ever PatchDistanceFunctor is being used. */
+  float Score = 0;
+};
+
+#endif
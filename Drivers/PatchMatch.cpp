@@ -16,7 +16,8 @@
  *
  *=========================================================================*/
 
-/** This program computes the NN field of an image. */
+/** This program computes the NN field of an image, or with --manifest, the NN fields of all of the
+  * images of a manifest (see ReadBatchManifest) in one process. */
 
 // STL
 #include <iostream>
@@ -30,12 +31,40 @@
 // Submodules
 #include <Mask/Mask.h>
 #include <Mask/ITKHelpers/ITKHelpers.h>
-#include <PatchComparison/SSD.h>
-
 // Custom
+#include "BatchPatchMatch.h"
+#include "NNFieldFile.h"
 #include "PatchMatch.h"
 #include "Propagator.h"
 #include "RandomSearch.h"
+#include "VectorizedSSD.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+/** Compute the NN fields of the jobs of 'manifestFilename'. */
+int ComputeManifest(const std::string& manifestFilename, const unsigned int patchRadius)
+{
+  std::vector<BatchJob> jobs = ReadBatchManifest(manifestFilename);
+  std::cout << "Read " << jobs.size() << " jobs from " << manifestFilename << std::endl;
+
+  BatchPatchMatch<ImageType> batchPatchMatch;
+  batchPatchMatch.SetPatchRadius(patchRadius);
+  batchPatchMatch.SetVerbose(true);
+  std::vector<BatchJobResult> results = batchPatchMatch.Compute(jobs);
+
+  unsigned int numberOfFailedJobs = 0;
+  for(size_t jobId = 0; jobId < results.size(); ++jobId)
+  {
+    if(!results[jobId].Succeeded)
+    {
+      numberOfFailedJobs++;
+    }
+  }
+
+  std::cout << numberOfFailedJobs << " of " << jobs.size() << " jobs failed" << std::endl;
+
+  return numberOfFailedJobs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 int main(int argc, char*argv[])
 {
@@ -43,9 +72,21 @@ int main(int argc, char*argv[])
   if(argc < 4)
   {
     std::cerr << "Required arguments: image patchRadius output" << std::endl;
+    std::cerr << "            or: --manifest manifest patchRadius" << std::endl;
     return EXIT_FAILURE;
   }
 
+  if(std::string(argv[1]) == "--manifest")
+  {
+    std::stringstream manifestArguments;
+    manifestArguments << argv[2] << " " << argv[3];
+    std::string manifestFilename;
+    unsigned int patchRadius;
+    manifestArguments >> manifestFilename >> patchRadius;
+
+    return ComputeManifest(manifestFilename, patchRadius);
+  }
+
   // Parse arguments
   std::stringstream ss;
   for(int i = 1; i < argc; ++i)
@@ -63,8 +104,6 @@ int main(int argc, char*argv[])
   std::cout << "patchRadius: " << patchRadius << std::endl;
   std::cout << "outputFilename: " << outputFilename << std::endl;
 
-  typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
-
   typedef itk::ImageFileReader<ImageType> ImageReaderType;
   ImageReaderType::Pointer imageReader = ImageReaderType::New();
   imageReader->SetFileName(imageFilename);
@@ -72,12 +111,15 @@ int main(int argc, char*argv[])
 
   ImageType* image = imageReader->GetOutput();
 
-  typedef SSD<ImageType> PatchDistanceFunctorType;
+  typedef VectorizedSSD<ImageType> PatchDistanceFunctorType;
   PatchDistanceFunctorType* patchDistanceFunctor = new PatchDistanceFunctorType;
   patchDistanceFunctor->SetImage(image);
 
   typedef Propagator<PatchDistanceFunctorType> PropagatorType;
   PropagatorType* propagator = new PropagatorType;
+  propagator->SetPatchDistanceFunctor(patchDistanceFunctor);
+  propagator->SetPatchRadius(patchRadius);
+  propagator->SetIncremental(true);
 
   typedef RandomSearch<ImageType, PatchDistanceFunctorType> RandomSearchType;
   RandomSearchType* randomSearchFunctor = new RandomSearchType;
@@ -92,7 +134,15 @@ int main(int argc, char*argv[])
 
   patchMatch.Compute();
 
-  PatchMatchHelpers::WriteNNField(patchMatch.GetNNField(), outputFilename);
+  // An .nnf output keeps the scores (see NNFieldFile), other formats only get the patch centers
+  if(outputFilename.size() > 4 && outputFilename.substr(outputFilename.size() - 4) == ".nnf")
+  {
+    NNFieldFile::Write(patchMatch.GetNNField(), patchRadius, outputFilename);
+  }
+  else
+  {
+    PatchMatchHelpers::WriteNNField(patchMatch.GetNNField(), outputFilename);
+  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,88 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program computes the NN field of an image that is too large to be in memory. The image and the
+  * optional masks are raw files (see MappedImage), and the NN field is written as an NN field file
+  * (see NNFieldFile). */
+
+// STL
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+
+// Custom
+#include "OutOfCorePatchMatch.h"
+#include "ThreadPool.h"
+
+int main(int argc, char*argv[])
+{
+  // Verify arguments
+  if(argc < 6)
+  {
+    std::cerr << "Required arguments: image.raw width height patchRadius output.nnf"
+              << " [validPatchCenters.raw] [targetPixels.raw]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Parse arguments
+  std::stringstream ss;
+  for(int i = 1; i < 6; ++i)
+  {
+    ss << argv[i] << " ";
+  }
+  std::string imageFilename;
+  itk::Size<2> size;
+  unsigned int patchRadius;
+  std::string outputFilename;
+
+  ss >> imageFilename >> size[0] >> size[1] >> patchRadius >> outputFilename;
+
+  std::string validPatchCentersFilename = argc > 6 ? argv[6] : "";
+  std::string targetPixelsFilename = argc > 7 ? argv[7] : "";
+
+  // Output arguments
+  std::cout << "imageFilename: " << imageFilename << std::endl;
+  std::cout << "size: " << size << std::endl;
+  std::cout << "patchRadius: " << patchRadius << std::endl;
+  std::cout << "outputFilename: " << outputFilename << std::endl;
+  std::cout << "validPatchCentersFilename: " << validPatchCentersFilename << std::endl;
+  std::cout << "targetPixelsFilename: " << targetPixelsFilename << std::endl;
+
+  typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+  ThreadPool threadPool;
+
+  OutOfCorePatchMatch<ImageType> patchMatch;
+  patchMatch.SetImageFile(imageFilename, size);
+  patchMatch.SetValidPatchCentersFile(validPatchCentersFilename);
+  patchMatch.SetTargetPixelsFile(targetPixelsFilename);
+  patchMatch.SetNNFieldFile(outputFilename);
+  patchMatch.SetPatchRadius(patchRadius);
+  patchMatch.SetThreadPool(&threadPool);
+
+  // On large images the whole image random search would mostly miss the source tile cache
+  patchMatch.SetMaximumSearchRadius(2048);
+
+  patchMatch.Compute();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ExemplarLibrary_H
+#define ExemplarLibrary_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// STL
+#include <limits>
+#include <vector>
+
+// Custom
+#include "ValidPatchCentersIndex.h"
+
+/** A match into an ExemplarLibrary: the exemplar and the center of the patch in it (in the
+  * coordinates of the exemplar image). */
+struct ExemplarMatch
+{
+  /** The id of a match that is not in any exemplar (e.g. the border pixels of a target). */
+  static const unsigned int NoExemplar = std::numeric_limits<unsigned int>::max();
+
+  unsigned int ExemplarId = NoExemplar;
+
+  itk::Index<2> Center = {{0, 0}};
+
+  float Score = std::numeric_limits<float>::infinity();
+};
+
+typedef itk::Image<ExemplarMatch, 2> ExemplarNNFieldType;
+
+/** A set of source images (exemplars) that targets are matched to as a whole. The exemplars are
+  * laid out side by side in a virtual "atlas" coordinate system, in which PatchMatch runs
+  * unmodified: a match is a patch of the atlas, which GetExemplarMatch() turns back into an
+  * exemplar and a position in it. The atlas is never stored as an image. Everything that only
+  * depends on the exemplars (the layout and the sampling index of the valid patch centers) is built
+  * once by Build(), after which the library is not modified, so any number of requests (even
+  * concurrent ones) share it. Since the index draws the valid centers of the whole atlas uniformly,
+  * random search picks an exemplar with a probability proportional to its valid area. */
+template <typename TImage>
+class ExemplarLibrary
+{
+public:
+  typedef itk::Image<bool, 2> BoolImageType;
+
+  /** Add an exemplar, which is referenced (not copied). Only the centers that are true in
+    * 'validPatchCentersImage' (of the size of the exemplar) are drawn by random search; without it,
+    * every fully defined patch is valid. Returns the id of the exemplar. */
+  unsigned int AddExemplar(TImage* const exemplar, BoolImageType* const validPatchCentersImage = nullptr);
+
+  /** Lay out the exemplars and build the sampling index of their valid patch centers for patches of
+    * 'patchRadius'. This has to be called after the last exemplar is added and before the library is used. */
+  void Build(const unsigned int patchRadius);
+
+  unsigned int GetNumberOfExemplars() const
+  {
+    return static_cast<unsigned int>(this->Exemplars.size());
+  }
+
+  TImage* GetExemplar(const unsigned int exemplarId) const
+  {
+    return this->Exemplars[exemplarId].Image;
+  }
+
+  /** Get the region of the exemplar in the atlas. */
+  const itk::ImageRegion<2>& GetAtlasRegion(const unsigned int exemplarId) const
+  {
+    return this->Exemplars[exemplarId].AtlasRegion;
+  }
+
+  /** Get the number of valid patch centers of the exemplar. */
+  unsigned int GetNumberOfValidPatchCenters(const unsigned int exemplarId) const
+  {
+    return this->ValidPatchCenters.GetNumberOfValidPixels(this->Exemplars[exemplarId].AtlasRegion);
+  }
+
+  /** Get an image that has the region of the atlas but no pixels. It is the source image of
+    * PatchMatch and RandomSearch, which only use its region. */
+  TImage* GetAtlasImage() const
+  {
+    return this->AtlasImage;
+  }
+
+  /** Get the sampling index of the valid patch centers of the atlas (see RandomSearch::SetValidPatchCentersIndex). */
+  const ValidPatchCentersIndex* GetValidPatchCentersIndex() const
+  {
+    return &this->ValidPatchCenters;
+  }
+
+  unsigned int GetPatchRadius() const
+  {
+    return this->PatchRadius;
+  }
+
+  /** Find the exemplar that contains the region 'atlasRegion' of the atlas. Returns false if no
+    * exemplar contains all of it (the region straddles two exemplars or the unused part of the atlas). */
+  bool FindExemplar(const itk::ImageRegion<2>& atlasRegion, unsigned int& exemplarId) const;
+
+  /** Get the region of the exemplar 'exemplarId' that is 'atlasRegion' in the atlas. */
+  itk::ImageRegion<2> GetExemplarRegion(const unsigned int exemplarId, const itk::ImageRegion<2>& atlasRegion) const;
+
+  /** Convert a match center in the atlas to an exemplar match. The exemplar id is ExemplarMatch::NoExemplar
+    * if the patch is not in an exemplar. */
+  ExemplarMatch GetExemplarMatch(const itk::Index<2>& atlasCenter, const float score) const;
+
+private:
+  struct Exemplar
+  {
+    typename TImage::Pointer Image;
+
+    typename BoolImageType::Pointer ValidPatchCentersImage;
+
+    itk::ImageRegion<2> AtlasRegion;
+  };
+
+  /** A row of the atlas. The exemplars of a shelf are sorted by their position in it. */
+  struct Shelf
+  {
+    itk::IndexValueType Top = 0;
+
+    itk::SizeValueType Height = 0;
+
+    std::vector<unsigned int> ExemplarIds;
+  };
+
+  /** Place the exemplars on shelves, the tallest first, so that the atlas is about square. */
+  void Layout();
+
+  /** The exemplars in the order of their ids. */
+  std::vector<Exemplar> Exemplars;
+
+  /** The rows of the atlas from top to bottom. */
+  std::vector<Shelf> Shelves;
+
+  /** The geometry of the atlas. */
+  typename TImage::Pointer AtlasImage = TImage::New();
+
+  /** The sampling index of the valid patch centers of all exemplars. */
+  ValidPatchCentersIndex ValidPatchCenters;
+
+  unsigned int PatchRadius = 0;
+};
+
+#include "ExemplarLibrary.hpp"
+
+#endif
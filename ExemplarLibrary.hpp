@@ -0,0 +1,213 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ExemplarLibrary_HPP
+#define ExemplarLibrary_HPP
+
+#include "ExemplarLibrary.h"
+
+// ITK
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+template <typename TImage>
+unsigned int ExemplarLibrary<TImage>::AddExemplar(TImage* const exemplar, BoolImageType* const validPatchCentersImage)
+{
+  assert(exemplar);
+  assert(!validPatchCentersImage ||
+         validPatchCentersImage->GetLargestPossibleRegion() == exemplar->GetLargestPossibleRegion());
+
+  Exemplar newExemplar;
+  newExemplar.Image = exemplar;
+  newExemplar.ValidPatchCentersImage = validPatchCentersImage;
+  this->Exemplars.push_back(newExemplar);
+
+  return static_cast<unsigned int>(this->Exemplars.size() - 1);
+}
+
+template <typename TImage>
+void ExemplarLibrary<TImage>::Build(const unsigned int patchRadius)
+{
+  assert(!this->Exemplars.empty());
+
+  this->PatchRadius = patchRadius;
+
+  Layout();
+
+  itk::Size<2> atlasSize = {{0, 0}};
+  for(size_t exemplarId = 0; exemplarId < this->Exemplars.size(); ++exemplarId)
+  {
+    const itk::ImageRegion<2>& atlasRegion = this->Exemplars[exemplarId].AtlasRegion;
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      atlasSize[dimension] = std::max(atlasSize[dimension],
+                                      static_cast<itk::SizeValueType>(atlasRegion.GetIndex()[dimension] +
+                                                                      atlasRegion.GetSize()[dimension]));
+    }
+  }
+
+  itk::Index<2> atlasCorner = {{0, 0}};
+  itk::ImageRegion<2> atlasRegion(atlasCorner, atlasSize);
+  this->AtlasImage->SetLargestPossibleRegion(atlasRegion);
+
+  // The valid patch centers of the atlas are only needed to build the index
+  BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+  validPatchCentersImage->SetRegions(atlasRegion);
+  validPatchCentersImage->Allocate();
+  validPatchCentersImage->FillBuffer(false);
+
+  for(size_t exemplarId = 0; exemplarId < this->Exemplars.size(); ++exemplarId)
+  {
+    const Exemplar& exemplar = this->Exemplars[exemplarId];
+    itk::ImageRegion<2> exemplarRegion = exemplar.Image->GetLargestPossibleRegion();
+    itk::Offset<2> atlasOffset = exemplar.AtlasRegion.GetIndex() - exemplarRegion.GetIndex();
+
+    // Only the patches that are entirely inside of the exemplar can be drawn
+    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(exemplarRegion, patchRadius);
+    itk::ImageRegionConstIteratorWithIndex<TImage> exemplarIterator(exemplar.Image, internalRegion);
+    while(!exemplarIterator.IsAtEnd())
+    {
+      const itk::Index<2>& pixel = exemplarIterator.GetIndex();
+      validPatchCentersImage->SetPixel(pixel + atlasOffset,
+                                       !exemplar.ValidPatchCentersImage || exemplar.ValidPatchCentersImage->GetPixel(pixel));
+      ++exemplarIterator;
+    }
+  }
+
+  this->ValidPatchCenters.Build(validPatchCentersImage);
+}
+
+template <typename TImage>
+void ExemplarLibrary<TImage>::Layout()
+{
+  std::vector<unsigned int> order(this->Exemplars.size());
+  itk::SizeValueType maximumWidth = 0;
+  double totalArea = 0;
+  for(unsigned int exemplarId = 0; exemplarId < this->Exemplars.size(); ++exemplarId)
+  {
+    order[exemplarId] = exemplarId;
+    itk::Size<2> size = this->Exemplars[exemplarId].Image->GetLargestPossibleRegion().GetSize();
+    maximumWidth = std::max(maximumWidth, size[0]);
+    totalArea += static_cast<double>(size[0]) * static_cast<double>(size[1]);
+  }
+
+  std::stable_sort(order.begin(), order.end(), [this](const unsigned int a, const unsigned int b)
+  {
+    return this->Exemplars[a].Image->GetLargestPossibleRegion().GetSize()[1] >
+           this->Exemplars[b].Image->GetLargestPossibleRegion().GetSize()[1];
+  });
+
+  const itk::SizeValueType atlasWidth =
+    std::max(maximumWidth, static_cast<itk::SizeValueType>(std::ceil(std::sqrt(totalArea))));
+
+  this->Shelves.clear();
+  itk::IndexValueType x = 0;
+  for(size_t orderId = 0; orderId < order.size(); ++orderId)
+  {
+    Exemplar& exemplar = this->Exemplars[order[orderId]];
+    itk::Size<2> size = exemplar.Image->GetLargestPossibleRegion().GetSize();
+
+    if(this->Shelves.empty() || x + static_cast<itk::IndexValueType>(size[0]) > static_cast<itk::IndexValueType>(atlasWidth))
+    {
+      Shelf shelf;
+      if(!this->Shelves.empty())
+      {
+        shelf.Top = this->Shelves.back().Top + static_cast<itk::IndexValueType>(this->Shelves.back().Height);
+      }
+      this->Shelves.push_back(shelf);
+      x = 0;
+    }
+
+    Shelf& shelf = this->Shelves.back();
+    itk::Index<2> corner = {{x, shelf.Top}};
+    exemplar.AtlasRegion = itk::ImageRegion<2>(corner, size);
+    shelf.Height = std::max(shelf.Height, size[1]);
+    shelf.ExemplarIds.push_back(order[orderId]);
+    x += static_cast<itk::IndexValueType>(size[0]);
+  }
+}
+
+template <typename TImage>
+bool ExemplarLibrary<TImage>::FindExemplar(const itk::ImageRegion<2>& atlasRegion, unsigned int& exemplarId) const
+{
+  const itk::Index<2>& corner = atlasRegion.GetIndex();
+
+  // The last shelf that starts above the corner, then the last exemplar on it that starts left of the corner
+  typename std::vector<Shelf>::const_iterator shelf =
+    std::upper_bound(this->Shelves.begin(), this->Shelves.end(), corner[1],
+                     [](const itk::IndexValueType y, const Shelf& s) { return y < s.Top; });
+  if(shelf == this->Shelves.begin())
+  {
+    return false;
+  }
+  --shelf;
+
+  std::vector<unsigned int>::const_iterator exemplar =
+    std::upper_bound(shelf->ExemplarIds.begin(), shelf->ExemplarIds.end(), corner[0],
+                     [this](const itk::IndexValueType x, const unsigned int id)
+                     { return x < this->Exemplars[id].AtlasRegion.GetIndex()[0]; });
+  if(exemplar == shelf->ExemplarIds.begin())
+  {
+    return false;
+  }
+  --exemplar;
+
+  if(!this->Exemplars[*exemplar].AtlasRegion.IsInside(atlasRegion))
+  {
+    return false;
+  }
+
+  exemplarId = *exemplar;
+  return true;
+}
+
+template <typename TImage>
+itk::ImageRegion<2> ExemplarLibrary<TImage>::GetExemplarRegion(const unsigned int exemplarId,
+                                                               const itk::ImageRegion<2>& atlasRegion) const
+{
+  const Exemplar& exemplar = this->Exemplars[exemplarId];
+  itk::Index<2> corner = exemplar.Image->GetLargestPossibleRegion().GetIndex() +
+                         (atlasRegion.GetIndex() - exemplar.AtlasRegion.GetIndex());
+  return itk::ImageRegion<2>(corner, atlasRegion.GetSize());
+}
+
+template <typename TImage>
+ExemplarMatch ExemplarLibrary<TImage>::GetExemplarMatch(const itk::Index<2>& atlasCenter, const float score) const
+{
+  ExemplarMatch exemplarMatch;
+  exemplarMatch.Score = score;
+
+  itk::ImageRegion<2> atlasRegion = ITKHelpers::GetRegionInRadiusAroundPixel(atlasCenter, this->PatchRadius);
+  unsigned int exemplarId = 0;
+  if(FindExemplar(atlasRegion, exemplarId))
+  {
+    exemplarMatch.ExemplarId = exemplarId;
+    exemplarMatch.Center = ITKHelpers::GetRegionCenter(GetExemplarRegion(exemplarId, atlasRegion));
+  }
+
+  return exemplarMatch;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ExemplarLibrarySSD_H
+#define ExemplarLibrarySSD_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// STL
+#include <limits>
+
+// Custom
+#include "ExemplarLibrary.h"
+#include "VectorizedSSD.h"
+
+/** The VectorizedSSD of a patch of the atlas of an ExemplarLibrary (the first patch) and a patch of
+  * the target image. The atlas patch is read from the exemplar that contains it. A patch that is not
+  * inside of a single exemplar is infinitely far from everything, so propagation never moves a match
+  * across the edge of its exemplar. Distance() does not modify the functor, so it is safe to call
+  * from several threads at once. */
+template <typename TImage>
+class ExemplarLibrarySSD
+{
+public:
+  /** Set the library that the first patches are taken from. */
+  void SetLibrary(const ExemplarLibrary<TImage>* const library)
+  {
+    this->Library = library;
+  }
+
+  /** Set the image that the second patch (the patch to match) is taken from. */
+  void SetTargetImage(TImage* const targetImage)
+  {
+    this->TargetImage = targetImage;
+  }
+
+  /** Compute the sum of squared differences of 'region1' of the atlas and 'region2' of the target image. */
+  float Distance(const itk::ImageRegion<2>& region1, const itk::ImageRegion<2>& region2) const
+  {
+    return Distance(region1, region2, std::numeric_limits<float>::infinity());
+  }
+
+  /** Compute the distance like above, but stop once it reaches 'upperBound' (see VectorizedSSD). */
+  float Distance(const itk::ImageRegion<2>& region1, const itk::ImageRegion<2>& region2, const float upperBound) const
+  {
+    assert(this->Library && this->TargetImage);
+
+    unsigned int exemplarId = 0;
+    if(!this->Library->FindExemplar(region1, exemplarId))
+    {
+      return std::numeric_limits<float>::infinity();
+    }
+
+    return VectorizedSSD<TImage>::Distance(this->Library->GetExemplar(exemplarId),
+                                           this->Library->GetExemplarRegion(exemplarId, region1),
+                                           this->TargetImage, region2, upperBound);
+  }
+
+private:
+  /** The library that the first patches are taken from. */
+  const ExemplarLibrary<TImage>* Library = nullptr;
+
+  /** The image that the second patches are taken from. */
+  TImage* TargetImage = nullptr;
+};
+
+#endif
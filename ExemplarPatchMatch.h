@@ -0,0 +1,144 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ExemplarPatchMatch_H
+#define ExemplarPatchMatch_H
+
+// ITK
+#include "itkImage.h"
+
+// STL
+#include <vector>
+
+// Custom
+#include "ExemplarLibrary.h"
+#include "ExemplarLibrarySSD.h"
+#include "NNField.h"
+#include "PatchMatch.h"
+#include "Propagator.h"
+#include "RandomSearch.h"
+#include "ThreadPool.h"
+
+/** This class matches target images to an ExemplarLibrary in a single run of PatchMatch over the
+  * atlas of the library, instead of one run per exemplar. A match moves to another exemplar through
+  * random search, which draws from the valid patch centers of all exemplars, and then spreads
+  * through propagation like any other match. The library is only read, so several of these objects
+  * (e.g. one per request) can share it. */
+template <typename TImage>
+class ExemplarPatchMatch
+{
+public:
+  typedef ExemplarLibrarySSD<TImage> PatchDistanceFunctorType;
+  typedef Propagator<PatchDistanceFunctorType> PropagatorType;
+  typedef RandomSearch<TImage, PatchDistanceFunctorType> RandomSearchType;
+  typedef PatchMatch<TImage, PropagatorType, RandomSearchType> PatchMatchType;
+
+  /** Compute the matches of 'target' in the library. */
+  void Compute(TImage* const target);
+
+  /** Set the library, which has to be built (see ExemplarLibrary::Build). The patch radius is the one
+    * that it was built for. */
+  void SetLibrary(const ExemplarLibrary<TImage>* const library)
+  {
+    this->Library = library;
+  }
+
+  /** Set the number of iterations of every target. */
+  void SetIterations(const unsigned int iterations)
+  {
+    this->Iterations = iterations;
+  }
+
+  /** Set the pool to run on. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the tile size of the tiled engine (see PatchMatch::SetTileSize). */
+  void SetTileSize(const unsigned int tileSize)
+  {
+    this->TileSize = tileSize;
+  }
+
+  /** Set if propagation candidates are scored incrementally (see Propagator::SetIncremental). */
+  void SetIncremental(const bool incremental)
+  {
+    this->Incremental = incremental;
+  }
+
+  /** Set the pixels of the target to match. If it is empty, every pixel is matched. */
+  void SetTargetPixels(const std::vector<itk::Index<2> >& targetPixels)
+  {
+    this->TargetPixels = targetPixels;
+  }
+
+  /** Set if the results are truly randomized. This should only be false for testing purposes. */
+  void SetRandom(const bool random)
+  {
+    this->Random = random;
+  }
+
+  /** Get the matches of the last target as patches of the atlas. */
+  NNFieldType* GetNNField()
+  {
+    return this->PatchMatchObject.GetNNField();
+  }
+
+  /** Get the matches of the last target as exemplars and positions in them. The border pixels
+    * of the target have no match (ExemplarMatch::NoExemplar). */
+  ExemplarNNFieldType* GetExemplarNNField()
+  {
+    return this->ExemplarNNField;
+  }
+
+private:
+  /** The library that the targets are matched to. */
+  const ExemplarLibrary<TImage>* Library = nullptr;
+
+  /** The number of iterations of every target. */
+  unsigned int Iterations = 5;
+
+  /** The pool to run on. */
+  ThreadPool* Pool = nullptr;
+
+  /** The tile size of the tiled engine. */
+  unsigned int TileSize = 0;
+
+  /** A flag indicating whether propagation candidates are scored incrementally. */
+  bool Incremental = true;
+
+  /** Determine if the result should be randomized. */
+  bool Random = true;
+
+  /** The pixels of the target to match. */
+  std::vector<itk::Index<2> > TargetPixels;
+
+  /** The functors and the PatchMatch object, which are kept so that their buffers are reused. */
+  PatchDistanceFunctorType PatchDistanceFunctor;
+  PropagatorType PropagationFunctor;
+  RandomSearchType RandomSearchFunctor;
+  PatchMatchType PatchMatchObject;
+
+  /** The matches of the last target in exemplar coordinates. */
+  ExemplarNNFieldType::Pointer ExemplarNNField = ExemplarNNFieldType::New();
+};
+
+#include "ExemplarPatchMatch.hpp"
+
+#endif
@@ -0,0 +1,88 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ExemplarPatchMatch_HPP
+#define ExemplarPatchMatch_HPP
+
+#include "ExemplarPatchMatch.h"
+
+// ITK
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+template <typename TImage>
+void ExemplarPatchMatch<TImage>::Compute(TImage* const target)
+{
+  assert(this->Library);
+  assert(target);
+
+  const unsigned int patchRadius = this->Library->GetPatchRadius();
+  TImage* atlasImage = this->Library->GetAtlasImage();
+
+  this->PatchDistanceFunctor.SetLibrary(this->Library);
+  this->PatchDistanceFunctor.SetTargetImage(target);
+
+  // The functors are reset, so the target does not depend on the targets before it
+  this->PropagationFunctor.SetPatchDistanceFunctor(&this->PatchDistanceFunctor);
+  this->PropagationFunctor.SetPatchRadius(patchRadius);
+  this->PropagationFunctor.SetThreadPool(this->Pool);
+  this->PropagationFunctor.SetIncremental(this->Incremental);
+  this->PropagationFunctor.SetForward(true);
+
+  // The index of the valid patch centers is the one of the library, so it is not built again
+  this->RandomSearchFunctor.SetPatchDistanceFunctor(&this->PatchDistanceFunctor);
+  this->RandomSearchFunctor.SetPatchRadius(patchRadius);
+  this->RandomSearchFunctor.SetThreadPool(this->Pool);
+  this->RandomSearchFunctor.SetSourceImage(atlasImage);
+  this->RandomSearchFunctor.SetTargetImage(target);
+  this->RandomSearchFunctor.SetValidPatchCentersIndex(this->Library->GetValidPatchCentersIndex());
+  this->RandomSearchFunctor.SetRandom(this->Random);
+
+  this->PatchMatchObject.SetPatchRadius(patchRadius);
+  this->PatchMatchObject.SetIterations(this->Iterations);
+  this->PatchMatchObject.SetPropagationFunctor(&this->PropagationFunctor);
+  this->PatchMatchObject.SetRandomSearchFunctor(&this->RandomSearchFunctor);
+  this->PatchMatchObject.SetThreadPool(this->Pool);
+  this->PatchMatchObject.SetTileSize(this->TileSize);
+  this->PatchMatchObject.SetVerbose(false);
+  this->PatchMatchObject.SetSourceImage(atlasImage);
+  this->PatchMatchObject.SetTargetImage(target);
+  this->PatchMatchObject.SetTargetPixels(this->TargetPixels);
+  this->PatchMatchObject.ResetNNField();
+  this->PatchMatchObject.Compute();
+
+  NNFieldType* nnField = this->PatchMatchObject.GetNNField();
+  this->ExemplarNNField->SetRegions(nnField->GetLargestPossibleRegion());
+  this->ExemplarNNField->Allocate();
+  this->ExemplarNNField->FillBuffer(ExemplarMatch());
+
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(nnField->GetLargestPossibleRegion(), patchRadius);
+  itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, internalRegion);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const Match& match = nnFieldIterator.Get();
+    this->ExemplarNNField->SetPixel(nnFieldIterator.GetIndex(),
+                                    this->Library->GetExemplarMatch(match.GetCenter(nnFieldIterator.GetIndex()),
+                                                                    match.GetScore()));
+    ++nnFieldIterator;
+  }
+}
+
+#endif
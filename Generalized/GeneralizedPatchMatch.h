@@ -19,38 +19,214 @@
 #ifndef GeneralizedPatchMatch_H
 #define GeneralizedPatchMatch_H
 
-#include "PatchMatch.h"
+// ITK
+#include "itkImage.h"
 
-template<typename TImage>
-class GeneralizedPatchMatch : public PatchMatch
+// STL
+#include <ctime>
+#include <vector>
+
+// Custom
+#include "KNNField.h"
+#include "Match.h"
+#include "PatchMatchHelpers.h"
+#include "ThreadPool.h"
+#include "ValidPatchCentersIndex.h"
+#include "VectorizedSSD.h"
+
+/** This class computes the K nearest neighbors of every patch of the target image among the patches
+  * of the source image (k-NN PatchMatch, as in the Generalized PatchMatch paper). It works like
+  * PatchMatch, but on a KNNField:
+  * - Every pixel starts with K random matches.
+  * - Propagation considers all K matches of each neighbor (shifted by the offset to it), in a
+  *   forward and a backward pass that are traversed as a wavefront of blocks (see WavefrontTraversal),
+  *   so the passes run in parallel and the result does not depend on the number of threads.
+  * - Random search looks for better matches in windows of decreasing radius around each of the K
+  *   matches of a pixel.
+  * A candidate only has to beat the worst of the K matches, which is the upper bound of its distance.
+  * The patch distance functor (e.g. VectorizedSSD) has to be set to the images by the caller and be
+  * safe to call from several threads at once. */
+template <typename TImage, typename TPatchDistanceFunctor = VectorizedSSD<TImage>, typename TMatch = Match>
+class GeneralizedPatchMatch
 {
 public:
+  /** The type of the field of the K nearest neighbors. */
+  typedef KNNField<TMatch> KNNFieldType;
+
+  /** The type of a field of a single match per pixel. */
+  typedef itk::Image<TMatch, 2> NNFieldType;
+
+  typedef itk::Image<bool, 2> BoolImageType;
+
+  /** Compute the K nearest neighbors of the target pixels. Throws std::runtime_error if TMatch cannot
+    * store the offsets between the target and the source (see CompactMatch::CanStoreOffsets). */
+  void Compute();
+
+  /** Get the K nearest neighbors of the last Compute(). */
+  KNNFieldType* GetKNNField()
+  {
+    return &this->Output;
+  }
+
+  /** Fill 'nnField' (of the size of the target) with the best of the K matches of every pixel, e.g. to
+    * write it with PatchMatchHelpers::WriteNNField. The border pixels get no match. */
+  void GetBestNNField(NNFieldType* const nnField) const;
+
+  /** Set the image that both the matches and the patches to match are taken from. */
+  void SetImage(TImage* const image)
+  {
+    SetSourceImage(image);
+    SetTargetImage(image);
+  }
+
+  /** Set the image that the matches are taken from. */
+  void SetSourceImage(TImage* const sourceImage)
+  {
+    this->SourceImage = sourceImage;
+    this->ValidPatchCentersChanged = true;
+  }
 
-  /** Constructor. */
-  GeneralizedPatchMatch();
+  /** Set the image whose patches are matched. */
+  void SetTargetImage(TImage* const targetImage)
+  {
+    this->TargetImage = targetImage;
+  }
 
-  /** The type that is used to store the nearest neighbor field. */
-  typedef itk::Image<std::vector<Match>, 2> GeneralizedPMImageType;
+  /** Set the functor that compares a patch of the source image (first) to one of the target image (second). */
+  void SetPatchDistanceFunctor(TPatchDistanceFunctor* const patchDistanceFunctor)
+  {
+    this->PatchDistanceFunctor = patchDistanceFunctor;
+  }
 
-  /** Get an image where the channels are (x component, y component, score) from the nearest neighbor field. */
-  static void GetPatchCentersImage(GeneralizedPMImageType* const pmImage,
-                                   typename PatchMatch<TImage>::CoordinateImageType* const output);
+  /** Only the centers that are true in this image (of the size of the source image) are drawn by the
+    * initialization and by random search. Without it, every fully defined patch is valid. */
+  void SetValidPatchCentersImage(BoolImageType* const validPatchCentersImage)
+  {
+    this->ValidPatchCentersImage = validPatchCentersImage;
+    this->ValidPatchCentersChanged = true;
+  }
 
-  /** Get the Output. */
-  GeneralizedPMImageType* GetOutput();
+  /** Set the pixels of the target to compute the nearest neighbors of. If it is empty, every pixel
+    * whose patch is inside of the target is processed. */
+  void SetTargetPixels(const std::vector<itk::Index<2> >& targetPixels)
+  {
+    this->TargetPixels = targetPixels;
+  }
 
-  /** Add this match to the top matches if it is better than any of the current matches. */
-  void AddIfBetter(const itk::Index<2>& index, const Match& match);
+  void SetPatchRadius(const unsigned int patchRadius)
+  {
+    this->PatchRadius = patchRadius;
+  }
 
-  /** Set the number of bestcandidate matches to store at each pixel. */
-  void SetNumberOfCandidates(const unsigned int numberOfCandidates);
+  void SetIterations(const unsigned int iterations)
+  {
+    this->Iterations = iterations;
+  }
+
+  /** Set the number of nearest neighbors (K) to store at each pixel. */
+  void SetNumberOfCandidates(const unsigned int numberOfCandidates)
+  {
+    this->NumberOfCandidates = numberOfCandidates;
+  }
+
+  /** Set the pool to run on. Without one, everything runs on the calling thread. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the side length of the blocks of the parallel propagation (see WavefrontTraversal). */
+  void SetWavefrontBlockSize(const unsigned int wavefrontBlockSize)
+  {
+    this->WavefrontBlockSize = wavefrontBlockSize;
+  }
+
+  /** Set if the results are truly randomized. This should only be false for testing purposes. */
+  void SetRandom(const bool random)
+  {
+    this->Seed = random ? static_cast<unsigned int>(time(NULL)) : 0;
+    this->NumberOfSearchPasses = 0;
+  }
 
 private:
-  /** The intermediate and final output. This is a different type than in the parent class. */
-  GeneralizedPMImageType::Pointer Output;
+  /** Give every pixel of the internal region of the target K random matches. */
+  void RandomlyInitializeKNNField(const itk::ImageRegion<2>& internalRegion);
+
+  /** Propagate the matches of the neighbors of the target pixels in the given direction. */
+  void Propagate(const itk::ImageRegion<2>& internalRegion, const bool forward);
+
+  /** Try to add the matches of the neighbors of 'targetPixel' at 'propagationOffsets' (shifted back
+    * by the offset) to its matches. */
+  void PropagatePixel(const itk::Index<2>& targetPixel, const itk::ImageRegion<2>& internalRegion,
+                      const std::vector<itk::Offset<2> >& propagationOffsets);
+
+  /** Look for better matches of the target pixels around each of their matches. */
+  void RandomSearch();
+
+  /** Look for better matches of 'targetPixel' in windows of decreasing radius around each of its
+    * matches. 'searchCenters' is a buffer for the centers of the windows. */
+  void SearchPixel(const itk::Index<2>& targetPixel, const unsigned int initialRadius,
+                   PatchMatchHelpers::RandomGeneratorType& randomGenerator, std::vector<itk::Index<2> >& searchCenters);
+
+  /** Add the patch at 'center' to the matches of 'targetPixel' if it is better than the worst of them. */
+  void TryMatch(const itk::Index<2>& targetPixel, const itk::ImageRegion<2>& targetRegion, const itk::Index<2>& center);
+
+  /** Get the pixels of the source image whose patches are inside of it. */
+  itk::ImageRegion<2> GetSourceInternalRegion() const;
+
+  /** Create the generator of random stream 'streamId' of the current sampling pass. */
+  PatchMatchHelpers::RandomGeneratorType CreateRandomGenerator(const unsigned int streamId) const
+  {
+    return PatchMatchHelpers::CreateRandomGenerator(this->Seed, this->NumberOfSearchPasses, streamId);
+  }
+
+  /** The image that the matches are taken from. */
+  TImage* SourceImage = nullptr;
+
+  /** The image whose patches are matched. */
+  TImage* TargetImage = nullptr;
+
+  /** The functor used to compare patches. */
+  TPatchDistanceFunctor* PatchDistanceFunctor = nullptr;
+
+  /** The valid patch centers of the source image, or null if every fully defined patch is valid. */
+  BoolImageType* ValidPatchCentersImage = nullptr;
+
+  /** A flag indicating whether the sampling index has to be built again for the next Compute(). */
+  bool ValidPatchCentersChanged = true;
+
+  /** The sampling index of the valid patch centers. */
+  ValidPatchCentersIndex ValidPatchCenters;
+
+  /** The pixels at which the nearest neighbors are computed. */
+  std::vector<itk::Index<2> > TargetPixels;
+
+  /** The K nearest neighbors. */
+  KNNFieldType Output;
+
+  /** The radius of the patches. */
+  unsigned int PatchRadius = 3;
+
+  /** The number of iterations of propagation and random search. */
+  unsigned int Iterations = 5;
+
+  /** The number of nearest neighbors to store at each pixel. */
+  unsigned int NumberOfCandidates = 5;
+
+  /** The pool to run on. */
+  ThreadPool* Pool = nullptr;
+
+  /** The side length of the blocks of the parallel propagation. */
+  unsigned int WavefrontBlockSize = 32;
+
+  /** The seed of the random streams. */
+  unsigned int Seed = static_cast<unsigned int>(time(NULL));
+
+  /** The number of sampling passes so far (the initialization and every random search). */
+  unsigned int NumberOfSearchPasses = 0;
 
-  /** The number of bestcandidate matches to store at each pixel. */
-  unsigned int NumberOfCandidates;
+  /** The number of pixels that share a random stream in the random search. */
+  const unsigned int PixelsPerRandomStream = 1024;
 };
 
 #include "GeneralizedPatchMatch.hpp"
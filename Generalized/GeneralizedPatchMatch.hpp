@@ -21,83 +21,284 @@
 
 #include "GeneralizedPatchMatch.h"
 
-template <typename TImage>
-GeneralizedPatchMatch<TImage>::GeneralizedPatchMatch()
-{
-}
+// ITK
+#include "itkImageRegionIteratorWithIndex.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
 
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
 
-template <typename TImage>
-void GeneralizedPatchMatch<TImage>::GetPatchCentersImage(GeneralizedPMImageType* const pmImage,
-                                                         typename PatchMatch<TImage>::CoordinateImageType* const output)
+// Custom
+#include "WavefrontTraversal.h"
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::Compute()
 {
-  output->SetRegions(pmImage->GetLargestPossibleRegion());
-  output->SetNumberOfComponentsPerPixel(3);
-  output->Allocate();
+  assert(this->SourceImage);
+  assert(this->TargetImage);
+  assert(this->PatchDistanceFunctor);
+  assert(this->NumberOfCandidates > 0);
 
-  itk::ImageRegionIterator<GeneralizedPMImageType> imageIterator(pmImage, pmImage->GetLargestPossibleRegion());
+  PatchMatchHelpers::CheckMatchRange<TMatch>(this->SourceImage->GetLargestPossibleRegion(),
+                                             this->TargetImage->GetLargestPossibleRegion());
 
-  while(!imageIterator.IsAtEnd())
+  // Without a valid patch centers image, every fully defined patch of the source is valid
+  if(this->ValidPatchCentersChanged)
+  {
+    if(this->ValidPatchCentersImage)
     {
-    typename PatchMatch<TImage>::CoordinateImageType::PixelType pixel;
+      assert(this->ValidPatchCentersImage->GetLargestPossibleRegion() == this->SourceImage->GetLargestPossibleRegion());
+      this->ValidPatchCenters.Build(this->ValidPatchCentersImage);
+    }
+    else
+    {
+      BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+      validPatchCentersImage->SetRegions(GetSourceInternalRegion());
+      validPatchCentersImage->Allocate();
+      validPatchCentersImage->FillBuffer(true);
+      this->ValidPatchCenters.Build(validPatchCentersImage);
+    }
+    this->ValidPatchCentersChanged = false;
+  }
+
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(this->TargetImage->GetLargestPossibleRegion(),
+                                                                     this->PatchRadius);
+
+  std::vector<itk::Index<2> > targetPixels = this->TargetPixels;
+  if(this->TargetPixels.empty())
+  {
+    this->TargetPixels = PatchMatchHelpers::GetAllPixelIndices(internalRegion);
+  }
+
+  RandomlyInitializeKNNField(internalRegion);
+
+  for(unsigned int iteration = 0; iteration < this->Iterations; ++iteration)
+  {
+    // Alternate between the forward and the backward pass, like the Propagator does
+    Propagate(internalRegion, iteration % 2 == 0);
+    RandomSearch();
+  }
+
+  this->TargetPixels = targetPixels;
+}
 
-    // This is the only difference from this function in PatchMatch -
-    // that we get the first element instead of the only element
-    Match match = imageIterator.Get()[0]; 
-    itk::Index<2> center = ITKHelpers::GetRegionCenter(match.Region);
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+RandomlyInitializeKNNField(const itk::ImageRegion<2>& internalRegion)
+{
+  this->Output.SetRegion(this->TargetImage->GetLargestPossibleRegion(), this->NumberOfCandidates);
+
+  const itk::ImageRegion<2> sourceInternalRegion = GetSourceInternalRegion();
 
-    pixel[0] = center[0];
-    pixel[1] = center[1];
-    pixel[2] = match.GetScore();
+  // Each row draws from its own random stream, so the rows can be initialized in parallel
+  this->NumberOfSearchPasses++;
 
-    output->SetPixel(imageIterator.GetIndex(), pixel);
+  auto initializeRow = [this, &internalRegion, &sourceInternalRegion](const size_t rowId)
+  {
+    PatchMatchHelpers::RandomGeneratorType randomGenerator = CreateRandomGenerator(rowId);
+
+    for(itk::SizeValueType column = 0; column < internalRegion.GetSize()[0]; ++column)
+    {
+      itk::Index<2> targetPixel = {{internalRegion.GetIndex()[0] + static_cast<itk::IndexValueType>(column),
+                                    internalRegion.GetIndex()[1] + static_cast<itk::IndexValueType>(rowId)}};
+      itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, this->PatchRadius);
 
-    ++imageIterator;
+      // A center that is drawn twice leaves a slot empty, which propagation and random search fill
+      for(unsigned int candidateId = 0; candidateId < this->NumberOfCandidates; ++candidateId)
+      {
+        itk::Index<2> randomCenter;
+        if(!this->ValidPatchCenters.GetRandomValidPixel(sourceInternalRegion, randomGenerator, randomCenter))
+        {
+          return; // There are no valid patches
+        }
+        TryMatch(targetPixel, targetRegion, randomCenter);
+      }
     }
+  };
+
+  if(this->Pool)
+  {
+    this->Pool->ParallelFor(internalRegion.GetSize()[1], initializeRow);
+  }
+  else
+  {
+    for(size_t rowId = 0; rowId < internalRegion.GetSize()[1]; ++rowId)
+    {
+      initializeRow(rowId);
+    }
+  }
 }
 
-template <typename TImage>
-typename GeneralizedPatchMatch<TImage>::GeneralizedPMImageType* GeneralizedPatchMatch<TImage>::GetOutput()
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+Propagate(const itk::ImageRegion<2>& internalRegion, const bool forward)
 {
-  return Output;
+  std::vector<itk::Offset<2> > propagationOffsets(2);
+  itk::Offset<2> leftOffset = {{forward ? -1 : 1, 0}};
+  itk::Offset<2> upOffset = {{0, forward ? -1 : 1}};
+  propagationOffsets[0] = leftOffset;
+  propagationOffsets[1] = upOffset;
+
+  WavefrontTraversal traversal(this->TargetPixels, internalRegion, this->WavefrontBlockSize);
+  traversal.Traverse(forward, this->Pool, [this, &internalRegion, &propagationOffsets](const itk::Index<2>& targetPixel,
+                                                                                       const size_t /* blockId */)
+  {
+    PropagatePixel(targetPixel, internalRegion, propagationOffsets);
+  });
 }
 
-template <typename TImage>
-void GeneralizedPatchMatch<TImage>::SetNumberOfCandidates(const unsigned int numberOfCandidates)
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+PropagatePixel(const itk::Index<2>& targetPixel, const itk::ImageRegion<2>& internalRegion,
+               const std::vector<itk::Offset<2> >& propagationOffsets)
 {
-  this->NumberOfCandidates = numberOfCandidates;
+  const itk::ImageRegion<2> sourceInternalRegion = GetSourceInternalRegion();
+  const itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, this->PatchRadius);
+
+  for(size_t propagationOffsetId = 0; propagationOffsetId < propagationOffsets.size(); ++propagationOffsetId)
+  {
+    const itk::Offset<2>& propagationOffset = propagationOffsets[propagationOffsetId];
+    itk::Index<2> neighbor = targetPixel + propagationOffset;
+    if(!internalRegion.IsInside(neighbor))
+    {
+      continue;
+    }
+
+    // The neighbor is not changed by this pass while its matches are read (see WavefrontTraversal)
+    const TMatch* neighborMatches = this->Output.GetMatches(neighbor);
+    const unsigned int numberOfNeighborMatches = this->Output.GetNumberOfMatches(neighbor);
+    for(unsigned int matchId = 0; matchId < numberOfNeighborMatches; ++matchId)
+    {
+      // The patch next to the match of the neighbor, as in Propagator
+      itk::Index<2> potentialMatchPixel = neighborMatches[matchId].GetCenter(neighbor) - propagationOffset;
+      if(sourceInternalRegion.IsInside(potentialMatchPixel))
+      {
+        TryMatch(targetPixel, targetRegion, potentialMatchPixel);
+      }
+    }
+  }
 }
 
-template <typename TImage>
-void GeneralizedPatchMatch<TImage>::AddIfBetter(const itk::Index<2>& index, const Match& potentialMatch)
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::RandomSearch()
 {
-  std::vector<Match> currentMatches = this->Output->GetPixel(index);
+  this->NumberOfSearchPasses++;
 
-  // Check if the item is already in the container
-  auto result = std::find_if(currentMatches.begin(), currentMatches.end(), [&potentialMatch](const Match& match) {
-        return match.GetRegion() == potentialMatch.GetRegion();});
+  const itk::ImageRegion<2> sourceInternalRegion = GetSourceInternalRegion();
+  const unsigned int initialRadius = std::max(sourceInternalRegion.GetSize()[0], sourceInternalRegion.GetSize()[1]);
 
-  // If the item was not found
-  if(result == currentMatches.end())
+  // Every pixel is searched independently, so blocks of pixels (each with their own random stream) can run in parallel
+  const size_t numberOfBlocks = (this->TargetPixels.size() + this->PixelsPerRandomStream - 1) / this->PixelsPerRandomStream;
+
+  auto searchBlock = [this, initialRadius](const size_t blockId)
   {
-    // Add the item to the container
-    currentMatches.push_back(potentialMatch);
+    PatchMatchHelpers::RandomGeneratorType randomGenerator = CreateRandomGenerator(blockId);
+    std::vector<itk::Index<2> > searchCenters;
+    searchCenters.reserve(this->NumberOfCandidates);
 
-    // Sort the container
-    std::sort(currentMatches.begin(), currentMatches.end(), [](const Match& match1, const Match& match2 )
+    size_t blockEnd = std::min(this->TargetPixels.size(), (blockId + 1) * this->PixelsPerRandomStream);
+    for(size_t pixelId = blockId * this->PixelsPerRandomStream; pixelId < blockEnd; ++pixelId)
     {
-      return match1.GetScore() < match2.GetScore();
+      SearchPixel(this->TargetPixels[pixelId], initialRadius, randomGenerator, searchCenters);
     }
-    );
+  };
 
-    // Trim the container
-    if(currentMatches.size() > this->NumberOfCandidates)
+  if(this->Pool)
+  {
+    this->Pool->ParallelFor(numberOfBlocks, searchBlock);
+  }
+  else
+  {
+    for(size_t blockId = 0; blockId < numberOfBlocks; ++blockId)
     {
-      currentMatches.resize(this->NumberOfCandidates);
+      searchBlock(blockId);
+    }
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+SearchPixel(const itk::Index<2>& targetPixel, const unsigned int initialRadius,
+            PatchMatchHelpers::RandomGeneratorType& randomGenerator, std::vector<itk::Index<2> >& searchCenters)
+{
+  const itk::ImageRegion<2> sourceInternalRegion = GetSourceInternalRegion();
+  const itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, this->PatchRadius);
+
+  // The windows are centered at the matches from before the search, which change while it runs
+  const TMatch* matches = this->Output.GetMatches(targetPixel);
+  searchCenters.clear();
+  for(unsigned int matchId = 0; matchId < this->Output.GetNumberOfMatches(targetPixel); ++matchId)
+  {
+    searchCenters.push_back(matches[matchId].GetCenter(targetPixel));
+  }
+
+  for(size_t searchCenterId = 0; searchCenterId < searchCenters.size(); ++searchCenterId)
+  {
+    // Search an exponentially smaller window each time through the loop
+    for(unsigned int radius = initialRadius; radius > this->PatchRadius; radius /= 2)
+    {
+      itk::ImageRegion<2> searchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(searchCenters[searchCenterId], radius);
+      searchRegion.Crop(sourceInternalRegion);
+
+      itk::Index<2> randomCenter;
+      if(!this->ValidPatchCenters.GetRandomValidPixel(searchRegion, randomGenerator, randomCenter))
+      {
+        break;
+      }
+
+      TryMatch(targetPixel, targetRegion, randomCenter);
     }
   }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+TryMatch(const itk::Index<2>& targetPixel, const itk::ImageRegion<2>& targetRegion, const itk::Index<2>& center)
+{
+  // A match that is already stored would have the same distance, which is more expensive to compute than the check
+  if(this->Output.HasMatch(targetPixel, center))
+  {
+    return;
+  }
+
+  const float worstScore = this->Output.GetWorstScore(targetPixel);
+  float distance = PatchMatchHelpers::BoundedDistance(this->PatchDistanceFunctor,
+                                                      ITKHelpers::GetRegionInRadiusAroundPixel(center, this->PatchRadius),
+                                                      targetRegion, worstScore);
+  if(distance < worstScore)
+  {
+    TMatch match;
+    match.SetCenter(targetPixel, center, this->PatchRadius);
+    match.SetScore(distance);
+    this->Output.AddMatch(targetPixel, match);
+  }
+}
 
-  this->Output->SetPixel(index, currentMatches);
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+itk::ImageRegion<2> GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::GetSourceInternalRegion() const
+{
+  return ITKHelpers::GetInternalRegion(this->SourceImage->GetLargestPossibleRegion(), this->PatchRadius);
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void GeneralizedPatchMatch<TImage, TPatchDistanceFunctor, TMatch>::GetBestNNField(NNFieldType* const nnField) const
+{
+  nnField->SetRegions(this->Output.GetRegion());
+  nnField->Allocate();
+  nnField->FillBuffer(TMatch());
+
+  itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, this->Output.GetRegion());
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    if(this->Output.GetNumberOfMatches(nnFieldIterator.GetIndex()) > 0)
+    {
+      nnFieldIterator.Set(this->Output.GetBestMatch(nnFieldIterator.GetIndex()));
+    }
+    ++nnFieldIterator;
+  }
 }
 
 #endif
@@ -77,9 +77,6 @@ public:
   /** Add this match to the set if it's SSD is better than the worst stored match, or if the container is not yet full. */
   void AddMatch(const Match& potentialMatch)
   {
-    // Insert 'match' to Matches if it is better than any of the existing saved matches.
-    // Delete (by trimming) any matches that are now not in the top MaximumMatches matches.
-
     // Check if a Match object of the same region is already in the container.
     // (We don't want to store the same match multipe times)
     auto result = std::find_if(this->Matches.begin(), this->Matches.end(), [&potentialMatch](const Match& match) {
@@ -90,56 +87,40 @@ public:
     {
       // Replace the match with the new match data.
       *result = potentialMatch;
+      return;
     }
-    else // If the item was not found
+
+    // The set keeps the top MaximumMatches matches according to SSD. If it is full, the match with
+    // the worst SSD makes room (or the potential match is not added if it is not better).
+    if(this->Matches.size() >= this->MaximumMatches)
     {
-      // Add the item to the container
-      this->Matches.push_back(potentialMatch);
-
-      // Keep the top MaximumMatches patches according to SSD
-      // Sort the container
-      // NaN does not sort correctly, so replace NaN's with max() before sorting
-      auto ssdSortFunctor = [](const Match& match1, const Match& match2)
-                            {
-                              float score1 = match1.GetSSDScore();
-                              float score2 = match2.GetSSDScore();
-                              if(Helpers::IsNaN(score1))
-                              {
-                                score1 = std::numeric_limits<float>::max();
-                              }
-                              if(Helpers::IsNaN(score2))
-                              {
-                                score2 = std::numeric_limits<float>::max();
-                              }
-                              return score1 < score2;
-                            };
-      std::sort(this->Matches.begin(), this->Matches.end(), ssdSortFunctor);
-
-      // Trim the container
-      if(this->Matches.size() > this->MaximumMatches)
+      auto worstMatch = std::max_element(this->Matches.begin(), this->Matches.end(),
+                                         [](const Match& match1, const Match& match2)
+                                         {
+                                           return GetSortScore(match1.GetSSDScore()) < GetSortScore(match2.GetSSDScore());
+                                         });
+      if(!(GetSortScore(potentialMatch.GetSSDScore()) < GetSortScore(worstMatch->GetSSDScore())))
       {
-        this->Matches.resize(this->MaximumMatches);
+        return;
       }
-
-      // NaN does not sort correctly, so replace NaN's with max() before sorting
-      auto verificationSortFunctor = [](const Match& match1, const Match& match2)
-                          {
-                          float score1 = match1.GetVerificationScore();
-                          float score2 = match2.GetVerificationScore();
-                          if(Helpers::IsNaN(score1))
-                          {
-                            score1 = std::numeric_limits<float>::max();
-                          }
-                          if(Helpers::IsNaN(score2))
-                          {
-                            score2 = std::numeric_limits<float>::max();
-                          }
-                          return score1 < score2;
-                          };
-      // stable_sort ensures that the order of identical elements is preserved. That is, we want the matches to remain
-      // ordered by their SSD scores if the verification scores are max().
-      std::stable_sort(this->Matches.begin(), this->Matches.end(), verificationSortFunctor);
+      this->Matches.erase(worstMatch);
     }
+
+    // The matches are kept ordered by their verification scores, and by their SSD scores where the
+    // verification scores are the same (e.g. max()), so the potential match is inserted in its place
+    // instead of sorting the container twice.
+    auto insertPosition = std::upper_bound(this->Matches.begin(), this->Matches.end(), potentialMatch,
+                                           [](const Match& match1, const Match& match2)
+                                           {
+                                             float verificationScore1 = GetSortScore(match1.GetVerificationScore());
+                                             float verificationScore2 = GetSortScore(match2.GetVerificationScore());
+                                             if(verificationScore1 != verificationScore2)
+                                             {
+                                               return verificationScore1 < verificationScore2;
+                                             }
+                                             return GetSortScore(match1.GetSSDScore()) < GetSortScore(match2.GetSSDScore());
+                                           });
+    this->Matches.insert(insertPosition, potentialMatch);
   }
 
   void SetMaximumMatches(const unsigned int maximumMatches)
@@ -153,6 +134,12 @@ public:
   }
 
 private:
+  /** NaN does not sort correctly, so NaN's are sorted as max(). */
+  static float GetSortScore(const float score)
+  {
+    return Helpers::IsNaN(score) ? std::numeric_limits<float>::max() : score;
+  }
+
   std::vector<Match> Matches;
   unsigned int MaximumMatches;
 };
@@ -0,0 +1,196 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef KNNField_H
+#define KNNField_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Custom
+#include "Match.h"
+
+/** A field of the K best matches of every pixel. The matches of all pixels are kept in one buffer
+  * of width*height*K matches (instead of a vector per pixel), and the matches of a pixel are a
+  * max-heap on the score, so the worst of them is known at once and a better candidate replaces it
+  * in O(log K). TMatch is any match type (Match or CompactMatch). The matches of different pixels
+  * can be added from different threads at once. */
+template <typename TMatch = Match>
+class KNNField
+{
+public:
+  typedef TMatch MatchType;
+
+  /** Make room for 'k' matches at every pixel of 'region' and remove all matches. A field of the same
+    * number of matches as before keeps its buffer. */
+  void SetRegion(const itk::ImageRegion<2>& region, const unsigned int k)
+  {
+    assert(k > 0 && k <= std::numeric_limits<uint16_t>::max());
+
+    this->Region = region;
+    this->K = k;
+    this->Matches.resize(region.GetNumberOfPixels() * k);
+    this->NumberOfMatches.assign(region.GetNumberOfPixels(), 0);
+  }
+
+  const itk::ImageRegion<2>& GetRegion() const
+  {
+    return this->Region;
+  }
+
+  /** Get the number of matches that are kept at every pixel. */
+  unsigned int GetK() const
+  {
+    return this->K;
+  }
+
+  /** Remove all matches. */
+  void Clear()
+  {
+    std::fill(this->NumberOfMatches.begin(), this->NumberOfMatches.end(), 0);
+  }
+
+  /** Get the number of matches of 'pixel' (at most K). */
+  unsigned int GetNumberOfMatches(const itk::Index<2>& pixel) const
+  {
+    return this->NumberOfMatches[GetPixelId(pixel)];
+  }
+
+  /** Get the matches of 'pixel' in heap order (the first one is the worst). */
+  const TMatch* GetMatches(const itk::Index<2>& pixel) const
+  {
+    return &this->Matches[GetPixelId(pixel) * this->K];
+  }
+
+  /** Get the score that a match of 'pixel' has to be below to be added: the score of the worst
+    * match once there are K of them, and infinity before. This is the upper bound with which to
+    * compute the distance of a candidate. */
+  float GetWorstScore(const itk::Index<2>& pixel) const
+  {
+    const size_t pixelId = GetPixelId(pixel);
+    if(this->NumberOfMatches[pixelId] < this->K)
+    {
+      return std::numeric_limits<float>::infinity();
+    }
+    return this->Matches[pixelId * this->K].GetScore();
+  }
+
+  /** Determine if the patch at 'center' is one of the matches of 'pixel'. This is cheaper than the
+    * distance of a candidate, so it is worth checking first where candidates often repeat (propagation). */
+  bool HasMatch(const itk::Index<2>& pixel, const itk::Index<2>& center) const
+  {
+    const size_t pixelId = GetPixelId(pixel);
+    const TMatch* matches = &this->Matches[pixelId * this->K];
+    for(unsigned int matchId = 0; matchId < this->NumberOfMatches[pixelId]; ++matchId)
+    {
+      if(matches[matchId].GetCenter(pixel) == center)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Add 'match' to the matches of 'pixel' if there are less than K of them or it is better than the
+    * worst of them, which it then replaces. A match of a patch that is already one of the matches
+    * of the pixel is not added again. Returns true if the match was added. */
+  bool AddMatch(const itk::Index<2>& pixel, const TMatch& match)
+  {
+    const size_t pixelId = GetPixelId(pixel);
+    TMatch* matches = &this->Matches[pixelId * this->K];
+    uint16_t& numberOfMatches = this->NumberOfMatches[pixelId];
+
+    // Most candidates are rejected here, without looking at the other matches
+    if(numberOfMatches == this->K && !(match.GetScore() < matches[0].GetScore()))
+    {
+      return false;
+    }
+
+    if(HasMatch(pixel, match.GetCenter(pixel)))
+    {
+      return false;
+    }
+
+    if(numberOfMatches < this->K)
+    {
+      matches[numberOfMatches] = match;
+      numberOfMatches++;
+      std::push_heap(matches, matches + numberOfMatches, IsBetter);
+    }
+    else
+    {
+      std::pop_heap(matches, matches + numberOfMatches, IsBetter);
+      matches[numberOfMatches - 1] = match;
+      std::push_heap(matches, matches + numberOfMatches, IsBetter);
+    }
+
+    return true;
+  }
+
+  /** Get the best match of 'pixel', which must have at least one. */
+  TMatch GetBestMatch(const itk::Index<2>& pixel) const
+  {
+    assert(GetNumberOfMatches(pixel) > 0);
+    const TMatch* matches = GetMatches(pixel);
+    return *std::min_element(matches, matches + GetNumberOfMatches(pixel), IsBetter);
+  }
+
+  /** Get the matches of 'pixel' from the best to the worst. */
+  void GetSortedMatches(const itk::Index<2>& pixel, std::vector<TMatch>& sortedMatches) const
+  {
+    const TMatch* matches = GetMatches(pixel);
+    sortedMatches.assign(matches, matches + GetNumberOfMatches(pixel));
+    std::sort(sortedMatches.begin(), sortedMatches.end(), IsBetter);
+  }
+
+private:
+  /** The order of the heaps: the match with the largest score is at the top. */
+  static bool IsBetter(const TMatch& match1, const TMatch& match2)
+  {
+    return match1.GetScore() < match2.GetScore();
+  }
+
+  /** Get the position of 'pixel' in the field. */
+  size_t GetPixelId(const itk::Index<2>& pixel) const
+  {
+    assert(this->Region.IsInside(pixel));
+    return static_cast<size_t>(pixel[1] - this->Region.GetIndex()[1]) * this->Region.GetSize()[0] +
+           static_cast<size_t>(pixel[0] - this->Region.GetIndex()[0]);
+  }
+
+  /** The pixels of the field. */
+  itk::ImageRegion<2> Region;
+
+  /** The number of matches that are kept at every pixel. */
+  unsigned int K = 1;
+
+  /** The K match slots of every pixel, row by row. */
+  std::vector<TMatch> Matches;
+
+  /** The number of used slots of every pixel. */
+  std::vector<uint16_t> NumberOfMatches;
+};
+
+#endif
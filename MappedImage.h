@@ -0,0 +1,195 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef MappedImage_H
+#define MappedImage_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// STL
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Custom
+#include "MemoryMappedFile.h"
+
+/** A 2D image of TPixel that is stored in a raw file (the pixels in raster order, after an optional
+  * header of a fixed size) and memory mapped, so that it can be much larger than the memory. Regions of it are copied to and
+  * from itk::Images whose buffered region is only that part of the image. TPixel has to be a plain
+  * type with the same layout as the pixels of those images (e.g. itk::CovariantVector<unsigned char, 3>
+  * for an interleaved RGB file). */
+template <typename TPixel>
+class MappedImage
+{
+public:
+  typedef TPixel PixelType;
+
+  /** Map the existing raw file 'fileName' of an image of 'size' whose pixels start after 'headerSize'
+    * bytes. Its size has to match. */
+  void Open(const std::string& fileName, const itk::Size<2>& size, const MappingModeEnum::MappingMode mode,
+            const size_t headerSize = 0)
+  {
+    this->File.Open(fileName, mode);
+    SetSize(size);
+    this->HeaderSize = headerSize;
+    if(this->File.GetSize() != headerSize + size[0] * size[1] * sizeof(TPixel))
+    {
+      this->File.Close();
+      throw std::runtime_error("MappedImage: the size of " + fileName + " does not match the image size");
+    }
+  }
+
+  /** Create the raw file 'fileName' of an image of 'size' (filled with zero bytes, after a header of
+    * 'headerSize' bytes) and map it for reading and writing. */
+  void Create(const std::string& fileName, const itk::Size<2>& size, const size_t headerSize = 0)
+  {
+    this->File.Create(fileName, headerSize + size[0] * size[1] * sizeof(TPixel));
+    SetSize(size);
+    this->HeaderSize = headerSize;
+  }
+
+  /** Unmap the file. */
+  void Close()
+  {
+    this->File.Close();
+  }
+
+  bool IsOpen() const
+  {
+    return this->File.IsOpen();
+  }
+
+  /** Get the header, which is the first bytes of the file. */
+  char* GetHeader()
+  {
+    return this->File.GetData();
+  }
+
+  /** Get the header, which is the first bytes of the file. */
+  const char* GetHeader() const
+  {
+    return this->File.GetData();
+  }
+
+  /** Get the first pixel, after which the others follow in raster order. */
+  TPixel* GetBufferPointer()
+  {
+    return GetRow(0);
+  }
+
+  /** Get the first pixel, after which the others follow in raster order. */
+  const TPixel* GetBufferPointer() const
+  {
+    return GetRow(0);
+  }
+
+  /** Get the region of the whole image, which starts at (0, 0). */
+  const itk::ImageRegion<2>& GetLargestPossibleRegion() const
+  {
+    return this->Region;
+  }
+
+  const TPixel& GetPixel(const itk::Index<2>& index) const
+  {
+    assert(this->Region.IsInside(index));
+    return GetRow(index[1])[index[0]];
+  }
+
+  void SetPixel(const itk::Index<2>& index, const TPixel& pixel)
+  {
+    assert(this->Region.IsInside(index));
+    GetRow(index[1])[index[0]] = pixel;
+  }
+
+  /** Copy 'region' of this image into 'image', whose buffered region has to contain it. */
+  template <typename TImage>
+  void ReadRegion(const itk::ImageRegion<2>& region, TImage* const image) const
+  {
+    static_assert(sizeof(typename TImage::PixelType) == sizeof(TPixel), "The pixel types have to have the same layout");
+    assert(this->Region.IsInside(region));
+    assert(image->GetBufferedRegion().IsInside(region));
+
+    const size_t rowBytes = region.GetSize()[0] * sizeof(TPixel);
+    for(itk::IndexValueType y = region.GetIndex()[1]; y < region.GetIndex()[1] + static_cast<itk::IndexValueType>(region.GetSize()[1]); ++y)
+    {
+      itk::Index<2> rowStart = {{region.GetIndex()[0], y}};
+      std::memcpy(image->GetBufferPointer() + image->ComputeOffset(rowStart), &GetPixel(rowStart), rowBytes);
+    }
+  }
+
+  /** Copy 'region' of 'image', whose buffered region has to contain it, into this image. */
+  template <typename TImage>
+  void WriteRegion(const TImage* const image, const itk::ImageRegion<2>& region)
+  {
+    static_assert(sizeof(typename TImage::PixelType) == sizeof(TPixel), "The pixel types have to have the same layout");
+    assert(this->Region.IsInside(region));
+    assert(image->GetBufferedRegion().IsInside(region));
+
+    const size_t rowBytes = region.GetSize()[0] * sizeof(TPixel);
+    for(itk::IndexValueType y = region.GetIndex()[1]; y < region.GetIndex()[1] + static_cast<itk::IndexValueType>(region.GetSize()[1]); ++y)
+    {
+      itk::Index<2> rowStart = {{region.GetIndex()[0], y}};
+      std::memcpy(&GetRow(y)[rowStart[0]], image->GetBufferPointer() + image->ComputeOffset(rowStart), rowBytes);
+    }
+  }
+
+  /** Let the operating system drop the pages of the rows of 'region' from the memory of the process
+    * (see MemoryMappedFile::Release). */
+  void Release(const itk::ImageRegion<2>& region) const
+  {
+    const size_t rowBytes = this->Region.GetSize()[0] * sizeof(TPixel);
+    this->File.Release(this->HeaderSize + region.GetIndex()[1] * rowBytes, region.GetSize()[1] * rowBytes);
+  }
+
+  /** Block until everything written to the image is in the file. */
+  void Flush()
+  {
+    this->File.Flush();
+  }
+
+private:
+  void SetSize(const itk::Size<2>& size)
+  {
+    itk::Index<2> corner = {{0, 0}};
+    this->Region = itk::ImageRegion<2>(corner, size);
+  }
+
+  const TPixel* GetRow(const itk::IndexValueType y) const
+  {
+    return reinterpret_cast<const TPixel*>(this->File.GetData() + this->HeaderSize) + y * this->Region.GetSize()[0];
+  }
+
+  TPixel* GetRow(const itk::IndexValueType y)
+  {
+    return reinterpret_cast<TPixel*>(this->File.GetData() + this->HeaderSize) + y * this->Region.GetSize()[0];
+  }
+
+  /** The mapped file. */
+  MemoryMappedFile File;
+
+  /** The region of the whole image. */
+  itk::ImageRegion<2> Region;
+
+  /** The number of bytes before the first pixel. */
+  size_t HeaderSize = 0;
+};
+
+#endif
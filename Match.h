@@ -61,6 +61,24 @@ public:
     return this->Score;
   }
 
+  /** Get the center of the matching region. Every kind of match provides this with the pixel
+    * that it is the match of, because a compact match only stores the offset from that pixel. */
+  itk::Index<2> GetCenter(const itk::Index<2>& /* pixel */) const
+  {
+    itk::Index<2> center = {{this->Region.GetIndex()[0] + static_cast<itk::IndexValueType>(this->Region.GetSize()[0] / 2),
+                             this->Region.GetIndex()[1] + static_cast<itk::IndexValueType>(this->Region.GetSize()[1] / 2)}};
+    return center;
+  }
+
+  /** Set the matching region to the patch of 'patchRadius' around 'center'. */
+  void SetCenter(const itk::Index<2>& /* pixel */, const itk::Index<2>& center, const unsigned int patchRadius)
+  {
+    itk::Index<2> corner = {{center[0] - static_cast<itk::IndexValueType>(patchRadius),
+                             center[1] - static_cast<itk::IndexValueType>(patchRadius)}};
+    itk::Size<2> size = {{2 * patchRadius + 1, 2 * patchRadius + 1}};
+    this->Region = itk::ImageRegion<2>(corner, size);
+  }
+
   bool operator==(const Match &other) const
   {
     if((this->Region != other.GetRegion()) || (this->Score != other.GetScore()))
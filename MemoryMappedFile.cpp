@@ -0,0 +1,156 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "MemoryMappedFile.h"
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// STL
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+/** Throw an exception that describes the last failed system call on 'fileName'. */
+void ThrowSystemError(const std::string& what, const std::string& fileName)
+{
+  throw std::runtime_error("MemoryMappedFile: " + what + " " + fileName + ": " + std::strerror(errno));
+}
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+  Close();
+}
+
+void MemoryMappedFile::Open(const std::string& fileName, const MappingModeEnum::MappingMode mode)
+{
+  Close();
+
+  this->FileDescriptor = open(fileName.c_str(), mode == MappingModeEnum::READ_WRITE ? O_RDWR : O_RDONLY);
+  if(this->FileDescriptor < 0)
+  {
+    ThrowSystemError("cannot open", fileName);
+  }
+
+  struct stat fileStatus;
+  if(fstat(this->FileDescriptor, &fileStatus) != 0)
+  {
+    Close();
+    ThrowSystemError("cannot stat", fileName);
+  }
+  this->Size = static_cast<size_t>(fileStatus.st_size);
+
+  Map(mode, fileName);
+}
+
+void MemoryMappedFile::Create(const std::string& fileName, const size_t size)
+{
+  Close();
+
+  this->FileDescriptor = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(this->FileDescriptor < 0)
+  {
+    ThrowSystemError("cannot create", fileName);
+  }
+
+  // The blocks of the file are reserved (and read as zeros) up front. A sparse file would only get
+  // them when the pages are written back, and a full disk would then kill the process with SIGBUS
+  // in the middle of a write to the mapping instead of failing here.
+  if(size > 0)
+  {
+    const int error = posix_fallocate(this->FileDescriptor, 0, static_cast<off_t>(size));
+    if(error != 0)
+    {
+      Close();
+      errno = error;
+      ThrowSystemError("cannot reserve space for", fileName);
+    }
+  }
+  this->Size = size;
+
+  Map(MappingModeEnum::READ_WRITE, fileName);
+}
+
+void MemoryMappedFile::Map(const MappingModeEnum::MappingMode mode, const std::string& fileName)
+{
+  // An empty file cannot be mapped, but there is nothing to access in it either
+  if(this->Size > 0)
+  {
+    int protection = mode == MappingModeEnum::READ_WRITE ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* data = mmap(nullptr, this->Size, protection, MAP_SHARED, this->FileDescriptor, 0);
+    if(data == MAP_FAILED)
+    {
+      Close();
+      ThrowSystemError("cannot map", fileName);
+    }
+    this->Data = static_cast<char*>(data);
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  close(this->FileDescriptor);
+  this->FileDescriptor = -1;
+}
+
+void MemoryMappedFile::Close()
+{
+  if(this->Data)
+  {
+    munmap(this->Data, this->Size);
+    this->Data = nullptr;
+  }
+
+  if(this->FileDescriptor >= 0)
+  {
+    close(this->FileDescriptor);
+    this->FileDescriptor = -1;
+  }
+
+  this->Size = 0;
+}
+
+void MemoryMappedFile::Flush()
+{
+  if(this->Data)
+  {
+    msync(this->Data, this->Size, MS_SYNC);
+  }
+}
+
+void MemoryMappedFile::Release(const size_t offset, const size_t length) const
+{
+  if(!this->Data || length == 0)
+  {
+    return;
+  }
+
+  // Only the pages that are entirely inside of the range can be released
+  const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+  size_t end = std::min(offset + length, this->Size) / pageSize * pageSize;
+  if(begin < end)
+  {
+    madvise(this->Data + begin, end - begin, MADV_DONTNEED);
+  }
+}
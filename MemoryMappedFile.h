@@ -0,0 +1,103 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef MemoryMappedFile_H
+#define MemoryMappedFile_H
+
+// STL
+#include <cstddef>
+#include <string>
+
+/** How a MemoryMappedFile maps its file. */
+struct MappingModeEnum
+{
+  enum MappingMode {READ_ONLY, READ_WRITE};
+};
+
+/** A whole file mapped into memory. The operating system pages the file in as it is accessed and
+  * can drop the pages again under memory pressure, so files much larger than the memory can be
+  * used as if they were in memory. Writes to a READ_WRITE mapping go to the file. The functions
+  * throw std::runtime_error if the file cannot be opened, created or mapped. */
+class MemoryMappedFile
+{
+public:
+  MemoryMappedFile() = default;
+
+  /** Destructor. Unmaps the file. */
+  ~MemoryMappedFile();
+
+  MemoryMappedFile(const MemoryMappedFile&) = delete;
+  MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+  /** Map the existing file 'fileName'. */
+  void Open(const std::string& fileName, const MappingModeEnum::MappingMode mode);
+
+  /** Create (or truncate) the file 'fileName' with 'size' bytes of zeros and map it for reading and writing.
+    * The disk space of the whole file is reserved here, so a full disk throws std::runtime_error
+    * instead of failing a later write to the mapping. */
+  void Create(const std::string& fileName, const size_t size);
+
+  /** Unmap the file. What was written to it stays in the file. */
+  void Close();
+
+  /** Block until the modified pages have been written to the file. */
+  void Flush();
+
+  /** Tell the operating system that the bytes [offset, offset + length) are not needed for now, so
+    * that their pages stop counting towards the memory of the process. They are read again from
+    * the file if they are accessed later (modified pages of a READ_WRITE mapping are kept). */
+  void Release(const size_t offset, const size_t length) const;
+
+  bool IsOpen() const
+  {
+    return this->Data != nullptr;
+  }
+
+  /** Get the first byte of the mapping. */
+  char* GetData()
+  {
+    return this->Data;
+  }
+
+  /** Get the first byte of the mapping. */
+  const char* GetData() const
+  {
+    return this->Data;
+  }
+
+  /** Get the size of the file in bytes. */
+  size_t GetSize() const
+  {
+    return this->Size;
+  }
+
+private:
+  /** Map 'this->Size' bytes of the open file 'this->FileDescriptor'. */
+  void Map(const MappingModeEnum::MappingMode mode, const std::string& fileName);
+
+  /** The first byte of the mapping, or null if no file is mapped. */
+  char* Data = nullptr;
+
+  /** The size of the file in bytes. */
+  size_t Size = 0;
+
+  /** The descriptor of the mapped file, or -1. */
+  int FileDescriptor = -1;
+};
+
+#endif
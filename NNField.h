@@ -19,10 +19,20 @@
 #ifndef NNField_H
 #define NNField_H
 
+#include "CompactMatch.h"
 #include "Match.h"
 
 #include "itkImage.h"
 
+// STL
+#include <cstdint>
+
 typedef itk::Image<Match, 2> NNFieldType;
 
+/** Nearest neighbor fields that store the offsets to the matches (8 bytes per pixel for images
+  * up to 32767 pixels on a side, 12 bytes per pixel beyond that). The propagation, random search
+  * and PatchMatch classes take the field type as a template parameter. */
+typedef itk::Image<CompactMatch<int16_t>, 2> CompactNNFieldType;
+typedef itk::Image<CompactMatch<int32_t>, 2> LargeCompactNNFieldType;
+
 #endif
@@ -0,0 +1,115 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "NNFieldFile.h"
+
+// STL
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+/** The magic number at the start of every NN field file. */
+const char NNFieldFileMagic[8] = {'P', 'M', 'N', 'N', 'F', 0, 0, 0};
+
+/** The version of the format that is written. */
+const uint32_t NNFieldFileVersion = 1;
+}
+
+static_assert(sizeof(NNFieldFileHeader) == 64, "The NN field file header has to be 64 bytes");
+
+void NNFieldFile::Create(const std::string& fileName, const itk::ImageRegion<2>& region,
+                         const unsigned int patchRadius)
+{
+  this->Matches.Create(fileName, region.GetSize(), sizeof(NNFieldFileHeader));
+
+  NNFieldFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, NNFieldFileMagic, sizeof(header.Magic));
+  header.Version = NNFieldFileVersion;
+  header.HeaderSize = sizeof(NNFieldFileHeader);
+  for(unsigned int dimension = 0; dimension < 2; ++dimension)
+  {
+    header.Index[dimension] = region.GetIndex()[dimension];
+    header.Size[dimension] = region.GetSize()[dimension];
+  }
+  header.PatchRadius = patchRadius;
+  header.MatchSize = sizeof(MatchType);
+  std::memcpy(this->Matches.GetHeader(), &header, sizeof(header));
+
+  this->Region = region;
+  this->PatchRadius = patchRadius;
+}
+
+void NNFieldFile::Open(const std::string& fileName, const MappingModeEnum::MappingMode mode)
+{
+  // The header is mapped on its own first, since the size of the matches is only known from it
+  MemoryMappedFile headerFile;
+  headerFile.Open(fileName, MappingModeEnum::READ_ONLY);
+
+  NNFieldFileHeader header;
+  if(headerFile.GetSize() < sizeof(header))
+  {
+    throw std::runtime_error("NNFieldFile: " + fileName + " is too small to be an NN field file");
+  }
+  std::memcpy(&header, headerFile.GetData(), sizeof(header));
+  headerFile.Close();
+
+  if(std::memcmp(header.Magic, NNFieldFileMagic, sizeof(header.Magic)) != 0)
+  {
+    throw std::runtime_error("NNFieldFile: " + fileName + " is not an NN field file");
+  }
+  if(header.Version != NNFieldFileVersion || header.HeaderSize != sizeof(NNFieldFileHeader) ||
+     header.MatchSize != sizeof(MatchType))
+  {
+    throw std::runtime_error("NNFieldFile: " + fileName + " has an unsupported version or layout");
+  }
+
+  itk::Index<2> index = {{static_cast<itk::IndexValueType>(header.Index[0]),
+                          static_cast<itk::IndexValueType>(header.Index[1])}};
+  itk::Size<2> size = {{static_cast<itk::SizeValueType>(header.Size[0]),
+                        static_cast<itk::SizeValueType>(header.Size[1])}};
+
+  // This checks that the file holds the matches of the whole region
+  this->Matches.Open(fileName, size, mode, header.HeaderSize);
+
+  this->Region = itk::ImageRegion<2>(index, size);
+  this->PatchRadius = header.PatchRadius;
+}
+
+LargeCompactNNFieldType::Pointer NNFieldFile::GetNNField()
+{
+  LargeCompactNNFieldType::Pointer nnField = LargeCompactNNFieldType::New();
+  nnField->SetRegions(this->Region);
+  nnField->GetPixelContainer()->SetImportPointer(this->Matches.GetBufferPointer(),
+                                                 this->Region.GetNumberOfPixels(), false);
+  return nnField;
+}
+
+void NNFieldFile::CopyMatches(const LargeCompactNNFieldType* const nnField, MappedImage<MatchType>& matches)
+{
+  std::memcpy(matches.GetBufferPointer(), nnField->GetBufferPointer(),
+              nnField->GetLargestPossibleRegion().GetNumberOfPixels() * sizeof(MatchType));
+}
+
+void NNFieldFile::CopyMatches(const MappedImage<MatchType>& matches, const unsigned int /* patchRadius */,
+                              LargeCompactNNFieldType* const nnField)
+{
+  std::memcpy(nnField->GetBufferPointer(), matches.GetBufferPointer(),
+              nnField->GetLargestPossibleRegion().GetNumberOfPixels() * sizeof(MatchType));
+}
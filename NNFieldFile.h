@@ -0,0 +1,159 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldFile_H
+#define NNFieldFile_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// STL
+#include <cstdint>
+#include <string>
+
+// Custom
+#include "MappedImage.h"
+#include "NNField.h"
+
+/** The header of an NN field file. It is followed by the matches (CompactMatch<int32_t>: the x and y
+  * offsets to the match and its score) of the pixels of the region in raster order. Everything is
+  * stored in the byte order of the machine. */
+struct NNFieldFileHeader
+{
+  /** "PMNNF" followed by zeros. */
+  char Magic[8];
+
+  /** The version of the format. */
+  uint32_t Version;
+
+  /** The size of this header in bytes, where the matches start. */
+  uint32_t HeaderSize;
+
+  /** The region of the NN field. */
+  int64_t Index[2];
+  uint64_t Size[2];
+
+  /** The patch radius that the scores were computed with. */
+  uint32_t PatchRadius;
+
+  /** The size of a match in bytes. */
+  uint32_t MatchSize;
+
+  uint8_t Reserved[8];
+};
+
+/** A binary NN field file (see NNFieldFileHeader), which keeps the scores of the matches so that a
+  * field that is read back can be iterated on without rescoring it. The file is memory mapped, so a
+  * LargeCompactNNFieldType can use the matches in place (GetNNField()), and Read() and Write() of a
+  * LargeCompactNNFieldType are a single copy. Other field types (e.g. NNFieldType) are converted
+  * pixel by pixel through the GetCenter/SetCenter and GetScore/SetScore interface of the matches.
+  * Files that cannot be created or are not valid NN field files throw std::runtime_error. */
+class NNFieldFile
+{
+public:
+  /** The type of the matches in the file. */
+  typedef LargeCompactNNFieldType::PixelType MatchType;
+
+  /** Write 'nnField', whose scores were computed with 'patchRadius', to 'fileName'. */
+  template <typename TNNField>
+  static void Write(const TNNField* const nnField, const unsigned int patchRadius, const std::string& fileName);
+
+  /** Read the NN field file 'fileName' into 'nnField' and return the patch radius of its scores. */
+  template <typename TNNField>
+  static unsigned int Read(const std::string& fileName, TNNField* const nnField);
+
+  /** Create the file 'fileName' for an NN field of 'region' (with zero offsets and scores) and map it
+    * for reading and writing. */
+  void Create(const std::string& fileName, const itk::ImageRegion<2>& region, const unsigned int patchRadius);
+
+  /** Map the existing NN field file 'fileName'. */
+  void Open(const std::string& fileName, const MappingModeEnum::MappingMode mode);
+
+  /** Unmap the file. */
+  void Close()
+  {
+    this->Matches.Close();
+  }
+
+  /** Block until everything written to the matches is in the file. */
+  void Flush()
+  {
+    this->Matches.Flush();
+  }
+
+  bool IsOpen() const
+  {
+    return this->Matches.IsOpen();
+  }
+
+  /** Get the region of the NN field. */
+  const itk::ImageRegion<2>& GetRegion() const
+  {
+    return this->Region;
+  }
+
+  /** Get the patch radius that the scores were computed with. */
+  unsigned int GetPatchRadius() const
+  {
+    return this->PatchRadius;
+  }
+
+  /** Get the mapped matches. They are indexed from (0, 0) at the corner of GetRegion(). */
+  MappedImage<MatchType>& GetMatches()
+  {
+    return this->Matches;
+  }
+
+  /** Get the mapped matches. They are indexed from (0, 0) at the corner of GetRegion(). */
+  const MappedImage<MatchType>& GetMatches() const
+  {
+    return this->Matches;
+  }
+
+  /** Get an NN field whose buffer is the mapped matches, without copying them. It is only valid while
+    * the file is open, and it can only be modified if the file was opened for writing. */
+  LargeCompactNNFieldType::Pointer GetNNField();
+
+private:
+  /** Copy the matches of 'nnField' to 'matches'. */
+  static void CopyMatches(const LargeCompactNNFieldType* const nnField, MappedImage<MatchType>& matches);
+
+  template <typename TNNField>
+  static void CopyMatches(const TNNField* const nnField, MappedImage<MatchType>& matches);
+
+  /** Copy 'matches' to 'nnField', whose buffer has the region of the file. */
+  static void CopyMatches(const MappedImage<MatchType>& matches, const unsigned int patchRadius,
+                          LargeCompactNNFieldType* const nnField);
+
+  template <typename TNNField>
+  static void CopyMatches(const MappedImage<MatchType>& matches, const unsigned int patchRadius,
+                          TNNField* const nnField);
+
+  /** The mapped matches (after the header). */
+  MappedImage<MatchType> Matches;
+
+  /** The region of the NN field. */
+  itk::ImageRegion<2> Region;
+
+  /** The patch radius that the scores were computed with. */
+  unsigned int PatchRadius = 0;
+};
+
+#include "NNFieldFile.hpp"
+
+#endif
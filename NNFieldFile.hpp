@@ -0,0 +1,99 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef NNFieldFile_HPP
+#define NNFieldFile_HPP
+
+#include "NNFieldFile.h"
+
+// ITK
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// STL
+#include <cassert>
+
+template <typename TNNField>
+void NNFieldFile::Write(const TNNField* const nnField, const unsigned int patchRadius, const std::string& fileName)
+{
+  assert(nnField->GetBufferedRegion() == nnField->GetLargestPossibleRegion());
+
+  NNFieldFile file;
+  file.Create(fileName, nnField->GetLargestPossibleRegion(), patchRadius);
+  CopyMatches(nnField, file.Matches);
+}
+
+template <typename TNNField>
+unsigned int NNFieldFile::Read(const std::string& fileName, TNNField* const nnField)
+{
+  NNFieldFile file;
+  file.Open(fileName, MappingModeEnum::READ_ONLY);
+
+  nnField->SetRegions(file.Region);
+  nnField->Allocate();
+  CopyMatches(file.Matches, file.PatchRadius, nnField);
+
+  return file.PatchRadius;
+}
+
+template <typename TNNField>
+void NNFieldFile::CopyMatches(const TNNField* const nnField, MappedImage<MatchType>& matches)
+{
+  const itk::ImageRegion<2> region = nnField->GetLargestPossibleRegion();
+
+  itk::ImageRegionConstIteratorWithIndex<TNNField> nnFieldIterator(nnField, region);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+
+    // The offsets do not depend on where the region starts, so the match is formed at 'pixel'
+    MatchType match;
+    match.SetCenter(pixel, nnFieldIterator.Get().GetCenter(pixel), 0);
+    match.SetScore(nnFieldIterator.Get().GetScore());
+
+    itk::Index<2> filePixel = {{pixel[0] - region.GetIndex()[0], pixel[1] - region.GetIndex()[1]}};
+    matches.SetPixel(filePixel, match);
+
+    ++nnFieldIterator;
+  }
+}
+
+template <typename TNNField>
+void NNFieldFile::CopyMatches(const MappedImage<MatchType>& matches, const unsigned int patchRadius,
+                              TNNField* const nnField)
+{
+  const itk::ImageRegion<2> region = nnField->GetLargestPossibleRegion();
+
+  itk::ImageRegionIteratorWithIndex<TNNField> nnFieldIterator(nnField, region);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+
+    itk::Index<2> filePixel = {{pixel[0] - region.GetIndex()[0], pixel[1] - region.GetIndex()[1]}};
+    const MatchType& match = matches.GetPixel(filePixel);
+
+    typename TNNField::PixelType nnFieldMatch;
+    nnFieldMatch.SetCenter(pixel, match.GetCenter(pixel), patchRadius);
+    nnFieldMatch.SetScore(match.GetScore());
+    nnFieldIterator.Set(nnFieldMatch);
+
+    ++nnFieldIterator;
+  }
+}
+
+#endif
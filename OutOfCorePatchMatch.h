@@ -0,0 +1,341 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef OutOfCorePatchMatch_H
+#define OutOfCorePatchMatch_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// STL
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Custom
+#include "MappedImage.h"
+#include "NNField.h"
+#include "NNFieldFile.h"
+#include "PatchMatchHelpers.h"
+#include "SourceTileCache.h"
+#include "ThreadPool.h"
+#include "VectorizedSSD.h"
+
+/** This class computes the nearest neighbor field of an image that is too large to be in memory (e.g. a
+  * whole slide microscopy image) with the PatchMatch algorithm. The image, the optional masks and the
+  * NN field (see NNFieldFile) are files that are memory mapped. The target pixels are processed in
+  * tiles of TileSize: each tile copies its part of the image and of the NN field (with a one pixel halo)
+  * into memory, propagates and searches its pixels, and writes its part of the NN field back. The source
+  * patches come from an LRU cache of tiles of SourceTileSize (see SourceTileCache). The memory in use is
+  * therefore bounded by the tile sizes, the cache capacity and the number of threads, and not by the size
+  * of the image. Tiles that do not share a halo run in parallel on the thread pool, and the result does
+  * not depend on the number of threads or on the cache capacity.
+  * The patch distance functor has to provide a static
+  * Distance(image1, region1, image2, region2, upperBound) like VectorizedSSD does, since the two patches
+  * generally come from different tiles. */
+template <typename TImage, typename TPatchDistanceFunctor = VectorizedSSD<TImage> >
+class OutOfCorePatchMatch
+{
+public:
+  typedef typename TImage::PixelType PixelType;
+
+  /** The matches of the NN field file, which store the offsets to the matches (12 bytes per pixel). */
+  typedef NNFieldFile::MatchType MatchType;
+
+  /** Perform the random initialization and the iterations, writing the NN field file. */
+  void Compute();
+
+  /** Set the raw file of the image and its size. */
+  void SetImageFile(const std::string& fileName, const itk::Size<2>& size)
+  {
+    this->ImageFileName = fileName;
+    this->ImageSize = size;
+  }
+
+  /** Set a raw file of one byte per pixel that is nonzero at the valid patch centers. Without it, every
+    * pixel whose patch is inside of the image is a valid patch center. */
+  void SetValidPatchCentersFile(const std::string& fileName)
+  {
+    this->ValidPatchCentersFileName = fileName;
+  }
+
+  /** Set a raw file of one byte per pixel that is nonzero at the pixels at which to compute the NN field.
+    * Without it, the NN field is computed at every pixel whose patch is inside of the image. */
+  void SetTargetPixelsFile(const std::string& fileName)
+  {
+    this->TargetPixelsFileName = fileName;
+  }
+
+  /** Set the NN field file (see NNFieldFile) that the NN field is written to. The pixels that are not
+    * target pixels, or that have no valid patch center within reach, get an infinite score. */
+  void SetNNFieldFile(const std::string& fileName)
+  {
+    this->NNFieldFileName = fileName;
+  }
+
+  /** Get the NN field file of the last call to Compute(). It stays mapped until the next one. */
+  const NNFieldFile& GetNNField() const
+  {
+    return this->NNField;
+  }
+
+  /** Set the patch radius. */
+  void SetPatchRadius(const unsigned int patchRadius)
+  {
+    this->PatchRadius = patchRadius;
+  }
+
+  /** Set the number of iterations to perform. */
+  void SetIterations(const unsigned int iterations)
+  {
+    this->Iterations = iterations;
+  }
+
+  /** Set the side length of the tiles of target pixels. */
+  void SetTileSize(const unsigned int tileSize)
+  {
+    this->TileSize = tileSize;
+  }
+
+  /** Set the side length of the cached tiles of source patches. */
+  void SetSourceTileSize(const unsigned int sourceTileSize)
+  {
+    this->SourceTileSize = sourceTileSize;
+  }
+
+  /** Set the maximum number of source tiles that are kept in memory. */
+  void SetSourceCacheCapacity(const size_t sourceCacheCapacity)
+  {
+    this->SourceCacheCapacity = sourceCacheCapacity;
+  }
+
+  /** Set the radius of the window around a pixel in which its random initial match is drawn, and of the
+    * first (largest) window around its match in which the random search looks. Zero (the default) uses
+    * the whole image, as in the PatchMatch paper. On very large images a smaller radius keeps most of
+    * the source patches in the cached tiles. */
+  void SetMaximumSearchRadius(const unsigned int maximumSearchRadius)
+  {
+    this->MaximumSearchRadius = maximumSearchRadius;
+  }
+
+  /** Set the pool on which the tiles run. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set if the results are truly randomized. */
+  void SetRandom(const bool random)
+  {
+    this->Seed = random ? static_cast<unsigned int>(time(NULL)) : 0;
+  }
+
+  /** Set if progress is printed to std::cout. */
+  void SetVerbose(const bool verbose)
+  {
+    this->Verbose = verbose;
+  }
+
+  /** Get the cache of source tiles, e.g. to see how often the last call to Compute() found the source
+    * patches in it. */
+  const SourceTileCache<TImage>& GetSourceTileCache() const
+  {
+    return this->SourceTiles;
+  }
+
+private:
+  /** The image of the valid patch centers and target pixels masks. */
+  typedef itk::Image<unsigned char, 2> MaskImageType;
+
+  /** The type of the in memory NN field of a tile. */
+  typedef LargeCompactNNFieldType NNFieldType;
+
+  /** The few cached tiles that a target tile used last. Most source patches are in one of them (they
+    * are near the matches of the neighbors), so they are found without going through the shared cache. */
+  template <typename TTileImage>
+  struct RecentTiles
+  {
+    /** Get a tile whose buffer contains 'region', taking it from 'cache' (as the tile of 'pixel') if none
+      * of the recent ones does. */
+    TTileImage* Get(const itk::Index<2>& pixel, const itk::ImageRegion<2>& region, SourceTileCache<TTileImage>& cache)
+    {
+      for(size_t tileId = 0; tileId < this->Tiles.size(); ++tileId)
+      {
+        if(this->Tiles[tileId]->GetBufferedRegion().IsInside(region))
+        {
+          return this->Tiles[tileId];
+        }
+      }
+
+      typename TTileImage::Pointer tile = cache.GetTile(pixel);
+      if(this->Tiles.size() < 4)
+      {
+        this->Tiles.push_back(tile);
+      }
+      else
+      {
+        this->Tiles[this->NextReplaced] = tile;
+        this->NextReplaced = (this->NextReplaced + 1) % this->Tiles.size();
+      }
+      return tile;
+    }
+
+    /** The recent tiles. */
+    std::vector<typename TTileImage::Pointer> Tiles;
+
+    /** The recent tile that the next tile from the cache replaces. */
+    size_t NextReplaced = 0;
+  };
+
+  /** The recent tiles of the image and of the valid patch centers mask. */
+  struct SourceTileSet
+  {
+    RecentTiles<TImage> Image;
+    RecentTiles<MaskImageType> ValidPatchCenters;
+  };
+
+  /** Randomly initialize the NN field of the pixels of 'tileRegion'. */
+  void InitializeTile(const itk::ImageRegion<2>& tileRegion, const unsigned int tileId);
+
+  /** Propagate and search the target pixels of 'tileRegion' once. */
+  void IterateTile(const itk::ImageRegion<2>& tileRegion, const unsigned int tileId, const unsigned int iteration);
+
+  /** Load 'region' of the image and of the target pixels mask (padded by the patch radius). */
+  typename TImage::Pointer LoadTargetTile(const itk::ImageRegion<2>& tileRegion, MaskImageType::Pointer& targetPixels) const;
+
+  /** Get if 'pixel' is a valid patch center. */
+  bool IsValidPatchCenter(const itk::Index<2>& pixel, SourceTileSet& sourceTiles);
+
+  /** The patch distance of one target tile, with the interface of the in memory patch distance functors
+    * (so that PatchMatchHelpers::TryMatch can use it). The source patches are read from the tiles. */
+  struct TileDistance
+  {
+    OutOfCorePatchMatch* Engine;
+
+    /** The target tile, buffered with the patches of its pixels. */
+    const TImage* TargetTile;
+
+    /** The recent source tiles of the target tile. */
+    SourceTileSet* SourceTiles;
+
+    /** Get the distance between 'sourceRegion' and 'targetRegion' (of the target tile), stopping early
+      * once it is at least 'upperBound'. */
+    float Distance(const itk::ImageRegion<2>& sourceRegion, const itk::ImageRegion<2>& targetRegion,
+                   const float upperBound) const
+    {
+      const TImage* sourceTile = this->SourceTiles->Image.Get(ITKHelpers::GetRegionCenter(sourceRegion), sourceRegion,
+                                                              this->Engine->SourceTiles);
+      return this->Engine->PatchDistanceFunctor.Distance(sourceTile, sourceRegion, this->TargetTile, targetRegion,
+                                                         upperBound);
+    }
+  };
+
+  /** Replace 'match' of 'targetPixel' with the patch around 'sourcePixel' if that is a valid patch
+    * center other than the current match, and closer (see PatchMatchHelpers::TryMatch). This is how
+    * the initialization, the propagation and the random search evaluate a candidate. */
+  void TryMatch(const itk::Index<2>& targetPixel, const itk::Index<2>& sourcePixel, TileDistance& tileDistance,
+                MatchType& match);
+
+  /** Get the radius of the random initialization and of the first random search window. */
+  unsigned int GetInitialRadius() const;
+
+  /** Split the image into tiles of TileSize. */
+  std::vector<itk::ImageRegion<2> > CreateTiles() const;
+
+  /** Run 'function(tileRegion, tileId)' on every tile; the tiles of each of the four classes of
+    * (x parity, y parity) run in parallel, since they do not touch each others pixels or halos. */
+  template <typename TFunction>
+  void ForEachTile(const std::vector<itk::ImageRegion<2> >& tiles, TFunction function);
+
+  /** The raw file of the image. */
+  std::string ImageFileName;
+
+  /** The size of the image. */
+  itk::Size<2> ImageSize = {{0, 0}};
+
+  /** The raw file of the valid patch centers mask, if any. */
+  std::string ValidPatchCentersFileName;
+
+  /** The raw file of the target pixels mask, if any. */
+  std::string TargetPixelsFileName;
+
+  /** The file of the NN field. */
+  std::string NNFieldFileName = "NNField.nnf";
+
+  /** The mapped image. */
+  MappedImage<PixelType> Image;
+
+  /** The mapped valid patch centers mask. */
+  MappedImage<unsigned char> ValidPatchCenters;
+
+  /** The mapped target pixels mask. */
+  MappedImage<unsigned char> TargetPixels;
+
+  /** The mapped NN field. */
+  NNFieldFile NNField;
+
+  /** The cache of the tiles of the image that the source patches come from. */
+  SourceTileCache<TImage> SourceTiles;
+
+  /** The cache of the tiles of the valid patch centers mask. */
+  SourceTileCache<MaskImageType> ValidPatchCentersTiles;
+
+  /** The functor used to compare patches. */
+  TPatchDistanceFunctor PatchDistanceFunctor;
+
+  /** The pixels whose patches are inside of the image. */
+  itk::ImageRegion<2> InternalRegion;
+
+  /** The radius of patches to compare. (Patch side length = 2*radius + 1)*/
+  unsigned int PatchRadius = 5;
+
+  /** The number of iterations to perform. */
+  unsigned int Iterations = 5;
+
+  /** The side length of the tiles of target pixels. */
+  unsigned int TileSize = 256;
+
+  /** The side length of the cached source tiles. */
+  unsigned int SourceTileSize = 256;
+
+  /** The maximum number of cached source tiles. */
+  size_t SourceCacheCapacity = 64;
+
+  /** The radius of the random initialization and of the first random search window, or zero for the whole image. */
+  unsigned int MaximumSearchRadius = 0;
+
+  /** The number of random patch centers that the initialization of a pixel tries before it gives up. */
+  unsigned int InitializationAttempts = 16;
+
+  /** The fraction by which to reduce the search radius at each step, given by 'alpha' in PatchMatch paper section 3.2 */
+  float RegionReductionRatio = 0.5;
+
+  /** The pool on which the tiles run. */
+  ThreadPool* Pool = nullptr;
+
+  /** The seed of all of the random streams. */
+  unsigned int Seed = static_cast<unsigned int>(time(NULL));
+
+  /** A flag indicating whether progress is printed. */
+  bool Verbose = true;
+};
+
+#include "OutOfCorePatchMatch.hpp"
+
+#endif
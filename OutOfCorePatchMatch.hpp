@@ -0,0 +1,382 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef OutOfCorePatchMatch_HPP
+#define OutOfCorePatchMatch_HPP
+
+#include "OutOfCorePatchMatch.h"
+
+// ITK
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+template <typename TImage, typename TPatchDistanceFunctor>
+void OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::Compute()
+{
+  assert(this->PatchRadius > 0);
+  assert(this->TileSize > 0);
+  assert(this->SourceTileSize > 0);
+
+  this->Image.Open(this->ImageFileName, this->ImageSize, MappingModeEnum::READ_ONLY);
+
+  this->ValidPatchCenters.Close();
+  if(!this->ValidPatchCentersFileName.empty())
+  {
+    this->ValidPatchCenters.Open(this->ValidPatchCentersFileName, this->ImageSize, MappingModeEnum::READ_ONLY);
+  }
+
+  this->TargetPixels.Close();
+  if(!this->TargetPixelsFileName.empty())
+  {
+    this->TargetPixels.Open(this->TargetPixelsFileName, this->ImageSize, MappingModeEnum::READ_ONLY);
+  }
+
+  this->NNField.Create(this->NNFieldFileName, this->Image.GetLargestPossibleRegion(), this->PatchRadius);
+
+  this->InternalRegion = ITKHelpers::GetInternalRegion(this->Image.GetLargestPossibleRegion(), this->PatchRadius);
+
+  // A source tile has to hold every patch whose center is in it
+  this->SourceTiles.SetImage(&this->Image);
+  this->SourceTiles.SetTileSize(this->SourceTileSize);
+  this->SourceTiles.SetMargin(this->PatchRadius);
+  this->SourceTiles.SetCapacity(this->SourceCacheCapacity);
+
+  this->ValidPatchCentersTiles.SetImage(&this->ValidPatchCenters);
+  this->ValidPatchCentersTiles.SetTileSize(this->SourceTileSize);
+  this->ValidPatchCentersTiles.SetMargin(0);
+  this->ValidPatchCentersTiles.SetCapacity(this->SourceCacheCapacity);
+
+  std::vector<itk::ImageRegion<2> > tiles = CreateTiles();
+
+  if(this->Verbose)
+  {
+    std::cout << "OutOfCorePatchMatch: Initializing " << tiles.size() << " tiles..." << std::endl;
+  }
+
+  ForEachTile(tiles, [this](const itk::ImageRegion<2>& tileRegion, const unsigned int tileId)
+  {
+    InitializeTile(tileRegion, tileId);
+  });
+
+  for(unsigned int iteration = 0; iteration < this->Iterations; ++iteration)
+  {
+    if(this->Verbose)
+    {
+      std::cout << "OutOfCorePatchMatch iteration " << iteration << std::endl;
+    }
+
+    ForEachTile(tiles, [this, iteration](const itk::ImageRegion<2>& tileRegion, const unsigned int tileId)
+    {
+      IterateTile(tileRegion, tileId, iteration);
+    });
+  }
+
+  if(this->Verbose)
+  {
+    std::cout << "OutOfCorePatchMatch: " << this->SourceTiles.GetNumberOfHits() << " source tile cache hits, "
+              << this->SourceTiles.GetNumberOfMisses() << " misses." << std::endl;
+  }
+
+  this->NNField.Flush();
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+void OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::
+InitializeTile(const itk::ImageRegion<2>& tileRegion, const unsigned int tileId)
+{
+  NNFieldType::Pointer nnField = NNFieldType::New();
+  nnField->SetLargestPossibleRegion(this->Image.GetLargestPossibleRegion());
+  nnField->SetBufferedRegion(tileRegion);
+  nnField->SetRequestedRegion(tileRegion);
+  nnField->Allocate();
+
+  MaskImageType::Pointer targetPixels;
+  typename TImage::Pointer targetTile = LoadTargetTile(tileRegion, targetPixels);
+
+  // The initialization is sampling pass 0, and iteration i is pass i + 1
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(this->Seed, 0, tileId);
+
+  SourceTileSet sourceTiles;
+  TileDistance tileDistance = {this, targetTile.GetPointer(), &sourceTiles};
+
+  const unsigned int initialRadius = GetInitialRadius();
+
+  itk::ImageRegionConstIteratorWithIndex<NNFieldType> tileIterator(nnField, tileRegion);
+  while(!tileIterator.IsAtEnd())
+  {
+    const itk::Index<2> targetPixel = tileIterator.GetIndex();
+
+    MatchType match;
+    match.SetScore(std::numeric_limits<float>::infinity());
+
+    if(this->InternalRegion.IsInside(targetPixel) && (!targetPixels || targetPixels->GetPixel(targetPixel)))
+    {
+      itk::ImageRegion<2> window = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, initialRadius);
+      window.Crop(this->InternalRegion);
+
+      // Any valid patch is better than no match
+      for(unsigned int attempt = 0; attempt < this->InitializationAttempts && !std::isfinite(match.GetScore()); ++attempt)
+      {
+        TryMatch(targetPixel, PatchMatchHelpers::GetRandomPixelInRegion(window, randomGenerator), tileDistance, match);
+      }
+    }
+
+    nnField->SetPixel(targetPixel, match);
+    ++tileIterator;
+  }
+
+  this->NNField.GetMatches().WriteRegion(nnField.GetPointer(), tileRegion);
+  this->NNField.GetMatches().Release(tileRegion);
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+void OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::
+IterateTile(const itk::ImageRegion<2>& tileRegion, const unsigned int tileId, const unsigned int iteration)
+{
+  itk::ImageRegion<2> processedRegion = tileRegion;
+  if(!processedRegion.Crop(this->InternalRegion))
+  {
+    return; // The tile only has border pixels
+  }
+
+  // The halo holds the neighbors that the pixels on the edge of the tile propagate from
+  itk::ImageRegion<2> nnFieldRegion = tileRegion;
+  nnFieldRegion.PadByRadius(1);
+  nnFieldRegion.Crop(this->Image.GetLargestPossibleRegion());
+
+  NNFieldType::Pointer nnField = NNFieldType::New();
+  nnField->SetLargestPossibleRegion(this->Image.GetLargestPossibleRegion());
+  nnField->SetBufferedRegion(nnFieldRegion);
+  nnField->SetRequestedRegion(nnFieldRegion);
+  nnField->Allocate();
+  this->NNField.GetMatches().ReadRegion(nnFieldRegion, nnField.GetPointer());
+
+  MaskImageType::Pointer targetPixels;
+  typename TImage::Pointer targetTile = LoadTargetTile(tileRegion, targetPixels);
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator =
+    PatchMatchHelpers::CreateRandomGenerator(this->Seed, iteration + 1, tileId);
+
+  SourceTileSet sourceTiles;
+  TileDistance tileDistance = {this, targetTile.GetPointer(), &sourceTiles};
+
+  const unsigned int initialRadius = GetInitialRadius();
+
+  // As in the in memory propagation, odd iterations go backwards and propagate from the right and bottom neighbors
+  const bool forward = (iteration % 2 == 0);
+  const int direction = forward ? -1 : 1;
+  const itk::Offset<2> propagationOffsets[2] = {{{direction, 0}}, {{0, direction}}};
+
+  const std::vector<itk::Index<2> > pixels = PatchMatchHelpers::GetAllPixelIndices(processedRegion);
+  for(size_t pixelCounter = 0; pixelCounter < pixels.size(); ++pixelCounter)
+  {
+    const itk::Index<2>& targetPixel = forward ? pixels[pixelCounter] : pixels[pixels.size() - 1 - pixelCounter];
+
+    if(targetPixels && !targetPixels->GetPixel(targetPixel))
+    {
+      continue;
+    }
+
+    MatchType match = nnField->GetPixel(targetPixel);
+
+    // Propagation: try the patch next to the match of each of the neighbors that were already processed
+    for(unsigned int offsetId = 0; offsetId < 2; ++offsetId)
+    {
+      itk::Index<2> neighbor = targetPixel + propagationOffsets[offsetId];
+      if(!this->InternalRegion.IsInside(neighbor))
+      {
+        continue;
+      }
+
+      const MatchType& neighborMatch = nnField->GetPixel(neighbor);
+      if(!std::isfinite(neighborMatch.GetScore()))
+      {
+        continue; // The neighbor is not a target pixel or has no match
+      }
+
+      itk::Index<2> sourcePixel = neighborMatch.GetCenter(neighbor) - propagationOffsets[offsetId];
+      if(this->InternalRegion.IsInside(sourcePixel))
+      {
+        TryMatch(targetPixel, sourcePixel, tileDistance, match);
+      }
+    }
+
+    // Random search in windows of decreasing radius around the match (PatchMatch paper section 3.2)
+    const itk::Index<2> searchCenter = std::isfinite(match.GetScore()) ? match.GetCenter(targetPixel) : targetPixel;
+    unsigned int radius = initialRadius;
+    while(radius > this->PatchRadius)
+    {
+      itk::ImageRegion<2> window = ITKHelpers::GetRegionInRadiusAroundPixel(searchCenter, radius);
+      window.Crop(this->InternalRegion);
+
+      TryMatch(targetPixel, PatchMatchHelpers::GetRandomPixelInRegion(window, randomGenerator), tileDistance, match);
+
+      radius *= this->RegionReductionRatio;
+    }
+
+    nnField->SetPixel(targetPixel, match);
+  }
+
+  this->NNField.GetMatches().WriteRegion(nnField.GetPointer(), tileRegion);
+  this->NNField.GetMatches().Release(nnFieldRegion);
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+typename TImage::Pointer OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::
+LoadTargetTile(const itk::ImageRegion<2>& tileRegion, MaskImageType::Pointer& targetPixels) const
+{
+  itk::ImageRegion<2> bufferedRegion = tileRegion;
+  bufferedRegion.PadByRadius(this->PatchRadius);
+  bufferedRegion.Crop(this->Image.GetLargestPossibleRegion());
+
+  typename TImage::Pointer targetTile = TImage::New();
+  targetTile->SetLargestPossibleRegion(this->Image.GetLargestPossibleRegion());
+  targetTile->SetBufferedRegion(bufferedRegion);
+  targetTile->SetRequestedRegion(bufferedRegion);
+  targetTile->Allocate();
+  this->Image.ReadRegion(bufferedRegion, targetTile.GetPointer());
+  this->Image.Release(bufferedRegion);
+
+  targetPixels = nullptr;
+  if(this->TargetPixels.IsOpen())
+  {
+    targetPixels = MaskImageType::New();
+    targetPixels->SetLargestPossibleRegion(this->Image.GetLargestPossibleRegion());
+    targetPixels->SetBufferedRegion(tileRegion);
+    targetPixels->SetRequestedRegion(tileRegion);
+    targetPixels->Allocate();
+    this->TargetPixels.ReadRegion(tileRegion, targetPixels.GetPointer());
+    this->TargetPixels.Release(tileRegion);
+  }
+
+  return targetTile;
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+bool OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::
+IsValidPatchCenter(const itk::Index<2>& pixel, SourceTileSet& sourceTiles)
+{
+  assert(this->InternalRegion.IsInside(pixel));
+
+  if(!this->ValidPatchCenters.IsOpen())
+  {
+    return true;
+  }
+
+  itk::ImageRegion<2> pixelRegion(pixel, itk::Size<2>{{1, 1}});
+  return sourceTiles.ValidPatchCenters.Get(pixel, pixelRegion, this->ValidPatchCentersTiles)->GetPixel(pixel) != 0;
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+void OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::
+TryMatch(const itk::Index<2>& targetPixel, const itk::Index<2>& sourcePixel, TileDistance& tileDistance,
+         MatchType& match)
+{
+  // An infinite score means that there is no current match
+  if((std::isfinite(match.GetScore()) && sourcePixel == match.GetCenter(targetPixel)) ||
+     !IsValidPatchCenter(sourcePixel, *tileDistance.SourceTiles))
+  {
+    return;
+  }
+
+  PatchMatchHelpers::TryMatch(&tileDistance, targetPixel,
+                              ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, this->PatchRadius),
+                              sourcePixel, this->PatchRadius, match);
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+unsigned int OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::GetInitialRadius() const
+{
+  unsigned int initialRadius = std::max(this->InternalRegion.GetSize()[0], this->InternalRegion.GetSize()[1]);
+
+  if(this->MaximumSearchRadius > 0)
+  {
+    initialRadius = std::min(initialRadius, this->MaximumSearchRadius);
+  }
+
+  return initialRadius;
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+std::vector<itk::ImageRegion<2> > OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::CreateTiles() const
+{
+  const itk::ImageRegion<2>& fullRegion = this->Image.GetLargestPossibleRegion();
+
+  std::vector<itk::ImageRegion<2> > tiles;
+  for(itk::IndexValueType y = 0; y < static_cast<itk::IndexValueType>(fullRegion.GetSize()[1]); y += this->TileSize)
+  {
+    for(itk::IndexValueType x = 0; x < static_cast<itk::IndexValueType>(fullRegion.GetSize()[0]); x += this->TileSize)
+    {
+      itk::Index<2> corner = {{x, y}};
+      itk::Size<2> size = {{this->TileSize, this->TileSize}};
+      itk::ImageRegion<2> tileRegion(corner, size);
+      tileRegion.Crop(fullRegion);
+      tiles.push_back(tileRegion);
+    }
+  }
+
+  return tiles;
+}
+
+template <typename TImage, typename TPatchDistanceFunctor>
+template <typename TFunction>
+void OutOfCorePatchMatch<TImage, TPatchDistanceFunctor>::
+ForEachTile(const std::vector<itk::ImageRegion<2> >& tiles, TFunction function)
+{
+  for(unsigned int tileClass = 0; tileClass < 4; ++tileClass)
+  {
+    std::vector<unsigned int> tileIds;
+    for(unsigned int tileId = 0; tileId < tiles.size(); ++tileId)
+    {
+      unsigned int tileX = tiles[tileId].GetIndex()[0] / this->TileSize;
+      unsigned int tileY = tiles[tileId].GetIndex()[1] / this->TileSize;
+      if((tileX % 2) + 2 * (tileY % 2) == tileClass)
+      {
+        tileIds.push_back(tileId);
+      }
+    }
+
+    auto processTile = [&tiles, &tileIds, &function](const size_t id)
+    {
+      function(tiles[tileIds[id]], tileIds[id]);
+    };
+
+    if(this->Pool)
+    {
+      this->Pool->ParallelFor(tileIds.size(), processTile);
+    }
+    else
+    {
+      for(size_t id = 0; id < tileIds.size(); ++id)
+      {
+        processTile(id);
+      }
+    }
+  }
+}
+
+#endif
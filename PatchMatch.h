@@ -31,27 +31,103 @@
 #include <Mask/Mask.h>
 #include <PatchComparison/PatchDistance.h>
 
+// STL
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+
 // Custom
+#include "BackgroundWriter.h"
 #include "Match.h"
 #include "NNField.h"
+#include "NNFieldFile.h"
+#include "PatchMatchStatistics.h"
+#include "ThreadPool.h"
+
+/** When PatchMatch writes snapshots of the NN field. */
+struct CheckpointPolicyEnum
+{
+  enum CheckpointPolicy {OFF, EVERY_N_ITERATIONS, FINAL_ONLY};
+};
+
+/** When PatchMatch stops iterating before the number of iterations. */
+struct ConvergenceCriterionEnum
+{
+  enum ConvergenceCriterion {NONE, IMPROVED_FRACTION, RELATIVE_SCORE_DECREASE};
+};
 
 /** This class computes a nearest neighbor field using the PatchMatch algorithm.
-  * Note that this class does not actually need the image, as the acceptance test
-  * and the patch distance functor already have the images that they need.*/
+  * The NN field covers the target image, and its matches are patches of the source image. Both are
+  * the same image (set with SetImage) to match an image to itself. To match one image to another, the
+  * functors have to be given the two images as well (see VectorizedSSD and RandomSearch). The source
+  * is only prepared (the valid patch centers are corrected and indexed for sampling) when it changes,
+  * so matching many targets to one source with the same object only does that once.
+  * Note that this class does not actually need the pixels of the images, as the acceptance test
+  * and the patch distance functor already have the images that they need.
+  * The type of the nearest neighbor field is the one that the propagation functor works on
+  * (NNFieldType, or CompactNNFieldType for a smaller field). */
 template <typename TImage, typename TPropagation, typename TRandomSearch>
 class PatchMatch
 {
 public:
+  /** The type of the nearest neighbor field. */
+  typedef typename TPropagation::NNFieldType NNFieldType;
+
 
-  /** Perform multiple iterations of propagation and random search.*/
+  /** Perform multiple iterations of propagation and random search. Throws std::runtime_error if the
+    * matches of the NN field cannot store the offsets between the target and the source (see
+    * CompactMatch::CanStoreOffsets). */
   void Compute();
 
-  /** Set the number of iterations to perform. */
+  /** Update the NN field after the image was modified (in place) inside of 'modifiedRegions'.
+    * The target pixels whose patches overlap a modified region, and those whose matches do, are
+    * rescored and then iterated on like Compute() does (with the same iterations, convergence
+    * criterion and active set), while the rest of the field is kept. Apart from one pass over
+    * the match centers to find the matches that overlap the modified regions, the cost is
+    * proportional to the size of the modified regions (tiles are only used if the affected pixels fill
+    * one). This is only for an image that is matched to itself. */
+  void Recompute(const std::vector<itk::ImageRegion<2> >& modifiedRegions);
+
+  /** Set the number of iterations to perform. With a convergence criterion, this is the maximum. */
   void SetIterations(const unsigned int iterations)
   {
     this->Iterations = iterations;
   }
 
+  /** Set when Compute() stops before the number of iterations. With IMPROVED_FRACTION it stops after an
+    * iteration whose improved pixels (see IterationStatistics::ImprovedFraction) are less than 'threshold'
+    * of the target pixels, and with RELATIVE_SCORE_DECREASE after one that decreased the total score of the
+    * target pixels by less than 'threshold' of it (and gave no pixel its first finite score). The default
+    * is NONE (always do every iteration). */
+  void SetConvergenceCriterion(const ConvergenceCriterionEnum::ConvergenceCriterion convergenceCriterion,
+                               const double convergenceThreshold)
+  {
+    this->ConvergenceCriterion = convergenceCriterion;
+    this->ConvergenceThreshold = convergenceThreshold;
+  }
+
+  /** Set if each iteration after the first only processes the active target pixels: those that
+    * improved in the previous iteration, those next to one that did (so that they can propagate
+    * from it), and those whose score is still above 'scoreThreshold'. The other pixels have
+    * converged and drop out, and Compute() stops once none are left. The functors mark the pixels
+    * that they improve as they accept the better matches (see Propagator::SetImprovedImage), so no
+    * scores are compared afterwards. Without tiles, the active pixels are given to the functors with
+    * SetTargetPixels and SetPixelsToProcess, which are set back to the target pixels when Compute()
+    * returns or throws. */
+  void SetActiveSet(const bool activeSet,
+                    const float scoreThreshold = std::numeric_limits<float>::infinity())
+  {
+    this->ActiveSet = activeSet;
+    this->ActiveSetScoreThreshold = scoreThreshold;
+  }
+
+  /** Get the number of iterations that the last call to Compute() performed. */
+  unsigned int GetNumberOfComputedIterations() const
+  {
+    return this->NumberOfComputedIterations;
+  }
+
   /** Set the patch radius. */
   void SetPatchRadius(const unsigned int patchRadius)
   {
@@ -74,6 +150,7 @@ public:
   void SetRandomSearchFunctor(TRandomSearch* const randomSearchFunctor)
   {
       this->RandomSearchFunctor = randomSearchFunctor;
+      this->ValidPatchCentersChanged = true;
   }
 
   /** Get the random search functor. */
@@ -82,10 +159,45 @@ public:
       return this->RandomSearchFunctor;
   }
 
-  /** Set the image. */
+  /** Set the image that is matched to itself, which is both the source and the target image. */
   void SetImage(TImage* const image)
   {
-      this->Image = image;
+      this->SourceImage = image;
+      this->TargetImage = image;
+  }
+
+  /** Set the image that the matches are taken from. It has to be set before the valid patch centers. */
+  void SetSourceImage(TImage* const sourceImage)
+  {
+      this->SourceImage = sourceImage;
+  }
+
+  /** Set the image for which to compute the NN field. Its size can differ from that of the source image. */
+  void SetTargetImage(TImage* const targetImage)
+  {
+      this->TargetImage = targetImage;
+  }
+
+  /** Set the NN field to start from instead of a random one. It is copied, so it can be released
+    * afterwards. It has to cover the whole image, and its scores have to come from the patch
+    * distance functor on this image (they are what new matches must improve on). */
+  void SetInitialNNField(const NNFieldType* const initialNNField)
+  {
+    ITKHelpers::DeepCopy(initialNNField, this->NNField.GetPointer());
+  }
+
+  /** Read the NN field to start from from an NN field file (see NNFieldFile), such as a checkpoint.
+    * The scores in the file are used as they are instead of being recomputed, so they have to come
+    * from the patch distance functor on this image with this patch radius. A file of another patch
+    * radius throws std::runtime_error. */
+  void ReadInitialNNField(const std::string& fileName);
+
+  /** Make the next Compute() start from a random NN field, as the first one does, even if the image
+    * has the same size as the field. The buffer of the field is kept, so it is reused for the next image
+    * if that is not larger. */
+  void ResetNNField()
+  {
+    this->NNField->SetLargestPossibleRegion(itk::ImageRegion<2>());
   }
 
   /** Set the image. */
@@ -99,24 +211,109 @@ public:
 
   boost::signals2::signal<void (NNFieldType*)> UpdatedSignal;
 
+  /** A signal that is emitted with the statistics of every iteration once it is done. */
+  boost::signals2::signal<void (const IterationStatistics&)> IterationStatisticsSignal;
+
+  /** Get the statistics of the last iteration. The score distribution is only filled in if
+    * something is connected to IterationStatisticsSignal. */
+  const IterationStatistics& GetLastIterationStatistics() const
+  {
+    return this->LastIterationStatistics;
+  }
+
   void SetTargetPixels(const std::vector<itk::Index<2> > targetPixels)
   {
     this->TargetPixels = targetPixels;
   }
 
+  /** Set the image of the valid patch centers of the source image. Its sampling index is built by the
+    * next Compute() and reused by the ones after it, so this has to be called again after the image
+    * (or the source image) has been modified. */
   void SetValidPatchCentersImage(itk::Image<bool, 2>* const validPatchCentersImage)
   {
     this->ValidPatchCentersImage = validPatchCentersImage;
+    this->ValidPatchCentersChanged = true;
     CorrectValidPatchCentersImage();
   }
 
+  /** Set the pool on which the random initialization and the tiled engine run. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the side length of the tiles that are propagated and searched independently.
+    * Tiling is only used if a thread pool is set. Zero (the default) runs whole-image
+    * propagation and random search passes. */
+  void SetTileSize(const unsigned int tileSize)
+  {
+    this->TileSize = tileSize;
+  }
+
+  /** Set when snapshots of the NN field are written. With EVERY_N_ITERATIONS a snapshot is written
+    * after every 'checkpointInterval'-th iteration. The default is OFF. The snapshots are copied
+    * and written on a background thread, so they do not block the iterations unless two snapshots
+    * are already waiting to be written. They are NN field files (see NNFieldFile) with the scores,
+    * so a run can be resumed with ReadInitialNNField(). A snapshot that cannot be written makes the
+    * next snapshot of Compute(), or WaitForCheckpoints(), throw. */
+  void SetCheckpointPolicy(const CheckpointPolicyEnum::CheckpointPolicy checkpointPolicy,
+                           const unsigned int checkpointInterval = 1)
+  {
+    this->CheckpointPolicy = checkpointPolicy;
+    this->CheckpointInterval = std::max(checkpointInterval, 1u);
+  }
+
+  /** Set the prefix of the snapshot file names (prefix_iteration.nnf). */
+  void SetCheckpointPrefix(const std::string& checkpointPrefix)
+  {
+    this->CheckpointPrefix = checkpointPrefix;
+  }
+
+  /** Block until every snapshot queued so far has been written, and throw the error of one that
+    * could not be. Waiting (but not throwing) also happens when this object is destroyed. */
+  void WaitForCheckpoints()
+  {
+    if(this->CheckpointWriter)
+    {
+      this->CheckpointWriter->Flush();
+    }
+  }
+
+  /** Set if progress is printed to std::cout. */
+  void SetVerbose(const bool verbose)
+  {
+    this->Verbose = verbose;
+  }
+
 protected:
 
   /** The number of iterations to perform. */
   unsigned int Iterations = 5;
 
+  /** When to stop before the number of iterations. */
+  ConvergenceCriterionEnum::ConvergenceCriterion ConvergenceCriterion = ConvergenceCriterionEnum::NONE;
+
+  /** The value of the convergence criterion below which the iterations stop. */
+  double ConvergenceThreshold = 0;
+
+  /** The number of iterations that the last call to Compute() performed. */
+  unsigned int NumberOfComputedIterations = 0;
+
+  /** A flag indicating whether only the active target pixels are processed. */
+  bool ActiveSet = false;
+
+  /** Pixels with a score above this stay active. */
+  float ActiveSetScoreThreshold = std::numeric_limits<float>::infinity();
+
+  /** The pixels that the current iteration improved, which the functors mark while they update the
+    * field (only if the active set, a convergence criterion or a statistics listener needs them). */
+  itk::Image<bool, 2>::Pointer ImprovedImage;
+
+  /** A flag indicating whether no pixel of the improved image is marked. */
+  bool ImprovedImageCleared = false;
+
   /** The nearest neighbor field. */
-  NNFieldType::Pointer NNField = NNFieldType::New();
+  typename NNFieldType::Pointer NNField = NNFieldType::New();
 
   /** Randomly initialize the NNField. */
   void RandomlyInitializeNNField();
@@ -130,8 +327,11 @@ protected:
   /** Set the random search functor. */
   TRandomSearch* RandomSearchFunctor = nullptr;
 
+  /** The image that the matches are taken from. */
+  TImage* SourceImage = nullptr;
+
   /** The image for which to compute the NNField. */
-  TImage* Image = nullptr;
+  TImage* TargetImage = nullptr;
 
   /** The pixel indices at which to compute the NNField. */
   std::vector<itk::Index<2> > TargetPixels;
@@ -140,10 +340,89 @@ protected:
   typedef itk::Image<bool, 2> BoolImageType;
   BoolImageType* ValidPatchCentersImage = nullptr;
 
+  /** A flag indicating whether the random search functor has to (re)index the valid patch centers. */
+  bool ValidPatchCentersChanged = false;
+
   /** Since the ValidPatchCentersImage can be constructed externally, this function ensures
-    * that the pixels marked as valid are the centers of patches of radius PatchRadius that are fully inside the image. */
+    * that the pixels marked as valid are the centers of patches of radius PatchRadius that are fully inside the source image. */
   void CorrectValidPatchCentersImage();
 
+  /** The pool on which the random initialization and the tiled engine run. */
+  ThreadPool* Pool = nullptr;
+
+  /** The side length of the tiles of the tiled engine. */
+  unsigned int TileSize = 0;
+
+  /** When snapshots of the NN field are written. */
+  CheckpointPolicyEnum::CheckpointPolicy CheckpointPolicy = CheckpointPolicyEnum::OFF;
+
+  /** The number of iterations between snapshots with EVERY_N_ITERATIONS. */
+  unsigned int CheckpointInterval = 1;
+
+  /** The prefix of the snapshot file names. */
+  std::string CheckpointPrefix = "PatchMatch";
+
+  /** The thread that writes the snapshots. It is only started once there is a snapshot to write. */
+  std::unique_ptr<BackgroundWriter> CheckpointWriter;
+
+  /** A flag indicating whether progress is printed. */
+  bool Verbose = true;
+
+  /** Queue a snapshot of the NN field after 'iteration' if the checkpoint policy asks for one.
+    * 'lastIteration' tells if no more iterations follow. */
+  void Checkpoint(const unsigned int iteration, const bool lastIteration);
+
+  /** A block of target pixels that is propagated and searched independently of the other
+    * blocks during an iteration. */
+  struct Tile
+  {
+    /** The region of the NN field that this tile is responsible for. */
+    itk::ImageRegion<2> Core;
+
+    /** The private copy of the NN field of this tile. Its largest possible region is the
+      * whole image, but only the core and a one pixel halo around it are buffered. */
+    typename NNFieldType::Pointer NNField;
+
+    /** The target pixels inside of the core, in raster order. */
+    std::vector<itk::Index<2> > TargetPixels;
+
+    /** The target pixels that the next iteration processes. */
+    std::vector<itk::Index<2> > ActivePixels;
+  };
+
+  /** Split the target pixels into tiles of TileSize and copy the NN field into them. */
+  std::vector<Tile> CreateTiles();
+
+  /** Run one propagation and random search iteration on every tile in parallel. The halos
+    * are refreshed from the shared NN field first (so that matches flow between tiles from
+    * one iteration to the next), and the cores are written back to it afterwards. The work
+    * of the tiles is added to 'statistics'. */
+  void IterateTiles(std::vector<Tile>& tiles, IterationStatistics& statistics);
+
+  /** The statistics of the last iteration. */
+  IterationStatistics LastIterationStatistics;
+
+  /** Fill in the mean, median and maximum score of the target pixels. */
+  void ComputeScoreStatistics(IterationStatistics& statistics) const;
+
+  /** Get the target pixels that a modification of the image inside of 'modifiedRegions' affects. */
+  std::vector<itk::Index<2> > GetAffectedPixels(const std::vector<itk::ImageRegion<2> >& modifiedRegions) const;
+
+  /** Set the score of the match of each of 'pixels' to the distance between the patches that it pairs. */
+  void RescorePixels(const std::vector<itk::Index<2> >& pixels);
+
+  /** Get the target pixels, which are all of the pixels of the internal region if none were set. */
+  std::vector<itk::Index<2> > GetTargetPixels() const;
+
+  /** Get the pixels of 'pixels' that are active for the next iteration (see SetActiveSet). */
+  std::vector<itk::Index<2> > GetActivePixels(const std::vector<itk::Index<2> >& pixels) const;
+
+  /** Clear the marks of 'pixels' in the improved image. */
+  void ClearImprovedPixels(const std::vector<itk::Index<2> >& pixels);
+
+  /** Get the sum of the finite scores of the target pixels. */
+  double ComputeTotalScore(const std::vector<itk::Index<2> >& targetPixels) const;
+
 }; // end PatchMatch class
 
 #include "PatchMatch.hpp"
@@ -32,11 +32,15 @@
 #include <Histogram/Histogram.h>
 
 // ITK
+#include "itkImageRegionIterator.h"
 #include "itkImageRegionReverseIterator.h"
 
 // STL
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <ctime>
+#include <stdexcept>
 
 // Custom
 #include "PatchMatchHelpers.h"
@@ -47,76 +51,563 @@ void PatchMatch<TImage, TPropagation, TRandomSearch>::Compute()
 {
   assert(this->PropagationFunctor);
   assert(this->RandomSearchFunctor);
+  assert(this->SourceImage);
+  assert(this->TargetImage);
+
+  PatchMatchHelpers::CheckMatchRange<typename NNFieldType::PixelType>(this->SourceImage->GetLargestPossibleRegion(),
+                                                                      this->TargetImage->GetLargestPossibleRegion());
 
   // If the NNField is not already initialized, initialize it
-  if(this->NNField->GetLargestPossibleRegion() != this->Image->GetLargestPossibleRegion())
+  if(this->NNField->GetLargestPossibleRegion() != this->TargetImage->GetLargestPossibleRegion())
   {
     RandomlyInitializeNNField();
   }
 
-  this->RandomSearchFunctor->SetValidPatchCentersImage(this->ValidPatchCentersImage);
+  // The index of the valid patch centers only depends on the source, so it is kept for the next targets.
+  // Without a valid patch centers image, the random search functor was given its index directly.
+  if(this->ValidPatchCentersChanged && this->ValidPatchCentersImage)
+  {
+    this->RandomSearchFunctor->SetValidPatchCentersImage(this->ValidPatchCentersImage);
+    this->ValidPatchCentersChanged = false;
+  }
+
   this->RandomSearchFunctor->SetPixelsToProcess(this->TargetPixels);
+  this->PropagationFunctor->SetTargetPixels(this->TargetPixels);
+  this->PropagationFunctor->SetSourceRegion(this->SourceImage->GetLargestPossibleRegion());
+
+  const bool tiled = this->Pool && this->TileSize > 0;
+
+  std::vector<Tile> tiles;
+  if(tiled)
+  {
+    tiles = CreateTiles();
+  }
+
+  // The total score is only summed up once; the iterations then report how much they decreased it
+  const std::vector<itk::Index<2> > targetPixels = GetTargetPixels();
+  double totalScore = ComputeTotalScore(targetPixels);
+
+  this->NumberOfComputedIterations = 0;
+
+  // The first iteration processes every target pixel
+  std::vector<itk::Index<2> > activePixels = targetPixels;
+  size_t numberOfActivePixels = targetPixels.size();
+  for(size_t tileId = 0; tileId < tiles.size(); ++tileId)
+  {
+    tiles[tileId].ActivePixels = tiles[tileId].TargetPixels;
+  }
+
+  // The functors only mark the improved pixels if the active set, a convergence criterion or a listener needs them
+  const bool markImprovedPixels = this->ActiveSet || this->ConvergenceCriterion != ConvergenceCriterionEnum::NONE ||
+                                  !this->IterationStatisticsSignal.empty();
+  if(markImprovedPixels)
+  {
+    // Each iteration clears the marks that it set, so the whole image is only cleared when it is new
+    // or when an earlier Compute() stopped in the middle of an iteration
+    if(!this->ImprovedImage ||
+       this->ImprovedImage->GetLargestPossibleRegion() != this->NNField->GetLargestPossibleRegion())
+    {
+      this->ImprovedImage = itk::Image<bool, 2>::New();
+      this->ImprovedImage->SetRegions(this->NNField->GetLargestPossibleRegion());
+      this->ImprovedImage->Allocate();
+      this->ImprovedImageCleared = false;
+    }
+    if(!this->ImprovedImageCleared)
+    {
+      this->ImprovedImage->FillBuffer(false);
+    }
+    this->ImprovedImageCleared = false;
+  }
+  this->PropagationFunctor->SetImprovedImage(markImprovedPixels ? this->ImprovedImage.GetPointer() : nullptr);
+  this->RandomSearchFunctor->SetImprovedImage(markImprovedPixels ? this->ImprovedImage.GetPointer() : nullptr);
+
+  // The functors are restored even if an iteration (e.g. its checkpoint) throws
+  PatchMatchHelpers::ScopeExit restoreFunctors([this, tiled]()
+  {
+    this->PropagationFunctor->SetImprovedImage(nullptr);
+    this->RandomSearchFunctor->SetImprovedImage(nullptr);
+
+    if(this->ActiveSet && !tiled)
+    {
+      this->PropagationFunctor->SetTargetPixels(this->TargetPixels);
+      this->RandomSearchFunctor->SetPixelsToProcess(this->TargetPixels);
+    }
+  });
 
   // For the number of iterations specified, perform the appropriate propagation and then a random search
   for(unsigned int iteration = 0; iteration < this->Iterations; ++iteration)
   {
-    std::cout << "PatchMatch iteration " << iteration << std::endl;
+    if(this->Verbose)
+    {
+      std::cout << "PatchMatch iteration " << iteration << std::endl;
+    }
+
+    IterationStatistics statistics;
+    statistics.Iteration = iteration;
+    statistics.ActivePixels = numberOfActivePixels;
+
+    typedef std::chrono::steady_clock ClockType;
+    ClockType::time_point iterationStart = ClockType::now();
+
+    if(tiled)
+    {
+      if(this->Verbose)
+      {
+        std::cout << "PatchMatch: Propagating and random searching " << tiles.size() << " tiles..." << std::endl;
+      }
+      IterateTiles(tiles, statistics);
 
-    // We can propagate before random search because we are hoping the the random initialization gave us something good enough to propagate
-    std::cout << "PatchMatch: Propagating..." << std::endl;
-    this->PropagationFunctor->Propagate(this->NNField);
+      UpdatedSignal(this->NNField);
+    }
+    else
+    {
+      if(this->ActiveSet)
+      {
+        this->PropagationFunctor->SetTargetPixels(activePixels);
+        this->RandomSearchFunctor->SetPixelsToProcess(activePixels);
+      }
 
-    UpdatedSignal(this->NNField);
+      // We can propagate before random search because we are hoping the the random initialization gave us something good enough to propagate
+      if(this->Verbose)
+      {
+        std::cout << "PatchMatch: Propagating..." << std::endl;
+      }
+      ClockType::time_point propagationStart = ClockType::now();
+      this->PropagationFunctor->Propagate(this->NNField);
+      statistics.PropagationSeconds = std::chrono::duration<double>(ClockType::now() - propagationStart).count();
+      statistics.Propagation = this->PropagationFunctor->GetStatistics();
 
-    PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(),
-                                    Helpers::GetSequentialFileName("AfterPropagation", iteration, "mha"));
+      UpdatedSignal(this->NNField);
 
-    std::cout << "PatchMatch: Random searching..." << std::endl;
-    this->RandomSearchFunctor->Search(this->NNField);
+      if(this->Verbose)
+      {
+        std::cout << "PatchMatch: Random searching..." << std::endl;
+      }
+      ClockType::time_point randomSearchStart = ClockType::now();
+      this->RandomSearchFunctor->Search(this->NNField);
+      statistics.RandomSearchSeconds = std::chrono::duration<double>(ClockType::now() - randomSearchStart).count();
+      statistics.RandomSearch = this->RandomSearchFunctor->GetStatistics();
+
+      UpdatedSignal(this->NNField);
+    }
+
+    statistics.IterationSeconds = std::chrono::duration<double>(ClockType::now() - iterationStart).count();
+
+    if(markImprovedPixels && targetPixels.size() > 0)
+    {
+      statistics.ImprovedFraction = static_cast<double>(statistics.GetImprovedPixels()) / targetPixels.size();
+    }
+
+    // The decreases of the two stages add up to the decrease of the iteration, and a pixel can only
+    // get its first finite score once
+    ImprovementStatistics improvement = statistics.Propagation;
+    improvement.Add(statistics.RandomSearch);
+
+    // The pixels that left an infinite score were not part of the total, so they are added to it
+    if(improvement.NewlyFinitePixels > 0)
+    {
+      statistics.RelativeScoreDecrease = std::numeric_limits<double>::infinity();
+    }
+    else if(totalScore > 0)
+    {
+      statistics.RelativeScoreDecrease = improvement.ScoreDecrease / totalScore;
+    }
+    totalScore += improvement.NewlyFiniteScore - improvement.ScoreDecrease;
+
+    // The score distribution needs a pass over the field, so it is only computed for listeners
+    if(!this->IterationStatisticsSignal.empty())
+    {
+      ComputeScoreStatistics(statistics);
+    }
+
+    this->LastIterationStatistics = statistics;
+    IterationStatisticsSignal(statistics);
+
+    this->NumberOfComputedIterations = iteration + 1;
+
+    bool converged = false;
+    switch(this->ConvergenceCriterion)
+    {
+      case ConvergenceCriterionEnum::IMPROVED_FRACTION:
+        converged = statistics.ImprovedFraction < this->ConvergenceThreshold;
+        break;
+      case ConvergenceCriterionEnum::RELATIVE_SCORE_DECREASE:
+        converged = statistics.RelativeScoreDecrease < this->ConvergenceThreshold;
+        break;
+      default:
+        break;
+    }
+
+    // Only the pixels that can still improve are processed by the next iteration. The active pixels
+    // are all found before any mark is cleared, since they depend on the marks of their neighbors.
+    const bool updateActivePixels = this->ActiveSet && !converged && iteration + 1 < this->Iterations;
+    std::vector<itk::Index<2> > nextActivePixels;
+    std::vector<std::vector<itk::Index<2> > > nextActivePixelsPerTile(tiles.size());
+    if(updateActivePixels)
+    {
+      if(tiled)
+      {
+        this->Pool->ParallelFor(tiles.size(), [this, &tiles, &nextActivePixelsPerTile](const size_t tileId)
+        {
+          nextActivePixelsPerTile[tileId] = GetActivePixels(tiles[tileId].TargetPixels);
+        });
+      }
+      else
+      {
+        nextActivePixels = GetActivePixels(targetPixels);
+      }
+    }
+
+    // Only the pixels that this iteration processed can be marked
+    if(markImprovedPixels)
+    {
+      if(tiled)
+      {
+        this->Pool->ParallelFor(tiles.size(), [this, &tiles](const size_t tileId)
+        {
+          ClearImprovedPixels(tiles[tileId].ActivePixels);
+        });
+      }
+      else
+      {
+        ClearImprovedPixels(activePixels);
+      }
+    }
+
+    if(updateActivePixels)
+    {
+      if(tiled)
+      {
+        numberOfActivePixels = 0;
+        for(size_t tileId = 0; tileId < tiles.size(); ++tileId)
+        {
+          tiles[tileId].ActivePixels.swap(nextActivePixelsPerTile[tileId]);
+          numberOfActivePixels += tiles[tileId].ActivePixels.size();
+        }
+      }
+      else
+      {
+        activePixels.swap(nextActivePixels);
+        numberOfActivePixels = activePixels.size();
+      }
 
-    UpdatedSignal(this->NNField);
+      converged = numberOfActivePixels == 0;
+    }
 
-    PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(),
-                                    Helpers::GetSequentialFileName("AfterRandomSearch", iteration, "mha"));
+    Checkpoint(iteration, converged || iteration + 1 == this->Iterations);
 
-    { // Debug only
-    std::string sequentialFileName = Helpers::GetSequentialFileName("PatchMatch", iteration, "mha", 2);
-    PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), sequentialFileName);
+    if(converged)
+    {
+      if(this->Verbose)
+      {
+        std::cout << "PatchMatch converged after " << iteration + 1 << " iterations." << std::endl;
+      }
+      break;
     }
   } // end iteration loop
 
-  std::cout << "PatchMatch finished." << std::endl;
+  // An iteration that throws leaves its marks, which the next Compute() then clears
+  if(markImprovedPixels)
+  {
+    this->ImprovedImageCleared = true;
+  }
+
+  if(this->Verbose)
+  {
+    std::cout << "PatchMatch finished." << std::endl;
+  }
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+void PatchMatch<TImage, TPropagation, TRandomSearch>::Recompute(const std::vector<itk::ImageRegion<2> >& modifiedRegions)
+{
+  assert(this->PropagationFunctor);
+  assert(this->RandomSearchFunctor);
+  assert(this->SourceImage == this->TargetImage);
+  assert(this->NNField->GetLargestPossibleRegion() == this->TargetImage->GetLargestPossibleRegion());
+
+  std::vector<itk::Index<2> > affectedPixels = GetAffectedPixels(modifiedRegions);
+  if(affectedPixels.size() == 0)
+  {
+    return;
+  }
+
+  // The stored scores of the affected pixels compare patches that have changed
+  RescorePixels(affectedPixels);
+
+  if(this->Verbose)
+  {
+    std::cout << "PatchMatch: Recomputing " << affectedPixels.size() << " affected pixels..." << std::endl;
+  }
+
+  // The iterations only visit the affected pixels, and read the rest of the field as it is. The
+  // tiles would copy the whole field, so they are only used if the affected pixels fill a tile.
+  std::vector<itk::Index<2> > targetPixels;
+  targetPixels.swap(this->TargetPixels);
+  const unsigned int tileSize = this->TileSize;
+
+  // The target pixels are restored even if an iteration (e.g. its checkpoint) throws
+  PatchMatchHelpers::ScopeExit restoreTargetPixels([this, &targetPixels, tileSize]()
+  {
+    this->TargetPixels.swap(targetPixels);
+    this->TileSize = tileSize;
+    this->PropagationFunctor->SetTargetPixels(this->TargetPixels);
+    this->RandomSearchFunctor->SetPixelsToProcess(this->TargetPixels);
+  });
+
+  if(affectedPixels.size() < static_cast<size_t>(this->TileSize) * this->TileSize)
+  {
+    this->TileSize = 0;
+  }
+  this->TargetPixels.swap(affectedPixels);
+
+  Compute();
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+std::vector<itk::Index<2> > PatchMatch<TImage, TPropagation, TRandomSearch>::
+GetAffectedPixels(const std::vector<itk::ImageRegion<2> >& modifiedRegions) const
+{
+  const itk::ImageRegion<2> fullRegion = this->NNField->GetLargestPossibleRegion();
+  const itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(fullRegion, this->PatchRadius);
+
+  // A patch overlaps a modified region if its center is inside of the region padded by the patch radius
+  std::vector<itk::ImageRegion<2> > overlapRegions;
+  for(size_t regionId = 0; regionId < modifiedRegions.size(); ++regionId)
+  {
+    itk::ImageRegion<2> overlapRegion = modifiedRegions[regionId];
+    overlapRegion.PadByRadius(this->PatchRadius);
+    if(overlapRegion.Crop(internalRegion))
+    {
+      overlapRegions.push_back(overlapRegion);
+    }
+  }
+
+  if(overlapRegions.size() == 0)
+  {
+    return std::vector<itk::Index<2> >();
+  }
+
+  auto isInOverlapRegion = [&overlapRegions](const itk::Index<2>& pixel)
+  {
+    for(size_t regionId = 0; regionId < overlapRegions.size(); ++regionId)
+    {
+      if(overlapRegions[regionId].IsInside(pixel))
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // The field has no index from the matches back to the pixels, so the matches that overlap a modified
+  // region are found with one read-only pass over the match centers. Each row collects its own pixels
+  // in raster order, so the rows can be scanned in parallel.
+  std::vector<std::vector<itk::Index<2> > > affectedPixelsPerRow(internalRegion.GetSize()[1]);
+  auto scanRow = [this, &internalRegion, &isInOverlapRegion, &affectedPixelsPerRow](const size_t rowId)
+  {
+    itk::Index<2> rowCorner = {{internalRegion.GetIndex()[0],
+                                internalRegion.GetIndex()[1] + static_cast<itk::IndexValueType>(rowId)}};
+    itk::Size<2> rowSize = {{internalRegion.GetSize()[0], 1}};
+
+    itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(this->NNField, itk::ImageRegion<2>(rowCorner, rowSize));
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      const itk::Index<2> pixel = nnFieldIterator.GetIndex();
+      if(isInOverlapRegion(pixel) || isInOverlapRegion(nnFieldIterator.Get().GetCenter(pixel)))
+      {
+        affectedPixelsPerRow[rowId].push_back(pixel);
+      }
+      ++nnFieldIterator;
+    }
+  };
+
+  if(this->Pool)
+  {
+    this->Pool->ParallelFor(affectedPixelsPerRow.size(), scanRow);
+  }
+  else
+  {
+    for(size_t rowId = 0; rowId < affectedPixelsPerRow.size(); ++rowId)
+    {
+      scanRow(rowId);
+    }
+  }
+
+  std::vector<itk::Index<2> > affectedInternalPixels;
+  for(size_t rowId = 0; rowId < affectedPixelsPerRow.size(); ++rowId)
+  {
+    affectedInternalPixels.insert(affectedInternalPixels.end(), affectedPixelsPerRow[rowId].begin(),
+                                  affectedPixelsPerRow[rowId].end());
+  }
+
+  // Without target pixels, every pixel of the internal region is one
+  if(this->TargetPixels.size() == 0)
+  {
+    return affectedInternalPixels;
+  }
+
+  // Otherwise each target pixel is looked up among the affected pixels, which are sorted in raster order
+  auto rasterOrder = [](const itk::Index<2>& pixel1, const itk::Index<2>& pixel2)
+  {
+    return pixel1[1] < pixel2[1] || (pixel1[1] == pixel2[1] && pixel1[0] < pixel2[0]);
+  };
+
+  std::vector<itk::Index<2> > affectedPixels;
+  for(size_t targetPixelId = 0; targetPixelId < this->TargetPixels.size(); ++targetPixelId)
+  {
+    if(std::binary_search(affectedInternalPixels.begin(), affectedInternalPixels.end(),
+                          this->TargetPixels[targetPixelId], rasterOrder))
+    {
+      affectedPixels.push_back(this->TargetPixels[targetPixelId]);
+    }
+  }
+
+  return affectedPixels;
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+void PatchMatch<TImage, TPropagation, TRandomSearch>::RescorePixels(const std::vector<itk::Index<2> >& pixels)
+{
+  auto rescorePixel = [this, &pixels](const size_t pixelId)
+  {
+    const itk::Index<2>& pixel = pixels[pixelId];
+    typename NNFieldType::PixelType match = this->NNField->GetPixel(pixel);
+
+    itk::ImageRegion<2> matchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(match.GetCenter(pixel), this->PatchRadius);
+    itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixel, this->PatchRadius);
+
+    match.SetScore(this->RandomSearchFunctor->GetPatchDistanceFunctor()->Distance(matchRegion, targetRegion));
+    this->NNField->SetPixel(pixel, match);
+  };
+
+  if(this->Pool)
+  {
+    this->Pool->ParallelFor(pixels.size(), rescorePixel);
+  }
+  else
+  {
+    for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+    {
+      rescorePixel(pixelId);
+    }
+  }
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+void PatchMatch<TImage, TPropagation, TRandomSearch>::Checkpoint(const unsigned int iteration,
+                                                                 const bool lastIteration)
+{
+  bool write = false;
+  switch(this->CheckpointPolicy)
+  {
+    case CheckpointPolicyEnum::EVERY_N_ITERATIONS:
+      write = (iteration + 1) % this->CheckpointInterval == 0;
+      break;
+    case CheckpointPolicyEnum::FINAL_ONLY:
+      write = lastIteration;
+      break;
+    default:
+      break;
+  }
+
+  if(!write)
+  {
+    return;
+  }
+
+  // The copy is the only part that runs on this thread
+  typename NNFieldType::Pointer snapshot = NNFieldType::New();
+  ITKHelpers::DeepCopy(this->NNField.GetPointer(), snapshot.GetPointer());
+
+  std::string fileName = Helpers::GetSequentialFileName(this->CheckpointPrefix, iteration, "nnf", 2);
+
+  if(!this->CheckpointWriter)
+  {
+    this->CheckpointWriter.reset(new BackgroundWriter);
+  }
+
+  const unsigned int patchRadius = this->PatchRadius;
+  this->CheckpointWriter->Enqueue([snapshot, patchRadius, fileName]()
+  {
+    NNFieldFile::Write(snapshot.GetPointer(), patchRadius, fileName);
+  });
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+void PatchMatch<TImage, TPropagation, TRandomSearch>::ReadInitialNNField(const std::string& fileName)
+{
+  unsigned int patchRadius = NNFieldFile::Read(fileName, this->NNField.GetPointer());
+  if(patchRadius != this->PatchRadius)
+  {
+    throw std::runtime_error("PatchMatch: the scores of " + fileName + " are not for the patch radius in use");
+  }
 }
 
 template<typename TImage, typename TPropagation, typename TRandomSearch>
 void PatchMatch<TImage, TPropagation, TRandomSearch>::RandomlyInitializeNNField()
 {
-    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(this->Image->GetLargestPossibleRegion(),
+    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(this->TargetImage->GetLargestPossibleRegion(),
                                               this->PatchRadius);
+    itk::ImageRegion<2> sourceInternalRegion = ITKHelpers::GetInternalRegion(this->SourceImage->GetLargestPossibleRegion(),
+                                                                             this->PatchRadius);
 
-    this->NNField->SetRegions(this->Image->GetLargestPossibleRegion());
+    this->NNField->SetRegions(this->TargetImage->GetLargestPossibleRegion());
     this->NNField->Allocate();
 
-    itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(this->NNField, internalRegion);
+    // The border pixels get no match. A buffer that is reused (see ResetNNField) still holds the previous field there.
+    this->NNField->FillBuffer(typename NNFieldType::PixelType());
 
-    while(!nnFieldIterator.IsAtEnd())
+    // Each row draws from its own random stream, so the rows can be scored in parallel
+    // and the result does not depend on the number of threads.
+    this->RandomSearchFunctor->NextSearchPass();
+
+    auto initializeRow = [this, &internalRegion, &sourceInternalRegion](const size_t rowId)
     {
-      itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(nnFieldIterator.GetIndex(), this->PatchRadius);
+      PatchMatchHelpers::RandomGeneratorType randomGenerator = this->RandomSearchFunctor->CreateRandomGenerator(rowId);
 
-      itk::ImageRegion<2> randomRegion = PatchMatchHelpers::GetRandomRegionInRegion(internalRegion, this->PatchRadius);
-      Match randomMatch;
-      randomMatch.SetRegion(randomRegion);
-      randomMatch.SetScore(this->RandomSearchFunctor->GetPatchDistanceFunctor()->Distance(randomRegion, targetRegion));
+      itk::Index<2> rowCorner = {{internalRegion.GetIndex()[0],
+                                  internalRegion.GetIndex()[1] + static_cast<itk::IndexValueType>(rowId)}};
+      itk::Size<2> rowSize = {{internalRegion.GetSize()[0], 1}};
 
-      nnFieldIterator.Set(randomMatch);
-      ++nnFieldIterator;
+      itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(this->NNField, itk::ImageRegion<2>(rowCorner, rowSize));
+
+      while(!nnFieldIterator.IsAtEnd())
+      {
+        itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(nnFieldIterator.GetIndex(), this->PatchRadius);
+
+        itk::Index<2> randomPixel = PatchMatchHelpers::GetRandomPixelInRegion(sourceInternalRegion, randomGenerator);
+        itk::ImageRegion<2> randomRegion = ITKHelpers::GetRegionInRadiusAroundPixel(randomPixel, this->PatchRadius);
+
+        typename NNFieldType::PixelType randomMatch;
+        randomMatch.SetCenter(nnFieldIterator.GetIndex(), randomPixel, this->PatchRadius);
+        randomMatch.SetScore(this->RandomSearchFunctor->GetPatchDistanceFunctor()->Distance(randomRegion, targetRegion));
+
+        nnFieldIterator.Set(randomMatch);
+        ++nnFieldIterator;
+      }
+    };
+
+    if(this->Pool)
+    {
+      this->Pool->ParallelFor(internalRegion.GetSize()[1], initializeRow);
+    }
+    else
+    {
+      for(size_t rowId = 0; rowId < internalRegion.GetSize()[1]; ++rowId)
+      {
+        initializeRow(rowId);
+      }
     }
 }
 
 template<typename TImage, typename TPropagation, typename TRandomSearch>
 void PatchMatch<TImage, TPropagation, TRandomSearch>::CorrectValidPatchCentersImage()
 {
-    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(this->Image->GetLargestPossibleRegion(),
+    assert(this->SourceImage);
+    assert(this->ValidPatchCentersImage->GetLargestPossibleRegion() == this->SourceImage->GetLargestPossibleRegion());
+
+    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(this->SourceImage->GetLargestPossibleRegion(),
                                               this->PatchRadius);
 
     itk::ImageRegionIteratorWithIndex<BoolImageType> boolImageIterator(this->ValidPatchCentersImage, internalRegion);
@@ -138,4 +629,234 @@ void PatchMatch<TImage, TPropagation, TRandomSearch>::CorrectValidPatchCentersIm
     }
 }
 
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+std::vector<typename PatchMatch<TImage, TPropagation, TRandomSearch>::Tile>
+PatchMatch<TImage, TPropagation, TRandomSearch>::CreateTiles()
+{
+  assert(this->TileSize > 0);
+
+  itk::ImageRegion<2> fullRegion = this->NNField->GetLargestPossibleRegion();
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(fullRegion, this->PatchRadius);
+
+  const std::vector<itk::Index<2> > targetPixels = GetTargetPixels();
+
+  const unsigned int numberOfTilesX = (internalRegion.GetSize()[0] + this->TileSize - 1) / this->TileSize;
+  const unsigned int numberOfTilesY = (internalRegion.GetSize()[1] + this->TileSize - 1) / this->TileSize;
+
+  std::vector<Tile> allTiles(numberOfTilesX * numberOfTilesY);
+  for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
+  {
+    const itk::Index<2>& targetPixel = targetPixels[targetPixelId];
+    assert(internalRegion.IsInside(targetPixel));
+    unsigned int tileX = (targetPixel[0] - internalRegion.GetIndex()[0]) / this->TileSize;
+    unsigned int tileY = (targetPixel[1] - internalRegion.GetIndex()[1]) / this->TileSize;
+    allTiles[tileY * numberOfTilesX + tileX].TargetPixels.push_back(targetPixel);
+  }
+
+  // Only keep the tiles that have work to do (masked jobs leave many of them empty)
+  std::vector<Tile> tiles;
+  for(unsigned int tileY = 0; tileY < numberOfTilesY; ++tileY)
+  {
+    for(unsigned int tileX = 0; tileX < numberOfTilesX; ++tileX)
+    {
+      Tile& tile = allTiles[tileY * numberOfTilesX + tileX];
+      if(tile.TargetPixels.size() == 0)
+      {
+        continue;
+      }
+
+      itk::Index<2> coreCorner = {{internalRegion.GetIndex()[0] + tileX * this->TileSize,
+                                   internalRegion.GetIndex()[1] + tileY * this->TileSize}};
+      itk::Size<2> coreSize = {{this->TileSize, this->TileSize}};
+      tile.Core = itk::ImageRegion<2>(coreCorner, coreSize);
+      tile.Core.Crop(internalRegion);
+
+      itk::ImageRegion<2> bufferedRegion = tile.Core;
+      bufferedRegion.PadByRadius(1);
+      bufferedRegion.Crop(fullRegion);
+
+      tile.NNField = NNFieldType::New();
+      tile.NNField->SetLargestPossibleRegion(fullRegion);
+      tile.NNField->SetBufferedRegion(bufferedRegion);
+      tile.NNField->SetRequestedRegion(bufferedRegion);
+      tile.NNField->Allocate();
+
+      tiles.push_back(tile);
+    }
+  }
+
+  this->Pool->ParallelFor(tiles.size(), [this, &tiles](const size_t tileId)
+  {
+    Tile& tile = tiles[tileId];
+    itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(this->NNField,
+                                                                        tile.NNField->GetBufferedRegion());
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      tile.NNField->SetPixel(nnFieldIterator.GetIndex(), nnFieldIterator.Get());
+      ++nnFieldIterator;
+    }
+  });
+
+  return tiles;
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+std::vector<itk::Index<2> > PatchMatch<TImage, TPropagation, TRandomSearch>::GetTargetPixels() const
+{
+  if(this->TargetPixels.size() > 0)
+  {
+    return this->TargetPixels;
+  }
+
+  return PatchMatchHelpers::GetAllPixelIndices(
+           ITKHelpers::GetInternalRegion(this->NNField->GetLargestPossibleRegion(), this->PatchRadius));
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+std::vector<itk::Index<2> > PatchMatch<TImage, TPropagation, TRandomSearch>::
+GetActivePixels(const std::vector<itk::Index<2> >& pixels) const
+{
+  const itk::ImageRegion<2> region = this->ImprovedImage->GetLargestPossibleRegion();
+
+  // A pixel propagates from its neighbors in both directions over two iterations
+  const itk::Offset<2> neighborOffsets[4] = {{{-1, 0}}, {{1, 0}}, {{0, -1}}, {{0, 1}}};
+
+  std::vector<itk::Index<2> > activePixels;
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    const itk::Index<2>& pixel = pixels[pixelId];
+
+    bool active = this->ImprovedImage->GetPixel(pixel) ||
+                  this->NNField->GetPixel(pixel).GetScore() > this->ActiveSetScoreThreshold;
+
+    for(unsigned int neighborId = 0; neighborId < 4 && !active; ++neighborId)
+    {
+      itk::Index<2> neighbor = pixel + neighborOffsets[neighborId];
+      active = region.IsInside(neighbor) && this->ImprovedImage->GetPixel(neighbor);
+    }
+
+    if(active)
+    {
+      activePixels.push_back(pixel);
+    }
+  }
+
+  return activePixels;
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+void PatchMatch<TImage, TPropagation, TRandomSearch>::
+ClearImprovedPixels(const std::vector<itk::Index<2> >& pixels)
+{
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    this->ImprovedImage->SetPixel(pixels[pixelId], false);
+  }
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+double PatchMatch<TImage, TPropagation, TRandomSearch>::
+ComputeTotalScore(const std::vector<itk::Index<2> >& targetPixels) const
+{
+  double totalScore = 0;
+  for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
+  {
+    float score = this->NNField->GetPixel(targetPixels[targetPixelId]).GetScore();
+    if(std::isfinite(score))
+    {
+      totalScore += score;
+    }
+  }
+  return totalScore;
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+void PatchMatch<TImage, TPropagation, TRandomSearch>::ComputeScoreStatistics(IterationStatistics& statistics) const
+{
+  const std::vector<itk::Index<2> > targetPixels = GetTargetPixels();
+
+  if(targetPixels.size() == 0)
+  {
+    return;
+  }
+
+  std::vector<float> scores(targetPixels.size());
+  double scoreSum = 0;
+  for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
+  {
+    scores[targetPixelId] = this->NNField->GetPixel(targetPixels[targetPixelId]).GetScore();
+    scoreSum += scores[targetPixelId];
+  }
+
+  statistics.MeanScore = static_cast<float>(scoreSum / scores.size());
+  statistics.MaxScore = *std::max_element(scores.begin(), scores.end());
+
+  std::vector<float>::iterator median = scores.begin() + scores.size() / 2;
+  std::nth_element(scores.begin(), median, scores.end());
+  statistics.MedianScore = *median;
+}
+
+template<typename TImage, typename TPropagation, typename TRandomSearch>
+void PatchMatch<TImage, TPropagation, TRandomSearch>::IterateTiles(std::vector<Tile>& tiles,
+                                                                   IterationStatistics& statistics)
+{
+  // Every halo has to be refreshed before any core is written back, so this is a separate pass
+  this->Pool->ParallelFor(tiles.size(), [this, &tiles](const size_t tileId)
+  {
+    Tile& tile = tiles[tileId];
+    itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(this->NNField,
+                                                                        tile.NNField->GetBufferedRegion());
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      if(!tile.Core.IsInside(nnFieldIterator.GetIndex()))
+      {
+        tile.NNField->SetPixel(nnFieldIterator.GetIndex(), nnFieldIterator.Get());
+      }
+      ++nnFieldIterator;
+    }
+  });
+
+  const bool forward = this->PropagationFunctor->GetForward();
+
+  this->RandomSearchFunctor->NextSearchPass();
+
+  // Each tile counts its own work, and the counts are summed once every tile is done
+  typedef std::chrono::steady_clock ClockType;
+  std::vector<IterationStatistics> statisticsPerTile(tiles.size());
+
+  this->Pool->ParallelFor(tiles.size(), [this, &tiles, &statisticsPerTile, forward](const size_t tileId)
+  {
+    Tile& tile = tiles[tileId];
+    IterationStatistics& tileStatistics = statisticsPerTile[tileId];
+
+    // Each tile only processes (and so only counts and marks) the pixels of its own core
+    ClockType::time_point propagationStart = ClockType::now();
+    this->PropagationFunctor->Propagate(tile.NNField, tile.ActivePixels, forward, &tileStatistics.Propagation);
+    ClockType::time_point randomSearchStart = ClockType::now();
+    tileStatistics.PropagationSeconds = std::chrono::duration<double>(randomSearchStart - propagationStart).count();
+
+    PatchMatchHelpers::RandomGeneratorType randomGenerator = this->RandomSearchFunctor->CreateRandomGenerator(tileId);
+    this->RandomSearchFunctor->Search(tile.NNField, tile.ActivePixels, randomGenerator, &tileStatistics.RandomSearch);
+    tileStatistics.RandomSearchSeconds = std::chrono::duration<double>(ClockType::now() - randomSearchStart).count();
+
+    itk::ImageRegionConstIteratorWithIndex<NNFieldType> tileIterator(tile.NNField, tile.Core);
+    while(!tileIterator.IsAtEnd())
+    {
+      this->NNField->SetPixel(tileIterator.GetIndex(), tileIterator.Get());
+      ++tileIterator;
+    }
+  });
+
+  for(size_t tileId = 0; tileId < tiles.size(); ++tileId)
+  {
+    statistics.PropagationSeconds += statisticsPerTile[tileId].PropagationSeconds;
+    statistics.RandomSearchSeconds += statisticsPerTile[tileId].RandomSearchSeconds;
+    statistics.Propagation.Add(statisticsPerTile[tileId].Propagation);
+    statistics.RandomSearch.Add(statisticsPerTile[tileId].RandomSearch);
+  }
+
+  // Reverse the propagation for the next iteration
+  this->PropagationFunctor->SetForward(!forward);
+}
+
 #endif
@@ -24,9 +24,20 @@ namespace PatchMatchHelpers
 
 itk::ImageRegion<2> GetRandomRegionInRegion(const itk::ImageRegion<2>& region, const unsigned int patchRadius)
 {
+    // RandomInt includes both bounds, so the last pixel of the region is index + size - 1
     itk::Index<2> randomPixel;
-    randomPixel[0] = Helpers::RandomInt(region.GetIndex()[0], region.GetIndex()[0] + region.GetSize()[0]);
-    randomPixel[1] = Helpers::RandomInt(region.GetIndex()[1], region.GetIndex()[1] + region.GetSize()[1]);
+    randomPixel[0] = Helpers::RandomInt(region.GetIndex()[0], region.GetIndex()[0] + region.GetSize()[0] - 1);
+    randomPixel[1] = Helpers::RandomInt(region.GetIndex()[1], region.GetIndex()[1] + region.GetSize()[1] - 1);
+
+    itk::ImageRegion<2> randomRegion = ITKHelpers::GetRegionInRadiusAroundPixel(randomPixel, patchRadius);
+
+    return randomRegion;
+}
+
+itk::ImageRegion<2> GetRandomRegionInRegion(const itk::ImageRegion<2>& region, const unsigned int patchRadius,
+                                            RandomGeneratorType& randomGenerator)
+{
+    itk::Index<2> randomPixel = GetRandomPixelInRegion(region, randomGenerator);
 
     itk::ImageRegion<2> randomRegion = ITKHelpers::GetRegionInRadiusAroundPixel(randomPixel, patchRadius);
 
@@ -68,6 +79,19 @@ itk::Index<2> GetRandomPixelInRegion(const itk::ImageRegion<2>& region)
     return pixel;
 }
 
+int RandomInt(const int min, const int max, RandomGeneratorType& randomGenerator)
+{
+    std::uniform_int_distribution<int> distribution(min, max);
+    return distribution(randomGenerator);
+}
+
+RandomGeneratorType CreateRandomGenerator(const unsigned int seed, const unsigned int pass,
+                                          const unsigned int streamId)
+{
+    std::seed_seq seedSequence = {seed, pass, streamId};
+    return RandomGeneratorType(seedSequence);
+}
+
 std::vector<itk::Index<2> > GetAllPixelIndices(const itk::ImageRegion<2>& region)
 {
   std::vector<itk::Index<2> > pixelIndices;
@@ -88,4 +112,51 @@ std::vector<itk::Index<2> > GetAllPixelIndices(const itk::ImageRegion<2>& region
   return pixelIndices;
 }
 
+void AddImprovement(const itk::Index<2>& pixel, const float originalScore, const float score,
+                    itk::Image<bool, 2>* const improvedImage, ImprovementStatistics& statistics)
+{
+  statistics.AddImprovement(originalScore, score);
+
+  // Each pixel is only touched by one thread of a pass, so the mark needs no synchronization
+  if(improvedImage && score < originalScore && !improvedImage->GetPixel(pixel))
+  {
+    improvedImage->SetPixel(pixel, true);
+    statistics.FirstImprovedPixels++;
+  }
+}
+
+void DownsampleValidPatchCenters(const itk::Image<bool, 2>* const validPatchCentersImage,
+                                 itk::Image<bool, 2>* const output)
+{
+  const itk::ImageRegion<2> region = validPatchCentersImage->GetLargestPossibleRegion();
+
+  itk::Size<2> outputSize = {{(region.GetSize()[0] + 1) / 2, (region.GetSize()[1] + 1) / 2}};
+  itk::ImageRegion<2> outputRegion(region.GetIndex(), outputSize);
+  output->SetRegions(outputRegion);
+  output->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<itk::Image<bool, 2> > outputIterator(output, outputRegion);
+
+  while(!outputIterator.IsAtEnd())
+  {
+    const itk::Index<2>& outputIndex = outputIterator.GetIndex();
+    itk::Index<2> corner = {{region.GetIndex()[0] + 2 * (outputIndex[0] - region.GetIndex()[0]),
+                             region.GetIndex()[1] + 2 * (outputIndex[1] - region.GetIndex()[1])}};
+    itk::Size<2> size = {{2, 2}};
+    itk::ImageRegion<2> coveredRegion(corner, size);
+    coveredRegion.Crop(region);
+
+    bool valid = true;
+    itk::ImageRegionConstIterator<itk::Image<bool, 2> > coveredIterator(validPatchCentersImage, coveredRegion);
+    while(!coveredIterator.IsAtEnd())
+    {
+      valid = valid && coveredIterator.Get();
+      ++coveredIterator;
+    }
+
+    outputIterator.Set(valid);
+    ++outputIterator;
+  }
+}
+
 } // namespace PatchMatchHelpers
@@ -29,15 +29,44 @@
 #include <Mask/Mask.h>
 #include <ITKHelpers/ITKHelpers.h>
 
+// STL
+#include <functional>
+#include <random>
+
 // Custom
 #include "Match.h"
 #include "NNField.h"
+#include "PatchMatchStatistics.h"
+#include "ThreadPool.h"
 
 namespace PatchMatchHelpers
 {
 ///////// Types //////////
 typedef itk::Image<itk::CovariantVector<unsigned int, 2>, 2> CoordinateImageType;
 
+/** The generator used for all random sampling. Each thread (or block of pixels) owns one,
+  * so sampling never goes through the global rand() state. */
+typedef std::mt19937 RandomGeneratorType;
+
+/** Calls a function when it goes out of scope, also when the scope is left by an exception. This
+  * undoes temporary changes to the state of a functor. */
+class ScopeExit
+{
+public:
+  explicit ScopeExit(const std::function<void()>& function) : Function(function) {}
+
+  ~ScopeExit()
+  {
+    this->Function();
+  }
+
+private:
+  ScopeExit(const ScopeExit&) = delete;
+  ScopeExit& operator=(const ScopeExit&) = delete;
+
+  std::function<void()> Function;
+};
+
 ///////// Function templates (defined in PatchMatchHelpers.hpp) //////////
 
 template <typename NNFieldType, typename CoordinateImageType>
@@ -48,8 +77,77 @@ void GetPatchCentersImage(const NNFieldType* const matchImage, CoordinateImageTy
 template <typename NNFieldType>
 void WriteNNField(const NNFieldType* const nnField, const std::string& fileName);
 
+/** Compute the distance between two patches, letting the functor stop as soon as the distance
+  * is known to be at least 'upperBound'. Functors that provide Distance(region1, region2, upperBound)
+  * are called with it, others compute the full distance. Either way the result is exact if it is
+  * less than 'upperBound', and not less than 'upperBound' otherwise. */
+template <typename TPatchDistanceFunctor, unsigned int VDimension>
+float BoundedDistance(TPatchDistanceFunctor* const patchDistanceFunctor, const itk::ImageRegion<VDimension>& region1,
+                      const itk::ImageRegion<VDimension>& region2, const float upperBound);
+
+/** Replace 'match' of 'targetPixel', whose patch is 'targetRegion', with the patch of 'patchRadius'
+  * around 'center' if that patch is closer according to 'patchDistanceFunctor' (which is only
+  * computed as far as needed to tell, see BoundedDistance). Returns true if 'match' was replaced.
+  * This is how propagation and random search evaluate a candidate, in any dimension. */
+template <typename TMatch, typename TPatchDistanceFunctor, unsigned int VDimension>
+bool TryMatch(TPatchDistanceFunctor* const patchDistanceFunctor, const itk::Index<VDimension>& targetPixel,
+              const itk::ImageRegion<VDimension>& targetRegion, const itk::Index<VDimension>& center,
+              const unsigned int patchRadius, TMatch& match);
+
+/** Set the score of every match of the internal region of 'nnField' to the distance that
+  * 'patchDistanceFunctor' gives for the two patches it pairs, for example after the image has
+  * changed. The rows are rescored in parallel on 'threadPool' unless it is null. */
+template <typename TNNField, typename TPatchDistanceFunctor>
+void RescoreNNField(TNNField* const nnField, TPatchDistanceFunctor* const patchDistanceFunctor,
+                    const unsigned int patchRadius, ThreadPool* const threadPool);
+
+/** Blur 'image' with a 3x3 binomial kernel and keep every second pixel in each direction, which
+  * gives the next (half resolution) level of a Gaussian pyramid. The output has a size of
+  * ceil(size / 2) and the same origin of the largest possible region. TImage can be an itk::VectorImage,
+  * in which case the output gets the number of components of 'image'. */
+template <typename TImage>
+void DownsampleImage(const TImage* const image, TImage* const output);
+
+/** Get the patch of 'patchRadius' around 'center' in any dimension (ITKHelpers::GetRegionInRadiusAroundPixel
+  * is only for images). */
+template <unsigned int VDimension>
+itk::ImageRegion<VDimension> GetPatchRegion(const itk::Index<VDimension>& center, const unsigned int patchRadius);
+
+/** Get the centers of the patches of 'patchRadius' that are entirely inside of 'region', in any dimension. */
+template <unsigned int VDimension>
+itk::ImageRegion<VDimension> GetInternalRegion(const itk::ImageRegion<VDimension>& region, const unsigned int patchRadius);
+
+/** Get the offsets of the neighbors that a pixel propagates from in any dimension: the face neighbors
+  * before it (-1 along each axis) in the forward pass, and those after it in the backward pass. */
+template <unsigned int VDimension>
+std::vector<itk::Offset<VDimension> > GetPropagationOffsets(const bool forward);
+
+/** Get the center of the patch that is proposed to a pixel by its neighbor at 'propagationOffset', whose
+  * match is centered at 'neighborMatchCenter'. This is the patch next to the neighbor's match, on the side
+  * of the pixel: if the pixel is one to the right of its neighbor, it is the patch one to the right of the
+  * neighbor's match (hence the opposite of the offset). */
+template <unsigned int VDimension>
+itk::Index<VDimension> GetPropagatedCenter(const itk::Index<VDimension>& neighborMatchCenter,
+                                           const itk::Offset<VDimension>& propagationOffset);
+
+/** Get a random pixel index in a 'region' of any dimension, drawn from 'randomGenerator'. */
+template <unsigned int VDimension>
+itk::Index<VDimension> GetRandomPixelInRegion(const itk::ImageRegion<VDimension>& region,
+                                              RandomGeneratorType& randomGenerator);
+
+/** Throw std::runtime_error if the matches of TMatch cannot store the offset from every pixel of
+  * 'targetRegion' to every pixel of 'sourceRegion'. Only compact matches (see CompactMatch) have a
+  * limited range, so this does nothing for the other matches. */
+template <typename TMatch, unsigned int VDimension>
+void CheckMatchRange(const itk::ImageRegion<VDimension>& sourceRegion, const itk::ImageRegion<VDimension>& targetRegion);
+
 /////////// Non-template functions (defined in PatchMatchHelpers.cpp) /////////////
 
+/** Halve the resolution of a valid patch centers image. A pixel of 'output' is valid only if all
+  * of the (up to four) pixels of 'validPatchCentersImage' that it covers are valid. */
+void DownsampleValidPatchCenters(const itk::Image<bool, 2>* const validPatchCentersImage,
+                                 itk::Image<bool, 2>* const output);
+
 /** Read a nearest neighbor field from a file. */
 void ReadNNField(const std::string& fileName, const unsigned int patchRadius,
                  NNFieldType* const nnField);
@@ -57,12 +155,31 @@ void ReadNNField(const std::string& fileName, const unsigned int patchRadius,
 /** Get a random region inside of a specified 'region'. */
 itk::ImageRegion<2> GetRandomRegionInRegion(const itk::ImageRegion<2>& region, const unsigned int patchRadius);
 
+/** Get a random region inside of a specified 'region', drawn from 'randomGenerator'. */
+itk::ImageRegion<2> GetRandomRegionInRegion(const itk::ImageRegion<2>& region, const unsigned int patchRadius,
+                                            RandomGeneratorType& randomGenerator);
+
 /** Get a random pixel index in a 'region'. */
 itk::Index<2> GetRandomPixelInRegion(const itk::ImageRegion<2>& region);
 
+/** Get a random integer in [min, max] (inclusive), drawn from 'randomGenerator'. */
+int RandomInt(const int min, const int max, RandomGeneratorType& randomGenerator);
+
+/** Create the generator of random stream 'streamId' of sampling pass 'pass'. Different
+  * (seed, pass, streamId) triples give independent sequences, and the same triple always
+  * gives the same sequence, independent of which thread uses it. */
+RandomGeneratorType CreateRandomGenerator(const unsigned int seed, const unsigned int pass,
+                                          const unsigned int streamId);
+
 /** Get a list of all of the indices in a 'region' in raster scan order. */
 std::vector<itk::Index<2> > GetAllPixelIndices(const itk::ImageRegion<2>& region);
 
+/** Count the change of the score of 'pixel' from 'originalScore' to 'score' in 'statistics'. If the
+  * pixel improved and 'improvedImage' is given, it is marked there, and it is counted as a first
+  * improvement unless an earlier pass had already marked it. */
+void AddImprovement(const itk::Index<2>& pixel, const float originalScore, const float score,
+                    itk::Image<bool, 2>* const improvedImage, ImprovementStatistics& statistics);
+
 } // end PatchMatchHelpers namespace
 
 #include "PatchMatchHelpers.hpp"
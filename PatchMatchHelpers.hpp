@@ -20,7 +20,18 @@
 #define PatchMatchHelpers_HPP
 
 // STL
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// ITK
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Custom
+#include "SSDKernels.h"
 
 namespace PatchMatchHelpers
 {
@@ -38,9 +49,7 @@ void GetPatchCentersImage(const NNFieldType* const matchImage, CoordinateImageTy
   {
     typename CoordinateImageType::PixelType pixel;
 
-    Match match = imageIterator.Get();
-
-    itk::Index<2> center = ITKHelpers::GetRegionCenter(match.GetRegion());
+    itk::Index<2> center = imageIterator.Get().GetCenter(imageIterator.GetIndex());
 
     pixel[0] = center[0];
     pixel[1] = center[1];
@@ -61,6 +70,240 @@ void WriteNNField(const NNFieldType* const nnField, const std::string& fileName)
   ITKHelpers::WriteImage(coordinateImage.GetPointer(), fileName);
 }
 
+/** Overload for functors that can stop early (preferred because 0 converts to int exactly). */
+template <typename TPatchDistanceFunctor, unsigned int VDimension>
+auto BoundedDistance(TPatchDistanceFunctor* const patchDistanceFunctor, const itk::ImageRegion<VDimension>& region1,
+                     const itk::ImageRegion<VDimension>& region2, const float upperBound, int)
+  -> decltype(patchDistanceFunctor->Distance(region1, region2, upperBound))
+{
+  return patchDistanceFunctor->Distance(region1, region2, upperBound);
+}
+
+/** Overload for functors that can only compute the full distance. */
+template <typename TPatchDistanceFunctor, unsigned int VDimension>
+float BoundedDistance(TPatchDistanceFunctor* const patchDistanceFunctor, const itk::ImageRegion<VDimension>& region1,
+                      const itk::ImageRegion<VDimension>& region2, const float, long)
+{
+  return patchDistanceFunctor->Distance(region1, region2);
+}
+
+template <typename TPatchDistanceFunctor, unsigned int VDimension>
+float BoundedDistance(TPatchDistanceFunctor* const patchDistanceFunctor, const itk::ImageRegion<VDimension>& region1,
+                      const itk::ImageRegion<VDimension>& region2, const float upperBound)
+{
+  return BoundedDistance(patchDistanceFunctor, region1, region2, upperBound, 0);
+}
+
+template <typename TMatch, typename TPatchDistanceFunctor, unsigned int VDimension>
+bool TryMatch(TPatchDistanceFunctor* const patchDistanceFunctor, const itk::Index<VDimension>& targetPixel,
+              const itk::ImageRegion<VDimension>& targetRegion, const itk::Index<VDimension>& center,
+              const unsigned int patchRadius, TMatch& match)
+{
+  const float distance = BoundedDistance(patchDistanceFunctor, GetPatchRegion(center, patchRadius), targetRegion,
+                                         match.GetScore());
+  if(distance < match.GetScore())
+  {
+    match.SetCenter(targetPixel, center, patchRadius);
+    match.SetScore(distance);
+    return true;
+  }
+  return false;
+}
+
+template <typename TNNField, typename TPatchDistanceFunctor>
+void RescoreNNField(TNNField* const nnField, TPatchDistanceFunctor* const patchDistanceFunctor,
+                    const unsigned int patchRadius, ThreadPool* const threadPool)
+{
+  const itk::ImageRegion<2> internalRegion =
+    ITKHelpers::GetInternalRegion(nnField->GetLargestPossibleRegion(), patchRadius);
+
+  auto rescoreRow = [nnField, patchDistanceFunctor, patchRadius, &internalRegion](const size_t rowId)
+  {
+    itk::Index<2> rowCorner = {{internalRegion.GetIndex()[0],
+                                internalRegion.GetIndex()[1] + static_cast<itk::IndexValueType>(rowId)}};
+    itk::Size<2> rowSize = {{internalRegion.GetSize()[0], 1}};
+
+    itk::ImageRegionIteratorWithIndex<TNNField> nnFieldIterator(nnField, itk::ImageRegion<2>(rowCorner, rowSize));
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+      typename TNNField::PixelType match = nnFieldIterator.Get();
+
+      itk::ImageRegion<2> matchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(match.GetCenter(pixel), patchRadius);
+      itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixel, patchRadius);
+      match.SetScore(patchDistanceFunctor->Distance(matchRegion, targetRegion));
+
+      nnFieldIterator.Set(match);
+      ++nnFieldIterator;
+    }
+  };
+
+  if(threadPool)
+  {
+    threadPool->ParallelFor(internalRegion.GetSize()[1], rescoreRow);
+  }
+  else
+  {
+    for(size_t rowId = 0; rowId < internalRegion.GetSize()[1]; ++rowId)
+    {
+      rescoreRow(rowId);
+    }
+  }
+}
+
+template <typename TImage>
+void DownsampleImage(const TImage* const image, TImage* const output)
+{
+  typedef typename SSDKernels::PixelTraits<typename TImage::PixelType>::ComponentType ComponentType;
+  // The number of components of an itk::VectorImage is only known at run time
+  const unsigned int numberOfComponents = image->GetNumberOfComponentsPerPixel();
+
+  const itk::ImageRegion<2> region = image->GetLargestPossibleRegion();
+  const size_t width = region.GetSize()[0];
+  const size_t height = region.GetSize()[1];
+  const size_t outputWidth = (width + 1) / 2;
+  const size_t outputHeight = (height + 1) / 2;
+
+  itk::Size<2> outputSize = {{outputWidth, outputHeight}};
+  output->SetRegions(itk::ImageRegion<2>(region.GetIndex(), outputSize));
+  output->SetNumberOfComponentsPerPixel(numberOfComponents);
+  output->Allocate();
+
+  assert(image->GetBufferedRegion() == region);
+  const ComponentType* input = reinterpret_cast<const ComponentType*>(image->GetBufferPointer());
+  ComponentType* result = reinterpret_cast<ComponentType*>(output->GetBufferPointer());
+
+  // The kernel is separable: [1 2 1]/4 along the rows (only at the kept columns), then along the columns.
+  // Pixels beyond the border are replaced by the nearest pixel inside of it.
+  std::vector<double> rows(outputWidth * height * numberOfComponents);
+  for(size_t y = 0; y < height; ++y)
+  {
+    for(size_t x = 0; x < outputWidth; ++x)
+    {
+      const size_t center = 2 * x;
+      const size_t left = center > 0 ? center - 1 : 0;
+      const size_t right = std::min(center + 1, width - 1);
+      for(unsigned int component = 0; component < numberOfComponents; ++component)
+      {
+        rows[(y * outputWidth + x) * numberOfComponents + component] =
+          0.25 * input[(y * width + left) * numberOfComponents + component] +
+          0.5 * input[(y * width + center) * numberOfComponents + component] +
+          0.25 * input[(y * width + right) * numberOfComponents + component];
+      }
+    }
+  }
+
+  for(size_t y = 0; y < outputHeight; ++y)
+  {
+    const size_t center = 2 * y;
+    const size_t top = center > 0 ? center - 1 : 0;
+    const size_t bottom = std::min(center + 1, height - 1);
+    for(size_t i = 0; i < outputWidth * numberOfComponents; ++i)
+    {
+      double value = 0.25 * rows[top * outputWidth * numberOfComponents + i] +
+                     0.5 * rows[center * outputWidth * numberOfComponents + i] +
+                     0.25 * rows[bottom * outputWidth * numberOfComponents + i];
+      if(std::numeric_limits<ComponentType>::is_integer)
+      {
+        value = std::floor(value + 0.5);
+      }
+      result[y * outputWidth * numberOfComponents + i] = static_cast<ComponentType>(value);
+    }
+  }
+}
+
+template <unsigned int VDimension>
+itk::ImageRegion<VDimension> GetPatchRegion(const itk::Index<VDimension>& center, const unsigned int patchRadius)
+{
+  itk::Index<VDimension> corner;
+  itk::Size<VDimension> size;
+  for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+  {
+    corner[dimension] = center[dimension] - static_cast<itk::IndexValueType>(patchRadius);
+    size[dimension] = 2 * patchRadius + 1;
+  }
+  return itk::ImageRegion<VDimension>(corner, size);
+}
+
+template <unsigned int VDimension>
+itk::ImageRegion<VDimension> GetInternalRegion(const itk::ImageRegion<VDimension>& region, const unsigned int patchRadius)
+{
+  itk::Index<VDimension> corner;
+  itk::Size<VDimension> size;
+  for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+  {
+    corner[dimension] = region.GetIndex()[dimension] + static_cast<itk::IndexValueType>(patchRadius);
+    size[dimension] = region.GetSize()[dimension] > 2 * patchRadius ? region.GetSize()[dimension] - 2 * patchRadius : 0;
+  }
+  return itk::ImageRegion<VDimension>(corner, size);
+}
+
+template <unsigned int VDimension>
+std::vector<itk::Offset<VDimension> > GetPropagationOffsets(const bool forward)
+{
+  std::vector<itk::Offset<VDimension> > propagationOffsets(VDimension);
+  for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+  {
+    propagationOffsets[dimension].Fill(0);
+    propagationOffsets[dimension][dimension] = forward ? -1 : 1;
+  }
+  return propagationOffsets;
+}
+
+template <unsigned int VDimension>
+itk::Index<VDimension> GetPropagatedCenter(const itk::Index<VDimension>& neighborMatchCenter,
+                                           const itk::Offset<VDimension>& propagationOffset)
+{
+  return neighborMatchCenter - propagationOffset;
+}
+
+template <unsigned int VDimension>
+itk::Index<VDimension> GetRandomPixelInRegion(const itk::ImageRegion<VDimension>& region,
+                                              RandomGeneratorType& randomGenerator)
+{
+  itk::Index<VDimension> pixel;
+  for(unsigned int dimension = 0; dimension < VDimension; ++dimension)
+  {
+    pixel[dimension] = region.GetIndex()[dimension] + RandomInt(0, region.GetSize()[dimension] - 1, randomGenerator);
+  }
+  return pixel;
+}
+
+/** Determine if the matches of TMatch can store the offsets between two regions. Matches that
+  * store the center itself (like Match) can store any of them. */
+template <typename TMatch>
+struct MatchRange
+{
+  template <unsigned int VDimension>
+  static bool CanStoreOffsets(const itk::ImageRegion<VDimension>&, const itk::ImageRegion<VDimension>&)
+  {
+    return true;
+  }
+};
+
+template <typename TOffset, unsigned int VDimension>
+struct MatchRange<CompactMatch<TOffset, VDimension> >
+{
+  static bool CanStoreOffsets(const itk::ImageRegion<VDimension>& sourceRegion,
+                              const itk::ImageRegion<VDimension>& targetRegion)
+  {
+    return CompactMatch<TOffset, VDimension>::CanStoreOffsets(sourceRegion, targetRegion);
+  }
+};
+
+template <typename TMatch, unsigned int VDimension>
+void CheckMatchRange(const itk::ImageRegion<VDimension>& sourceRegion, const itk::ImageRegion<VDimension>& targetRegion)
+{
+  if(!MatchRange<TMatch>::CanStoreOffsets(sourceRegion, targetRegion))
+  {
+    std::stringstream message;
+    message << "PatchMatchHelpers: the offsets from the target region " << targetRegion.GetIndex() << " " << targetRegion.GetSize()
+            << " to the source region " << sourceRegion.GetIndex() << " " << sourceRegion.GetSize()
+            << " do not fit in the compact matches; use matches with larger offsets (like LargeCompactNNFieldType).";
+    throw std::runtime_error(message.str());
+  }
+}
+
 } // end PatchMatchHelpers namespace
 
 #endif
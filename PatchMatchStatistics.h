@@ -0,0 +1,176 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PatchMatchStatistics_H
+#define PatchMatchStatistics_H
+
+// STL
+#include <cmath>
+#include <vector>
+
+/** Counts of the pixels that a pass improved, which are cheap to gather while updating the
+  * field and tell how close it is to convergence. */
+struct ImprovementStatistics
+{
+  /** The number of pixels whose match was improved. */
+  unsigned long long ImprovedPixels = 0;
+
+  /** The number of improved pixels that no earlier pass of the iteration had improved. This is only
+    * counted while PatchMatch marks the improved pixels (see PatchMatchHelpers::AddImprovement). */
+  unsigned long long FirstImprovedPixels = 0;
+
+  /** The sum of the score decreases of the improved pixels (that had a finite score before). */
+  double ScoreDecrease = 0;
+
+  /** The number of improved pixels that had an infinite score before, and the sum of their new scores. */
+  unsigned long long NewlyFinitePixels = 0;
+  double NewlyFiniteScore = 0;
+
+  /** Count the change of the score of a pixel from 'originalScore' to 'score'. */
+  void AddImprovement(const float originalScore, const float score)
+  {
+    if(score < originalScore)
+    {
+      this->ImprovedPixels++;
+      if(std::isfinite(originalScore))
+      {
+        this->ScoreDecrease += originalScore - score;
+      }
+      else if(std::isfinite(score))
+      {
+        this->NewlyFinitePixels++;
+        this->NewlyFiniteScore += score;
+      }
+    }
+  }
+
+  void Add(const ImprovementStatistics& other)
+  {
+    this->ImprovedPixels += other.ImprovedPixels;
+    this->FirstImprovedPixels += other.FirstImprovedPixels;
+    this->ScoreDecrease += other.ScoreDecrease;
+    this->NewlyFinitePixels += other.NewlyFinitePixels;
+    this->NewlyFiniteScore += other.NewlyFiniteScore;
+  }
+};
+
+/** Counts of one propagation pass. */
+struct PropagationStatistics : public ImprovementStatistics
+{
+  /** The number of candidate patches whose distance was computed (possibly stopping early). */
+  unsigned long long DistanceEvaluations = 0;
+
+  /** The number of candidates that were only scored incrementally (and rejected that way). */
+  unsigned long long IncrementalEstimates = 0;
+
+  /** The number of candidates that improved a match. */
+  unsigned long long Accepts = 0;
+
+  void Add(const PropagationStatistics& other)
+  {
+    this->DistanceEvaluations += other.DistanceEvaluations;
+    this->IncrementalEstimates += other.IncrementalEstimates;
+    this->Accepts += other.Accepts;
+    ImprovementStatistics::Add(other);
+  }
+};
+
+/** Counts of one random search pass. */
+struct RandomSearchStatistics : public ImprovementStatistics
+{
+  /** The number of candidate patches whose distance was computed (possibly stopping early). */
+  unsigned long long DistanceEvaluations = 0;
+
+  /** The number of candidates that improved a match, by level of the search window. Level 0 is
+    * the largest window, and each following level is smaller by the region reduction ratio. */
+  std::vector<unsigned long long> AcceptsPerLevel;
+
+  void AddAccept(const unsigned int level)
+  {
+    if(this->AcceptsPerLevel.size() <= level)
+    {
+      this->AcceptsPerLevel.resize(level + 1, 0);
+    }
+    this->AcceptsPerLevel[level]++;
+  }
+
+  void Add(const RandomSearchStatistics& other)
+  {
+    this->DistanceEvaluations += other.DistanceEvaluations;
+    ImprovementStatistics::Add(other);
+    if(this->AcceptsPerLevel.size() < other.AcceptsPerLevel.size())
+    {
+      this->AcceptsPerLevel.resize(other.AcceptsPerLevel.size(), 0);
+    }
+    for(size_t level = 0; level < other.AcceptsPerLevel.size(); ++level)
+    {
+      this->AcceptsPerLevel[level] += other.AcceptsPerLevel[level];
+    }
+  }
+};
+
+/** Statistics of one PatchMatch iteration. */
+struct IterationStatistics
+{
+  /** The iteration (counting from 0). */
+  unsigned int Iteration = 0;
+
+  /** The number of target pixels that the iteration processed (all of them unless only the
+    * active set is processed, see PatchMatch::SetActiveSet). */
+  unsigned long long ActivePixels = 0;
+
+  /** The wall time of the whole iteration. */
+  double IterationSeconds = 0;
+
+  /** The wall time of the propagation and of the random search. In the tiled engine the two run
+    * interleaved on every tile, so these are the times summed over the tiles instead. */
+  double PropagationSeconds = 0;
+  double RandomSearchSeconds = 0;
+
+  PropagationStatistics Propagation;
+
+  RandomSearchStatistics RandomSearch;
+
+  /** The number of distinct improved pixels over the number of target pixels (from 0 to 1). */
+  double ImprovedFraction = 0;
+
+  /** The decrease of the total (finite) score of the target pixels over the total score before the
+    * iteration. It is infinite if a pixel got its first finite score, since the total cannot express
+    * that improvement. */
+  double RelativeScoreDecrease = 0;
+
+  /** The mean, median and maximum score of the target pixels after the iteration. These are only
+    * computed if something is connected to PatchMatch::IterationStatisticsSignal. */
+  float MeanScore = 0;
+  float MedianScore = 0;
+  float MaxScore = 0;
+
+  /** Get the number of distinct pixels that the iteration improved (if they were marked). */
+  unsigned long long GetImprovedPixels() const
+  {
+    return this->Propagation.FirstImprovedPixels + this->RandomSearch.FirstImprovedPixels;
+  }
+
+  /** Get the number of distance computations of both stages. */
+  unsigned long long GetDistanceEvaluations() const
+  {
+    return this->Propagation.DistanceEvaluations + this->RandomSearch.DistanceEvaluations;
+  }
+};
+
+#endif
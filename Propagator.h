@@ -23,21 +23,48 @@
 #include "Match.h"
 #include "PatchMatchHelpers.h"
 #include "NNField.h"
+#include "PatchMatchStatistics.h"
+#include "ThreadPool.h"
+#include "WavefrontTraversal.h"
 
-/** A class that traverses a target region and propagates good matches. */
-template <typename TPatchDistanceFunctor>
+/** A class that traverses a target region and propagates good matches. The nearest neighbor field
+  * can be of any pixel type with the interface of Match (GetCenter, SetCenter, GetScore and SetScore).
+  * The matches are taken from the region of the NN field itself unless a separate source region is
+  * set (to match one image to another). */
+template <typename TPatchDistanceFunctor, typename TNNField = NNFieldType>
 class Propagator
 {
 public:
+  /** The type of the nearest neighbor field. */
+  typedef TNNField NNFieldType;
+
   /** Propagate good matches from specified offsets. Returns the number of pixels
     * that were successfully propagated to. */
   unsigned int Propagate(NNFieldType* const nnField);
 
+  /** Propagate to 'targetPixels' in the given direction on the calling thread, without
+    * changing the state of this functor. Only the buffered region of 'nnField' has to be
+    * allocated, so this can be called concurrently on separate tiles of an NN field.
+    * The counts of the pass are added to 'statistics' if it is given. */
+  unsigned int Propagate(NNFieldType* const nnField, const std::vector<itk::Index<2> >& targetPixels,
+                         const bool forward, PropagationStatistics* const statistics = nullptr) const;
+
+  /** Get the counts of the last Propagate(nnField) pass. */
+  const PropagationStatistics& GetStatistics() const
+  {
+      return this->Statistics;
+  }
+
   void SetForward(const bool forward)
   {
       this->Forward = forward;
   }
 
+  bool GetForward() const
+  {
+      return this->Forward;
+  }
+
   void SetPatchRadius(const unsigned int patchRadius)
   {
       this->PatchRadius = patchRadius;
@@ -53,12 +80,70 @@ public:
       this->TargetPixels = targetPixels;
   }
 
+  /** Set the largest possible region of the source image, which the propagated matches have to be
+    * inside of. An empty region (the default) means that the source is the image of the NN field. */
+  void SetSourceRegion(const itk::ImageRegion<2>& sourceRegion)
+  {
+      this->SourceRegion = sourceRegion;
+  }
+
+  /** Set the pool used to propagate in parallel. If no pool (or a pool of a single thread)
+    * is set, the target pixels are traversed serially. The patch distance functor must be
+    * safe to call from several threads at once. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+      this->Pool = threadPool;
+  }
+
+  /** Set the side length of the blocks that are scheduled together in the parallel
+    * (wavefront) traversal. A block size of 1 processes single anti-diagonals. */
+  void SetWavefrontBlockSize(const unsigned int wavefrontBlockSize)
+  {
+      this->WavefrontBlockSize = wavefrontBlockSize;
+  }
+
+  /** Enable the incremental evaluation of propagation candidates. The candidate from a neighbor
+    * covers the same pixel pairs as the neighbor's own match except for one row or column, so
+    * its distance is estimated from the neighbor's score by subtracting the edge that leaves and
+    * adding the edge that enters (2*(2r+1) instead of (2r+1)^2 pixel comparisons). The full
+    * distance is only computed for candidates whose estimate beats the current match. This
+    * requires a patch distance that is a sum over pixels (like SSD) and an NN field whose scores
+    * were all computed with the patch distance functor on the current image. */
+  void SetIncremental(const bool incremental)
+  {
+      this->Incremental = incremental;
+  }
+
+  /** Set the image in which the improved pixels are marked (see PatchMatchHelpers::AddImprovement).
+    * No image (the default) marks nothing. */
+  void SetImprovedImage(itk::Image<bool, 2>* const improvedImage)
+  {
+      this->ImprovedImage = improvedImage;
+  }
+
 private:
   /** A flag indicating whether we are in the forward (true) or backward (false) pass case. */
   bool Forward = true;
 
-  /** Return either the top and left pixel offsets or bottom and right pixel offsets depending on the Forward flag. */
-  std::vector<itk::Offset<2> > GetPropagationOffsets();
+  /** Try to improve the match of 'targetPixel' from its neighbors at 'propagationOffsets',
+    * counting the work in 'statistics'. Returns true if any neighbor could be propagated from. */
+  bool PropagatePixel(NNFieldType* const nnField, const itk::Index<2>& targetPixel,
+                      const itk::ImageRegion<2>& internalRegion, const itk::ImageRegion<2>& sourceInternalRegion,
+                      const std::vector<itk::Offset<2> >& propagationOffsets,
+                      PropagationStatistics& statistics) const;
+
+  /** Get the pixels of the source image whose patches are inside of it. */
+  itk::ImageRegion<2> GetSourceInternalRegion(const NNFieldType* const nnField) const;
+
+  /** Return the row or column of the patch around 'center' that is furthest in the
+    * direction of 'offset' (which must have a single non-zero component). */
+  itk::ImageRegion<2> GetPatchEdge(const itk::Index<2>& center, const itk::Offset<2>& offset) const;
+
+  /** Traverse the target pixels as a wavefront of blocks (see WavefrontTraversal), whose result is
+    * identical to the serial traversal. */
+  unsigned int PropagateWavefront(NNFieldType* const nnField, const itk::ImageRegion<2>& internalRegion,
+                                  const itk::ImageRegion<2>& sourceInternalRegion,
+                                  const bool forward, PropagationStatistics& statistics);
 
   /** The radius of the patches. */
   unsigned int PatchRadius = 5;
@@ -68,6 +153,24 @@ private:
 
   /** The pixels at which to compute the NNField. */
   std::vector<itk::Index<2> > TargetPixels;
+
+  /** The largest possible region of the source image, or an empty region for the region of the NN field. */
+  itk::ImageRegion<2> SourceRegion;
+
+  /** The pool used for the parallel traversal. */
+  ThreadPool* Pool = nullptr;
+
+  /** The side length of the blocks of the parallel traversal. */
+  unsigned int WavefrontBlockSize = 32;
+
+  /** A flag indicating whether candidates are first scored incrementally from their neighbor's score. */
+  bool Incremental = false;
+
+  /** The counts of the last Propagate(nnField) pass. */
+  PropagationStatistics Statistics;
+
+  /** The image in which the improved pixels are marked, if any. */
+  itk::Image<bool, 2>* ImprovedImage = nullptr;
 };
 
 #include "Propagator.hpp"
@@ -22,11 +22,12 @@
 #include "Propagator.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "itkImageRegionIteratorWithIndex.h"
 
-template <typename TPatchDistanceFunctor>
-unsigned int Propagator<TPatchDistanceFunctor>::
+template <typename TPatchDistanceFunctor, typename TNNField>
+unsigned int Propagator<TPatchDistanceFunctor, TNNField>::
 Propagate(NNFieldType* const nnField)
 {
   assert(this->PatchDistanceFunctor);
@@ -39,127 +40,213 @@ Propagate(NNFieldType* const nnField)
     this->TargetPixels = PatchMatchHelpers::GetAllPixelIndices(internalRegion);
   }
 
-  std::vector<itk::Index<2> > targetPixels = this->TargetPixels;
+//  std::cout << "Propagation(): There are " << this->TargetPixels.size()
+//            << " pixels that would like to be processed." << std::endl;
+
+  unsigned int numberOfPropagatedPixels = 0;
 
-  if(!this->Forward)
+  this->Statistics = PropagationStatistics();
+
+  if(this->Pool && this->Pool->GetNumberOfThreads() > 1)
+  {
+    numberOfPropagatedPixels = PropagateWavefront(nnField, internalRegion, GetSourceInternalRegion(nnField),
+                                                  this->Forward, this->Statistics);
+  }
+  else
   {
-    std::reverse(targetPixels.begin(), targetPixels.end());
+    numberOfPropagatedPixels = Propagate(nnField, this->TargetPixels, this->Forward, &this->Statistics);
   }
 
-//  std::cout << "Propagation(): There are " << targetPixels.size()
-//            << " pixels that would like to be processed." << std::endl;
+  // Reverse the propagation for the next iteration
+  this->Forward = !this->Forward;
 
-  unsigned int numberOfPropagatedPixels = 0;
+  //std::cout << "Propagation() propagated " << propagatedPixels << " pixels." << std::endl;
+  //std::cout << "AcceptanceTest failed " << acceptanceTestFailed << std::endl;
+  return numberOfPropagatedPixels;
+}
 
-  for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
-  {
-    itk::Index<2> targetPixel = targetPixels[targetPixelId];
-    //ProcessPixelSignal(targetPixel);
+template <typename TPatchDistanceFunctor, typename TNNField>
+unsigned int Propagator<TPatchDistanceFunctor, TNNField>::
+Propagate(NNFieldType* const nnField, const std::vector<itk::Index<2> >& targetPixels,
+          const bool forward, PropagationStatistics* const statistics) const
+{
+  assert(this->PatchDistanceFunctor);
+
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(nnField->GetLargestPossibleRegion(), this->PatchRadius);
+  itk::ImageRegion<2> sourceInternalRegion = GetSourceInternalRegion(nnField);
+
+  std::vector<itk::Offset<2> > propagationOffsets = PatchMatchHelpers::GetPropagationOffsets<2>(forward);
 
-    itk::ImageRegion<2> targetRegion =
-          ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, this->PatchRadius);
+  unsigned int numberOfPropagatedPixels = 0;
 
-    std::vector<itk::Offset<2> > propagationOffsets = GetPropagationOffsets();
+  PropagationStatistics passStatistics;
+
+  for(size_t targetPixelCounter = 0; targetPixelCounter < targetPixels.size(); ++targetPixelCounter)
+  {
+    size_t targetPixelId = forward ? targetPixelCounter : targetPixels.size() - 1 - targetPixelCounter;
 
-    bool propagated = false;
-    for(size_t propagationOffsetId = 0;
-        propagationOffsetId < propagationOffsets.size();
-        ++propagationOffsetId)
+    if(PropagatePixel(nnField, targetPixels[targetPixelId], internalRegion, sourceInternalRegion, propagationOffsets,
+                      passStatistics))
     {
-      itk::Offset<2> propagationOffset = propagationOffsets[propagationOffsetId];
+      numberOfPropagatedPixels++;
+    }
+  } // end loop over target pixels
 
-      // The potential match is the opposite (hence the " - offset" in the following line)
-      // of the offset of the neighbor. Consider the following case:
-      // - We are at (4,4) and potentially propagating from (3,4)
-      // - The best match to (3,4) is (10,10)
-      // - potentialMatch should be (11,10), because since the current pixel is 1 to the right
-      // of the neighbor, we need to consider the patch one to the right of the neighbors best match
+  if(statistics)
+  {
+    statistics->Add(passStatistics);
+  }
 
-      itk::Index<2> nnFieldLocation = targetPixel + propagationOffset;
+  return numberOfPropagatedPixels;
+}
 
-      if(!internalRegion.IsInside(nnFieldLocation))
-      {
-          continue; // We don't want to propagate information from outside of the
-                    // viable NN field region
-      }
+template <typename TPatchDistanceFunctor, typename TNNField>
+bool Propagator<TPatchDistanceFunctor, TNNField>::
+PropagatePixel(NNFieldType* const nnField, const itk::Index<2>& targetPixel,
+               const itk::ImageRegion<2>& internalRegion, const itk::ImageRegion<2>& sourceInternalRegion,
+               const std::vector<itk::Offset<2> >& propagationOffsets,
+               PropagationStatistics& statistics) const
+{
+  //ProcessPixelSignal(targetPixel);
 
-      NNFieldType::PixelType nnFieldPixel = nnField->GetPixel(nnFieldLocation);
-      itk::Index<2> bestMatchPixel =
-        ITKHelpers::GetRegionCenter(nnFieldPixel.GetRegion());
+  itk::ImageRegion<2> targetRegion =
+        ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, this->PatchRadius);
 
-      itk::Index<2> potentialMatchPixel = bestMatchPixel - propagationOffset;
+  const float originalScore = nnField->GetPixel(targetPixel).GetScore();
 
-      if(!internalRegion.IsInside(potentialMatchPixel))
-      {
-          continue; // We don't want to propagate information from outside of the
-                    // viable NN field region
-      }
+  bool propagated = false;
+  for(size_t propagationOffsetId = 0;
+      propagationOffsetId < propagationOffsets.size();
+      ++propagationOffsetId)
+  {
+    itk::Offset<2> propagationOffset = propagationOffsets[propagationOffsetId];
 
-      itk::ImageRegion<2> potentialMatchRegion =
-            ITKHelpers::GetRegionInRadiusAroundPixel(potentialMatchPixel, this->PatchRadius);
+    itk::Index<2> nnFieldLocation = targetPixel + propagationOffset;
 
+    if(!internalRegion.IsInside(nnFieldLocation))
+    {
+        continue; // We don't want to propagate information from outside of the
+                  // viable NN field region
+    }
 
-      float distance = this->PatchDistanceFunctor->Distance(potentialMatchRegion, targetRegion);
+    typename NNFieldType::PixelType nnFieldPixel = nnField->GetPixel(nnFieldLocation);
+    itk::Index<2> bestMatchPixel = nnFieldPixel.GetCenter(nnFieldLocation);
 
-      Match potentialMatch;
-      potentialMatch.SetRegion(potentialMatchRegion);
-      potentialMatch.SetScore(distance);
+    // E.g. at (4,4), propagating from (3,4) whose best match is (10,10), the potential match is (11,10)
+    itk::Index<2> potentialMatchPixel = PatchMatchHelpers::GetPropagatedCenter(bestMatchPixel, propagationOffset);
 
-      // If there were previous matches, add this one if it is better
-      Match currentMatch = nnField->GetPixel(targetPixel);
+    if(!sourceInternalRegion.IsInside(potentialMatchPixel))
+    {
+        continue; // The potential match has to be a fully defined patch of the source image
+    }
 
-      if(potentialMatch.GetScore() < currentMatch.GetScore())
+    // If there were previous matches, add this one if it is better. The distance computation can stop
+    // as soon as it is clear that the potential match is not better than the current one.
+    typename NNFieldType::PixelType currentMatch = nnField->GetPixel(targetPixel);
+
+    // The potential match pairs the same pixels as the neighbor and its best match, except that the
+    // edge of both patches in the direction of the propagation offset leaves and the opposite edge enters.
+    if(this->Incremental && std::isfinite(nnFieldPixel.GetScore()))
+    {
+      itk::Offset<2> oppositeOffset = {{-propagationOffset[0], -propagationOffset[1]}};
+      float leavingDistance =
+        this->PatchDistanceFunctor->Distance(GetPatchEdge(bestMatchPixel, propagationOffset),
+                                             GetPatchEdge(nnFieldLocation, propagationOffset));
+      float enteringDistance =
+        this->PatchDistanceFunctor->Distance(GetPatchEdge(potentialMatchPixel, oppositeOffset),
+                                             GetPatchEdge(targetPixel, oppositeOffset));
+      float estimatedDistance = nnFieldPixel.GetScore() - leavingDistance + enteringDistance;
+
+      // Allow for the rounding error of the estimate so that no better match is skipped
+      float tolerance = 1e-5f * (nnFieldPixel.GetScore() + leavingDistance + enteringDistance);
+      if(estimatedDistance >= currentMatch.GetScore() + tolerance)
       {
-        nnField->SetPixel(targetPixel, potentialMatch);
+        statistics.IncrementalEstimates++;
+        propagated = true;
+        continue;
       }
+    }
 
-      //PropagatedSignal(nnField);
-      propagated = true;
-
-    } // end loop over potentialPropagationPixels
-
-    if(propagated)
+    statistics.DistanceEvaluations++;
+    if(PatchMatchHelpers::TryMatch(this->PatchDistanceFunctor, targetPixel, targetRegion, potentialMatchPixel,
+                                   this->PatchRadius, currentMatch))
     {
-      numberOfPropagatedPixels++;
+      statistics.Accepts++;
+      nnField->SetPixel(targetPixel, currentMatch);
     }
 
-  } // end loop over target pixels
+    //PropagatedSignal(nnField);
+    propagated = true;
 
-  // Reverse the propagation for the next iteration
-  this->Forward = !this->Forward;
+  } // end loop over potentialPropagationPixels
 
-  //std::cout << "Propagation() propagated " << propagatedPixels << " pixels." << std::endl;
-  //std::cout << "AcceptanceTest failed " << acceptanceTestFailed << std::endl;
-  return numberOfPropagatedPixels;
+  PatchMatchHelpers::AddImprovement(targetPixel, originalScore, nnField->GetPixel(targetPixel).GetScore(),
+                                    this->ImprovedImage, statistics);
+
+  return propagated;
 }
 
+template <typename TPatchDistanceFunctor, typename TNNField>
+itk::ImageRegion<2> Propagator<TPatchDistanceFunctor, TNNField>::
+GetPatchEdge(const itk::Index<2>& center, const itk::Offset<2>& offset) const
+{
+  itk::ImageRegion<2> patchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(center, this->PatchRadius);
+  itk::Index<2> edgeIndex = patchRegion.GetIndex();
+  itk::Size<2> edgeSize = patchRegion.GetSize();
+  for(unsigned int dimension = 0; dimension < 2; ++dimension)
+  {
+    if(offset[dimension] != 0)
+    {
+      edgeIndex[dimension] = center[dimension] + offset[dimension] * static_cast<itk::OffsetValueType>(this->PatchRadius);
+      edgeSize[dimension] = 1;
+    }
+  }
+  return itk::ImageRegion<2>(edgeIndex, edgeSize);
+}
 
-template <typename TPatchDistanceFunctor>
-std::vector<itk::Offset<2> > Propagator<TPatchDistanceFunctor>::
-GetPropagationOffsets()
+template <typename TPatchDistanceFunctor, typename TNNField>
+itk::ImageRegion<2> Propagator<TPatchDistanceFunctor, TNNField>::
+GetSourceInternalRegion(const NNFieldType* const nnField) const
 {
-  std::vector<itk::Offset<2> > propagationOffsets;
-  if(this->Forward)
+  if(this->SourceRegion.GetNumberOfPixels() == 0)
   {
-    itk::Offset<2> offset;
-    offset[0] = -1;
-    offset[1] = 0;
-    propagationOffsets.push_back(offset);
-    offset[0] = 0;
-    offset[1] = -1;
-    propagationOffsets.push_back(offset);
+    return ITKHelpers::GetInternalRegion(nnField->GetLargestPossibleRegion(), this->PatchRadius);
   }
-  else
+
+  return ITKHelpers::GetInternalRegion(this->SourceRegion, this->PatchRadius);
+}
+
+template <typename TPatchDistanceFunctor, typename TNNField>
+unsigned int Propagator<TPatchDistanceFunctor, TNNField>::
+PropagateWavefront(NNFieldType* const nnField, const itk::ImageRegion<2>& internalRegion,
+                   const itk::ImageRegion<2>& sourceInternalRegion,
+                   const bool forward, PropagationStatistics& statistics)
+{
+  std::vector<itk::Offset<2> > propagationOffsets = PatchMatchHelpers::GetPropagationOffsets<2>(forward);
+
+  WavefrontTraversal traversal(this->TargetPixels, internalRegion, this->WavefrontBlockSize);
+  const size_t numberOfBlocks = traversal.GetNumberOfBlocks();
+
+  std::vector<unsigned int> numberOfPropagatedPixelsPerBlock(numberOfBlocks, 0);
+  std::vector<PropagationStatistics> statisticsPerBlock(numberOfBlocks);
+
+  traversal.Traverse(forward, this->Pool, [&](const itk::Index<2>& targetPixel, const size_t blockId)
   {
-    itk::Offset<2> offset;
-    offset[0] = 1;
-    offset[1] = 0;
-    propagationOffsets.push_back(offset);
-    offset[0] = 0;
-    offset[1] = 1;
-    propagationOffsets.push_back(offset);
+    if(PropagatePixel(nnField, targetPixel, internalRegion, sourceInternalRegion, propagationOffsets,
+                      statisticsPerBlock[blockId]))
+    {
+      numberOfPropagatedPixelsPerBlock[blockId]++;
+    }
+  });
+
+  unsigned int numberOfPropagatedPixels = 0;
+  for(size_t blockId = 0; blockId < numberOfBlocks; ++blockId)
+  {
+    numberOfPropagatedPixels += numberOfPropagatedPixelsPerBlock[blockId];
+    statistics.Add(statisticsPerBlock[blockId]);
   }
-  return propagationOffsets;
+
+  return numberOfPropagatedPixels;
 }
 
 #endif
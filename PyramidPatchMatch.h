@@ -0,0 +1,200 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PyramidPatchMatch_H
+#define PyramidPatchMatch_H
+
+// ITK
+#include "itkImage.h"
+
+// Custom
+#include "NNField.h"
+#include "PatchMatch.h"
+#include "Propagator.h"
+#include "RandomSearch.h"
+#include "ThreadPool.h"
+
+/** This class computes a nearest neighbor field coarse to fine. It builds a Gaussian pyramid
+  * of the image (and of the valid patch centers), runs PatchMatch from a random field at the
+  * coarsest level, and initializes every finer level with the upsampled (and rescored) field
+  * of the level below it. Good matches are then found across the whole image at low cost, so
+  * the finest level only needs to refine them for an iteration or two.
+  * A patch distance functor of type TPatchDistanceFunctor (which must provide SetImage and
+  * Distance) is created for every level. */
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField = NNFieldType>
+class PyramidPatchMatch
+{
+public:
+  /** The type of the nearest neighbor field. */
+  typedef TNNField NNFieldType;
+
+  typedef Propagator<TPatchDistanceFunctor, NNFieldType> PropagatorType;
+  typedef RandomSearch<TImage, TPatchDistanceFunctor, NNFieldType> RandomSearchType;
+  typedef PatchMatch<TImage, PropagatorType, RandomSearchType> PatchMatchType;
+
+  typedef itk::Image<bool, 2> BoolImageType;
+
+  /** Compute the nearest neighbor field of every pixel of the internal region of the image. */
+  void Compute();
+
+  /** Set the image (the finest level). */
+  void SetImage(TImage* const image)
+  {
+    this->Image = image;
+  }
+
+  /** Set the image of valid patch centers at the finest level. If none is set, every
+    * fully defined patch is valid. */
+  void SetValidPatchCentersImage(BoolImageType* const validPatchCentersImage)
+  {
+    this->ValidPatchCentersImage = validPatchCentersImage;
+  }
+
+  /** Set the patch radius, which is the same at every level. */
+  void SetPatchRadius(const unsigned int patchRadius)
+  {
+    this->PatchRadius = patchRadius;
+  }
+
+  /** Set the number of levels (including the finest one). Zero (the default) keeps halving
+    * the image while its smaller side stays at least MinimumLevelSize. */
+  void SetNumberOfLevels(const unsigned int numberOfLevels)
+  {
+    this->NumberOfLevels = numberOfLevels;
+  }
+
+  /** Set the smallest side length of the coarsest level when the number of levels is automatic.
+    * Zero (the default) uses eight patch side lengths. */
+  void SetMinimumLevelSize(const unsigned int minimumLevelSize)
+  {
+    this->MinimumLevelSize = minimumLevelSize;
+  }
+
+  /** Set the number of iterations at each of the coarser levels. */
+  void SetIterations(const unsigned int iterations)
+  {
+    this->Iterations = iterations;
+  }
+
+  /** Set the number of iterations at the finest level. */
+  void SetFinestLevelIterations(const unsigned int finestLevelIterations)
+  {
+    this->FinestLevelIterations = finestLevelIterations;
+  }
+
+  /** Set the pool on which every level runs. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the tile size of the tiled engine (see PatchMatch::SetTileSize). */
+  void SetTileSize(const unsigned int tileSize)
+  {
+    this->TileSize = tileSize;
+  }
+
+  /** Set if propagation candidates are scored incrementally (see Propagator::SetIncremental). */
+  void SetIncremental(const bool incremental)
+  {
+    this->Incremental = incremental;
+  }
+
+  /** Set if the results are truly randomized. This should only be false for testing purposes. */
+  void SetRandom(const bool random)
+  {
+    this->Random = random;
+  }
+
+  /** Set if the levels and the iterations of each level are printed to std::cout. */
+  void SetVerbose(const bool verbose)
+  {
+    this->Verbose = verbose;
+  }
+
+  /** Get the nearest neighbor field of the finest level. */
+  NNFieldType* GetNNField()
+  {
+    return this->NNField;
+  }
+
+  /** Get the number of levels that the last call to Compute() used. */
+  unsigned int GetNumberOfComputedLevels() const
+  {
+    return this->NumberOfComputedLevels;
+  }
+
+private:
+  /** The image (the finest level). */
+  TImage* Image = nullptr;
+
+  /** The valid patch centers at the finest level. */
+  BoolImageType* ValidPatchCentersImage = nullptr;
+
+  /** The radius of patches to compare. (Patch side length = 2*radius + 1)*/
+  unsigned int PatchRadius = 5;
+
+  /** The number of levels, or zero to choose it from MinimumLevelSize. */
+  unsigned int NumberOfLevels = 0;
+
+  /** The smallest side length of the coarsest level, or zero for eight patch side lengths. */
+  unsigned int MinimumLevelSize = 0;
+
+  /** The number of iterations at each of the coarser levels. */
+  unsigned int Iterations = 5;
+
+  /** The number of iterations at the finest level. */
+  unsigned int FinestLevelIterations = 2;
+
+  /** The pool on which every level runs. */
+  ThreadPool* Pool = nullptr;
+
+  /** The tile size of the tiled engine. */
+  unsigned int TileSize = 0;
+
+  /** A flag indicating whether propagation candidates are scored incrementally. */
+  bool Incremental = false;
+
+  /** Determine if the result should be randomized. */
+  bool Random = true;
+
+  /** A flag indicating whether the progress is printed. */
+  bool Verbose = false;
+
+  /** The number of levels that the last call to Compute() used. */
+  unsigned int NumberOfComputedLevels = 0;
+
+  /** The nearest neighbor field of the finest level. */
+  typename NNFieldType::Pointer NNField = NNFieldType::New();
+
+  /** Get the number of levels to compute for the image. */
+  unsigned int GetNumberOfLevelsToCompute() const;
+
+  /** Mark the centers of patches that are not fully inside of the image as invalid. */
+  void ClearInvalidBorder(BoolImageType* const validPatchCentersImage) const;
+
+  /** Initialize 'nnField' over 'region' from the field of the next coarser level. Pixel p takes the
+    * match of its coarse pixel p/2, scaled back up and offset by the position of p inside of the
+    * coarse pixel, and is rescored with 'patchDistanceFunctor'. */
+  void UpsampleNNField(const NNFieldType* const coarseNNField, const itk::ImageRegion<2>& region,
+                       TPatchDistanceFunctor* const patchDistanceFunctor, NNFieldType* const nnField) const;
+};
+
+#include "PyramidPatchMatch.hpp"
+
+#endif
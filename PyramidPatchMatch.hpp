@@ -0,0 +1,250 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PyramidPatchMatch_HPP
+#define PyramidPatchMatch_HPP
+
+#include "PyramidPatchMatch.h"
+
+// STL
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// ITK
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// Custom
+#include "PatchMatchHelpers.h"
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+void PyramidPatchMatch<TImage, TPatchDistanceFunctor, TNNField>::Compute()
+{
+  assert(this->Image);
+  assert(this->PatchRadius > 0);
+
+  this->NumberOfComputedLevels = GetNumberOfLevelsToCompute();
+
+  // Level 0 is the finest level
+  std::vector<typename TImage::Pointer> images(this->NumberOfComputedLevels);
+  std::vector<BoolImageType::Pointer> validPatchCentersImages(this->NumberOfComputedLevels);
+
+  images[0] = this->Image;
+  if(this->ValidPatchCentersImage)
+  {
+    validPatchCentersImages[0] = this->ValidPatchCentersImage;
+  }
+  else
+  {
+    validPatchCentersImages[0] = BoolImageType::New();
+    validPatchCentersImages[0]->SetRegions(this->Image->GetLargestPossibleRegion());
+    validPatchCentersImages[0]->Allocate();
+    validPatchCentersImages[0]->FillBuffer(true);
+  }
+  ClearInvalidBorder(validPatchCentersImages[0]);
+
+  for(unsigned int level = 1; level < this->NumberOfComputedLevels; ++level)
+  {
+    images[level] = TImage::New();
+    PatchMatchHelpers::DownsampleImage(images[level - 1].GetPointer(), images[level].GetPointer());
+
+    validPatchCentersImages[level] = BoolImageType::New();
+    PatchMatchHelpers::DownsampleValidPatchCenters(validPatchCentersImages[level - 1].GetPointer(),
+                                                   validPatchCentersImages[level].GetPointer());
+    ClearInvalidBorder(validPatchCentersImages[level]);
+  }
+
+  typename NNFieldType::Pointer coarseNNField;
+
+  for(int level = static_cast<int>(this->NumberOfComputedLevels) - 1; level >= 0; --level)
+  {
+    if(this->Verbose)
+    {
+      std::cout << "PyramidPatchMatch: level " << level << " ("
+                << images[level]->GetLargestPossibleRegion().GetSize() << ")" << std::endl;
+    }
+
+    TPatchDistanceFunctor patchDistanceFunctor;
+    patchDistanceFunctor.SetImage(images[level]);
+
+    PropagatorType propagationFunctor;
+    propagationFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+    propagationFunctor.SetPatchRadius(this->PatchRadius);
+    propagationFunctor.SetThreadPool(this->Pool);
+    propagationFunctor.SetIncremental(this->Incremental);
+
+    RandomSearchType randomSearchFunctor;
+    randomSearchFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+    randomSearchFunctor.SetPatchRadius(this->PatchRadius);
+    randomSearchFunctor.SetImage(images[level]);
+    randomSearchFunctor.SetThreadPool(this->Pool);
+    randomSearchFunctor.SetRandom(this->Random);
+
+    PatchMatchType patchMatch;
+    patchMatch.SetImage(images[level]);
+    patchMatch.SetPatchRadius(this->PatchRadius);
+    patchMatch.SetPropagationFunctor(&propagationFunctor);
+    patchMatch.SetRandomSearchFunctor(&randomSearchFunctor);
+    patchMatch.SetValidPatchCentersImage(validPatchCentersImages[level]);
+    patchMatch.SetThreadPool(this->Pool);
+    patchMatch.SetTileSize(this->TileSize);
+    patchMatch.SetIterations(level == 0 ? this->FinestLevelIterations : this->Iterations);
+    patchMatch.SetVerbose(this->Verbose);
+
+    if(coarseNNField)
+    {
+      typename NNFieldType::Pointer initialNNField = NNFieldType::New();
+      UpsampleNNField(coarseNNField, images[level]->GetLargestPossibleRegion(), &patchDistanceFunctor,
+                      initialNNField);
+      patchMatch.SetInitialNNField(initialNNField);
+    }
+
+    patchMatch.Compute();
+
+    // The field outlives the PatchMatch object of its level because it is reference counted
+    coarseNNField = patchMatch.GetNNField();
+  }
+
+  this->NNField = coarseNNField;
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+unsigned int PyramidPatchMatch<TImage, TPatchDistanceFunctor, TNNField>::GetNumberOfLevelsToCompute() const
+{
+  itk::Size<2> size = this->Image->GetLargestPossibleRegion().GetSize();
+
+  // A level must at least have one pixel with a fully defined patch
+  const unsigned int patchSideLength = 2 * this->PatchRadius + 1;
+  const unsigned int minimumLevelSize = std::max(this->MinimumLevelSize > 0 ? this->MinimumLevelSize : 8 * patchSideLength,
+                                                 patchSideLength);
+
+  unsigned int numberOfLevels = 1;
+  while(this->NumberOfLevels == 0 || numberOfLevels < this->NumberOfLevels)
+  {
+    size[0] = (size[0] + 1) / 2;
+    size[1] = (size[1] + 1) / 2;
+    if(std::min(size[0], size[1]) < minimumLevelSize)
+    {
+      break;
+    }
+    numberOfLevels++;
+  }
+
+  return numberOfLevels;
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+void PyramidPatchMatch<TImage, TPatchDistanceFunctor, TNNField>::ClearInvalidBorder(BoolImageType* const validPatchCentersImage) const
+{
+  itk::ImageRegion<2> region = validPatchCentersImage->GetLargestPossibleRegion();
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(region, this->PatchRadius);
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> imageIterator(validPatchCentersImage, region);
+
+  while(!imageIterator.IsAtEnd())
+  {
+    if(!internalRegion.IsInside(imageIterator.GetIndex()))
+    {
+      imageIterator.Set(false);
+    }
+    ++imageIterator;
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+void PyramidPatchMatch<TImage, TPatchDistanceFunctor, TNNField>::
+UpsampleNNField(const NNFieldType* const coarseNNField, const itk::ImageRegion<2>& region,
+                TPatchDistanceFunctor* const patchDistanceFunctor, NNFieldType* const nnField) const
+{
+  const itk::Index<2> origin = region.GetIndex();
+  const itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(region, this->PatchRadius);
+  const itk::ImageRegion<2> coarseInternalRegion =
+    ITKHelpers::GetInternalRegion(coarseNNField->GetLargestPossibleRegion(), this->PatchRadius);
+
+  nnField->SetRegions(region);
+  nnField->Allocate();
+  nnField->FillBuffer(typename NNFieldType::PixelType());
+
+  // Returns 'index' moved to the closest pixel of 'clampRegion'
+  auto clamp = [](itk::Index<2> index, const itk::ImageRegion<2>& clampRegion)
+  {
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      index[dimension] = std::max(index[dimension], clampRegion.GetIndex()[dimension]);
+      index[dimension] = std::min(index[dimension], clampRegion.GetIndex()[dimension] +
+                                                    static_cast<itk::IndexValueType>(clampRegion.GetSize()[dimension]) - 1);
+    }
+    return index;
+  };
+
+  // Every pixel is rescored independently, so the rows can run in parallel
+  auto upsampleRow = [&](const size_t rowId)
+  {
+    itk::Index<2> rowCorner = {{internalRegion.GetIndex()[0],
+                                internalRegion.GetIndex()[1] + static_cast<itk::IndexValueType>(rowId)}};
+    itk::Size<2> rowSize = {{internalRegion.GetSize()[0], 1}};
+
+    itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, itk::ImageRegion<2>(rowCorner, rowSize));
+
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+
+      itk::Index<2> coarsePixel = {{origin[0] + (pixel[0] - origin[0]) / 2,
+                                    origin[1] + (pixel[1] - origin[1]) / 2}};
+      coarsePixel = clamp(coarsePixel, coarseInternalRegion);
+
+      itk::Index<2> coarseMatchPixel = coarseNNField->GetPixel(coarsePixel).GetCenter(coarsePixel);
+
+      itk::Index<2> matchPixel;
+      for(unsigned int dimension = 0; dimension < 2; ++dimension)
+      {
+        matchPixel[dimension] = origin[dimension] + 2 * (coarseMatchPixel[dimension] - origin[dimension]) +
+                                (pixel[dimension] - origin[dimension]) - 2 * (coarsePixel[dimension] - origin[dimension]);
+      }
+      matchPixel = clamp(matchPixel, internalRegion);
+
+      itk::ImageRegion<2> matchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(matchPixel, this->PatchRadius);
+      itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixel, this->PatchRadius);
+
+      typename NNFieldType::PixelType match;
+      match.SetCenter(pixel, matchPixel, this->PatchRadius);
+      match.SetScore(patchDistanceFunctor->Distance(matchRegion, targetRegion));
+
+      nnFieldIterator.Set(match);
+      ++nnFieldIterator;
+    }
+  };
+
+  if(this->Pool)
+  {
+    this->Pool->ParallelFor(internalRegion.GetSize()[1], upsampleRow);
+  }
+  else
+  {
+    for(size_t rowId = 0; rowId < internalRegion.GetSize()[1]; ++rowId)
+    {
+      upsampleRow(rowId);
+    }
+  }
+}
+
+#endif
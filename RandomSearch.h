@@ -22,29 +22,84 @@
 // ITK
 #include "itkImage.h"
 
+// STL
+#include <ctime>
+
 // Custom
 #include "Match.h"
 #include "NNField.h"
+#include "PatchMatchHelpers.h"
+#include "PatchMatchStatistics.h"
+#include "ThreadPool.h"
+#include "ValidPatchCentersIndex.h"
 
 // Submodules
 #include <Mask/Mask.h>
 
-template <typename TImage, typename TPatchDistanceFunctor>
+/** A functor that looks for better matches at random locations. The nearest neighbor field can be
+  * of any pixel type with the interface of Match (GetCenter, SetCenter, GetScore and SetScore).
+  * The matches are taken from the source image, and the NN field covers the target image. Both are
+  * the same image unless they are set separately (to match one image to another, in which case
+  * the patch distance functor has to compare patches of the source to patches of the target). */
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField = NNFieldType>
 struct RandomSearch
 {
+  /** The type of the nearest neighbor field. */
+  typedef TNNField NNFieldType;
+
   /** Look for a better matching patch in a region of decreasing radius. */
   void Search(NNFieldType* const nnField);
 
+  /** Search for better matches of 'pixelsToProcess', drawing the candidates from 'randomGenerator',
+    * without changing the state of this functor. Only the buffered region of 'nnField' has to be
+    * allocated, so this can be called concurrently on separate tiles of an NN field.
+    * The counts of the pass are added to 'statistics' if it is given. */
+  unsigned int Search(NNFieldType* const nnField, const std::vector<itk::Index<2> >& pixelsToProcess,
+                      PatchMatchHelpers::RandomGeneratorType& randomGenerator,
+                      RandomSearchStatistics* const statistics = nullptr) const;
+
+  /** Get the counts of the last Search(nnField) pass. */
+  const RandomSearchStatistics& GetStatistics() const
+  {
+    return this->Statistics;
+  }
+
+  /** Start a new sampling pass, so that the generators created afterwards draw new sequences. */
+  void NextSearchPass()
+  {
+    this->NumberOfSearchPasses++;
+  }
+
+  /** Create the generator of random stream 'streamId' of the current sampling pass. Each thread,
+    * block or tile should use its own stream. */
+  PatchMatchHelpers::RandomGeneratorType CreateRandomGenerator(const unsigned int streamId) const
+  {
+    return PatchMatchHelpers::CreateRandomGenerator(this->Seed, this->NumberOfSearchPasses, streamId);
+  }
+
   /** Set the patch radius. */
   void SetPatchRadius(const unsigned int patchRadius)
   {
     this->PatchRadius = patchRadius;
   }
 
-  /** Set the image on which to operate. */
+  /** Set the image on which to operate, which is both the source and the target image. */
   void SetImage(TImage* const image)
   {
-    this->Image = image;
+    this->SourceImage = image;
+    this->TargetImage = image;
+  }
+
+  /** Set the image that the matches are taken from. */
+  void SetSourceImage(TImage* const sourceImage)
+  {
+    this->SourceImage = sourceImage;
+  }
+
+  /** Set the image that the NN field covers. */
+  void SetTargetImage(TImage* const targetImage)
+  {
+    this->TargetImage = targetImage;
   }
 
   /** Set the functor used to compare patches. */
@@ -62,10 +117,21 @@ struct RandomSearch
   /** A signal to indicate that we accepted a new patch. */
   boost::signals2::signal<void (const itk::Index<2>& queryCenter, const itk::Index<2>& matchCenter, const float)> AcceptedSignal;
 
-  /** Set if the results are truly randomized. */
+  /** Set the radius of the first (largest) search window. Zero (the default) searches the whole
+    * image first, as in the PatchMatch paper. A smaller radius only refines matches that are
+    * already good, such as those carried over from the previous frame of a video. */
+  void SetMaximumSearchRadius(const unsigned int maximumSearchRadius)
+  {
+    this->MaximumSearchRadius = maximumSearchRadius;
+  }
+
+  /** Set if the results are truly randomized. This starts the random streams over, so a functor that
+    * is reused for another image draws the same samples as a new one. */
   void SetRandom(const bool random)
   {
     this->Random = random;
+    this->Seed = random ? static_cast<unsigned int>(time(NULL)) : 0;
+    this->NumberOfSearchPasses = 0;
   }
 
   void SetPixelsToProcess(const std::vector<itk::Index<2> >& pixelsToProcess)
@@ -73,14 +139,43 @@ struct RandomSearch
       this->PixelsToProcess = pixelsToProcess;
   }
 
+  /** Set the image of valid patch centers of the source image. The sampling index of the valid
+    * centers is rebuilt here, so this should not be called more often than the image changes. */
   void SetValidPatchCentersImage(itk::Image<bool, 2>* const validPatchCentersImage)
   {
     this->ValidPatchCentersImage = validPatchCentersImage;
+    this->ValidPatchCenters.Build(validPatchCentersImage);
+    this->SharedValidPatchCenters = nullptr;
+  }
+
+  /** Sample from a sampling index of the valid patch centers that was built elsewhere (e.g. the one
+    * of an ExemplarLibrary, which all of its requests share) instead of building one. It is not
+    * copied, so it has to outlive the searches. */
+  void SetValidPatchCentersIndex(const ValidPatchCentersIndex* const validPatchCentersIndex)
+  {
+    this->SharedValidPatchCenters = validPatchCentersIndex;
+  }
+
+  /** Set the pool used to search the pixels in parallel. The patch distance functor
+    * must be safe to call from several threads at once. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the image in which the improved pixels are marked (see PatchMatchHelpers::AddImprovement).
+    * No image (the default) marks nothing. */
+  void SetImprovedImage(itk::Image<bool, 2>* const improvedImage)
+  {
+    this->ImprovedImage = improvedImage;
   }
 
 private:
-  /** The image on which to operate. */
-  TImage* Image = nullptr;
+  /** The image that the matches are taken from. */
+  TImage* SourceImage = nullptr;
+
+  /** The image that the NN field covers. */
+  TImage* TargetImage = nullptr;
 
   /** The patch radius we are using to define regions to compare. */
   unsigned int PatchRadius = 0;
@@ -91,8 +186,22 @@ private:
   /** Determine if the result should be randomized. This should only be false for testing purposes. */
   bool Random = true;
 
-  /** Seed the random number generator if we are supposed to. */
-  void InitializeRandomGenerator();
+  /** The seed of all of the random streams. */
+  unsigned int Seed = static_cast<unsigned int>(time(NULL));
+
+  /** The number of sampling passes so far. Together with the seed and a stream id, this
+    * determines the sequence of a random generator. */
+  unsigned int NumberOfSearchPasses = 0;
+
+  /** The number of consecutive pixels that share a random stream (and a task of the pool).
+    * The streams do not depend on the number of threads, so neither does the result. */
+  unsigned int PixelsPerRandomStream = 1024;
+
+  /** The pool used to search in parallel. */
+  ThreadPool* Pool = nullptr;
+
+  /** The image in which the improved pixels are marked, if any. */
+  itk::Image<bool, 2>* ImprovedImage = nullptr;
 
   /** Get a random pixel in the specified region. */
   itk::Index<2> GetRandomPixelInRegion(const itk::ImageRegion<2>& region);
@@ -101,14 +210,40 @@ private:
       given by 'alpha' in PatchMatch paper section 3.2 */
   float RegionReductionRatio = 0.5;
 
+  /** The radius of the first search window, or zero for the whole image. */
+  unsigned int MaximumSearchRadius = 0;
+
   /** The pixels for which we are trying to randomly find a better match. */
   std::vector<itk::Index<2> > PixelsToProcess;
 
   /** An image where if a pixel is 'true', it is the center of a valid region. */
   typedef itk::Image<bool, 2> BoolImageType;
-  BoolImageType* ValidPatchCentersImage;
+  BoolImageType* ValidPatchCentersImage = nullptr;
+
+  /** The sampling index of the valid patch centers. */
+  ValidPatchCentersIndex ValidPatchCenters;
+
+  /** The sampling index that is used instead of ValidPatchCenters if it is set. */
+  const ValidPatchCentersIndex* SharedValidPatchCenters = nullptr;
+
+  /** The counts of the last Search(nnField) pass. */
+  RandomSearchStatistics Statistics;
+
+  bool GetRandomValidRegion(const itk::ImageRegion<2>& region, PatchMatchHelpers::RandomGeneratorType& randomGenerator,
+                            itk::ImageRegion<2>& randomValidRegion) const;
+
+  /** Get the pixels of the source image whose patches are inside of it. */
+  itk::ImageRegion<2> GetSourceInternalRegion() const;
+
+  /** Get the radius of the first search window in 'sourceInternalRegion'. */
+  unsigned int GetInitialRadius(const itk::ImageRegion<2>& sourceInternalRegion) const;
 
-  bool GetRandomValidRegion(const itk::ImageRegion<2>& region, itk::ImageRegion<2>& randomValidRegion);
+  /** Look for a better match of 'queryPixel' in windows of decreasing radius, counting the work in
+    * 'statistics'. Returns the number of times the match was improved. */
+  unsigned int SearchPixel(NNFieldType* const nnField, const itk::Index<2>& queryPixel,
+                           const itk::ImageRegion<2>& sourceInternalRegion, const unsigned int initialRadius,
+                           PatchMatchHelpers::RandomGeneratorType& randomGenerator,
+                           RandomSearchStatistics& statistics) const;
 
 };
 
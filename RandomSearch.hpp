@@ -25,133 +25,206 @@
 #include "itkImageRegion.h"
 
 // STL
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
 // Submodules
 #include <ITKHelpers/ITKHelpers.h>
 
-template <typename TImage, typename TPatchDistanceFunctor>
-void RandomSearch<TImage, TPatchDistanceFunctor>::
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+void RandomSearch<TImage, TPatchDistanceFunctor, TNNField>::
 Search(NNFieldType* const nnField)
 {
   assert(nnField);
-  assert(this->Image);
+  assert(this->SourceImage);
+  assert(this->TargetImage);
   assert(this->PatchRadius > 0);
   assert(this->PatchDistanceFunctor);
 
   assert(nnField->GetLargestPossibleRegion().GetSize()[0] > 0);
-  assert(this->Image->GetLargestPossibleRegion().GetSize()[0] > 0);
+  assert(this->SourceImage->GetLargestPossibleRegion().GetSize()[0] > 0);
   assert(nnField->GetLargestPossibleRegion().GetSize() ==
-         this->Image->GetLargestPossibleRegion().GetSize());
+         this->TargetImage->GetLargestPossibleRegion().GetSize());
 
-  InitializeRandomGenerator();
+  NextSearchPass();
 
-  itk::ImageRegion<2> fullRegion = nnField->GetLargestPossibleRegion();
-  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(fullRegion, this->PatchRadius);
+  if(this->PixelsToProcess.size() == 0)
+  {
+    this->PixelsToProcess = PatchMatchHelpers::GetAllPixelIndices(
+                              ITKHelpers::GetInternalRegion(nnField->GetLargestPossibleRegion(), this->PatchRadius));
+  }
 
-  unsigned int numberOfUpdatedPixels = 0;
+  const itk::ImageRegion<2> sourceInternalRegion = GetSourceInternalRegion();
+  unsigned int initialRadius = GetInitialRadius(sourceInternalRegion);
 
-  if(this->PixelsToProcess.size() == 0)
+  // Every pixel is searched independently, so blocks of pixels (each with their own random stream) can run in parallel
+  const size_t numberOfBlocks = (this->PixelsToProcess.size() + this->PixelsPerRandomStream - 1) / this->PixelsPerRandomStream;
+  std::vector<RandomSearchStatistics> statisticsPerBlock(numberOfBlocks);
+
+  auto searchBlock = [this, nnField, &sourceInternalRegion, initialRadius, &statisticsPerBlock](const size_t blockId)
   {
-    this->PixelsToProcess = PatchMatchHelpers::GetAllPixelIndices(internalRegion);
+    PatchMatchHelpers::RandomGeneratorType randomGenerator = CreateRandomGenerator(blockId);
+
+    size_t blockEnd = std::min(this->PixelsToProcess.size(), (blockId + 1) * this->PixelsPerRandomStream);
+    for(size_t pixelId = blockId * this->PixelsPerRandomStream; pixelId < blockEnd; ++pixelId)
+    {
+      SearchPixel(nnField, this->PixelsToProcess[pixelId], sourceInternalRegion, initialRadius, randomGenerator,
+                  statisticsPerBlock[blockId]);
+    }
+  };
+
+  if(this->Pool)
+  {
+    this->Pool->ParallelFor(numberOfBlocks, searchBlock);
+  }
+  else
+  {
+    for(size_t blockId = 0; blockId < numberOfBlocks; ++blockId)
+    {
+      searchBlock(blockId);
+    }
   }
 
-  unsigned int width = internalRegion.GetSize()[0];
-  unsigned int height = internalRegion.GetSize()[1];
+  this->Statistics = RandomSearchStatistics();
+  for(size_t blockId = 0; blockId < numberOfBlocks; ++blockId)
+  {
+    this->Statistics.Add(statisticsPerBlock[blockId]);
+  }
+}
 
-  // The maximum (first) search radius, as prescribed in PatchMatch paper section 3.2
-  unsigned int initialRadius = std::max(width, height);
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+unsigned int RandomSearch<TImage, TPatchDistanceFunctor, TNNField>::
+Search(NNFieldType* const nnField, const std::vector<itk::Index<2> >& pixelsToProcess,
+       PatchMatchHelpers::RandomGeneratorType& randomGenerator, RandomSearchStatistics* const statistics) const
+{
+  const itk::ImageRegion<2> sourceInternalRegion = GetSourceInternalRegion();
+  unsigned int initialRadius = GetInitialRadius(sourceInternalRegion);
+
+  unsigned int numberOfUpdatedPixels = 0;
+
+  RandomSearchStatistics passStatistics;
 
-  for(size_t pixelId = 0; pixelId < this->PixelsToProcess.size(); ++pixelId)
+  for(size_t pixelId = 0; pixelId < pixelsToProcess.size(); ++pixelId)
   {
-    std::cout << "Searching for a better match for pixel " << pixelId << std::endl;
+    numberOfUpdatedPixels += SearchPixel(nnField, pixelsToProcess[pixelId], sourceInternalRegion, initialRadius, randomGenerator,
+                                         passStatistics);
+  }
 
-    itk::Index<2> queryPixel = this->PixelsToProcess[pixelId];
+  if(statistics)
+  {
+    statistics->Add(passStatistics);
+  }
 
-    itk::ImageRegion<2> queryRegion =
-      ITKHelpers::GetRegionInRadiusAroundPixel(queryPixel, this->PatchRadius);
+  return numberOfUpdatedPixels;
+}
 
-    assert(fullRegion.IsInside(queryRegion));
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+unsigned int RandomSearch<TImage, TPatchDistanceFunctor, TNNField>::
+SearchPixel(NNFieldType* const nnField, const itk::Index<2>& queryPixel,
+            const itk::ImageRegion<2>& sourceInternalRegion, const unsigned int initialRadius,
+            PatchMatchHelpers::RandomGeneratorType& randomGenerator, RandomSearchStatistics& statistics) const
+{
+  //std::cout << "Searching for a better match for pixel " << queryPixel << std::endl;
 
-    unsigned int radius = initialRadius;
+  itk::ImageRegion<2> queryRegion =
+    ITKHelpers::GetRegionInRadiusAroundPixel(queryPixel, this->PatchRadius);
 
-    // Search an exponentially smaller window each time through the loop
-    while(radius > this->PatchRadius) // while there is more than just the current patch to search
+  assert(nnField->GetLargestPossibleRegion().IsInside(queryRegion));
+
+  unsigned int numberOfUpdates = 0;
+
+  const float originalScore = nnField->GetPixel(queryPixel).GetScore();
+
+  // The location of the query pixel means nothing in another image, so there the windows are
+  // centered at the current match instead (as in the PatchMatch paper)
+  const itk::Index<2> searchCenter = this->SourceImage == this->TargetImage ? queryPixel :
+                                     nnField->GetPixel(queryPixel).GetCenter(queryPixel);
+
+  unsigned int radius = initialRadius;
+  unsigned int level = 0;
+
+  // Search an exponentially smaller window each time through the loop
+  while(radius > this->PatchRadius) // while there is more than just the current patch to search
+  {
+    itk::ImageRegion<2> searchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(searchCenter, radius);
+    searchRegion.Crop(sourceInternalRegion);
+
+    itk::ImageRegion<2> randomValidRegion;
+    bool hasPixels = GetRandomValidRegion(searchRegion, randomGenerator, randomValidRegion);
+
+    if(!hasPixels)
     {
-      itk::ImageRegion<2> searchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(queryPixel, radius);
-      searchRegion.Crop(internalRegion);
+        break;
+    }
 
-      itk::ImageRegion<2> randomValidRegion;
-      bool hasPixels = GetRandomValidRegion(searchRegion, randomValidRegion);
+    // Store this match as the best match if it meets the criteria.
+    // In this class, the criteria is simply that it is
+    // better than the current best patch. In subclasses (i.e. GeneralizedPatchMatch),
+    // it must be better than the worst patch currently stored.
 
-      if(!hasPixels)
-      {
-          break;
-      }
+    typename NNFieldType::PixelType currentMatch = nnField->GetPixel(queryPixel);
 
-      // Compute the patch difference
-      float dist = this->PatchDistanceFunctor->Distance(randomValidRegion, queryRegion);
+    // Compute the patch difference (only as far as needed to tell if it beats the current match)
+    statistics.DistanceEvaluations++;
+    if(PatchMatchHelpers::TryMatch(this->PatchDistanceFunctor, queryPixel, queryRegion,
+                                   ITKHelpers::GetRegionCenter(randomValidRegion), this->PatchRadius, currentMatch))
+    {
+      statistics.AddAccept(level);
+      nnField->SetPixel(queryPixel, currentMatch);
+      numberOfUpdates++;
+    }
 
-      // Construct a match object
-      Match potentialMatch;
-      potentialMatch.SetRegion(randomValidRegion);
-      potentialMatch.SetScore(dist);
+    radius *= this->RegionReductionRatio;
+    level++;
+  } // end decreasing radius loop
 
-      // Store this match as the best match if it meets the criteria.
-      // In this class, the criteria is simply that it is
-      // better than the current best patch. In subclasses (i.e. GeneralizedPatchMatch),
-      // it must be better than the worst patch currently stored.
+  PatchMatchHelpers::AddImprovement(queryPixel, originalScore, nnField->GetPixel(queryPixel).GetScore(),
+                                    this->ImprovedImage, statistics);
 
-      Match currentMatch = nnField->GetPixel(queryPixel);
+  return numberOfUpdates;
+}
 
-      if(potentialMatch.GetScore() < currentMatch.GetScore())
-      {
-        nnField->SetPixel(queryPixel, potentialMatch);
-        numberOfUpdatedPixels++;
-      }
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+itk::ImageRegion<2> RandomSearch<TImage, TPatchDistanceFunctor, TNNField>::GetSourceInternalRegion() const
+{
+  assert(this->SourceImage);
+  return ITKHelpers::GetInternalRegion(this->SourceImage->GetLargestPossibleRegion(), this->PatchRadius);
+}
 
-      radius *= this->RegionReductionRatio;
-    } // end decreasing radius loop
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+unsigned int RandomSearch<TImage, TPatchDistanceFunctor, TNNField>::
+GetInitialRadius(const itk::ImageRegion<2>& sourceInternalRegion) const
+{
+  // The maximum (first) search radius, as prescribed in PatchMatch paper section 3.2
+  unsigned int initialRadius = std::max(sourceInternalRegion.GetSize()[0], sourceInternalRegion.GetSize()[1]);
 
-  } // end loop over target pixels
+  if(this->MaximumSearchRadius > 0)
+  {
+    initialRadius = std::min(initialRadius, this->MaximumSearchRadius);
+  }
 
-//  std::cout << "RandomSearch() updated " << numberOfUpdatedPixels << " pixels." << std::endl;
-  //std::cout << "RandomSearch: already exact match " << exactMatchPixels << std::endl;
+  return initialRadius;
 }
 
-template <typename TImage, typename TPatchDistanceFunctor>
-bool RandomSearch<TImage, TPatchDistanceFunctor>::
-GetRandomValidRegion(const itk::ImageRegion<2>& region, itk::ImageRegion<2>& randomValidRegion)
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+bool RandomSearch<TImage, TPatchDistanceFunctor, TNNField>::
+GetRandomValidRegion(const itk::ImageRegion<2>& region, PatchMatchHelpers::RandomGeneratorType& randomGenerator,
+                     itk::ImageRegion<2>& randomValidRegion) const
 {
-    std::vector<itk::Index<2> > truePixels = ITKHelpers::GetPixelsWithValueInRegion(this->ValidPatchCentersImage, region, true);
+    const ValidPatchCentersIndex& validPatchCenters =
+      this->SharedValidPatchCenters ? *this->SharedValidPatchCenters : this->ValidPatchCenters;
 
-    if(truePixels.size() == 0)
+    itk::Index<2> randomPixel;
+    if(!validPatchCenters.GetRandomValidPixel(region, randomGenerator, randomPixel))
     {
         return false;
     }
 
-    unsigned int randomIndex = Helpers::RandomInt(0, truePixels.size() - 1);
-
-    itk::Index<2> randomPixel = truePixels[randomIndex];
-
     // This is filled instead of returned since it is passed by reference
     randomValidRegion = ITKHelpers::GetRegionInRadiusAroundPixel(randomPixel, this->PatchRadius);
 
     return true;
 }
 
-template <typename TImage, typename TPatchDistanceFunctor>
-void RandomSearch<TImage, TPatchDistanceFunctor>::InitializeRandomGenerator()
-{
-  if(this->Random)
-  {
-    srand(time(NULL));
-  }
-  else
-  {
-    srand(0);
-  }
-}
-
 #endif
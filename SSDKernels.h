@@ -0,0 +1,349 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef SSDKernels_H
+#define SSDKernels_H
+
+// ITK
+#include "itkCovariantVector.h"
+#include "itkVariableLengthVector.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+// SIMD
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/** Sum of squared differences of runs of consecutive pixel components. A patch row of an
+  * image of scalar or fixed length vector pixels is one such run, so these are the inner
+  * loops of the patch distance. The instruction set is chosen at compile time
+  * (see PatchMatch_USE_AVX2). */
+namespace SSDKernels
+{
+
+/** The component type and number of components of a pixel that is stored as a plain array. */
+template <typename TPixel>
+struct PixelTraits
+{
+  typedef TPixel ComponentType;
+  static const unsigned int NumberOfComponents = 1;
+};
+
+template <typename TComponent, unsigned int VLength>
+struct PixelTraits<itk::CovariantVector<TComponent, VLength> >
+{
+  typedef TComponent ComponentType;
+  static const unsigned int NumberOfComponents = VLength;
+};
+
+/** The pixels of an itk::VectorImage, whose number of components is only known at run time (0 here). */
+template <typename TComponent>
+struct PixelTraits<itk::VariableLengthVector<TComponent> >
+{
+  typedef TComponent ComponentType;
+  static const unsigned int NumberOfComponents = 0;
+};
+
+/** Generic (scalar) version, accumulated in double. */
+template <typename TComponent>
+inline double SumOfSquaredDifferences(const TComponent* const a, const TComponent* const b, const size_t length)
+{
+  double sum = 0;
+  for(size_t i = 0; i < length; ++i)
+  {
+    double difference = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+    sum += difference * difference;
+  }
+  return sum;
+}
+
+/** 8-bit version. The differences are widened to 16 bits and squared and pairwise added
+  * with a multiply-add, so the sum is exact. */
+inline double SumOfSquaredDifferences(const unsigned char* const a, const unsigned char* const b, const size_t length)
+{
+  uint64_t sum = 0;
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+  while(i + 32 <= length)
+  {
+    // Each 32 byte step adds at most 4 * 255^2 to a 32-bit lane, so flush before they can overflow
+    const size_t blockEnd = std::min(length - length % 32, i + 32 * 4096);
+    __m256i accumulator = _mm256_setzero_si256();
+    for(; i < blockEnd; i += 32)
+    {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      __m256i differenceLow = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+      __m256i differenceHigh = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+      accumulator = _mm256_add_epi32(accumulator, _mm256_madd_epi16(differenceLow, differenceLow));
+      accumulator = _mm256_add_epi32(accumulator, _mm256_madd_epi16(differenceHigh, differenceHigh));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), accumulator);
+    for(unsigned int lane = 0; lane < 8; ++lane)
+    {
+      sum += lanes[lane];
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  while(i + 16 <= length)
+  {
+    // Each 16 byte step adds at most 4 * 255^2 to a 32-bit lane, so flush before they can overflow
+    const size_t blockEnd = std::min(length - length % 16, i + 16 * 4096);
+    __m128i accumulator = _mm_setzero_si128();
+    for(; i < blockEnd; i += 16)
+    {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      __m128i differenceLow = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+      __m128i differenceHigh = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+      accumulator = _mm_add_epi32(accumulator, _mm_madd_epi16(differenceLow, differenceLow));
+      accumulator = _mm_add_epi32(accumulator, _mm_madd_epi16(differenceHigh, differenceHigh));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+    for(unsigned int lane = 0; lane < 4; ++lane)
+    {
+      sum += lanes[lane];
+    }
+  }
+#endif
+
+  for(; i < length; ++i)
+  {
+    int difference = static_cast<int>(a[i]) - static_cast<int>(b[i]);
+    sum += difference * difference;
+  }
+
+  return static_cast<double>(sum);
+}
+
+/** Single precision version, with fused multiply-adds when they are available. The lanes and the
+  * remaining components are summed in double, like the generic version does. */
+inline double SumOfSquaredDifferences(const float* const a, const float* const b, const size_t length)
+{
+  double sum = 0;
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  // Two accumulators to hide the latency of the multiply-adds
+  __m256 accumulator0 = _mm256_setzero_ps();
+  __m256 accumulator1 = _mm256_setzero_ps();
+  for(; i + 16 <= length; i += 16)
+  {
+    __m256 difference0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    __m256 difference1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+#if defined(__FMA__)
+    accumulator0 = _mm256_fmadd_ps(difference0, difference0, accumulator0);
+    accumulator1 = _mm256_fmadd_ps(difference1, difference1, accumulator1);
+#else
+    accumulator0 = _mm256_add_ps(accumulator0, _mm256_mul_ps(difference0, difference0));
+    accumulator1 = _mm256_add_ps(accumulator1, _mm256_mul_ps(difference1, difference1));
+#endif
+  }
+  for(; i + 8 <= length; i += 8)
+  {
+    __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+#if defined(__FMA__)
+    accumulator0 = _mm256_fmadd_ps(difference, difference, accumulator0);
+#else
+    accumulator0 = _mm256_add_ps(accumulator0, _mm256_mul_ps(difference, difference));
+#endif
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, _mm256_add_ps(accumulator0, accumulator1));
+  for(unsigned int lane = 0; lane < 8; ++lane)
+  {
+    sum += lanes[lane];
+  }
+#elif defined(__SSE2__)
+  __m128 accumulator = _mm_setzero_ps();
+  for(; i + 4 <= length; i += 4)
+  {
+    __m128 difference = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    accumulator = _mm_add_ps(accumulator, _mm_mul_ps(difference, difference));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, accumulator);
+  for(unsigned int lane = 0; lane < 4; ++lane)
+  {
+    sum += lanes[lane];
+  }
+#endif
+
+  for(; i < length; ++i)
+  {
+    double difference = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+    sum += difference * difference;
+  }
+
+  return sum;
+}
+
+/** Sum of squared differences of a run of 'length' components of pixels that have VNumberOfComponents
+  * components each (0 if that is only known at run time). Generic version: the run kernels above do
+  * not care where the pixels start, and with 8-bit components a pixel of 16, 32 or 64 components is
+  * already a whole number of vectors. */
+template <unsigned int VNumberOfComponents, typename TComponent>
+struct PixelKernel
+{
+  static double SumOfSquaredDifferences(const TComponent* const a, const TComponent* const b, const size_t length)
+  {
+    return SSDKernels::SumOfSquaredDifferences(a, b, length);
+  }
+};
+
+#if defined(__AVX2__)
+/** Add the squares of 'difference' to 'accumulator', with a fused multiply-add when it is available. */
+inline __m256 AddSquares(const __m256 accumulator, const __m256 difference)
+{
+#if defined(__FMA__)
+  return _mm256_fmadd_ps(difference, difference, accumulator);
+#else
+  return _mm256_add_ps(accumulator, _mm256_mul_ps(difference, difference));
+#endif
+}
+#endif
+
+/** Single precision version. If a pixel is a whole number of vectors (e.g. 8, 16, 32 or 64 channels),
+  * so is the run, which then needs no remainder loop. Its vectors are multiply-added into four
+  * independent accumulators in turn, across pixels as well as within them, so that even a pixel of
+  * a single vector keeps four multiply-adds in flight. The lanes are summed in double, like the
+  * generic kernel does. */
+template <unsigned int VNumberOfComponents>
+struct PixelKernel<VNumberOfComponents, float>
+{
+  static double SumOfSquaredDifferences(const float* const a, const float* const b, const size_t length)
+  {
+#if defined(__AVX2__)
+    const unsigned int vectorLength = 8;
+#elif defined(__SSE2__)
+    const unsigned int vectorLength = 4;
+#else
+    const unsigned int vectorLength = 1; // No vectors, so nothing to specialise
+#endif
+    if(VNumberOfComponents == 0 || vectorLength == 1 || VNumberOfComponents % vectorLength != 0)
+    {
+      return SSDKernels::SumOfSquaredDifferences(a, b, length);
+    }
+
+    assert(length % VNumberOfComponents == 0);
+    double sum = 0;
+
+#if defined(__AVX2__)
+    size_t i = 0;
+    __m256 accumulator0 = _mm256_setzero_ps();
+    __m256 accumulator1 = _mm256_setzero_ps();
+    __m256 accumulator2 = _mm256_setzero_ps();
+    __m256 accumulator3 = _mm256_setzero_ps();
+    for(; i + 32 <= length; i += 32)
+    {
+      __m256 difference0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+      __m256 difference1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+      __m256 difference2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+      __m256 difference3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+      accumulator0 = AddSquares(accumulator0, difference0);
+      accumulator1 = AddSquares(accumulator1, difference1);
+      accumulator2 = AddSquares(accumulator2, difference2);
+      accumulator3 = AddSquares(accumulator3, difference3);
+    }
+
+    // The (at most three) remaining vectors continue the rotation
+    if(i < length)
+    {
+      accumulator0 = AddSquares(accumulator0, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+      i += 8;
+    }
+    if(i < length)
+    {
+      accumulator1 = AddSquares(accumulator1, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+      i += 8;
+    }
+    if(i < length)
+    {
+      accumulator2 = AddSquares(accumulator2, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, _mm256_add_ps(_mm256_add_ps(accumulator0, accumulator1),
+                                          _mm256_add_ps(accumulator2, accumulator3)));
+    for(unsigned int lane = 0; lane < 8; ++lane)
+    {
+      sum += lanes[lane];
+    }
+#elif defined(__SSE2__)
+    size_t i = 0;
+    __m128 accumulator0 = _mm_setzero_ps();
+    __m128 accumulator1 = _mm_setzero_ps();
+    __m128 accumulator2 = _mm_setzero_ps();
+    __m128 accumulator3 = _mm_setzero_ps();
+    for(; i + 16 <= length; i += 16)
+    {
+      __m128 difference0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+      __m128 difference1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+      __m128 difference2 = _mm_sub_ps(_mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8));
+      __m128 difference3 = _mm_sub_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12));
+      accumulator0 = _mm_add_ps(accumulator0, _mm_mul_ps(difference0, difference0));
+      accumulator1 = _mm_add_ps(accumulator1, _mm_mul_ps(difference1, difference1));
+      accumulator2 = _mm_add_ps(accumulator2, _mm_mul_ps(difference2, difference2));
+      accumulator3 = _mm_add_ps(accumulator3, _mm_mul_ps(difference3, difference3));
+    }
+
+    // The (at most three) remaining vectors continue the rotation
+    if(i < length)
+    {
+      __m128 difference = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+      accumulator0 = _mm_add_ps(accumulator0, _mm_mul_ps(difference, difference));
+      i += 4;
+    }
+    if(i < length)
+    {
+      __m128 difference = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+      accumulator1 = _mm_add_ps(accumulator1, _mm_mul_ps(difference, difference));
+      i += 4;
+    }
+    if(i < length)
+    {
+      __m128 difference = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+      accumulator2 = _mm_add_ps(accumulator2, _mm_mul_ps(difference, difference));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(_mm_add_ps(accumulator0, accumulator1),
+                                    _mm_add_ps(accumulator2, accumulator3)));
+    for(unsigned int lane = 0; lane < 4; ++lane)
+    {
+      sum += lanes[lane];
+    }
+#endif
+
+    return sum;
+  }
+};
+
+} // end SSDKernels namespace
+
+#endif
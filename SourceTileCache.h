@@ -0,0 +1,122 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef SourceTileCache_H
+#define SourceTileCache_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// STL
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// Custom
+#include "MappedImage.h"
+
+/** A least recently used cache of the tiles of an image that is too large to be in memory. The image
+  * is divided into tiles of TileSize x TileSize pixels, and each tile is loaded into an itk::Image that
+  * buffers the tile and a margin of Margin pixels around it. With a margin of the patch radius, every
+  * patch whose center is in a tile is inside of the buffer of that tile. At most Capacity tiles are
+  * kept; a tile that is evicted while it is still in use stays valid until the last pointer to it is
+  * released. The pages of the mapped image that a tile was copied from are released right away, so
+  * the memory in use is bounded by the capacity. GetTile() can be called from several threads at once. */
+template <typename TImage>
+class SourceTileCache
+{
+public:
+  typedef typename TImage::PixelType PixelType;
+
+  /** Set the image that the tiles are loaded from. This clears the cache. */
+  void SetImage(const MappedImage<PixelType>* const image);
+
+  /** Set the side length of the tiles (without the margin). This clears the cache. */
+  void SetTileSize(const unsigned int tileSize);
+
+  /** Set the number of pixels around a tile that are loaded with it. This clears the cache. */
+  void SetMargin(const unsigned int margin);
+
+  /** Set the maximum number of tiles to keep. */
+  void SetCapacity(const size_t capacity)
+  {
+    this->Capacity = std::max<size_t>(capacity, 1);
+  }
+
+  /** Get the tile whose core contains 'pixel', loading it if it is not cached. */
+  typename TImage::Pointer GetTile(const itk::Index<2>& pixel);
+
+  /** Get the region of the tile whose core contains 'pixel' (without the margin). */
+  itk::ImageRegion<2> GetTileRegion(const itk::Index<2>& pixel) const;
+
+  /** Get the number of tiles in the cache. */
+  size_t GetNumberOfCachedTiles() const;
+
+  /** Get the number of calls to GetTile() that found the tile in the cache. */
+  size_t GetNumberOfHits() const;
+
+  /** Get the number of calls to GetTile() that loaded the tile into the cache. When several threads
+    * load the same tile at once, only the one whose copy is kept counts as a miss (the others count
+    * as hits), so this is the number of tiles that were added to the cache. */
+  size_t GetNumberOfMisses() const;
+
+  /** Remove every tile from the cache and reset the counts. */
+  void Clear();
+
+private:
+  /** The id of the tile whose core contains 'pixel'. */
+  size_t GetTileId(const itk::Index<2>& pixel) const;
+
+  /** Load the tile 'tileId' (with its margin) from the image. */
+  typename TImage::Pointer LoadTile(const size_t tileId) const;
+
+  /** The image that the tiles are loaded from. */
+  const MappedImage<PixelType>* Image = nullptr;
+
+  /** The side length of the tiles. */
+  unsigned int TileSize = 256;
+
+  /** The number of pixels around a tile that are loaded with it. */
+  unsigned int Margin = 0;
+
+  /** The maximum number of tiles to keep. */
+  size_t Capacity = 64;
+
+  /** The cached tiles, the most recently used first. */
+  typedef std::list<std::pair<size_t, typename TImage::Pointer> > TileListType;
+  TileListType Tiles;
+
+  /** The position of each cached tile in Tiles, by tile id. */
+  std::unordered_map<size_t, typename TileListType::iterator> TilePositions;
+
+  /** The number of calls to GetTile() that found the tile in the cache. */
+  size_t NumberOfHits = 0;
+
+  /** The number of calls to GetTile() that loaded the tile into the cache. */
+  size_t NumberOfMisses = 0;
+
+  /** Protects the cache and the counts. */
+  mutable std::mutex Mutex;
+};
+
+#include "SourceTileCache.hpp"
+
+#endif
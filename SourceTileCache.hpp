@@ -0,0 +1,167 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef SourceTileCache_HPP
+#define SourceTileCache_HPP
+
+#include "SourceTileCache.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+
+template <typename TImage>
+void SourceTileCache<TImage>::SetImage(const MappedImage<PixelType>* const image)
+{
+  this->Image = image;
+  Clear();
+}
+
+template <typename TImage>
+void SourceTileCache<TImage>::SetTileSize(const unsigned int tileSize)
+{
+  assert(tileSize > 0);
+  this->TileSize = tileSize;
+  Clear();
+}
+
+template <typename TImage>
+void SourceTileCache<TImage>::SetMargin(const unsigned int margin)
+{
+  this->Margin = margin;
+  Clear();
+}
+
+template <typename TImage>
+typename TImage::Pointer SourceTileCache<TImage>::GetTile(const itk::Index<2>& pixel)
+{
+  assert(this->Image);
+
+  const size_t tileId = GetTileId(pixel);
+
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    auto position = this->TilePositions.find(tileId);
+    if(position != this->TilePositions.end())
+    {
+      this->NumberOfHits++;
+      this->Tiles.splice(this->Tiles.begin(), this->Tiles, position->second);
+      return position->second->second;
+    }
+  }
+
+  // The tile is loaded without holding the lock, so that other threads can use the cache meanwhile
+  typename TImage::Pointer tile = LoadTile(tileId);
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+
+  // Another thread may have loaded the same tile in the meantime, in which case only that load counts as a miss
+  auto position = this->TilePositions.find(tileId);
+  if(position != this->TilePositions.end())
+  {
+    this->NumberOfHits++;
+    this->Tiles.splice(this->Tiles.begin(), this->Tiles, position->second);
+    return position->second->second;
+  }
+
+  this->NumberOfMisses++;
+  this->Tiles.push_front(std::make_pair(tileId, tile));
+  this->TilePositions[tileId] = this->Tiles.begin();
+
+  while(this->Tiles.size() > this->Capacity)
+  {
+    this->TilePositions.erase(this->Tiles.back().first);
+    this->Tiles.pop_back();
+  }
+
+  return tile;
+}
+
+template <typename TImage>
+itk::ImageRegion<2> SourceTileCache<TImage>::GetTileRegion(const itk::Index<2>& pixel) const
+{
+  itk::Index<2> corner = {{pixel[0] / this->TileSize * this->TileSize, pixel[1] / this->TileSize * this->TileSize}};
+  itk::Size<2> size = {{this->TileSize, this->TileSize}};
+  itk::ImageRegion<2> tileRegion(corner, size);
+  tileRegion.Crop(this->Image->GetLargestPossibleRegion());
+  return tileRegion;
+}
+
+template <typename TImage>
+size_t SourceTileCache<TImage>::GetTileId(const itk::Index<2>& pixel) const
+{
+  assert(this->Image->GetLargestPossibleRegion().IsInside(pixel));
+  const size_t numberOfTilesX = (this->Image->GetLargestPossibleRegion().GetSize()[0] + this->TileSize - 1) / this->TileSize;
+  return (pixel[1] / this->TileSize) * numberOfTilesX + pixel[0] / this->TileSize;
+}
+
+template <typename TImage>
+typename TImage::Pointer SourceTileCache<TImage>::LoadTile(const size_t tileId) const
+{
+  const size_t numberOfTilesX = (this->Image->GetLargestPossibleRegion().GetSize()[0] + this->TileSize - 1) / this->TileSize;
+  itk::Index<2> tileCorner = {{static_cast<itk::IndexValueType>(tileId % numberOfTilesX * this->TileSize),
+                               static_cast<itk::IndexValueType>(tileId / numberOfTilesX * this->TileSize)}};
+
+  itk::ImageRegion<2> bufferedRegion = GetTileRegion(tileCorner);
+  bufferedRegion.PadByRadius(this->Margin);
+  bufferedRegion.Crop(this->Image->GetLargestPossibleRegion());
+
+  typename TImage::Pointer tile = TImage::New();
+  tile->SetLargestPossibleRegion(this->Image->GetLargestPossibleRegion());
+  tile->SetBufferedRegion(bufferedRegion);
+  tile->SetRequestedRegion(bufferedRegion);
+  tile->Allocate();
+
+  this->Image->ReadRegion(bufferedRegion, tile.GetPointer());
+  this->Image->Release(bufferedRegion);
+
+  return tile;
+}
+
+template <typename TImage>
+size_t SourceTileCache<TImage>::GetNumberOfCachedTiles() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->Tiles.size();
+}
+
+template <typename TImage>
+size_t SourceTileCache<TImage>::GetNumberOfHits() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->NumberOfHits;
+}
+
+template <typename TImage>
+size_t SourceTileCache<TImage>::GetNumberOfMisses() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->NumberOfMisses;
+}
+
+template <typename TImage>
+void SourceTileCache<TImage>::Clear()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->Tiles.clear();
+  this->TilePositions.clear();
+  this->NumberOfHits = 0;
+  this->NumberOfMisses = 0;
+}
+
+#endif
@@ -0,0 +1,245 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that BatchPatchMatch computes the same NN field for every job of a manifest
+  * as a standalone PatchMatch does, even though the buffers are reused from job to job, and that a
+  * job that cannot be read fails without stopping the batch. */
+
+// STL
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "BatchPatchMatch.h"
+#include "NNFieldFile.h"
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+#include "VectorizedSSD.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef BatchPatchMatch<ImageType> BatchPatchMatchType;
+
+/** Create a mask that is nonzero (known) in the left half of 'image' and zero (the hole) in the right half. */
+BatchPatchMatchType::MaskImageType::Pointer CreateLeftHalfMask(const ImageType* const image)
+{
+  const itk::ImageRegion<2> region = image->GetLargestPossibleRegion();
+
+  BatchPatchMatchType::MaskImageType::Pointer mask = BatchPatchMatchType::MaskImageType::New();
+  mask->SetRegions(region);
+  mask->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<BatchPatchMatchType::MaskImageType> maskIterator(mask, region);
+  while(!maskIterator.IsAtEnd())
+  {
+    maskIterator.Set(maskIterator.GetIndex()[0] < static_cast<itk::IndexValueType>(region.GetSize()[0] / 2) ? 255 : 0);
+    ++maskIterator;
+  }
+
+  return mask;
+}
+
+template <typename TImage>
+void WriteImage(const TImage* const image, const std::string& fileName)
+{
+  typedef itk::ImageFileWriter<TImage> WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName(fileName);
+  writer->SetInput(image);
+  writer->Update();
+}
+
+/** Compute the NN field of 'image' with a standalone PatchMatch with the settings of the batch. */
+NNFieldType::Pointer ComputeStandalone(ImageType* const image, const BatchPatchMatchType::MaskImageType* const mask,
+                                       const unsigned int patchRadius, const unsigned int iterations,
+                                       ThreadPool* const threadPool)
+{
+  typedef itk::Image<bool, 2> BoolImageType;
+  BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+  validPatchCentersImage->SetRegions(image->GetLargestPossibleRegion());
+  validPatchCentersImage->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> validIterator(validPatchCentersImage,
+                                                                 image->GetLargestPossibleRegion());
+  while(!validIterator.IsAtEnd())
+  {
+    validIterator.Set(mask->GetPixel(validIterator.GetIndex()) != 0);
+    ++validIterator;
+  }
+
+  std::vector<itk::Index<2> > targetPixels;
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(image->GetLargestPossibleRegion(), patchRadius);
+  itk::ImageRegionIteratorWithIndex<BoolImageType> targetIterator(validPatchCentersImage, internalRegion);
+  while(!targetIterator.IsAtEnd())
+  {
+    if(!targetIterator.Get())
+    {
+      targetPixels.push_back(targetIterator.GetIndex());
+    }
+    ++targetIterator;
+  }
+
+  VectorizedSSD<ImageType> patchDistanceFunctor;
+  patchDistanceFunctor.SetImage(image);
+
+  BatchPatchMatchType::PropagatorType propagationFunctor;
+  propagationFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  propagationFunctor.SetPatchRadius(patchRadius);
+  propagationFunctor.SetThreadPool(threadPool);
+  propagationFunctor.SetIncremental(true);
+
+  BatchPatchMatchType::RandomSearchType randomSearchFunctor;
+  randomSearchFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  randomSearchFunctor.SetPatchRadius(patchRadius);
+  randomSearchFunctor.SetImage(image);
+  randomSearchFunctor.SetThreadPool(threadPool);
+  randomSearchFunctor.SetRandom(false);
+
+  BatchPatchMatchType::PatchMatchType patchMatch;
+  patchMatch.SetImage(image);
+  patchMatch.SetPatchRadius(patchRadius);
+  patchMatch.SetIterations(iterations);
+  patchMatch.SetPropagationFunctor(&propagationFunctor);
+  patchMatch.SetRandomSearchFunctor(&randomSearchFunctor);
+  patchMatch.SetValidPatchCentersImage(validPatchCentersImage);
+  patchMatch.SetTargetPixels(targetPixels);
+  patchMatch.SetThreadPool(threadPool);
+  patchMatch.SetVerbose(false);
+  patchMatch.Compute();
+
+  return patchMatch.GetNNField();
+}
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+  const unsigned int iterations = 3;
+
+  // Two jobs of the same size (the second one reuses the buffers of the first) and one of another size
+  itk::Size<2> size = {{64, 48}};
+  itk::Size<2> otherSize = {{40, 56}};
+
+  std::vector<ImageType::Pointer> images;
+  images.push_back(TestHelpers::CreateNoiseImage<ImageType>(size, 0));
+  images.push_back(TestHelpers::CreateNoiseImage<ImageType>(size, 1));
+  images.push_back(TestHelpers::CreateNoiseImage<ImageType>(otherSize, 2));
+
+  // Without a hole every patch would match itself
+  BatchPatchMatchType::MaskImageType::Pointer mask = CreateLeftHalfMask(images[0]);
+  BatchPatchMatchType::MaskImageType::Pointer otherMask = CreateLeftHalfMask(images[2]);
+
+  WriteImage(images[0].GetPointer(), "TestBatchPatchMatch_0.mha");
+  WriteImage(images[1].GetPointer(), "TestBatchPatchMatch_1.mha");
+  WriteImage(images[2].GetPointer(), "TestBatchPatchMatch_2.mha");
+  WriteImage(mask.GetPointer(), "TestBatchPatchMatch_0_valid.mha");
+  WriteImage(otherMask.GetPointer(), "TestBatchPatchMatch_2_valid.mha");
+
+  {
+    std::ofstream manifest("TestBatchPatchMatch.txt");
+    manifest << "# image output [mask]" << std::endl;
+    manifest << "TestBatchPatchMatch_0.mha TestBatchPatchMatch_0.nnf TestBatchPatchMatch_0_valid.mha" << std::endl;
+    manifest << std::endl;
+    manifest << "TestBatchPatchMatch_1.mha TestBatchPatchMatch_1.nnf TestBatchPatchMatch_0_valid.mha" << std::endl;
+    manifest << "TestBatchPatchMatch_Missing.mha TestBatchPatchMatch_Missing.nnf" << std::endl;
+    manifest << "TestBatchPatchMatch_2.mha TestBatchPatchMatch_2.nnf TestBatchPatchMatch_2_valid.mha" << std::endl;
+  }
+
+  std::vector<BatchJob> jobs = ReadBatchManifest("TestBatchPatchMatch.txt");
+  if(jobs.size() != 4 || jobs[0].MaskFileName != "TestBatchPatchMatch_0_valid.mha" ||
+     !jobs[2].MaskFileName.empty())
+  {
+    std::cerr << "The manifest was read as " << jobs.size() << " jobs" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ThreadPool threadPool(3);
+
+  BatchPatchMatchType batchPatchMatch;
+  batchPatchMatch.SetPatchRadius(patchRadius);
+  batchPatchMatch.SetIterations(iterations);
+  batchPatchMatch.SetThreadPool(&threadPool);
+  batchPatchMatch.SetRandom(false);
+  std::vector<BatchJobResult> results = batchPatchMatch.Compute(jobs);
+
+  if(results[2].Succeeded || results[2].Error.empty())
+  {
+    std::cerr << "The job of a missing image did not fail" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const int computedJobs[3] = {0, 1, 3};
+  for(unsigned int imageId = 0; imageId < 3; ++imageId)
+  {
+    const BatchJob& job = jobs[computedJobs[imageId]];
+    const BatchJobResult& result = results[computedJobs[imageId]];
+    if(!result.Succeeded)
+    {
+      std::cerr << "The job of " << job.ImageFileName << " failed: " << result.Error << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    NNFieldType::Pointer batchNNField = NNFieldType::New();
+    if(NNFieldFile::Read(job.OutputFileName, batchNNField.GetPointer()) != patchRadius)
+    {
+      std::cerr << job.OutputFileName << " has the wrong patch radius" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    NNFieldType::Pointer nnField = ComputeStandalone(images[imageId], imageId < 2 ? mask.GetPointer() : otherMask.GetPointer(),
+                                                     patchRadius, iterations, &threadPool);
+
+    // The border pixels have no match, which an NN field file does not keep apart from other matches
+    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(nnField->GetLargestPossibleRegion(), patchRadius);
+    itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, internalRegion);
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      const Match& match = nnFieldIterator.Get();
+      const Match& batchMatch = batchNNField->GetPixel(nnFieldIterator.GetIndex());
+      if(match.GetRegion() != batchMatch.GetRegion() || match.GetScore() != batchMatch.GetScore())
+      {
+        std::cerr << "The batch match of " << nnFieldIterator.GetIndex() << " in " << job.ImageFileName
+                  << " differs from the standalone match" << std::endl;
+        return EXIT_FAILURE;
+      }
+      ++nnFieldIterator;
+    }
+
+    std::remove(job.OutputFileName.c_str());
+  }
+
+  const char* inputFileNames[6] = {"TestBatchPatchMatch.txt", "TestBatchPatchMatch_0.mha", "TestBatchPatchMatch_0_valid.mha",
+                                   "TestBatchPatchMatch_1.mha", "TestBatchPatchMatch_2.mha", "TestBatchPatchMatch_2_valid.mha"};
+  for(unsigned int fileId = 0; fileId < 6; ++fileId)
+  {
+    std::remove(inputFileNames[fileId]);
+  }
+
+  std::cout << "BatchPatchMatch passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
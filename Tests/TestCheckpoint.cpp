@@ -0,0 +1,163 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that the snapshots of PatchMatch are written after the right iterations and
+  * read back as the NN field, and that an error of the background writer reaches the caller. */
+
+// STL
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+// Submodules
+#include "Helpers/Helpers.h"
+
+// Custom
+#include "BackgroundWriter.h"
+#include "NNField.h"
+#include "NNFieldFile.h"
+#include "TestHelpers.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+const unsigned int PatchRadius = 3;
+
+const unsigned int Iterations = 4;
+
+/** Compute the NN field of 'target' in 'source', writing a snapshot every other iteration with
+  * 'checkpointPrefix', and wait for the snapshots. */
+NNFieldType::Pointer ComputeNNField(ImageType* const source, ImageType* const target,
+                                    const std::string& checkpointPrefix)
+{
+  TestHelpers::PatchMatchFixture<ImageType> fixture(source, target, PatchRadius);
+  fixture.Engine.SetIterations(Iterations);
+  fixture.Engine.SetCheckpointPolicy(CheckpointPolicyEnum::EVERY_N_ITERATIONS, 2);
+  fixture.Engine.SetCheckpointPrefix(checkpointPrefix);
+
+  fixture.Engine.Compute();
+  fixture.Engine.WaitForCheckpoints();
+
+  return fixture.Engine.GetNNField();
+}
+
+bool FileExists(const std::string& fileName)
+{
+  std::ifstream file(fileName.c_str());
+  return file.good();
+}
+
+int main(int, char*[])
+{
+  // An error of a job is rethrown once, by the next Flush()
+  {
+    BackgroundWriter writer(1);
+    writer.Enqueue([]() { throw std::runtime_error("Job failed."); });
+    bool thrown = false;
+    try
+    {
+      writer.Flush();
+    }
+    catch(const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    if(!thrown)
+    {
+      std::cerr << "The error of the job was not rethrown." << std::endl;
+      return EXIT_FAILURE;
+    }
+    writer.Flush();
+  }
+
+  itk::Size<2> sourceSize = {{50, 40}};
+  ImageType::Pointer source = TestHelpers::CreateNoiseImage<ImageType>(sourceSize, 0);
+
+  itk::Size<2> targetSize = {{30, 20}};
+  ImageType::Pointer target = TestHelpers::CreateNoiseImage<ImageType>(targetSize, 1);
+
+  const std::string checkpointPrefix = "TestCheckpoint";
+  NNFieldType::Pointer nnField = ComputeNNField(source, target, checkpointPrefix);
+
+  // The snapshots are written after the second and the fourth (last) iterations
+  for(unsigned int iteration = 0; iteration < Iterations; ++iteration)
+  {
+    const std::string fileName = Helpers::GetSequentialFileName(checkpointPrefix, iteration, "nnf", 2);
+    if(FileExists(fileName) != (iteration % 2 == 1))
+    {
+      std::cerr << "The snapshot " << fileName << " is " << (FileExists(fileName) ? "" : "not ")
+                << "written." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The last snapshot is the NN field
+  const std::string lastFileName = Helpers::GetSequentialFileName(checkpointPrefix, Iterations - 1, "nnf", 2);
+  NNFieldType::Pointer snapshot = NNFieldType::New();
+  if(NNFieldFile::Read(lastFileName, snapshot.GetPointer()) != PatchRadius ||
+     snapshot->GetLargestPossibleRegion() != nnField->GetLargestPossibleRegion())
+  {
+    std::cerr << "The snapshot " << lastFileName << " has the wrong patch radius or region." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, nnField->GetLargestPossibleRegion());
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+    const Match& match = nnFieldIterator.Get();
+    const Match& snapshotMatch = snapshot->GetPixel(pixel);
+    if(snapshotMatch.GetCenter(pixel) != match.GetCenter(pixel) || snapshotMatch.GetScore() != match.GetScore())
+    {
+      std::cerr << "The snapshot matches " << pixel << " to " << snapshotMatch.GetCenter(pixel)
+                << " rather than " << match.GetCenter(pixel) << std::endl;
+      return EXIT_FAILURE;
+    }
+    ++nnFieldIterator;
+  }
+
+  for(unsigned int iteration = 1; iteration < Iterations; iteration += 2)
+  {
+    std::remove(Helpers::GetSequentialFileName(checkpointPrefix, iteration, "nnf", 2).c_str());
+  }
+
+  // A snapshot that cannot be written makes Compute() or WaitForCheckpoints() throw
+  bool thrown = false;
+  try
+  {
+    ComputeNNField(source, target, "TestCheckpointMissingDirectory/TestCheckpoint");
+  }
+  catch(const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  if(!thrown)
+  {
+    std::cerr << "The snapshot in a missing directory did not throw." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Checkpoint passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that PatchMatch computes the same matches and scores with a compact
+  * NN field as with a field of Match, with and without tiles, and that images whose offsets do not
+  * fit in a compact match are refused. */
+
+// STL
+#include <iostream>
+#include <stdexcept>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "NNField.h"
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef itk::Image<bool, 2> BoolImageType;
+
+const unsigned int PatchRadius = 3;
+
+template <typename TNNField>
+typename TNNField::Pointer ComputeNNField(ImageType* const image, BoolImageType* const validPatchCentersImage,
+                                          ThreadPool* const threadPool, const unsigned int tileSize)
+{
+  return TestHelpers::ComputeNNField<ImageType, TNNField>(image, image, PatchRadius, threadPool,
+    [validPatchCentersImage, tileSize](TestHelpers::PatchMatchFixture<ImageType, TNNField>& fixture)
+    {
+      fixture.Engine.SetValidPatchCentersImage(validPatchCentersImage);
+      fixture.Engine.SetTileSize(tileSize);
+      fixture.Engine.SetIterations(3);
+    });
+}
+
+int main(int, char*[])
+{
+  if(sizeof(CompactNNFieldType::PixelType) != 8)
+  {
+    std::cerr << "A compact match is " << sizeof(CompactNNFieldType::PixelType) << " bytes but should be 8" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The offsets of 16 bit matches reach from -32768 to 32767
+  itk::Index<2> origin = {{0, 0}};
+  itk::Size<2> largestSize = {{32768, 10}};
+  itk::Size<2> tooLargeSize = {{32769, 10}};
+  itk::ImageRegion<2> largestRegion(origin, largestSize);
+  itk::ImageRegion<2> tooLargeRegion(origin, tooLargeSize);
+  if(!CompactNNFieldType::PixelType::CanStoreOffsets(largestRegion, largestRegion) ||
+     CompactNNFieldType::PixelType::CanStoreOffsets(tooLargeRegion, tooLargeRegion) ||
+     !LargeCompactNNFieldType::PixelType::CanStoreOffsets(tooLargeRegion, tooLargeRegion))
+  {
+    std::cerr << "The range of the compact matches is wrong." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  bool thrown = false;
+  try
+  {
+    PatchMatchHelpers::CheckMatchRange<CompactNNFieldType::PixelType>(tooLargeRegion, tooLargeRegion);
+  }
+  catch(const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  if(!thrown)
+  {
+    std::cerr << "A source and target that are too large for compact matches were accepted." << std::endl;
+    return EXIT_FAILURE;
+  }
+  PatchMatchHelpers::CheckMatchRange<NNFieldType::PixelType>(tooLargeRegion, tooLargeRegion);
+
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{83, 61}};
+  itk::ImageRegion<2> imageRegion(corner, size);
+
+  ImageType::Pointer image = TestHelpers::CreateNoiseImage<ImageType>(imageRegion, 0);
+
+  // Only the top half of the image can be matched to
+  BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+  validPatchCentersImage->SetRegions(imageRegion);
+  validPatchCentersImage->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> validIterator(validPatchCentersImage, imageRegion);
+  while(!validIterator.IsAtEnd())
+  {
+    validIterator.Set(validIterator.GetIndex()[1] < static_cast<itk::IndexValueType>(size[1] / 2));
+    ++validIterator;
+  }
+
+  ThreadPool threadPool(3);
+
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(imageRegion, PatchRadius);
+
+  const unsigned int tileSizes[] = {0, 16};
+  for(unsigned int tileSize : tileSizes)
+  {
+    NNFieldType::Pointer nnField = ComputeNNField<NNFieldType>(image, validPatchCentersImage, &threadPool, tileSize);
+    CompactNNFieldType::Pointer compactNNField =
+      ComputeNNField<CompactNNFieldType>(image, validPatchCentersImage, &threadPool, tileSize);
+
+    itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, internalRegion);
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+      Match match = nnFieldIterator.Get();
+      CompactNNFieldType::PixelType compactMatch = compactNNField->GetPixel(pixel);
+
+      if(match.GetCenter(pixel) != compactMatch.GetCenter(pixel) ||
+         match.GetRegion() != compactMatch.GetRegion(pixel, PatchRadius) ||
+         match.GetScore() != compactMatch.GetScore())
+      {
+        std::cerr << "With tile size " << tileSize << " the match of " << pixel << " is " << match.GetCenter(pixel)
+                  << " (" << match.GetScore() << ") but the compact match is " << compactMatch.GetCenter(pixel)
+                  << " (" << compactMatch.GetScore() << ")" << std::endl;
+        return EXIT_FAILURE;
+      }
+      ++nnFieldIterator;
+    }
+  }
+
+  std::cout << "CompactNNField passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
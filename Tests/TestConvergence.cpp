@@ -0,0 +1,199 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks the iteration control of PatchMatch on a target that is a crop of the source,
+  * so that every target patch has exactly one exact match: the convergence criteria stop Compute()
+  * early (but not after the first iteration when the initial scores are infinite), the
+  * active set reaches the same field as processing every pixel, and the iteration statistics stay
+  * in range. */
+
+// STL
+#include <functional>
+#include <iostream>
+#include <limits>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "NNField.h"
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef TestHelpers::PatchMatchFixture<ImageType> FixtureType;
+typedef FixtureType::PatchMatchType PatchMatchType;
+
+const unsigned int PatchRadius = 3;
+
+const unsigned int MaximumIterations = 30;
+
+/** Compute the NN field of 'target' in 'source' with 'configure' applied to the PatchMatch object
+  * first. The number of iterations that were performed is returned in 'numberOfIterations', and
+  * 'statisticsInRange' is cleared if the statistics of an iteration are out of range. */
+NNFieldType::Pointer ComputeNNField(ImageType* const source, ImageType* const target, ThreadPool* const threadPool,
+                                    const unsigned int tileSize, const std::function<void(PatchMatchType&)>& configure,
+                                    unsigned int& numberOfIterations, bool& statisticsInRange)
+{
+  FixtureType fixture(source, target, PatchRadius, threadPool);
+  fixture.Engine.SetIterations(MaximumIterations);
+  fixture.Engine.SetTileSize(tileSize);
+
+  const double numberOfTargetPixels =
+    ITKHelpers::GetInternalRegion(target->GetLargestPossibleRegion(), PatchRadius).GetNumberOfPixels();
+  fixture.Engine.IterationStatisticsSignal.connect([&statisticsInRange, numberOfTargetPixels](const IterationStatistics& statistics)
+  {
+    if(statistics.ImprovedFraction < 0 || statistics.ImprovedFraction > 1 ||
+       statistics.GetImprovedPixels() > statistics.ActivePixels ||
+       statistics.GetImprovedPixels() < statistics.Propagation.ImprovedPixels ||
+       statistics.GetImprovedPixels() < statistics.RandomSearch.ImprovedPixels ||
+       statistics.GetImprovedPixels() > statistics.Propagation.ImprovedPixels + statistics.RandomSearch.ImprovedPixels ||
+       statistics.ActivePixels > numberOfTargetPixels || !(statistics.RelativeScoreDecrease >= 0))
+    {
+      std::cerr << "Iteration " << statistics.Iteration << " has an improved fraction of " << statistics.ImprovedFraction
+                << " and a relative score decrease of " << statistics.RelativeScoreDecrease << " with "
+                << statistics.ActivePixels << " active pixels" << std::endl;
+      statisticsInRange = false;
+    }
+  });
+
+  configure(fixture.Engine);
+  fixture.Engine.Compute();
+
+  numberOfIterations = fixture.Engine.GetNumberOfComputedIterations();
+  return fixture.Engine.GetNNField();
+}
+
+/** Check that every pixel of the internal region of 'nnField' is matched exactly to the pixel at
+  * 'offset' from it. */
+bool IsExact(const NNFieldType* const nnField, const itk::Offset<2>& offset, const std::string& name)
+{
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(nnField->GetLargestPossibleRegion(), PatchRadius);
+  itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, internalRegion);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+    if(nnFieldIterator.Get().GetCenter(pixel) != pixel + offset || nnFieldIterator.Get().GetScore() != 0)
+    {
+      std::cerr << name << ": the match of " << pixel << " is " << nnFieldIterator.Get().GetCenter(pixel)
+                << " with a score of " << nnFieldIterator.Get().GetScore() << std::endl;
+      return false;
+    }
+    ++nnFieldIterator;
+  }
+  return true;
+}
+
+int main(int, char*[])
+{
+  itk::Size<2> sourceSize = {{60, 50}};
+  ImageType::Pointer source = TestHelpers::CreateNoiseImage<ImageType>(sourceSize, 0);
+
+  // The target is a crop of the source
+  itk::Size<2> targetSize = {{40, 30}};
+  ImageType::Pointer target = TestHelpers::CreateNoiseImage<ImageType>(targetSize, 1);
+  const itk::Index<2> cropCorner = {{12, 9}};
+  const itk::Offset<2> cropOffset = {{12, 9}};
+  TestHelpers::CopyBlock<ImageType>(source, cropCorner, target, target->GetLargestPossibleRegion());
+
+  ThreadPool threadPool(3);
+
+  bool statisticsInRange = true;
+
+  // Without and with tiles
+  const unsigned int tileSizes[] = {0, 16};
+  for(unsigned int tileSize : tileSizes)
+  {
+    unsigned int fullIterations = 0;
+    NNFieldType::Pointer fullNNField = ComputeNNField(source, target, &threadPool, tileSize, [](PatchMatchType&) {},
+                                                      fullIterations, statisticsInRange);
+    if(fullIterations != MaximumIterations || !IsExact(fullNNField, cropOffset, "Every pixel"))
+    {
+      return EXIT_FAILURE;
+    }
+
+    // Once the field is exact no pixel improves, so the iterations stop early
+    unsigned int convergedIterations = 0;
+    NNFieldType::Pointer convergedNNField =
+      ComputeNNField(source, target, &threadPool, tileSize, [](PatchMatchType& patchMatch)
+                     {
+                       patchMatch.SetConvergenceCriterion(ConvergenceCriterionEnum::IMPROVED_FRACTION, 1e-9);
+                     }, convergedIterations, statisticsInRange);
+    if(convergedIterations >= MaximumIterations || !IsExact(convergedNNField, cropOffset, "Improved fraction"))
+    {
+      std::cerr << "With the improved fraction criterion " << convergedIterations << " iterations ran" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // The pixels that are not exact yet stay active, so the active set reaches the same field
+    unsigned int activeSetIterations = 0;
+    NNFieldType::Pointer activeSetNNField =
+      ComputeNNField(source, target, &threadPool, tileSize, [](PatchMatchType& patchMatch)
+                     {
+                       patchMatch.SetActiveSet(true, 0);
+                     }, activeSetIterations, statisticsInRange);
+    if(activeSetIterations >= MaximumIterations || !IsExact(activeSetNNField, cropOffset, "Active set"))
+    {
+      std::cerr << "With the active set " << activeSetIterations << " iterations ran" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Every pixel starts with an infinite score, so the first iteration cannot look converged from
+    // the (finite) total score, which is zero before it
+    NNFieldType::Pointer initialNNField = NNFieldType::New();
+    initialNNField->SetRegions(target->GetLargestPossibleRegion());
+    initialNNField->Allocate();
+    const itk::Index<2> initialCenter = {{static_cast<itk::IndexValueType>(PatchRadius),
+                                          static_cast<itk::IndexValueType>(PatchRadius)}};
+    itk::ImageRegionIteratorWithIndex<NNFieldType> initialIterator(initialNNField, initialNNField->GetLargestPossibleRegion());
+    while(!initialIterator.IsAtEnd())
+    {
+      Match match;
+      match.SetCenter(initialIterator.GetIndex(), initialCenter, PatchRadius);
+      match.SetScore(std::numeric_limits<float>::infinity());
+      initialIterator.Set(match);
+      ++initialIterator;
+    }
+
+    unsigned int scoreDecreaseIterations = 0;
+    ComputeNNField(source, target, &threadPool, tileSize, [&initialNNField](PatchMatchType& patchMatch)
+                   {
+                     patchMatch.SetInitialNNField(initialNNField);
+                     patchMatch.SetConvergenceCriterion(ConvergenceCriterionEnum::RELATIVE_SCORE_DECREASE, 1e-3);
+                   }, scoreDecreaseIterations, statisticsInRange);
+    if(scoreDecreaseIterations <= 1 || scoreDecreaseIterations >= MaximumIterations)
+    {
+      std::cerr << "With the relative score decrease criterion " << scoreDecreaseIterations << " iterations ran" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(!statisticsInRange)
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Convergence passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that PatchMatch matches a target image to a source image of another size: the
+  * matches are inside of the source, the scores compare the source to the target, and the exact copies
+  * of source patches in the target are found. The same object is then reused for a second target. */
+
+// STL
+#include <iostream>
+#include <vector>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "NNField.h"
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef TestHelpers::PatchMatchFixture<ImageType> FixtureType;
+
+/** Check the field of 'target' and count the pixels in 'blockRegions' whose patches are exact copies
+  * (inside of a block) that were matched exactly. Returns false if a match or a score is wrong. */
+bool CheckNNField(const NNFieldType* const nnField, const ImageType* const source, ImageType* const target,
+                  const std::vector<itk::ImageRegion<2> >& blockRegions, const unsigned int patchRadius,
+                  unsigned int& numberOfCopies, unsigned int& numberOfExactMatches)
+{
+  itk::ImageRegion<2> sourceInternalRegion = ITKHelpers::GetInternalRegion(source->GetLargestPossibleRegion(), patchRadius);
+  itk::ImageRegion<2> targetInternalRegion = ITKHelpers::GetInternalRegion(target->GetLargestPossibleRegion(), patchRadius);
+
+  if(nnField->GetLargestPossibleRegion() != target->GetLargestPossibleRegion())
+  {
+    std::cerr << "The NN field does not cover the target" << std::endl;
+    return false;
+  }
+
+  FixtureType::PatchDistanceFunctorType patchDistanceFunctor;
+  patchDistanceFunctor.SetSourceImage(const_cast<ImageType*>(source));
+  patchDistanceFunctor.SetTargetImage(target);
+
+  numberOfCopies = 0;
+  numberOfExactMatches = 0;
+
+  itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, targetInternalRegion);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<2>& targetPixel = nnFieldIterator.GetIndex();
+    const Match& match = nnFieldIterator.Get();
+
+    if(!sourceInternalRegion.IsInside(match.GetCenter(targetPixel)))
+    {
+      std::cerr << "The match of " << targetPixel << " is not a patch of the source" << std::endl;
+      return false;
+    }
+
+    itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, patchRadius);
+    if(match.GetScore() != patchDistanceFunctor.Distance(match.GetRegion(), targetRegion))
+    {
+      std::cerr << "The score of " << targetPixel << " does not compare its match to it" << std::endl;
+      return false;
+    }
+
+    for(size_t blockId = 0; blockId < blockRegions.size(); ++blockId)
+    {
+      if(blockRegions[blockId].IsInside(targetRegion))
+      {
+        numberOfCopies++;
+        if(match.GetScore() == 0)
+        {
+          numberOfExactMatches++;
+        }
+      }
+    }
+
+    ++nnFieldIterator;
+  }
+
+  return true;
+}
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+
+  itk::Size<2> sourceSize = {{50, 40}};
+  ImageType::Pointer source = TestHelpers::CreateNoiseImage<ImageType>(sourceSize, 0);
+
+  // The targets are wider but lower than the source, and their halves are copied from two parts of it
+  itk::Size<2> targetSize = {{64, 30}};
+  itk::Size<2> blockSize = {{32, 30}};
+  std::vector<itk::ImageRegion<2> > blockRegions;
+  itk::Index<2> leftCorner = {{0, 0}};
+  itk::Index<2> rightCorner = {{32, 0}};
+  blockRegions.push_back(itk::ImageRegion<2>(leftCorner, blockSize));
+  blockRegions.push_back(itk::ImageRegion<2>(rightCorner, blockSize));
+
+  std::vector<ImageType::Pointer> targets;
+  for(unsigned int targetId = 0; targetId < 2; ++targetId)
+  {
+    ImageType::Pointer target = TestHelpers::CreateNoiseImage<ImageType>(targetSize, targetId + 1);
+    itk::Index<2> leftSourceCorner = {{18, static_cast<itk::IndexValueType>(2 + 5 * targetId)}};
+    itk::Index<2> rightSourceCorner = {{static_cast<itk::IndexValueType>(3 * targetId), 10}};
+    TestHelpers::CopyBlock<ImageType>(source, leftSourceCorner, target, blockRegions[0]);
+    TestHelpers::CopyBlock<ImageType>(source, rightSourceCorner, target, blockRegions[1]);
+    targets.push_back(target);
+  }
+
+  ThreadPool threadPool(3);
+
+  FixtureType fixture(source, targets[0], patchRadius, &threadPool);
+  fixture.PropagationFunctor.SetIncremental(true);
+  fixture.Engine.SetIterations(6);
+
+  // The source (and its valid patch centers) stays the same for both targets
+  for(unsigned int targetId = 0; targetId < targets.size(); ++targetId)
+  {
+    fixture.PatchDistanceFunctor.SetTargetImage(targets[targetId]);
+    fixture.RandomSearchFunctor.SetTargetImage(targets[targetId]);
+    fixture.Engine.SetTargetImage(targets[targetId]);
+    fixture.Engine.ResetNNField();
+
+    // The second target also runs the tiled engine
+    fixture.Engine.SetTileSize(targetId == 0 ? 0 : 16);
+    fixture.Engine.Compute();
+
+    unsigned int numberOfCopies = 0;
+    unsigned int numberOfExactMatches = 0;
+    if(!CheckNNField(fixture.Engine.GetNNField(), source, targets[targetId], blockRegions, patchRadius,
+                     numberOfCopies, numberOfExactMatches))
+    {
+      std::cerr << "The NN field of target " << targetId << " is wrong" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Propagation spreads an exact match over its whole block once random search finds one
+    if(numberOfExactMatches < 0.95 * numberOfCopies)
+    {
+      std::cerr << "Only " << numberOfExactMatches << " of the " << numberOfCopies
+                << " copied patches of target " << targetId << " were matched exactly" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Cross image PatchMatch passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
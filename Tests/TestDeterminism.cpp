@@ -0,0 +1,116 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that PatchMatch computes the same NN field from the same seed whether the
+  * propagation and the random search run serially or on thread pools of any size, and whether the
+  * propagation candidates are evaluated incrementally or not. */
+
+// STL
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+// Custom
+#include "NNField.h"
+#include "TestHelpers.h"
+#include "ThreadPool.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef TestHelpers::PatchMatchFixture<ImageType> FixtureType;
+
+// With this radius and 8 bit components every SSD is an integer that a float holds exactly, so the
+// incremental estimates equal the full distances and the fields have to be identical bit for bit
+const unsigned int PatchRadius = 3;
+
+/** Compute the NN field of 'target' in 'source' with a fixed seed, on 'threadPool' (serially if it
+  * is null) and with the incremental propagation if 'incremental' is set. */
+NNFieldType::Pointer ComputeNNField(ImageType* const source, ImageType* const target, ThreadPool* const threadPool,
+                                    const bool incremental)
+{
+  return TestHelpers::ComputeNNField(source, target, PatchRadius, threadPool, [incremental](FixtureType& fixture)
+  {
+    fixture.PropagationFunctor.SetWavefrontBlockSize(8); // Several blocks per anti-diagonal
+    fixture.PropagationFunctor.SetIncremental(incremental);
+    fixture.Engine.SetIterations(3);
+  });
+}
+
+/** Check that every match (and its score) of 'nnField' is the same as in 'expectedNNField'. */
+bool IsSame(const NNFieldType* const nnField, const NNFieldType* const expectedNNField, const std::string& name)
+{
+  itk::ImageRegionConstIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, nnField->GetLargestPossibleRegion());
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<2>& pixel = nnFieldIterator.GetIndex();
+    const Match& match = nnFieldIterator.Get();
+    const Match& expectedMatch = expectedNNField->GetPixel(pixel);
+    if(match.GetCenter(pixel) != expectedMatch.GetCenter(pixel) || match.GetScore() != expectedMatch.GetScore())
+    {
+      std::cerr << name << ": the match of " << pixel << " is " << match.GetCenter(pixel) << " with a score of "
+                << match.GetScore() << " rather than " << expectedMatch.GetCenter(pixel) << " with a score of "
+                << expectedMatch.GetScore() << std::endl;
+      return false;
+    }
+    ++nnFieldIterator;
+  }
+  return true;
+}
+
+int main(int, char*[])
+{
+  itk::Size<2> sourceSize = {{70, 60}};
+  ImageType::Pointer source = TestHelpers::CreateNoiseImage<ImageType>(sourceSize, 0);
+
+  itk::Size<2> targetSize = {{64, 48}};
+  ImageType::Pointer target = TestHelpers::CreateNoiseImage<ImageType>(targetSize, 1);
+
+  // Serially and without the incremental propagation
+  NNFieldType::Pointer expectedNNField = ComputeNNField(source, target, nullptr, false);
+
+  const unsigned int numbersOfThreads[] = {0, 1, 4};
+  for(unsigned int numberOfThreads : numbersOfThreads)
+  {
+    std::unique_ptr<ThreadPool> threadPool;
+    if(numberOfThreads > 0)
+    {
+      threadPool.reset(new ThreadPool(numberOfThreads));
+    }
+
+    for(bool incremental : {false, true})
+    {
+      std::stringstream name;
+      name << numberOfThreads << " threads, incremental " << incremental;
+
+      NNFieldType::Pointer nnField = ComputeNNField(source, target, threadPool.get(), incremental);
+      if(!IsSame(nnField, expectedNNField, name.str()))
+      {
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  std::cout << "Determinism passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
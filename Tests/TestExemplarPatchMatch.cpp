@@ -0,0 +1,311 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks the layout of an ExemplarLibrary, and that ExemplarPatchMatch finds the
+  * exemplar and the position of the copies of exemplar patches in two targets, which are matched
+  * at the same time to the same library. */
+
+// STL
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "ExemplarLibrary.h"
+#include "ExemplarPatchMatch.h"
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+#include "VectorizedSSD.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef itk::Image<bool, 2> BoolImageType;
+typedef ExemplarLibrary<ImageType> ExemplarLibraryType;
+typedef ExemplarPatchMatch<ImageType> ExemplarPatchMatchType;
+
+/** A block of a target that is a copy of a block of an exemplar. */
+struct CopiedBlock
+{
+  itk::ImageRegion<2> TargetRegion;
+  unsigned int ExemplarId;
+  itk::Index<2> ExemplarCorner;
+};
+
+/** Check the layout of the atlas: the exemplars do not overlap, every patch inside of an exemplar
+  * is found in it, patches across its edge are not, and the valid patch centers are counted. */
+bool CheckLayout(const ExemplarLibraryType& library, const unsigned int maskedExemplarId)
+{
+  const unsigned int patchRadius = library.GetPatchRadius();
+  const itk::ImageRegion<2> atlasRegion = library.GetAtlasImage()->GetLargestPossibleRegion();
+
+  for(unsigned int exemplarId = 0; exemplarId < library.GetNumberOfExemplars(); ++exemplarId)
+  {
+    const itk::ImageRegion<2>& exemplarAtlasRegion = library.GetAtlasRegion(exemplarId);
+    if(!atlasRegion.IsInside(exemplarAtlasRegion) ||
+       exemplarAtlasRegion.GetSize() != library.GetExemplar(exemplarId)->GetLargestPossibleRegion().GetSize())
+    {
+      std::cerr << "Exemplar " << exemplarId << " is not placed in the atlas" << std::endl;
+      return false;
+    }
+
+    for(unsigned int otherId = exemplarId + 1; otherId < library.GetNumberOfExemplars(); ++otherId)
+    {
+      itk::ImageRegion<2> overlap = exemplarAtlasRegion;
+      if(overlap.Crop(library.GetAtlasRegion(otherId)))
+      {
+        std::cerr << "Exemplars " << exemplarId << " and " << otherId << " overlap in the atlas" << std::endl;
+        return false;
+      }
+    }
+
+    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(exemplarAtlasRegion, patchRadius);
+    itk::ImageRegionConstIteratorWithIndex<ImageType> centerIterator(library.GetAtlasImage(), internalRegion);
+    while(!centerIterator.IsAtEnd())
+    {
+      unsigned int foundId = 0;
+      if(!library.FindExemplar(ITKHelpers::GetRegionInRadiusAroundPixel(centerIterator.GetIndex(), patchRadius), foundId) ||
+         foundId != exemplarId)
+      {
+        std::cerr << "The patch at " << centerIterator.GetIndex() << " is not found in exemplar " << exemplarId << std::endl;
+        return false;
+      }
+      ++centerIterator;
+    }
+
+    // Patches that stick out of the exemplar by one pixel on any side
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      itk::Index<2> outsideCenters[2] = {internalRegion.GetIndex(), internalRegion.GetIndex()};
+      outsideCenters[0][dimension] -= 1;
+      outsideCenters[1][dimension] += internalRegion.GetSize()[dimension];
+      for(unsigned int side = 0; side < 2; ++side)
+      {
+        unsigned int foundId = 0;
+        if(library.FindExemplar(ITKHelpers::GetRegionInRadiusAroundPixel(outsideCenters[side], patchRadius), foundId))
+        {
+          std::cerr << "The patch at " << outsideCenters[side] << " is found in exemplar " << foundId
+                    << " although it crosses the edge of exemplar " << exemplarId << std::endl;
+          return false;
+        }
+      }
+    }
+
+    unsigned int expectedValidPatchCenters = exemplarId == maskedExemplarId ? 0 : internalRegion.GetNumberOfPixels();
+    if(library.GetNumberOfValidPatchCenters(exemplarId) != expectedValidPatchCenters)
+    {
+      std::cerr << "Exemplar " << exemplarId << " has " << library.GetNumberOfValidPatchCenters(exemplarId)
+                << " valid patch centers instead of " << expectedValidPatchCenters << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/** Check the exemplar matches of 'target', and count the pixels whose patches are inside of a copied
+  * block and were matched to the block of the exemplar that it was copied from. Returns false if a
+  * match is outside of its exemplar or its score is wrong. */
+bool CheckExemplarNNField(const ExemplarNNFieldType* const exemplarNNField, const ExemplarLibraryType& library,
+                          ImageType* const target, const std::vector<CopiedBlock>& blocks,
+                          unsigned int& numberOfCopies, unsigned int& numberOfExactMatches)
+{
+  const unsigned int patchRadius = library.GetPatchRadius();
+  itk::ImageRegion<2> targetInternalRegion = ITKHelpers::GetInternalRegion(target->GetLargestPossibleRegion(), patchRadius);
+
+  numberOfCopies = 0;
+  numberOfExactMatches = 0;
+
+  itk::ImageRegionConstIteratorWithIndex<ExemplarNNFieldType> nnFieldIterator(exemplarNNField, targetInternalRegion);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<2>& targetPixel = nnFieldIterator.GetIndex();
+    const ExemplarMatch& match = nnFieldIterator.Get();
+
+    if(match.ExemplarId >= library.GetNumberOfExemplars())
+    {
+      std::cerr << "The match of " << targetPixel << " is not in an exemplar" << std::endl;
+      return false;
+    }
+
+    const ImageType* exemplar = library.GetExemplar(match.ExemplarId);
+    itk::ImageRegion<2> exemplarRegion = ITKHelpers::GetRegionInRadiusAroundPixel(match.Center, patchRadius);
+    if(!exemplar->GetLargestPossibleRegion().IsInside(exemplarRegion))
+    {
+      std::cerr << "The match of " << targetPixel << " is not a patch of exemplar " << match.ExemplarId << std::endl;
+      return false;
+    }
+
+    itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, patchRadius);
+    float distance = VectorizedSSD<ImageType>::Distance(exemplar, exemplarRegion, target, targetRegion,
+                                                        std::numeric_limits<float>::infinity());
+    if(match.Score != distance)
+    {
+      std::cerr << "The score of " << targetPixel << " does not compare its match to it" << std::endl;
+      return false;
+    }
+
+    for(size_t blockId = 0; blockId < blocks.size(); ++blockId)
+    {
+      if(blocks[blockId].TargetRegion.IsInside(targetRegion))
+      {
+        numberOfCopies++;
+        itk::Index<2> expectedCenter = blocks[blockId].ExemplarCorner + (targetPixel - blocks[blockId].TargetRegion.GetIndex());
+        if(match.ExemplarId == blocks[blockId].ExemplarId && match.Center == expectedCenter)
+        {
+          numberOfExactMatches++;
+        }
+      }
+    }
+
+    ++nnFieldIterator;
+  }
+
+  return true;
+}
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+
+  // Exemplars of different sizes, one of which has no valid patch centers
+  const unsigned int numberOfExemplars = 4;
+  const itk::SizeValueType exemplarSizes[numberOfExemplars][2] = {{40, 34}, {36, 40}, {50, 20}, {12, 12}};
+  const unsigned int maskedExemplarId = 3;
+
+  std::vector<ImageType::Pointer> exemplars;
+  ExemplarLibraryType library;
+  for(unsigned int exemplarId = 0; exemplarId < numberOfExemplars; ++exemplarId)
+  {
+    itk::Size<2> size = {{exemplarSizes[exemplarId][0], exemplarSizes[exemplarId][1]}};
+    exemplars.push_back(TestHelpers::CreateNoiseImage<ImageType>(size, 10 + exemplarId));
+
+    BoolImageType::Pointer validPatchCentersImage;
+    if(exemplarId == maskedExemplarId)
+    {
+      validPatchCentersImage = BoolImageType::New();
+      validPatchCentersImage->SetRegions(exemplars.back()->GetLargestPossibleRegion());
+      validPatchCentersImage->Allocate();
+      validPatchCentersImage->FillBuffer(false);
+    }
+
+    if(library.AddExemplar(exemplars.back(), validPatchCentersImage) != exemplarId)
+    {
+      std::cerr << "Exemplar " << exemplarId << " got the wrong id" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  library.Build(patchRadius);
+
+  if(!CheckLayout(library, maskedExemplarId))
+  {
+    std::cerr << "The layout of the library is wrong" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The halves of both targets are copied from two different exemplars
+  itk::Size<2> targetSize = {{64, 30}};
+  itk::Size<2> blockSize = {{32, 30}};
+  std::vector<ImageType::Pointer> targets;
+  std::vector<std::vector<CopiedBlock> > targetBlocks;
+  for(unsigned int targetId = 0; targetId < 2; ++targetId)
+  {
+    ImageType::Pointer target = TestHelpers::CreateNoiseImage<ImageType>(targetSize, targetId + 1);
+
+    std::vector<CopiedBlock> blocks(2);
+    itk::Index<2> leftCorner = {{0, 0}};
+    itk::Index<2> rightCorner = {{32, 0}};
+    blocks[0].TargetRegion = itk::ImageRegion<2>(leftCorner, blockSize);
+    blocks[0].ExemplarId = 1;
+    blocks[0].ExemplarCorner[0] = 2 * targetId;
+    blocks[0].ExemplarCorner[1] = 5 + targetId;
+    blocks[1].TargetRegion = itk::ImageRegion<2>(rightCorner, blockSize);
+    blocks[1].ExemplarId = targetId == 0 ? 0 : 2;
+    blocks[1].ExemplarCorner[0] = 5 + 10 * targetId;
+    blocks[1].ExemplarCorner[1] = targetId == 0 ? 1 : 0;
+
+    for(size_t blockId = 0; blockId < blocks.size(); ++blockId)
+    {
+      // The block of the second target that comes from the low exemplar is as high as it
+      itk::Size<2> copySize = blocks[blockId].TargetRegion.GetSize();
+      copySize[1] = std::min(copySize[1], exemplars[blocks[blockId].ExemplarId]->GetLargestPossibleRegion().GetSize()[1]);
+      blocks[blockId].TargetRegion.SetSize(copySize);
+      TestHelpers::CopyBlock<ImageType>(exemplars[blocks[blockId].ExemplarId], blocks[blockId].ExemplarCorner, target, blocks[blockId].TargetRegion);
+    }
+
+    targets.push_back(target);
+    targetBlocks.push_back(blocks);
+  }
+
+  // Both targets are matched at the same time, each on its own pool, and share the library
+  std::vector<ExemplarPatchMatchType> exemplarPatchMatches(targets.size());
+  std::vector<std::thread> requests;
+  for(unsigned int targetId = 0; targetId < targets.size(); ++targetId)
+  {
+    requests.push_back(std::thread([&library, &exemplarPatchMatches, &targets, targetId]()
+    {
+      ThreadPool threadPool(2);
+
+      ExemplarPatchMatchType& exemplarPatchMatch = exemplarPatchMatches[targetId];
+      exemplarPatchMatch.SetLibrary(&library);
+      exemplarPatchMatch.SetIterations(6);
+      exemplarPatchMatch.SetThreadPool(&threadPool);
+      exemplarPatchMatch.SetRandom(false);
+
+      // The second target also runs the tiled engine
+      exemplarPatchMatch.SetTileSize(targetId == 0 ? 0 : 16);
+      exemplarPatchMatch.Compute(targets[targetId]);
+    }));
+  }
+
+  for(size_t requestId = 0; requestId < requests.size(); ++requestId)
+  {
+    requests[requestId].join();
+  }
+
+  for(unsigned int targetId = 0; targetId < targets.size(); ++targetId)
+  {
+    unsigned int numberOfCopies = 0;
+    unsigned int numberOfExactMatches = 0;
+    if(!CheckExemplarNNField(exemplarPatchMatches[targetId].GetExemplarNNField(), library, targets[targetId],
+                             targetBlocks[targetId], numberOfCopies, numberOfExactMatches))
+    {
+      std::cerr << "The exemplar NN field of target " << targetId << " is wrong" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if(numberOfExactMatches < 0.95 * numberOfCopies)
+    {
+      std::cerr << "Only " << numberOfExactMatches << " of the " << numberOfCopies
+                << " copied patches of target " << targetId << " were matched to their exemplar" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Exemplar PatchMatch passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -16,80 +16,190 @@
  *
  *=========================================================================*/
 
-/** This program computes the NN field of an image. */
+/** This program checks that GeneralizedPatchMatch finds all copies of a tile that appears several
+  * times in the source image as the K nearest neighbors of the patches of the tile in the target, that
+  * the K matches of every pixel are distinct and correctly scored, and that the result does not depend
+  * on the number of threads. */
 
 // STL
 #include <iostream>
+#include <set>
+#include <utility>
+#include <vector>
 
 // ITK
 #include "itkImage.h"
-#include "itkImageFileReader.h"
-#include "itkImageFileWriter.h"
 #include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
 
 // Submodules
-#include "Mask/Mask.h"
-#include "Mask/ITKHelpers/ITKHelpers.h"
-#include "PatchComparison/SSD.h"
+#include "ITKHelpers/ITKHelpers.h"
 
 // Custom
-#include "GeneralizedPatchMatch.h"
-
-typedef itk::Image<itk::CovariantVector<float, 3>, 2> ImageType;
-
-int main(int argc, char*argv[])
+#include "Generalized/GeneralizedPatchMatch.h"
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+#include "ThreadPool.h"
+#include "VectorizedSSD.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+typedef GeneralizedPatchMatch<ImageType> GeneralizedPatchMatchType;
+typedef GeneralizedPatchMatchType::KNNFieldType KNNFieldType;
+
+/** Compute the K nearest neighbors of 'target' in 'source' on a pool of 'numberOfThreads' threads. */
+void ComputeKNNField(ImageType* const source, ImageType* const target, const unsigned int patchRadius,
+                     const unsigned int k, const unsigned int numberOfThreads, KNNFieldType& knnField)
 {
-  if(argc < 4)
-  {
-    std::cerr << "Required arguments: image mask output" << std::endl;
-    return EXIT_FAILURE;
-  }
+  VectorizedSSD<ImageType> patchDistanceFunctor;
+  patchDistanceFunctor.SetSourceImage(source);
+  patchDistanceFunctor.SetTargetImage(target);
+
+  ThreadPool threadPool(numberOfThreads);
+
+  GeneralizedPatchMatchType patchMatch;
+  patchMatch.SetSourceImage(source);
+  patchMatch.SetTargetImage(target);
+  patchMatch.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  patchMatch.SetPatchRadius(patchRadius);
+  patchMatch.SetNumberOfCandidates(k);
+  patchMatch.SetIterations(5);
+  patchMatch.SetWavefrontBlockSize(8);
+  patchMatch.SetThreadPool(&threadPool);
+  patchMatch.SetRandom(false);
+  patchMatch.Compute();
 
-  std::string imageFilename = argv[1];
-  std::string maskFilename = argv[2];
-  std::string outputFilename = argv[3];
+  knnField = *patchMatch.GetKNNField();
+}
 
-  std::cout << "imageFilename: " << imageFilename << std::endl;
-  std::cout << "maskFilename: " << maskFilename << std::endl;
-  std::cout << "outputFilename: " << outputFilename << std::endl;
+/** Check that every pixel of the internal region of the target has K distinct matches inside of the
+  * source whose scores are their distances. */
+bool CheckMatches(const KNNFieldType& knnField, ImageType* const source, ImageType* const target,
+                  const unsigned int patchRadius)
+{
+  VectorizedSSD<ImageType> patchDistanceFunctor;
+  patchDistanceFunctor.SetSourceImage(source);
+  patchDistanceFunctor.SetTargetImage(target);
 
-  typedef itk::ImageFileReader<ImageType> ImageReaderType;
-  ImageReaderType::Pointer imageReader = ImageReaderType::New();
-  imageReader->SetFileName(imageFilename);
-  imageReader->Update();
+  itk::ImageRegion<2> targetInternalRegion = ITKHelpers::GetInternalRegion(target->GetLargestPossibleRegion(), patchRadius);
+  std::vector<itk::Index<2> > targetPixels = PatchMatchHelpers::GetAllPixelIndices(targetInternalRegion);
 
-  Mask::Pointer sourceMask = Mask::New();
-  sourceMask->Read(maskFilename);
+  std::vector<Match> matches;
+  for(size_t pixelId = 0; pixelId < targetPixels.size(); ++pixelId)
+  {
+    const itk::Index<2>& targetPixel = targetPixels[pixelId];
+    knnField.GetSortedMatches(targetPixel, matches);
+    if(matches.size() != knnField.GetK())
+    {
+      std::cerr << targetPixel << " has " << matches.size() << " matches instead of " << knnField.GetK() << std::endl;
+      return false;
+    }
+
+    itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, patchRadius);
+    std::set<std::pair<itk::IndexValueType, itk::IndexValueType> > centers;
+    for(size_t matchId = 0; matchId < matches.size(); ++matchId)
+    {
+      itk::Index<2> center = matches[matchId].GetCenter(targetPixel);
+      itk::ImageRegion<2> sourceRegion = ITKHelpers::GetRegionInRadiusAroundPixel(center, patchRadius);
+      if(!source->GetLargestPossibleRegion().IsInside(sourceRegion))
+      {
+        std::cerr << "A match of " << targetPixel << " is not inside of the source" << std::endl;
+        return false;
+      }
+
+      if(!centers.insert(std::make_pair(center[0], center[1])).second)
+      {
+        std::cerr << targetPixel << " is matched to " << center << " more than once" << std::endl;
+        return false;
+      }
+
+      if(matches[matchId].GetScore() != patchDistanceFunctor.Distance(sourceRegion, targetRegion))
+      {
+        std::cerr << "The score of a match of " << targetPixel << " is not its distance" << std::endl;
+        return false;
+      }
+    }
+  }
 
-  Mask::Pointer targetMask = Mask::New();
-  targetMask->SetRegions(sourceMask->GetLargestPossibleRegion());
-  targetMask->Allocate();
-  ITKHelpers::SetImageToConstant(targetMask.GetPointer(), targetMask->GetValidValue());
+  return true;
+}
 
-  SSD<ImageType>* patchDistanceFunctor = new SSD<ImageType>;
-  patchDistanceFunctor->SetImage(imageReader->GetOutput());
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 2;
+  const unsigned int k = 4;
+
+  itk::Size<2> tileSize = {{16, 16}};
+  ImageType::Pointer tile = TestHelpers::CreateNoiseImage<ImageType>(tileSize, 1);
+  const itk::Index<2> tileCorner = {{0, 0}};
+
+  // The tile is in the source four times, so the K = 4 nearest neighbors of a patch of the tile are its copies
+  itk::Size<2> sourceSize = {{60, 48}};
+  ImageType::Pointer source = TestHelpers::CreateNoiseImage<ImageType>(sourceSize, 2);
+  const itk::Index<2> sourceCorners[4] = {{{2, 2}}, {{40, 4}}, {{6, 28}}, {{38, 30}}};
+  for(unsigned int copyId = 0; copyId < 4; ++copyId)
+  {
+    TestHelpers::CopyBlock<ImageType>(tile, tileCorner, source, itk::ImageRegion<2>(sourceCorners[copyId], tileSize));
+  }
 
-  GeneralizedPatchMatch<ImageType> patchMatch;
-  patchMatch.SetImage(imageReader->GetOutput());
-  patchMatch.SetPatchRadius(3);
+  itk::Size<2> targetSize = {{40, 30}};
+  ImageType::Pointer target = TestHelpers::CreateNoiseImage<ImageType>(targetSize, 3);
+  itk::Index<2> targetCorner = {{12, 8}};
+  TestHelpers::CopyBlock<ImageType>(tile, tileCorner, target, itk::ImageRegion<2>(targetCorner, tileSize));
 
-  patchMatch.SetPatchDistanceFunctor(patchDistanceFunctor);
+  KNNFieldType knnField;
+  ComputeKNNField(source, target, patchRadius, k, 1, knnField);
 
-  patchMatch.SetTargetMask(targetMask);
-  patchMatch.SetSourceMask(sourceMask);
-  patchMatch.SetIterations(10);
+  if(!CheckMatches(knnField, source, target, patchRadius))
+  {
+    return EXIT_FAILURE;
+  }
 
-  patchMatch.Compute();
+  // Count the patches of the tile in the target whose K matches are all exact
+  itk::ImageRegion<2> tileRegion(targetCorner, tileSize);
+  std::vector<itk::Index<2> > tilePixels =
+      PatchMatchHelpers::GetAllPixelIndices(ITKHelpers::GetInternalRegion(tileRegion, patchRadius));
+  unsigned int numberOfExactPixels = 0;
+  std::vector<Match> matches;
+  for(size_t pixelId = 0; pixelId < tilePixels.size(); ++pixelId)
+  {
+    knnField.GetSortedMatches(tilePixels[pixelId], matches);
+    if(matches.back().GetScore() == 0.0f)
+    {
+      numberOfExactPixels++;
+    }
+  }
 
-  PatchMatch<ImageType>::CoordinateImageType::Pointer output = PatchMatch<ImageType>::CoordinateImageType::New();
+  std::cout << numberOfExactPixels << " of " << tilePixels.size() << " patches of the tile have all "
+            << k << " copies as matches." << std::endl;
+  if(numberOfExactPixels < 0.95 * tilePixels.size())
+  {
+    std::cerr << "Too few patches of the tile found all of their copies" << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  patchMatch.GetPatchCentersImage(patchMatch.GetOutput(), output.GetPointer());
+  // The wavefront propagation and the per block random streams make the result independent of the threads
+  KNNFieldType parallelKNNField;
+  ComputeKNNField(source, target, patchRadius, k, 3, parallelKNNField);
 
-  typedef itk::ImageFileWriter<PatchMatch<ImageType>::CoordinateImageType> WriterType;
-  WriterType::Pointer writer = WriterType::New();
-  writer->SetFileName(outputFilename);
-  writer->SetInput(output);
-  writer->Update();
+  std::vector<itk::Index<2> > targetPixels = PatchMatchHelpers::GetAllPixelIndices(target->GetLargestPossibleRegion());
+  std::vector<Match> parallelMatches;
+  for(size_t pixelId = 0; pixelId < targetPixels.size(); ++pixelId)
+  {
+    knnField.GetSortedMatches(targetPixels[pixelId], matches);
+    parallelKNNField.GetSortedMatches(targetPixels[pixelId], parallelMatches);
+    bool identical = matches.size() == parallelMatches.size();
+    for(size_t matchId = 0; identical && matchId < matches.size(); ++matchId)
+    {
+      identical = matches[matchId].GetCenter(targetPixels[pixelId]) == parallelMatches[matchId].GetCenter(targetPixels[pixelId]) &&
+                  matches[matchId].GetScore() == parallelMatches[matchId].GetScore();
+    }
+
+    if(!identical)
+    {
+      std::cerr << "The matches of " << targetPixels[pixelId] << " depend on the number of threads" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,159 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef TestHelpers_H
+#define TestHelpers_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Custom
+#include "NNField.h"
+#include "PatchMatch.h"
+#include "PatchMatchHelpers.h"
+#include "Propagator.h"
+#include "RandomSearch.h"
+#include "SSDKernels.h"
+#include "ThreadPool.h"
+#include "VectorizedSSD.h"
+
+/** Image and PatchMatch fixtures that are shared by the tests. */
+namespace TestHelpers
+{
+
+/** Create an image of noise (with components from 0 to 255) over 'region'. TImage can be an image of
+  * scalars or of fixed length vectors of any dimension. Images with the same 'seed' are the same. */
+template <typename TImage>
+typename TImage::Pointer CreateNoiseImage(const itk::ImageRegion<TImage::ImageDimension>& region,
+                                          const unsigned int seed)
+{
+  typedef typename SSDKernels::PixelTraits<typename TImage::PixelType>::ComponentType ComponentType;
+  const unsigned int numberOfComponents = SSDKernels::PixelTraits<typename TImage::PixelType>::NumberOfComponents;
+
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions(region);
+  image->Allocate();
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(seed, 0, 0);
+
+  // The components are drawn in the order of the buffer: pixel by pixel in raster order
+  ComponentType* buffer = reinterpret_cast<ComponentType*>(image->GetBufferPointer());
+  for(size_t i = 0; i < region.GetNumberOfPixels() * numberOfComponents; ++i)
+  {
+    buffer[i] = static_cast<ComponentType>(PatchMatchHelpers::RandomInt(0, 255, randomGenerator));
+  }
+
+  return image;
+}
+
+/** Create an image of noise of 'size' with its corner at the origin. */
+template <typename TImage>
+typename TImage::Pointer CreateNoiseImage(const itk::Size<TImage::ImageDimension>& size, const unsigned int seed)
+{
+  itk::Index<TImage::ImageDimension> corner;
+  corner.Fill(0);
+  return CreateNoiseImage<TImage>(itk::ImageRegion<TImage::ImageDimension>(corner, size), seed);
+}
+
+/** Copy the block of 'source' at 'sourceCorner' to 'blockRegion' of 'target'. */
+template <typename TImage>
+void CopyBlock(const TImage* const source, const itk::Index<TImage::ImageDimension>& sourceCorner,
+               TImage* const target, const itk::ImageRegion<TImage::ImageDimension>& blockRegion)
+{
+  itk::ImageRegionIteratorWithIndex<TImage> targetIterator(target, blockRegion);
+  while(!targetIterator.IsAtEnd())
+  {
+    targetIterator.Set(source->GetPixel(sourceCorner + (targetIterator.GetIndex() - blockRegion.GetIndex())));
+    ++targetIterator;
+  }
+}
+
+/** A PatchMatch that matches the patches of 'target' to those of 'source' (the same image to match an
+  * image to itself) with VectorizedSSD, and its functors. Every source patch is a valid match, the random
+  * search is not randomized (so runs can be compared) and nothing is printed. Tests change the rest
+  * through the members. The PatchMatch points to the functors, so a fixture cannot be copied. */
+template <typename TImage, typename TNNField = NNFieldType>
+struct PatchMatchFixture
+{
+  typedef VectorizedSSD<TImage> PatchDistanceFunctorType;
+  typedef Propagator<PatchDistanceFunctorType, TNNField> PropagatorType;
+  typedef RandomSearch<TImage, PatchDistanceFunctorType, TNNField> RandomSearchType;
+  typedef PatchMatch<TImage, PropagatorType, RandomSearchType> PatchMatchType;
+
+  PatchMatchFixture(TImage* const source, TImage* const target, const unsigned int patchRadius,
+                    ThreadPool* const threadPool = nullptr)
+  {
+    this->ValidPatchCentersImage = itk::Image<bool, 2>::New();
+    this->ValidPatchCentersImage->SetRegions(source->GetLargestPossibleRegion());
+    this->ValidPatchCentersImage->Allocate();
+    this->ValidPatchCentersImage->FillBuffer(true);
+
+    this->PatchDistanceFunctor.SetSourceImage(source);
+    this->PatchDistanceFunctor.SetTargetImage(target);
+
+    this->PropagationFunctor.SetPatchDistanceFunctor(&this->PatchDistanceFunctor);
+    this->PropagationFunctor.SetPatchRadius(patchRadius);
+    this->PropagationFunctor.SetThreadPool(threadPool);
+
+    this->RandomSearchFunctor.SetPatchDistanceFunctor(&this->PatchDistanceFunctor);
+    this->RandomSearchFunctor.SetPatchRadius(patchRadius);
+    this->RandomSearchFunctor.SetSourceImage(source);
+    this->RandomSearchFunctor.SetTargetImage(target);
+    this->RandomSearchFunctor.SetThreadPool(threadPool);
+    this->RandomSearchFunctor.SetRandom(false);
+
+    this->Engine.SetPatchRadius(patchRadius);
+    this->Engine.SetPropagationFunctor(&this->PropagationFunctor);
+    this->Engine.SetRandomSearchFunctor(&this->RandomSearchFunctor);
+    this->Engine.SetSourceImage(source);
+    this->Engine.SetTargetImage(target);
+    this->Engine.SetValidPatchCentersImage(this->ValidPatchCentersImage);
+    this->Engine.SetThreadPool(threadPool);
+    this->Engine.SetVerbose(false);
+  }
+
+  PatchMatchFixture(const PatchMatchFixture&) = delete;
+  PatchMatchFixture& operator=(const PatchMatchFixture&) = delete;
+
+  itk::Image<bool, 2>::Pointer ValidPatchCentersImage;
+
+  PatchDistanceFunctorType PatchDistanceFunctor;
+
+  PropagatorType PropagationFunctor;
+
+  RandomSearchType RandomSearchFunctor;
+
+  PatchMatchType Engine;
+};
+
+/** Compute the NN field of 'target' in 'source' with a PatchMatchFixture, after 'configure(fixture)'
+  * has set what the test needs (the iterations, tiles, functor options, ...). */
+template <typename TImage, typename TNNField = NNFieldType, typename TConfigure>
+typename TNNField::Pointer ComputeNNField(TImage* const source, TImage* const target, const unsigned int patchRadius,
+                                          ThreadPool* const threadPool, TConfigure configure)
+{
+  PatchMatchFixture<TImage, TNNField> fixture(source, target, patchRadius, threadPool);
+  configure(fixture);
+  fixture.Engine.Compute();
+  return fixture.Engine.GetNNField();
+}
+
+} // end TestHelpers namespace
+
+#endif
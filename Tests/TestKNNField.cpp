@@ -0,0 +1,141 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that a KNNField keeps the K best distinct matches of every pixel, by adding
+  * random candidates (many of them more than once) and comparing the result to a sorted list of
+  * the distinct candidates. */
+
+// STL
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// ITK
+#include "itkImageRegion.h"
+
+// Custom
+#include "CompactMatch.h"
+#include "KNNField.h"
+#include "Match.h"
+#include "PatchMatchHelpers.h"
+
+/** The score of the patch at 'center' for 'pixel'. It only depends on the two, like a patch distance,
+  * and is different for every center of a pixel. */
+float GetScore(const itk::Index<2>& pixel, const itk::Index<2>& center)
+{
+  return static_cast<float>((center[0] * 7 + center[1] * 131 + pixel[0] * 17 + pixel[1] * 3) % 1009);
+}
+
+/** Add random candidates to a field of 'k' matches of type TMatch and compare it to the reference. */
+template <typename TMatch>
+bool CheckKNNField(const unsigned int k)
+{
+  const unsigned int patchRadius = 2;
+  const unsigned int numberOfCandidates = 60;
+
+  itk::Index<2> corner = {{3, 5}};
+  itk::Size<2> size = {{9, 7}};
+  itk::ImageRegion<2> region(corner, size);
+
+  KNNField<TMatch> knnField;
+
+  // The second round reuses the buffer of the first one
+  for(unsigned int round = 0; round < 2; ++round)
+  {
+    knnField.SetRegion(region, k);
+
+    PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(round, 0, 0);
+
+    for(itk::SizeValueType pixelId = 0; pixelId < region.GetNumberOfPixels(); ++pixelId)
+    {
+      itk::Index<2> pixel = {{corner[0] + static_cast<itk::IndexValueType>(pixelId % size[0]),
+                              corner[1] + static_cast<itk::IndexValueType>(pixelId / size[0])}};
+
+      // The candidates are drawn from a small area, so that many of them are added more than once
+      std::map<float, itk::Index<2> > distinctCandidates;
+      for(unsigned int candidateId = 0; candidateId < numberOfCandidates; ++candidateId)
+      {
+        itk::Index<2> center = {{PatchMatchHelpers::RandomInt(0, 5, randomGenerator),
+                                 PatchMatchHelpers::RandomInt(0, 5, randomGenerator)}};
+
+        TMatch match;
+        match.SetCenter(pixel, center, patchRadius);
+        match.SetScore(GetScore(pixel, center));
+
+        float worstScore = knnField.GetWorstScore(pixel);
+        bool isNew = distinctCandidates.find(match.GetScore()) == distinctCandidates.end();
+        distinctCandidates[match.GetScore()] = center;
+
+        // A new candidate is added exactly if it is better than the worst of K matches
+        bool added = knnField.AddMatch(pixel, match);
+        if(added != (isNew && match.GetScore() < worstScore))
+        {
+          std::cerr << "The candidate " << center << " of " << pixel << " was " << (added ? "" : "not ")
+                    << "added" << std::endl;
+          return false;
+        }
+      }
+
+      std::vector<TMatch> sortedMatches;
+      knnField.GetSortedMatches(pixel, sortedMatches);
+
+      size_t expectedNumberOfMatches = std::min<size_t>(k, distinctCandidates.size());
+      if(sortedMatches.size() != expectedNumberOfMatches || knnField.GetNumberOfMatches(pixel) != expectedNumberOfMatches)
+      {
+        std::cerr << pixel << " has " << sortedMatches.size() << " matches instead of " << expectedNumberOfMatches << std::endl;
+        return false;
+      }
+
+      typename std::map<float, itk::Index<2> >::const_iterator expected = distinctCandidates.begin();
+      for(size_t matchId = 0; matchId < sortedMatches.size(); ++matchId, ++expected)
+      {
+        if(sortedMatches[matchId].GetScore() != expected->first || sortedMatches[matchId].GetCenter(pixel) != expected->second)
+        {
+          std::cerr << "Match " << matchId << " of " << pixel << " is not the candidate at " << expected->second << std::endl;
+          return false;
+        }
+      }
+
+      if(knnField.GetBestMatch(pixel).GetScore() != sortedMatches[0].GetScore())
+      {
+        std::cerr << "The best match of " << pixel << " is wrong" << std::endl;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int main(int, char*[])
+{
+  const unsigned int ks[3] = {1, 4, 16};
+  for(unsigned int kId = 0; kId < 3; ++kId)
+  {
+    if(!CheckKNNField<Match>(ks[kId]) || !CheckKNNField<CompactMatch<int16_t> >(ks[kId]))
+    {
+      std::cerr << "The field of " << ks[kId] << " matches per pixel is wrong" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "KNNField passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that NN field files keep the matches and scores of every type of NN field, that
+  * a compact field can be used and modified in place, and that files of another format are rejected. */
+
+// STL
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Custom
+#include "NNField.h"
+#include "NNFieldFile.h"
+#include "PatchMatchHelpers.h"
+
+/** Check that 'nnField' has the region, match centers and scores of 'expected'. */
+template <typename TNNField>
+bool Compare(const NNFieldType* const expected, const TNNField* const nnField, const std::string& name)
+{
+  if(nnField->GetLargestPossibleRegion() != expected->GetLargestPossibleRegion())
+  {
+    std::cerr << name << ": the region is " << nnField->GetLargestPossibleRegion() << std::endl;
+    return false;
+  }
+
+  itk::ImageRegionConstIteratorWithIndex<NNFieldType> expectedIterator(expected, expected->GetLargestPossibleRegion());
+  while(!expectedIterator.IsAtEnd())
+  {
+    const itk::Index<2>& pixel = expectedIterator.GetIndex();
+    const typename TNNField::PixelType& match = nnField->GetPixel(pixel);
+    if(match.GetCenter(pixel) != expectedIterator.Get().GetCenter(pixel) ||
+       match.GetScore() != expectedIterator.Get().GetScore())
+    {
+      std::cerr << name << ": the match of " << pixel << " is " << match.GetCenter(pixel) << " with a score of "
+                << match.GetScore() << std::endl;
+      return false;
+    }
+    ++expectedIterator;
+  }
+
+  return true;
+}
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+  const std::string fileName = "TestNNFieldFile.nnf";
+
+  // A field of random matches whose region does not start at the origin
+  itk::Index<2> corner = {{5, 7}};
+  itk::Size<2> size = {{40, 30}};
+  itk::ImageRegion<2> region(corner, size);
+
+  NNFieldType::Pointer nnField = NNFieldType::New();
+  nnField->SetRegions(region);
+  nnField->Allocate();
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(0, 0, 0);
+
+  itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, region);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    Match match;
+    match.SetCenter(nnFieldIterator.GetIndex(), PatchMatchHelpers::GetRandomPixelInRegion(region, randomGenerator),
+                    patchRadius);
+    int score = PatchMatchHelpers::RandomInt(-1, 100000, randomGenerator);
+    match.SetScore(score < 0 ? std::numeric_limits<float>::infinity() : score / 7.0f);
+    nnFieldIterator.Set(match);
+    ++nnFieldIterator;
+  }
+
+  NNFieldFile::Write(nnField.GetPointer(), patchRadius, fileName);
+
+  // Every type of field reads back the same matches and scores
+  NNFieldType::Pointer readNNField = NNFieldType::New();
+  if(NNFieldFile::Read(fileName, readNNField.GetPointer()) != patchRadius)
+  {
+    std::cerr << "The patch radius was not kept" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  CompactNNFieldType::Pointer compactNNField = CompactNNFieldType::New();
+  NNFieldFile::Read(fileName, compactNNField.GetPointer());
+
+  LargeCompactNNFieldType::Pointer largeCompactNNField = LargeCompactNNFieldType::New();
+  NNFieldFile::Read(fileName, largeCompactNNField.GetPointer());
+
+  if(!Compare(nnField.GetPointer(), readNNField.GetPointer(), "NNFieldType") ||
+     !Compare(nnField.GetPointer(), compactNNField.GetPointer(), "CompactNNFieldType") ||
+     !Compare(nnField.GetPointer(), largeCompactNNField.GetPointer(), "LargeCompactNNFieldType"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The matches of the full regions of NNFieldType keep their size
+  if(readNNField->GetPixel(corner).GetRegion().GetSize()[0] != 2 * patchRadius + 1)
+  {
+    std::cerr << "The matches do not have the patch radius of the file" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // A compact field is written in one copy and used in place
+  NNFieldFile::Write(largeCompactNNField.GetPointer(), patchRadius, fileName);
+  {
+    NNFieldFile file;
+    file.Open(fileName, MappingModeEnum::READ_WRITE);
+    LargeCompactNNFieldType::Pointer mappedNNField = file.GetNNField();
+    if(mappedNNField->GetBufferPointer() != file.GetMatches().GetBufferPointer() ||
+       !Compare(nnField.GetPointer(), mappedNNField.GetPointer(), "Mapped LargeCompactNNFieldType"))
+    {
+      std::cerr << "The mapped field is not the matches of the file" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    NNFieldFile::MatchType match;
+    match.SetCenter(corner, corner, patchRadius);
+    match.SetScore(1.5f);
+    mappedNNField->SetPixel(corner, match);
+  }
+
+  NNFieldFile::Read(fileName, largeCompactNNField.GetPointer());
+  if(largeCompactNNField->GetPixel(corner).GetCenter(corner) != corner ||
+     largeCompactNNField->GetPixel(corner).GetScore() != 1.5f)
+  {
+    std::cerr << "A match that was set in place was not written to the file" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // A file of another format is rejected
+  {
+    std::ofstream otherFile(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    otherFile << "This is not an NN field file, but it is longer than the header of one.............";
+  }
+
+  bool rejected = false;
+  try
+  {
+    NNFieldFile::Read(fileName, readNNField.GetPointer());
+  }
+  catch(const std::runtime_error&)
+  {
+    rejected = true;
+  }
+
+  std::remove(fileName.c_str());
+
+  if(!rejected)
+  {
+    std::cerr << "A file of another format was read" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "NNFieldFile passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
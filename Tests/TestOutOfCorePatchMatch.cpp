@@ -0,0 +1,211 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that OutOfCorePatchMatch finds the exact matches of the right half of an image,
+  * which is a copy of the left half, with a source tile cache that holds only a few tiles, and that the
+  * result does not depend on the number of threads or on the cache capacity. */
+
+// STL
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "MappedImage.h"
+#include "OutOfCorePatchMatch.h"
+#include "PatchMatchHelpers.h"
+#include "VectorizedSSD.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+  const itk::IndexValueType halfWidth = 75;
+
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{2 * halfWidth, 110}};
+  itk::ImageRegion<2> imageRegion(corner, size);
+
+  // The image is noise on the left and a copy of the left half on the right. The left half is the
+  // source and the right half is the target.
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(imageRegion);
+  image->Allocate();
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(0, 0, 0);
+
+  {
+    MappedImage<ImageType::PixelType> imageFile;
+    imageFile.Create("TestOutOfCorePatchMatch_image.raw", size);
+    MappedImage<unsigned char> validPatchCentersFile;
+    validPatchCentersFile.Create("TestOutOfCorePatchMatch_valid.raw", size);
+    MappedImage<unsigned char> targetPixelsFile;
+    targetPixelsFile.Create("TestOutOfCorePatchMatch_target.raw", size);
+
+    itk::ImageRegionIteratorWithIndex<ImageType> imageIterator(image, imageRegion);
+    while(!imageIterator.IsAtEnd())
+    {
+      itk::Index<2> pixel = imageIterator.GetIndex();
+      ImageType::PixelType value;
+      if(pixel[0] < halfWidth)
+      {
+        for(unsigned int component = 0; component < 3; ++component)
+        {
+          value[component] = static_cast<unsigned char>(PatchMatchHelpers::RandomInt(0, 255, randomGenerator));
+        }
+      }
+      else
+      {
+        itk::Index<2> copiedPixel = {{pixel[0] - halfWidth, pixel[1]}};
+        value = image->GetPixel(copiedPixel);
+      }
+      imageIterator.Set(value);
+      imageFile.SetPixel(pixel, value);
+      validPatchCentersFile.SetPixel(pixel, pixel[0] < halfWidth);
+      targetPixelsFile.SetPixel(pixel, pixel[0] >= halfWidth);
+      ++imageIterator;
+    }
+  }
+
+  typedef OutOfCorePatchMatch<ImageType> OutOfCorePatchMatchType;
+  OutOfCorePatchMatchType patchMatch;
+  patchMatch.SetImageFile("TestOutOfCorePatchMatch_image.raw", size);
+  patchMatch.SetValidPatchCentersFile("TestOutOfCorePatchMatch_valid.raw");
+  patchMatch.SetTargetPixelsFile("TestOutOfCorePatchMatch_target.raw");
+  patchMatch.SetNNFieldFile("TestOutOfCorePatchMatch_nnfield.nnf");
+  patchMatch.SetPatchRadius(patchRadius);
+  patchMatch.SetIterations(5);
+  patchMatch.SetTileSize(32);
+  patchMatch.SetSourceTileSize(24);
+  patchMatch.SetSourceCacheCapacity(4);
+  patchMatch.SetRandom(false);
+  patchMatch.SetVerbose(false);
+
+  ThreadPool threadPool(3);
+  patchMatch.SetThreadPool(&threadPool);
+
+  patchMatch.Compute();
+
+  if(patchMatch.GetSourceTileCache().GetNumberOfCachedTiles() > 4)
+  {
+    std::cerr << "The source tile cache holds more tiles than its capacity" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(imageRegion, patchRadius);
+
+  VectorizedSSD<ImageType> patchDistanceFunctor;
+  patchDistanceFunctor.SetImage(image);
+
+  // Every target pixel has to have a valid match with the correct score, and the exact copies have to be found
+  const MappedImage<OutOfCorePatchMatchType::MatchType>& nnField = patchMatch.GetNNField().GetMatches();
+  unsigned int numberOfTargetPixels = 0;
+  unsigned int numberOfExactMatches = 0;
+  itk::ImageRegionIteratorWithIndex<ImageType> targetIterator(image, internalRegion);
+  while(!targetIterator.IsAtEnd())
+  {
+    itk::Index<2> targetPixel = targetIterator.GetIndex();
+    const OutOfCorePatchMatchType::MatchType& match = nnField.GetPixel(targetPixel);
+    if(targetPixel[0] < halfWidth)
+    {
+      if(std::isfinite(match.GetScore()))
+      {
+        std::cerr << targetPixel << " is not a target pixel but has a match" << std::endl;
+        return EXIT_FAILURE;
+      }
+      ++targetIterator;
+      continue;
+    }
+
+    numberOfTargetPixels++;
+
+    itk::Index<2> matchCenter = match.GetCenter(targetPixel);
+    if(!internalRegion.IsInside(matchCenter) || matchCenter[0] >= halfWidth)
+    {
+      std::cerr << "The match " << matchCenter << " of " << targetPixel << " is not a valid patch center" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    float distance = patchDistanceFunctor.Distance(match.GetRegion(targetPixel, patchRadius),
+                                                   ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, patchRadius));
+    if(match.GetScore() != distance)
+    {
+      std::cerr << "The score of " << targetPixel << " is " << match.GetScore() << " but should be " << distance << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if(distance == 0)
+    {
+      numberOfExactMatches++;
+    }
+
+    ++targetIterator;
+  }
+
+  std::cout << numberOfExactMatches << " of " << numberOfTargetPixels << " target pixels have an exact match." << std::endl;
+  if(numberOfExactMatches < 0.9 * numberOfTargetPixels)
+  {
+    std::cerr << "Too few exact matches were found" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // A single thread with a cache that holds every tile computes the same NN field
+  std::vector<OutOfCorePatchMatchType::MatchType> matches;
+  for(itk::IndexValueType y = 0; y < static_cast<itk::IndexValueType>(size[1]); ++y)
+  {
+    for(itk::IndexValueType x = 0; x < static_cast<itk::IndexValueType>(size[0]); ++x)
+    {
+      itk::Index<2> pixel = {{x, y}};
+      matches.push_back(nnField.GetPixel(pixel));
+    }
+  }
+
+  patchMatch.SetThreadPool(nullptr);
+  patchMatch.SetSourceCacheCapacity(1000);
+  patchMatch.Compute();
+
+  for(size_t pixelId = 0; pixelId < matches.size(); ++pixelId)
+  {
+    itk::Index<2> pixel = {{static_cast<itk::IndexValueType>(pixelId % size[0]),
+                            static_cast<itk::IndexValueType>(pixelId / size[0])}};
+    if(!(patchMatch.GetNNField().GetMatches().GetPixel(pixel) == matches[pixelId]))
+    {
+      std::cerr << "The match of " << pixel << " depends on the number of threads or the cache capacity" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::remove("TestOutOfCorePatchMatch_image.raw");
+  std::remove("TestOutOfCorePatchMatch_valid.raw");
+  std::remove("TestOutOfCorePatchMatch_target.raw");
+  std::remove("TestOutOfCorePatchMatch_nnfield.nnf");
+
+  std::cout << "OutOfCorePatchMatch passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks the pyramid downsampling (also of vector images), and that the coarse to
+  * fine NN field of a periodic image is made of fully defined, correctly scored and good matches. */
+
+// STL
+#include <cmath>
+#include <iostream>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkVectorImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "PatchMatchHelpers.h"
+#include "PyramidPatchMatch.h"
+#include "VectorizedSSD.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{171, 129}};
+  itk::ImageRegion<2> imageRegion(corner, size);
+
+  // A pattern that repeats every 16 columns, so every patch has exact matches elsewhere
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(imageRegion);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> imageIterator(image, imageRegion);
+  while(!imageIterator.IsAtEnd())
+  {
+    itk::Index<2> index = imageIterator.GetIndex();
+    ImageType::PixelType pixel;
+    pixel[0] = static_cast<unsigned char>(127 + 120 * std::sin(index[0] * 0.3926990817 + index[1] * 0.05));
+    pixel[1] = static_cast<unsigned char>((index[0] % 16) * 15);
+    pixel[2] = static_cast<unsigned char>(index[1]);
+    imageIterator.Set(pixel);
+    ++imageIterator;
+  }
+
+  // Downsampling has to give a half size image that keeps constant regions constant
+  ImageType::Pointer constantImage = ImageType::New();
+  constantImage->SetRegions(imageRegion);
+  constantImage->Allocate();
+  ImageType::PixelType constantPixel;
+  constantPixel.Fill(77);
+  constantImage->FillBuffer(constantPixel);
+
+  ImageType::Pointer downsampledImage = ImageType::New();
+  PatchMatchHelpers::DownsampleImage(constantImage.GetPointer(), downsampledImage.GetPointer());
+
+  if(downsampledImage->GetLargestPossibleRegion().GetSize()[0] != 86 ||
+     downsampledImage->GetLargestPossibleRegion().GetSize()[1] != 65)
+  {
+    std::cerr << "Downsampled size is " << downsampledImage->GetLargestPossibleRegion().GetSize()
+              << " but should be [86, 65]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  itk::ImageRegionIteratorWithIndex<ImageType> downsampledIterator(downsampledImage,
+                                                                   downsampledImage->GetLargestPossibleRegion());
+  while(!downsampledIterator.IsAtEnd())
+  {
+    if(downsampledIterator.Get() != constantPixel)
+    {
+      std::cerr << "Downsampled constant image is " << downsampledIterator.Get()
+                << " at " << downsampledIterator.GetIndex() << std::endl;
+      return EXIT_FAILURE;
+    }
+    ++downsampledIterator;
+  }
+
+  // The number of components of a vector image is only known at run time, and has to be kept
+  typedef itk::VectorImage<unsigned char, 2> VectorImageType;
+  const unsigned int numberOfComponents = 4;
+  VectorImageType::Pointer constantVectorImage = VectorImageType::New();
+  constantVectorImage->SetRegions(imageRegion);
+  constantVectorImage->SetNumberOfComponentsPerPixel(numberOfComponents);
+  constantVectorImage->Allocate();
+  VectorImageType::PixelType constantVectorPixel(numberOfComponents);
+  constantVectorPixel.Fill(77);
+  constantVectorImage->FillBuffer(constantVectorPixel);
+
+  VectorImageType::Pointer downsampledVectorImage = VectorImageType::New();
+  PatchMatchHelpers::DownsampleImage(constantVectorImage.GetPointer(), downsampledVectorImage.GetPointer());
+
+  if(downsampledVectorImage->GetNumberOfComponentsPerPixel() != numberOfComponents)
+  {
+    std::cerr << "Downsampled vector image has " << downsampledVectorImage->GetNumberOfComponentsPerPixel()
+              << " components but should have " << numberOfComponents << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  itk::ImageRegionIteratorWithIndex<VectorImageType> downsampledVectorIterator(downsampledVectorImage,
+                                                                               downsampledVectorImage->GetLargestPossibleRegion());
+  while(!downsampledVectorIterator.IsAtEnd())
+  {
+    if(downsampledVectorIterator.Get() != constantVectorPixel)
+    {
+      std::cerr << "Downsampled constant vector image is " << downsampledVectorIterator.Get()
+                << " at " << downsampledVectorIterator.GetIndex() << std::endl;
+      return EXIT_FAILURE;
+    }
+    ++downsampledVectorIterator;
+  }
+
+  // Only the left half of the image can be matched to
+  typedef itk::Image<bool, 2> BoolImageType;
+  BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+  validPatchCentersImage->SetRegions(imageRegion);
+  validPatchCentersImage->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> validIterator(validPatchCentersImage, imageRegion);
+  while(!validIterator.IsAtEnd())
+  {
+    validIterator.Set(validIterator.GetIndex()[0] < static_cast<itk::IndexValueType>(size[0] / 2));
+    ++validIterator;
+  }
+
+  typedef VectorizedSSD<ImageType> PatchDistanceFunctorType;
+  typedef PyramidPatchMatch<ImageType, PatchDistanceFunctorType> PyramidPatchMatchType;
+
+  ThreadPool threadPool(4);
+
+  PyramidPatchMatchType pyramidPatchMatch;
+  pyramidPatchMatch.SetImage(image);
+  pyramidPatchMatch.SetValidPatchCentersImage(validPatchCentersImage);
+  pyramidPatchMatch.SetPatchRadius(patchRadius);
+  pyramidPatchMatch.SetMinimumLevelSize(30);
+  pyramidPatchMatch.SetThreadPool(&threadPool);
+  pyramidPatchMatch.SetIncremental(true);
+  pyramidPatchMatch.SetRandom(false);
+  pyramidPatchMatch.Compute();
+
+  if(pyramidPatchMatch.GetNumberOfComputedLevels() != 3)
+  {
+    std::cerr << "Computed " << pyramidPatchMatch.GetNumberOfComputedLevels()
+              << " levels but should have computed 3" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  PatchDistanceFunctorType patchDistanceFunctor;
+  patchDistanceFunctor.SetImage(image);
+
+  NNFieldType* nnField = pyramidPatchMatch.GetNNField();
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(imageRegion, patchRadius);
+
+  // A random field of this image has a mean score in the tens of thousands
+  double totalScore = 0;
+  itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(nnField, internalRegion);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    Match match = nnFieldIterator.Get();
+    itk::ImageRegion<2> targetRegion =
+      ITKHelpers::GetRegionInRadiusAroundPixel(nnFieldIterator.GetIndex(), patchRadius);
+
+    if(!internalRegion.IsInside(ITKHelpers::GetRegionCenter(match.GetRegion())))
+    {
+      std::cerr << "Match " << match.GetRegion() << " of " << nnFieldIterator.GetIndex()
+                << " is not fully inside of the image" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if(match.GetScore() != patchDistanceFunctor.Distance(match.GetRegion(), targetRegion))
+    {
+      std::cerr << "Score of " << nnFieldIterator.GetIndex() << " is " << match.GetScore()
+                << " but should be " << patchDistanceFunctor.Distance(match.GetRegion(), targetRegion) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    totalScore += match.GetScore();
+    ++nnFieldIterator;
+  }
+
+  double meanScore = totalScore / internalRegion.GetNumberOfPixels();
+  std::cout << "Mean score: " << meanScore << std::endl;
+  if(meanScore > 1000)
+  {
+    std::cerr << "Mean score is too high" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "PyramidPatchMatch passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that after an edit of the image, PatchMatch::Recompute only visits the
+  * pixels near the edit and those matched into it, and that it leaves every score of the field exact. */
+
+// STL
+#include <cmath>
+#include <iostream>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "NNField.h"
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{120, 90}};
+  itk::ImageRegion<2> imageRegion(corner, size);
+
+  // A pattern that repeats every 16 columns
+  const itk::IndexValueType period = 16;
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(imageRegion);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> imageIterator(image, imageRegion);
+  while(!imageIterator.IsAtEnd())
+  {
+    itk::Index<2> index = imageIterator.GetIndex();
+    ImageType::PixelType pixel;
+    pixel[0] = static_cast<unsigned char>(127 + 120 * std::sin(index[0] * 0.3926990817 + index[1] * 0.05));
+    pixel[1] = static_cast<unsigned char>((index[0] % period) * 15);
+    pixel[2] = static_cast<unsigned char>(index[1]);
+    imageIterator.Set(pixel);
+    ++imageIterator;
+  }
+
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(imageRegion, patchRadius);
+
+  TestHelpers::PatchMatchFixture<ImageType> fixture(image, image, patchRadius);
+
+  // Every pixel starts out matched (exactly) to the pixel one period to its right, or to its left
+  // near the right border, so that the matches of the pixels next to an edit lead into it
+  NNFieldType::Pointer initialNNField = NNFieldType::New();
+  initialNNField->SetRegions(imageRegion);
+  initialNNField->Allocate();
+  initialNNField->FillBuffer(Match());
+
+  itk::ImageRegionIteratorWithIndex<NNFieldType> initialIterator(initialNNField, internalRegion);
+  while(!initialIterator.IsAtEnd())
+  {
+    itk::Index<2> pixel = initialIterator.GetIndex();
+    itk::Index<2> matchPixel = {{pixel[0] + period, pixel[1]}};
+    if(!internalRegion.IsInside(matchPixel))
+    {
+      matchPixel[0] = pixel[0] - period;
+    }
+
+    Match match;
+    match.SetCenter(pixel, matchPixel, patchRadius);
+    match.SetScore(fixture.PatchDistanceFunctor.Distance(match.GetRegion(),
+                                                         ITKHelpers::GetRegionInRadiusAroundPixel(pixel, patchRadius)));
+    initialIterator.Set(match);
+    ++initialIterator;
+  }
+
+  fixture.Engine.SetInitialNNField(initialNNField);
+
+  itk::Size<2> editSize = {{6, 5}};
+  const unsigned long long overlappingPixels = (editSize[0] + 2 * patchRadius) * (editSize[1] + 2 * patchRadius);
+
+  // The first edit is only rescored (no iterations), the second one is also iterated on
+  const itk::IndexValueType editCornersX[] = {40, 70};
+  for(unsigned int editId = 0; editId < 2; ++editId)
+  {
+    // Paint a small rectangle of the image with a constant color
+    itk::Index<2> editCorner = {{editCornersX[editId], 40}};
+    itk::ImageRegion<2> editRegion(editCorner, editSize);
+
+    ImageType::PixelType editPixel;
+    editPixel.Fill(200);
+    itk::ImageRegionIteratorWithIndex<ImageType> editIterator(image, editRegion);
+    while(!editIterator.IsAtEnd())
+    {
+      editIterator.Set(editPixel);
+      ++editIterator;
+    }
+
+    fixture.Engine.SetIterations(editId);
+
+    std::vector<itk::ImageRegion<2> > modifiedRegions(1, editRegion);
+    fixture.Engine.Recompute(modifiedRegions);
+
+    // Besides the pixels whose patches overlap the edit, only the pixels that were matched into it are visited
+    const unsigned long long activePixels = fixture.Engine.GetLastIterationStatistics().ActivePixels;
+    if(editId > 0 && (activePixels <= overlappingPixels || activePixels > 3 * overlappingPixels))
+    {
+      std::cerr << "Recompute visited " << activePixels << " pixels for an edit that " << overlappingPixels
+                << " patches overlap" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    itk::ImageRegionIteratorWithIndex<NNFieldType> nnFieldIterator(fixture.Engine.GetNNField(), internalRegion);
+    while(!nnFieldIterator.IsAtEnd())
+    {
+      Match match = nnFieldIterator.Get();
+      itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(nnFieldIterator.GetIndex(), patchRadius);
+      float distance = fixture.PatchDistanceFunctor.Distance(match.GetRegion(), targetRegion);
+
+      if(match.GetScore() != distance)
+      {
+        std::cerr << "After edit " << editId << " the score of " << nnFieldIterator.GetIndex() << " is "
+                  << match.GetScore() << " but should be " << distance << std::endl;
+        return EXIT_FAILURE;
+      }
+      ++nnFieldIterator;
+    }
+  }
+
+  std::cout << "Recompute passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that ValidPatchCentersIndex counts and samples the same pixels
+  * as a brute force scan of the valid patch centers image. */
+
+// STL
+#include <iostream>
+#include <map>
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "ValidPatchCentersIndex.h"
+
+typedef itk::Image<bool, 2> BoolImageType;
+
+int main(int, char*[])
+{
+  itk::Index<2> corner = {{3, 5}};
+  itk::Size<2> size = {{57, 41}};
+  itk::ImageRegion<2> imageRegion(corner, size);
+
+  BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+  validPatchCentersImage->SetRegions(imageRegion);
+  validPatchCentersImage->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> imageIterator(validPatchCentersImage, imageRegion);
+  while(!imageIterator.IsAtEnd())
+  {
+    itk::Index<2> index = imageIterator.GetIndex();
+    imageIterator.Set((index[0] * 7 + index[1] * 3) % 5 == 0 && index[0] != 20);
+    ++imageIterator;
+  }
+
+  ValidPatchCentersIndex validPatchCentersIndex;
+  validPatchCentersIndex.Build(validPatchCentersImage);
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(0, 0, 0);
+
+  // Windows that are inside of, overlap and miss the image
+  std::vector<itk::ImageRegion<2> > queryRegions;
+  queryRegions.push_back(imageRegion);
+  queryRegions.push_back(ITKHelpers::GetRegionInRadiusAroundPixel(itk::Index<2>{{20, 20}}, 4));
+  queryRegions.push_back(ITKHelpers::GetRegionInRadiusAroundPixel(itk::Index<2>{{3, 5}}, 10));
+  queryRegions.push_back(ITKHelpers::GetRegionInRadiusAroundPixel(itk::Index<2>{{20, 30}}, 0));
+  queryRegions.push_back(ITKHelpers::GetRegionInRadiusAroundPixel(itk::Index<2>{{200, 200}}, 3));
+
+  for(size_t queryRegionId = 0; queryRegionId < queryRegions.size(); ++queryRegionId)
+  {
+    itk::ImageRegion<2> queryRegion = queryRegions[queryRegionId];
+
+    itk::ImageRegion<2> croppedRegion = queryRegion;
+    std::vector<itk::Index<2> > validPixels;
+    if(croppedRegion.Crop(imageRegion))
+    {
+      validPixels = ITKHelpers::GetPixelsWithValueInRegion(validPatchCentersImage.GetPointer(), croppedRegion, true);
+    }
+
+    if(validPatchCentersIndex.GetNumberOfValidPixels(queryRegion) != validPixels.size())
+    {
+      std::cerr << "Wrong number of valid pixels in " << queryRegion << ": "
+                << validPatchCentersIndex.GetNumberOfValidPixels(queryRegion) << " should be "
+                << validPixels.size() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Every sample must be one of the valid pixels, and every valid pixel should be drawn
+    std::map<std::pair<long, long>, unsigned int> numberOfDraws;
+    const unsigned int numberOfSamples = 50 * validPixels.size();
+    for(unsigned int sampleId = 0; sampleId < numberOfSamples; ++sampleId)
+    {
+      itk::Index<2> randomValidPixel;
+      if(!validPatchCentersIndex.GetRandomValidPixel(queryRegion, randomGenerator, randomValidPixel))
+      {
+        std::cerr << "No pixel was drawn from " << queryRegion << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if(!croppedRegion.IsInside(randomValidPixel) || !validPatchCentersImage->GetPixel(randomValidPixel))
+      {
+        std::cerr << "Drew invalid pixel " << randomValidPixel << " from " << queryRegion << std::endl;
+        return EXIT_FAILURE;
+      }
+      numberOfDraws[std::make_pair(randomValidPixel[0], randomValidPixel[1])]++;
+    }
+
+    if(numberOfDraws.size() != validPixels.size())
+    {
+      std::cerr << "Only " << numberOfDraws.size() << " of the " << validPixels.size()
+                << " valid pixels of " << queryRegion << " were drawn." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    itk::Index<2> randomValidPixel;
+    if(validPixels.empty() && validPatchCentersIndex.GetRandomValidPixel(queryRegion, randomGenerator, randomValidPixel))
+    {
+      std::cerr << "A pixel was drawn from " << queryRegion << ", which has no valid pixels." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "ValidPatchCentersIndex passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
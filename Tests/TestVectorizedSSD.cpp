@@ -0,0 +1,198 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks VectorizedSSD (with and without an upper bound) against a pixel by pixel
+  * sum of squared differences, for images of scalars, of fixed length vectors and itk::VectorImages. */
+
+// STL
+#include <cmath>
+#include <iostream>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkVectorImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "PatchMatchHelpers.h"
+#include "VectorizedSSD.h"
+
+/** The sum of squared differences of two patches, component by component. The components are read
+  * from the buffer, so that this works for the pixels of an itk::VectorImage too. */
+template <typename TImage>
+double ReferenceSSD(const TImage* const image, const itk::ImageRegion<2>& region1, const itk::ImageRegion<2>& region2)
+{
+  typedef typename SSDKernels::PixelTraits<typename TImage::PixelType>::ComponentType ComponentType;
+  const unsigned int numberOfComponents = image->GetNumberOfComponentsPerPixel();
+  const ComponentType* buffer = reinterpret_cast<const ComponentType*>(image->GetBufferPointer());
+
+  itk::ImageRegionConstIteratorWithIndex<TImage> iterator1(image, region1);
+  itk::ImageRegionConstIteratorWithIndex<TImage> iterator2(image, region2);
+
+  double sum = 0;
+  while(!iterator1.IsAtEnd())
+  {
+    const ComponentType* components1 = buffer + image->ComputeOffset(iterator1.GetIndex()) * numberOfComponents;
+    const ComponentType* components2 = buffer + image->ComputeOffset(iterator2.GetIndex()) * numberOfComponents;
+    for(unsigned int component = 0; component < numberOfComponents; ++component)
+    {
+      double difference = static_cast<double>(components1[component]) - static_cast<double>(components2[component]);
+      sum += difference * difference;
+    }
+    ++iterator1;
+    ++iterator2;
+  }
+  return sum;
+}
+
+/** Fill the allocated 'image' with noise and compare VectorizedSSD to ReferenceSSD on it. */
+template <typename TImage>
+bool TestImage(TImage* const image, const double maximumRelativeError)
+{
+  typedef typename SSDKernels::PixelTraits<typename TImage::PixelType>::ComponentType ComponentType;
+  const unsigned int numberOfComponents = image->GetNumberOfComponentsPerPixel();
+  const itk::ImageRegion<2> imageRegion = image->GetLargestPossibleRegion();
+
+  PatchMatchHelpers::RandomGeneratorType randomGenerator = PatchMatchHelpers::CreateRandomGenerator(0, 0, 0);
+
+  ComponentType* buffer = reinterpret_cast<ComponentType*>(image->GetBufferPointer());
+  for(size_t i = 0; i < imageRegion.GetNumberOfPixels() * numberOfComponents; ++i)
+  {
+    buffer[i] = static_cast<ComponentType>(PatchMatchHelpers::RandomInt(0, 255, randomGenerator));
+  }
+
+  VectorizedSSD<TImage> vectorizedSSD;
+  vectorizedSSD.SetImage(image);
+
+  // Cover patch widths that exercise the vector loops as well as their remainders
+  for(unsigned int patchRadius = 0; patchRadius < 16; ++patchRadius)
+  {
+    itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(imageRegion, patchRadius);
+    for(unsigned int trial = 0; trial < 20; ++trial)
+    {
+      itk::ImageRegion<2> region1 =
+        ITKHelpers::GetRegionInRadiusAroundPixel(PatchMatchHelpers::GetRandomPixelInRegion(internalRegion, randomGenerator),
+                                                 patchRadius);
+      itk::ImageRegion<2> region2 =
+        ITKHelpers::GetRegionInRadiusAroundPixel(PatchMatchHelpers::GetRandomPixelInRegion(internalRegion, randomGenerator),
+                                                 patchRadius);
+
+      double reference = ReferenceSSD(image, region1, region2);
+      double distance = vectorizedSSD.Distance(region1, region2);
+
+      if(std::fabs(distance - reference) > maximumRelativeError * std::max(1.0, reference))
+      {
+        std::cerr << "Distance between " << region1 << " and " << region2 << " with " << numberOfComponents
+                  << " components is " << distance << " but should be " << reference << std::endl;
+        return false;
+      }
+
+      // A bounded distance must be exact below the bound and at least the bound otherwise
+      float upperBound = static_cast<float>(reference * (0.5 + 0.05 * (trial % 20)));
+      float boundedDistance = vectorizedSSD.Distance(region1, region2, upperBound);
+      float fullDistance = vectorizedSSD.Distance(region1, region2);
+      if((fullDistance < upperBound && boundedDistance != fullDistance) ||
+         (fullDistance >= upperBound && boundedDistance < upperBound))
+      {
+        std::cerr << "Distance between " << region1 << " and " << region2 << " bounded by " << upperBound
+                  << " is " << boundedDistance << " but the full distance is " << fullDistance << std::endl;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/** The size of the test images. */
+const itk::Size<2> ImageSize = {{101, 67}};
+
+template <typename TImage>
+bool TestImageType(const double maximumRelativeError)
+{
+  itk::Index<2> corner = {{0, 0}};
+
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions(itk::ImageRegion<2>(corner, ImageSize));
+  image->Allocate();
+
+  return TestImage(image.GetPointer(), maximumRelativeError);
+}
+
+/** Test an itk::VectorImage with 'numberOfComponents' components per pixel. */
+template <typename TComponent>
+bool TestVectorImageType(const unsigned int numberOfComponents, const double maximumRelativeError)
+{
+  typedef itk::VectorImage<TComponent, 2> VectorImageType;
+
+  itk::Index<2> corner = {{0, 0}};
+
+  typename VectorImageType::Pointer image = VectorImageType::New();
+  image->SetRegions(itk::ImageRegion<2>(corner, ImageSize));
+  image->SetNumberOfComponentsPerPixel(numberOfComponents);
+  image->Allocate();
+
+  return TestImage(image.GetPointer(), maximumRelativeError);
+}
+
+int main(int, char*[])
+{
+  // The 8-bit kernel is exact up to the final conversion to float
+  if(!TestImageType<itk::Image<itk::CovariantVector<unsigned char, 3>, 2> >(1e-7))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if(!TestImageType<itk::Image<unsigned char, 2> >(1e-7))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if(!TestImageType<itk::Image<itk::CovariantVector<float, 3>, 2> >(1e-5))
+  {
+    return EXIT_FAILURE;
+  }
+
+  if(!TestImageType<itk::Image<float, 2> >(1e-5))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The specialised kernels (1 to 4 and powers of two up to 64 components) and the generic one (5, 12)
+  const unsigned int numbersOfComponents[] = {1, 2, 3, 4, 5, 8, 12, 16, 32, 64};
+  for(unsigned int numberOfComponents : numbersOfComponents)
+  {
+    if(!TestVectorImageType<unsigned char>(numberOfComponents, 1e-7))
+    {
+      return EXIT_FAILURE;
+    }
+
+    if(!TestVectorImageType<float>(numberOfComponents, 1e-5))
+    {
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "VectorizedSSD passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that VideoPatchMatch warm starts every frame after the first one, and that
+  * the matches carried over from the previous frame are rescored against the new one. */
+
+// STL
+#include <iostream>
+#include <vector>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Submodules
+#include "ITKHelpers/ITKHelpers.h"
+
+// Custom
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+#include "VectorizedSSD.h"
+#include "VideoPatchMatch.h"
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 3;
+
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{96, 72}};
+  itk::ImageRegion<2> imageRegion(corner, size);
+  itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(imageRegion, patchRadius);
+
+  // The right half of the image is matched to the left half
+  typedef itk::Image<bool, 2> BoolImageType;
+  BoolImageType::Pointer validPatchCentersImage = BoolImageType::New();
+  validPatchCentersImage->SetRegions(imageRegion);
+  validPatchCentersImage->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> validIterator(validPatchCentersImage, imageRegion);
+  while(!validIterator.IsAtEnd())
+  {
+    validIterator.Set(validIterator.GetIndex()[0] < static_cast<itk::IndexValueType>(size[0] / 2));
+    ++validIterator;
+  }
+
+  std::vector<itk::Index<2> > targetPixels;
+  itk::ImageRegionIteratorWithIndex<BoolImageType> targetIterator(validPatchCentersImage, internalRegion);
+  while(!targetIterator.IsAtEnd())
+  {
+    if(!targetIterator.Get())
+    {
+      targetPixels.push_back(targetIterator.GetIndex());
+    }
+    ++targetIterator;
+  }
+
+  typedef VectorizedSSD<ImageType> PatchDistanceFunctorType;
+  typedef VideoPatchMatch<ImageType, PatchDistanceFunctorType> VideoPatchMatchType;
+
+  ThreadPool threadPool(3);
+
+  VideoPatchMatchType videoPatchMatch;
+  videoPatchMatch.SetValidPatchCentersImage(validPatchCentersImage);
+  videoPatchMatch.SetTargetPixels(targetPixels);
+  videoPatchMatch.SetPatchRadius(patchRadius);
+  videoPatchMatch.SetThreadPool(&threadPool);
+  videoPatchMatch.SetFrameIterations(1);
+  videoPatchMatch.SetRandom(false);
+
+  // The frames alternate between two images, so none of the scores of a frame hold for the next one
+  const unsigned int numberOfFrames = 4;
+  for(unsigned int frameId = 0; frameId < numberOfFrames; ++frameId)
+  {
+    ImageType::Pointer frame = TestHelpers::CreateNoiseImage<ImageType>(imageRegion, frameId % 2);
+    videoPatchMatch.ComputeFrame(frame);
+
+    if(videoPatchMatch.GetLastFrameWasWarmStarted() != (frameId > 0))
+    {
+      std::cerr << "Frame " << frameId << " was " << (videoPatchMatch.GetLastFrameWasWarmStarted() ? "" : "not ")
+                << "warm started" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    PatchDistanceFunctorType patchDistanceFunctor;
+    patchDistanceFunctor.SetImage(frame);
+
+    for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
+    {
+      const itk::Index<2>& targetPixel = targetPixels[targetPixelId];
+      Match match = videoPatchMatch.GetNNField()->GetPixel(targetPixel);
+      itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(targetPixel, patchRadius);
+      float distance = patchDistanceFunctor.Distance(match.GetRegion(), targetRegion);
+
+      if(match.GetScore() != distance)
+      {
+        std::cerr << "In frame " << frameId << " the score of " << targetPixel << " is "
+                  << match.GetScore() << " but should be " << distance << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // After a reset, the next frame starts over
+  videoPatchMatch.Reset();
+  ImageType::Pointer frame = TestHelpers::CreateNoiseImage<ImageType>(imageRegion, 0);
+  videoPatchMatch.ComputeFrame(frame);
+  if(videoPatchMatch.GetLastFrameWasWarmStarted())
+  {
+    std::cerr << "The frame after Reset() was warm started" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "VideoPatchMatch passed." << std::endl;
+
+  return EXIT_SUCCESS;
+}
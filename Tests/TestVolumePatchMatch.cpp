@@ -0,0 +1,157 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+/** This program checks that VolumePatchMatch finds a cube of a source volume that was copied into a
+  * target volume, that the scores of the matches are the voxel by voxel sums of squared differences,
+  * and that the result does not depend on the number of threads. */
+
+// STL
+#include <iostream>
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// Custom
+#include "PatchMatchHelpers.h"
+#include "TestHelpers.h"
+#include "ThreadPool.h"
+#include "VectorizedSSD.h"
+#include "VolumePatchMatch.h"
+
+typedef itk::Image<unsigned char, 3> VolumeType;
+typedef VolumePatchMatch<VolumeType> VolumePatchMatchType;
+typedef VolumePatchMatchType::NNFieldType VolumeNNFieldType;
+
+/** The sum of squared differences of two patches, voxel by voxel. */
+float ReferenceSSD(const VolumeType* const source, const itk::ImageRegion<3>& sourceRegion,
+                   const VolumeType* const target, const itk::ImageRegion<3>& targetRegion)
+{
+  itk::ImageRegionConstIteratorWithIndex<VolumeType> sourceIterator(source, sourceRegion);
+  itk::ImageRegionConstIteratorWithIndex<VolumeType> targetIterator(target, targetRegion);
+
+  double sum = 0;
+  while(!sourceIterator.IsAtEnd())
+  {
+    double difference = static_cast<double>(sourceIterator.Get()) - static_cast<double>(targetIterator.Get());
+    sum += difference * difference;
+    ++sourceIterator;
+    ++targetIterator;
+  }
+
+  return static_cast<float>(sum);
+}
+
+/** Compute the NN field of 'target' in 'source' on a pool of 'numberOfThreads' threads. */
+VolumeNNFieldType::Pointer ComputeNNField(VolumeType* const source, VolumeType* const target, const unsigned int patchRadius,
+                                          const unsigned int numberOfThreads)
+{
+  VectorizedSSD<VolumeType> patchDistanceFunctor;
+  patchDistanceFunctor.SetSourceImage(source);
+  patchDistanceFunctor.SetTargetImage(target);
+
+  ThreadPool threadPool(numberOfThreads);
+
+  VolumePatchMatchType patchMatch;
+  patchMatch.SetSourceImage(source);
+  patchMatch.SetTargetImage(target);
+  patchMatch.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  patchMatch.SetPatchRadius(patchRadius);
+  patchMatch.SetIterations(5);
+  patchMatch.SetBlockSize(8);
+  patchMatch.SetThreadPool(&threadPool);
+  patchMatch.SetRandom(false);
+  patchMatch.Compute();
+
+  return patchMatch.GetOutput();
+}
+
+int main(int, char*[])
+{
+  const unsigned int patchRadius = 2;
+
+  itk::Size<3> sourceSize = {{32, 28, 24}};
+  VolumeType::Pointer source = TestHelpers::CreateNoiseImage<VolumeType>(sourceSize, 1);
+
+  itk::Size<3> targetSize = {{24, 20, 18}};
+  VolumeType::Pointer target = TestHelpers::CreateNoiseImage<VolumeType>(targetSize, 2);
+
+  // Copy a cube of the source into the target
+  itk::Size<3> cubeSize = {{12, 12, 12}};
+  itk::Index<3> sourceCubeCorner = {{14, 10, 8}};
+  itk::Index<3> targetCubeCorner = {{6, 4, 3}};
+  itk::ImageRegion<3> targetCube(targetCubeCorner, cubeSize);
+  TestHelpers::CopyBlock<VolumeType>(source, sourceCubeCorner, target, targetCube);
+
+  VolumeNNFieldType::Pointer nnField = ComputeNNField(source, target, patchRadius, 1);
+
+  itk::ImageRegion<3> sourceInternalRegion = PatchMatchHelpers::GetInternalRegion(source->GetLargestPossibleRegion(), patchRadius);
+  itk::ImageRegion<3> targetInternalRegion = PatchMatchHelpers::GetInternalRegion(target->GetLargestPossibleRegion(), patchRadius);
+  itk::ImageRegion<3> cubeInternalRegion = PatchMatchHelpers::GetInternalRegion(targetCube, patchRadius);
+
+  unsigned int numberOfCorrectPixels = 0;
+  itk::ImageRegionConstIteratorWithIndex<VolumeNNFieldType> nnFieldIterator(nnField, targetInternalRegion);
+  while(!nnFieldIterator.IsAtEnd())
+  {
+    const itk::Index<3>& targetPixel = nnFieldIterator.GetIndex();
+    itk::Index<3> center = nnFieldIterator.Get().GetCenter(targetPixel);
+    if(!sourceInternalRegion.IsInside(center))
+    {
+      std::cerr << "The match of " << targetPixel << " is not inside of the source" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    float referenceScore = ReferenceSSD(source, PatchMatchHelpers::GetPatchRegion(center, patchRadius),
+                                        target, PatchMatchHelpers::GetPatchRegion(targetPixel, patchRadius));
+    if(nnFieldIterator.Get().GetScore() != referenceScore)
+    {
+      std::cerr << "The score of " << targetPixel << " is " << nnFieldIterator.Get().GetScore()
+                << " instead of " << referenceScore << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if(cubeInternalRegion.IsInside(targetPixel) && center == sourceCubeCorner + (targetPixel - targetCubeCorner))
+    {
+      numberOfCorrectPixels++;
+    }
+    ++nnFieldIterator;
+  }
+
+  std::cout << numberOfCorrectPixels << " of " << cubeInternalRegion.GetNumberOfPixels()
+            << " patches of the cube were matched to their origin." << std::endl;
+  if(numberOfCorrectPixels < 0.95 * cubeInternalRegion.GetNumberOfPixels())
+  {
+    std::cerr << "Too few patches of the cube were found" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The wavefront propagation and the per block random streams make the result independent of the threads
+  VolumeNNFieldType::Pointer parallelNNField = ComputeNNField(source, target, patchRadius, 3);
+  itk::ImageRegionConstIteratorWithIndex<VolumeNNFieldType> parallelIterator(parallelNNField, target->GetLargestPossibleRegion());
+  while(!parallelIterator.IsAtEnd())
+  {
+    if(!(parallelIterator.Get() == nnField->GetPixel(parallelIterator.GetIndex())))
+    {
+      std::cerr << "The match of " << parallelIterator.GetIndex() << " depends on the number of threads" << std::endl;
+      return EXIT_FAILURE;
+    }
+    ++parallelIterator;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ThreadPool.h"
+
+// STL
+#include <algorithm>
+
+ThreadPool::ThreadPool(const unsigned int numberOfThreads)
+{
+  unsigned int totalThreads = numberOfThreads;
+  if(totalThreads == 0)
+  {
+    totalThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  this->Ranges.reset(new WorkRange[totalThreads]);
+
+  // The calling thread is the remaining participant (with id 0)
+  for(unsigned int threadId = 1; threadId < totalThreads; ++threadId)
+  {
+    this->Workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, threadId));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Stop = true;
+  }
+  this->WorkAvailable.notify_all();
+
+  for(size_t workerId = 0; workerId < this->Workers.size(); ++workerId)
+  {
+    this->Workers[workerId].join();
+  }
+}
+
+void ThreadPool::ParallelFor(const size_t count, const std::function<void(size_t)>& functor)
+{
+  if(count == 0)
+  {
+    return;
+  }
+
+  // There is nothing to gain from waking the workers for a single index
+  if(this->Workers.empty() || count == 1)
+  {
+    for(size_t i = 0; i < count; ++i)
+    {
+      functor(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Functor = &functor;
+
+    // Start every thread with an equal contiguous share of the range
+    const unsigned int numberOfThreads = GetNumberOfThreads();
+    for(unsigned int threadId = 0; threadId < numberOfThreads; ++threadId)
+    {
+      std::lock_guard<std::mutex> rangeLock(this->Ranges[threadId].Mutex);
+      this->Ranges[threadId].Begin = count * threadId / numberOfThreads;
+      this->Ranges[threadId].End = count * (threadId + 1) / numberOfThreads;
+    }
+
+    this->NumberOfBusyWorkers = this->Workers.size();
+    this->Generation++;
+  }
+  this->WorkAvailable.notify_all();
+
+  RunJob(0);
+
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  this->WorkFinished.wait(lock, [this]{ return this->NumberOfBusyWorkers == 0; });
+  this->Functor = nullptr;
+}
+
+void ThreadPool::WorkerLoop(const unsigned int threadId)
+{
+  unsigned long long lastGeneration = 0;
+
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(this->Mutex);
+      this->WorkAvailable.wait(lock, [this, lastGeneration]{
+        return this->Stop || this->Generation != lastGeneration; });
+
+      if(this->Stop)
+      {
+        return;
+      }
+      lastGeneration = this->Generation;
+    }
+
+    RunJob(threadId);
+
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->NumberOfBusyWorkers--;
+    }
+    this->WorkFinished.notify_one();
+  }
+}
+
+void ThreadPool::RunJob(const unsigned int threadId)
+{
+  size_t index = 0;
+  do
+  {
+    while(PopIndex(threadId, index))
+    {
+      (*this->Functor)(index);
+    }
+  } while(Steal(threadId));
+}
+
+bool ThreadPool::PopIndex(const unsigned int threadId, size_t& index)
+{
+  WorkRange& range = this->Ranges[threadId];
+  std::lock_guard<std::mutex> lock(range.Mutex);
+
+  if(range.Begin >= range.End)
+  {
+    return false;
+  }
+
+  index = range.Begin++;
+  return true;
+}
+
+bool ThreadPool::Steal(const unsigned int threadId)
+{
+  const unsigned int numberOfThreads = GetNumberOfThreads();
+
+  for(unsigned int victimCounter = 1; victimCounter < numberOfThreads; ++victimCounter)
+  {
+    WorkRange& victim = this->Ranges[(threadId + victimCounter) % numberOfThreads];
+
+    size_t stolenBegin = 0;
+    size_t stolenEnd = 0;
+    {
+      std::lock_guard<std::mutex> lock(victim.Mutex);
+      if(victim.Begin >= victim.End)
+      {
+        continue;
+      }
+
+      // Take the back half (or the last index) so that the victim keeps the work next to what it is doing
+      stolenBegin = victim.Begin + (victim.End - victim.Begin) / 2;
+      stolenEnd = victim.End;
+      victim.End = stolenBegin;
+    }
+
+    WorkRange& range = this->Ranges[threadId];
+    std::lock_guard<std::mutex> lock(range.Mutex);
+    range.Begin = stolenBegin;
+    range.End = stolenEnd;
+    return true;
+  }
+
+  return false;
+}
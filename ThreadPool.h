@@ -0,0 +1,113 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ThreadPool_H
+#define ThreadPool_H
+
+// STL
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed set of worker threads that execute index ranges in parallel.
+  * The thread that calls ParallelFor() participates in the work, so a pool
+  * constructed with N threads starts N-1 workers. A pool of 1 thread runs
+  * everything inline on the calling thread.
+  *
+  * Scheduling is by work-stealing: each thread starts with a contiguous share of the
+  * range and takes indices from the front of it. A thread that runs out of work steals
+  * the back half of the remaining range of another thread. This keeps neighboring indices
+  * (e.g. neighboring tiles) on the same thread while still balancing very uneven work. */
+class ThreadPool
+{
+public:
+  /** Constructor. Zero threads means "use the number of hardware threads". */
+  explicit ThreadPool(const unsigned int numberOfThreads = 0);
+
+  /** Destructor. Joins all of the workers. */
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /** Get the number of threads that participate in a ParallelFor (including the caller). */
+  unsigned int GetNumberOfThreads() const
+  {
+    return this->Workers.size() + 1;
+  }
+
+  /** Call 'functor(i)' for every i in [0, count) and block until all calls have returned.
+    * Each call should represent a reasonable amount of work (a tile or a block of pixels
+    * rather than a single pixel).
+    * This function must not be called concurrently or from inside 'functor'. */
+  void ParallelFor(const size_t count, const std::function<void(size_t)>& functor);
+
+private:
+  /** The part of the current job that a thread has not yet run. */
+  struct WorkRange
+  {
+    std::mutex Mutex;
+    size_t Begin = 0;
+    size_t End = 0;
+  };
+
+  /** The function that each worker thread runs until the pool is destroyed. */
+  void WorkerLoop(const unsigned int threadId);
+
+  /** Run indices of the current job, stealing from other threads when 'threadId' runs out. */
+  void RunJob(const unsigned int threadId);
+
+  /** Take the next index from the range of 'threadId'. Returns false if the range is empty. */
+  bool PopIndex(const unsigned int threadId, size_t& index);
+
+  /** Move half of the remaining work of some other thread to 'threadId'. Returns false if
+    * every other thread is out of work. */
+  bool Steal(const unsigned int threadId);
+
+  /** The worker threads. */
+  std::vector<std::thread> Workers;
+
+  /** The remaining work of each thread (the calling thread has id 0). */
+  std::unique_ptr<WorkRange[]> Ranges;
+
+  /** Protects the job description and the worker bookkeeping below. */
+  std::mutex Mutex;
+
+  /** Signalled when a new job is available or the pool is stopping. */
+  std::condition_variable WorkAvailable;
+
+  /** Signalled when a worker finishes its part of a job. */
+  std::condition_variable WorkFinished;
+
+  /** The functor of the current job. */
+  const std::function<void(size_t)>* Functor = nullptr;
+
+  /** Incremented for every job so that workers can tell a new job from a spurious wakeup. */
+  unsigned long long Generation = 0;
+
+  /** The number of workers that have not yet finished the current job. */
+  unsigned int NumberOfBusyWorkers = 0;
+
+  /** Set when the pool is being destroyed. */
+  bool Stop = false;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ValidPatchCentersIndex.h"
+
+// ITK
+#include "itkImageRegionConstIterator.h"
+
+void ValidPatchCentersIndex::Build(const BoolImageType* const validPatchCentersImage)
+{
+  assert(validPatchCentersImage);
+
+  this->Region = validPatchCentersImage->GetLargestPossibleRegion();
+
+  const size_t width = this->Region.GetSize()[0];
+  const size_t height = this->Region.GetSize()[1];
+
+  this->TableWidth = width + 1;
+  this->Table.assign(this->TableWidth * (height + 1), 0);
+
+  // Raster order, so the iterator visits (x, y) in the same order as the table is filled
+  itk::ImageRegionConstIterator<BoolImageType> imageIterator(validPatchCentersImage, this->Region);
+
+  for(size_t y = 0; y < height; ++y)
+  {
+    unsigned int rowCount = 0;
+    for(size_t x = 0; x < width; ++x)
+    {
+      if(imageIterator.Get())
+      {
+        rowCount++;
+      }
+      ++imageIterator;
+
+      this->Table[(y + 1) * this->TableWidth + x + 1] = this->Table[y * this->TableWidth + x + 1] + rowCount;
+    }
+  }
+}
+
+bool ValidPatchCentersIndex::GetTableRange(const itk::ImageRegion<2>& region,
+                                           size_t& x0, size_t& x1, size_t& y0, size_t& y1) const
+{
+  itk::ImageRegion<2> croppedRegion = region;
+  if(!croppedRegion.Crop(this->Region))
+  {
+    return false;
+  }
+
+  x0 = croppedRegion.GetIndex()[0] - this->Region.GetIndex()[0];
+  y0 = croppedRegion.GetIndex()[1] - this->Region.GetIndex()[1];
+  x1 = x0 + croppedRegion.GetSize()[0];
+  y1 = y0 + croppedRegion.GetSize()[1];
+
+  return x1 > x0 && y1 > y0;
+}
+
+unsigned int ValidPatchCentersIndex::GetNumberOfValidPixels(const itk::ImageRegion<2>& region) const
+{
+  size_t x0, x1, y0, y1;
+  if(!GetTableRange(region, x0, x1, y0, y1))
+  {
+    return 0;
+  }
+
+  return GetCount(x0, x1, y0, y1);
+}
+
+bool ValidPatchCentersIndex::GetRandomValidPixel(const itk::ImageRegion<2>& region,
+                                                 PatchMatchHelpers::RandomGeneratorType& randomGenerator,
+                                                 itk::Index<2>& randomValidPixel) const
+{
+  size_t x0, x1, y0, y1;
+  if(!GetTableRange(region, x0, x1, y0, y1))
+  {
+    return false;
+  }
+
+  const unsigned int numberOfValidPixels = GetCount(x0, x1, y0, y1);
+  if(numberOfValidPixels == 0)
+  {
+    return false;
+  }
+
+  // Pick the rank of the valid pixel (in raster order inside of the region) that we will return
+  std::uniform_int_distribution<unsigned int> distribution(0, numberOfValidPixels - 1);
+  const unsigned int rank = distribution(randomGenerator);
+
+  // Find the row: the first y for which the rows [y0, y] contain more than 'rank' valid pixels
+  size_t low = y0;
+  size_t high = y1 - 1;
+  while(low < high)
+  {
+    size_t middle = low + (high - low) / 2;
+    if(GetCount(x0, x1, y0, middle + 1) > rank)
+    {
+      high = middle;
+    }
+    else
+    {
+      low = middle + 1;
+    }
+  }
+  const size_t y = low;
+  const unsigned int rankInRow = rank - GetCount(x0, x1, y0, y);
+
+  // Find the column: the first x for which [x0, x] of row y contains more than 'rankInRow' valid pixels
+  low = x0;
+  high = x1 - 1;
+  while(low < high)
+  {
+    size_t middle = low + (high - low) / 2;
+    if(GetCount(x0, middle + 1, y, y + 1) > rankInRow)
+    {
+      high = middle;
+    }
+    else
+    {
+      low = middle + 1;
+    }
+  }
+  const size_t x = low;
+
+  randomValidPixel[0] = this->Region.GetIndex()[0] + static_cast<itk::IndexValueType>(x);
+  randomValidPixel[1] = this->Region.GetIndex()[1] + static_cast<itk::IndexValueType>(y);
+
+  return true;
+}
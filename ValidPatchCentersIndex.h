@@ -0,0 +1,85 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef ValidPatchCentersIndex_H
+#define ValidPatchCentersIndex_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// STL
+#include <vector>
+
+// Custom
+#include "PatchMatchHelpers.h"
+
+/** A summed-area table of a "valid patch centers" image. It answers "how many valid centers
+  * are in this rectangle" in constant time, and draws a uniformly distributed valid center
+  * from any rectangle in O(log(width) + log(height)) without allocating. This replaces
+  * collecting every valid pixel of the search window for each random sample. */
+class ValidPatchCentersIndex
+{
+public:
+  typedef itk::Image<bool, 2> BoolImageType;
+
+  /** Build the table from 'validPatchCentersImage'. The image is not referenced afterwards. */
+  void Build(const BoolImageType* const validPatchCentersImage);
+
+  /** Get the number of valid centers in 'region' (which is cropped to the indexed image). */
+  unsigned int GetNumberOfValidPixels(const itk::ImageRegion<2>& region) const;
+
+  /** Draw a uniformly distributed valid center inside of 'region' from 'randomGenerator'.
+    * Returns false if the region does not contain any valid centers. */
+  bool GetRandomValidPixel(const itk::ImageRegion<2>& region, PatchMatchHelpers::RandomGeneratorType& randomGenerator,
+                           itk::Index<2>& randomValidPixel) const;
+
+  /** Get the region of the image that the table was built from. */
+  const itk::ImageRegion<2>& GetRegion() const
+  {
+    return this->Region;
+  }
+
+private:
+  /** The region of the image that the table was built from. */
+  itk::ImageRegion<2> Region;
+
+  /** The number of columns of the table (the image width + 1). */
+  size_t TableWidth = 0;
+
+  /** Table[y * TableWidth + x] is the number of valid centers in [0, x) x [0, y) (relative to the region corner). */
+  std::vector<unsigned int> Table;
+
+  /** Get the table entry at (x, y). */
+  unsigned int GetTableValue(const size_t x, const size_t y) const
+  {
+    return this->Table[y * this->TableWidth + x];
+  }
+
+  /** Get the number of valid centers in [x0, x1) x [y0, y1) (relative to the region corner). */
+  unsigned int GetCount(const size_t x0, const size_t x1, const size_t y0, const size_t y1) const
+  {
+    return GetTableValue(x1, y1) - GetTableValue(x0, y1) - GetTableValue(x1, y0) + GetTableValue(x0, y0);
+  }
+
+  /** Crop 'region' to the indexed region and convert it to half-open table coordinates.
+    * Returns false if nothing is left. */
+  bool GetTableRange(const itk::ImageRegion<2>& region, size_t& x0, size_t& x1, size_t& y0, size_t& y1) const;
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef VectorizedSSD_H
+#define VectorizedSSD_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// STL
+#include <limits>
+
+// Custom
+#include "SSDKernels.h"
+
+/** A sum of squared differences patch distance functor that works on whole patch rows
+  * of the image buffer instead of iterating pixel by pixel. It can be used anywhere the
+  * PatchComparison SSD functor is used (as the TPatchDistanceFunctor of Propagator and
+  * RandomSearch). TImage must be an itk::Image of scalars or of fixed length vectors
+  * (e.g. itk::CovariantVector<unsigned char, 3>), or an itk::VectorImage (e.g. a multi-modal MRI
+  * or a feature stack), of any dimension; the patches of volumes are compared row by row like
+  * those of images. The first patch of Distance() is taken from the source image and the second
+  * one from the target image, which are the same image unless they are set separately (to match
+  * one image to another). Distance() does not modify the functor, so it is safe to call from
+  * several threads at once. */
+template <typename TImage>
+class VectorizedSSD
+{
+public:
+  typedef typename SSDKernels::PixelTraits<typename TImage::PixelType>::ComponentType ComponentType;
+
+  static const unsigned int Dimension = TImage::ImageDimension;
+
+  typedef itk::ImageRegion<Dimension> RegionType;
+
+  /** Set the image that both patches are taken from. */
+  void SetImage(TImage* const image)
+  {
+    this->SourceImage = image;
+    this->TargetImage = image;
+  }
+
+  /** Set the image that the first patch (the match) is taken from. */
+  void SetSourceImage(TImage* const sourceImage)
+  {
+    this->SourceImage = sourceImage;
+  }
+
+  /** Set the image that the second patch (the patch to match) is taken from. */
+  void SetTargetImage(TImage* const targetImage)
+  {
+    this->TargetImage = targetImage;
+  }
+
+  /** Compute the sum of squared differences of the pixels of 'region1' of the source image and
+    * 'region2' of the target image (which must be the same size and inside of the buffered regions
+    * of the images). */
+  float Distance(const RegionType& region1, const RegionType& region2) const
+  {
+    return Distance(region1, region2, std::numeric_limits<float>::infinity());
+  }
+
+  /** Compute the sum of squared differences of 'region1' and 'region2', but stop after the first
+    * row at which the partial sum reaches 'upperBound'. The result is exact if it is less than
+    * 'upperBound', and not less than 'upperBound' otherwise. This lets a candidate patch that is
+    * worse than the current match be rejected after only a few of its rows. */
+  float Distance(const RegionType& region1, const RegionType& region2, const float upperBound) const
+  {
+    assert(this->SourceImage && this->TargetImage);
+    return Distance(this->SourceImage, region1, this->TargetImage, region2, upperBound);
+  }
+
+  /** Compute the sum of squared differences of 'region1' of 'image1' and 'region2' of 'image2', like
+    * above. The regions have to be inside of the buffered regions of their images, which can hold
+    * just a part of a larger image (e.g. tiles of an image that does not fit in memory). */
+  static float Distance(const TImage* const image1, const RegionType& region1,
+                        const TImage* const image2, const RegionType& region2, const float upperBound)
+  {
+    assert(region1.GetSize() == region2.GetSize());
+    assert(image1->GetBufferedRegion().IsInside(region1));
+    assert(image2->GetBufferedRegion().IsInside(region2));
+    assert(image1->GetNumberOfComponentsPerPixel() == image2->GetNumberOfComponentsPerPixel());
+
+    const unsigned int pixelLength = SSDKernels::PixelTraits<typename TImage::PixelType>::NumberOfComponents;
+    if(pixelLength != 0)
+    {
+      return DistanceOfRows<pixelLength>(image1, region1, image2, region2, upperBound, pixelLength);
+    }
+
+    // The number of components of the pixels of an itk::VectorImage is only known at run time. The
+    // common channel counts get kernels that are specialised for them, the others the generic one.
+    const unsigned int numberOfComponents = image1->GetNumberOfComponentsPerPixel();
+    switch(numberOfComponents)
+    {
+      case 1:
+        return DistanceOfRows<1>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      case 2:
+        return DistanceOfRows<2>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      case 3:
+        return DistanceOfRows<3>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      case 4:
+        return DistanceOfRows<4>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      case 8:
+        return DistanceOfRows<8>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      case 16:
+        return DistanceOfRows<16>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      case 32:
+        return DistanceOfRows<32>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      case 64:
+        return DistanceOfRows<64>(image1, region1, image2, region2, upperBound, numberOfComponents);
+      default:
+        return DistanceOfRows<0>(image1, region1, image2, region2, upperBound, numberOfComponents);
+    }
+  }
+
+private:
+  /** Compute the distance like above for pixels of VNumberOfComponents components (0 if that is only
+    * known at run time, in which case it is 'runTimeNumberOfComponents'). */
+  template <unsigned int VNumberOfComponents>
+  static float DistanceOfRows(const TImage* const image1, const RegionType& region1,
+                              const TImage* const image2, const RegionType& region2, const float upperBound,
+                              const unsigned int runTimeNumberOfComponents)
+  {
+    const size_t numberOfComponents = VNumberOfComponents != 0 ? VNumberOfComponents : runTimeNumberOfComponents;
+    const size_t rowLength = region1.GetSize()[0] * numberOfComponents;
+
+    // The distance (in components) between consecutive rows, slices, ... of the buffers
+    size_t strides1[Dimension];
+    size_t strides2[Dimension];
+    strides1[0] = numberOfComponents;
+    strides2[0] = numberOfComponents;
+    for(unsigned int dimension = 1; dimension < Dimension; ++dimension)
+    {
+      strides1[dimension] = strides1[dimension - 1] * image1->GetBufferedRegion().GetSize()[dimension - 1];
+      strides2[dimension] = strides2[dimension - 1] * image2->GetBufferedRegion().GetSize()[dimension - 1];
+    }
+
+    const ComponentType* row1 = reinterpret_cast<const ComponentType*>(image1->GetBufferPointer()) +
+                                image1->ComputeOffset(region1.GetIndex()) * numberOfComponents;
+    const ComponentType* row2 = reinterpret_cast<const ComponentType*>(image2->GetBufferPointer()) +
+                                image2->ComputeOffset(region2.GetIndex()) * numberOfComponents;
+
+    // The position of the current row in each dimension above the first
+    itk::SizeValueType rowPosition[Dimension] = {};
+
+    double sum = 0;
+    while(true)
+    {
+      sum += SSDKernels::PixelKernel<VNumberOfComponents, ComponentType>::SumOfSquaredDifferences(row1, row2, rowLength);
+      if(sum >= upperBound)
+      {
+        break; // The remaining rows can only make the distance larger
+      }
+
+      // Step to the next row, wrapping around to the next slice (and so on) at the end of one
+      unsigned int dimension = 1;
+      for(; dimension < Dimension; ++dimension)
+      {
+        if(++rowPosition[dimension] < region1.GetSize()[dimension])
+        {
+          row1 += strides1[dimension];
+          row2 += strides2[dimension];
+          break;
+        }
+        rowPosition[dimension] = 0;
+        row1 -= strides1[dimension] * (region1.GetSize()[dimension] - 1);
+        row2 -= strides2[dimension] * (region1.GetSize()[dimension] - 1);
+      }
+
+      if(dimension == Dimension)
+      {
+        break; // That was the last row
+      }
+    }
+
+    return static_cast<float>(sum);
+  }
+
+  /** The image that the first patches are taken from. */
+  TImage* SourceImage = nullptr;
+
+  /** The image that the second patches are taken from. */
+  TImage* TargetImage = nullptr;
+};
+
+#endif
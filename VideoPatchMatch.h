@@ -0,0 +1,188 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef VideoPatchMatch_H
+#define VideoPatchMatch_H
+
+// STL
+#include <vector>
+
+// ITK
+#include "itkImage.h"
+
+// Custom
+#include "NNField.h"
+#include "PatchMatch.h"
+#include "Propagator.h"
+#include "RandomSearch.h"
+#include "ThreadPool.h"
+
+/** This class computes the nearest neighbor fields of the frames of a video, one frame after the
+  * other. The first frame (and any frame of a different size) starts from a random field. Every
+  * following frame starts from the field of the previous frame, rescored against the new frame,
+  * so that a few iterations with a small random search window are enough to follow the motion.
+  * A patch distance functor of type TPatchDistanceFunctor (which must provide SetImage and
+  * Distance) is created for every frame. */
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField = NNFieldType>
+class VideoPatchMatch
+{
+public:
+  /** The type of the nearest neighbor field. */
+  typedef TNNField NNFieldType;
+
+  typedef Propagator<TPatchDistanceFunctor, NNFieldType> PropagatorType;
+  typedef RandomSearch<TImage, TPatchDistanceFunctor, NNFieldType> RandomSearchType;
+  typedef PatchMatch<TImage, PropagatorType, RandomSearchType> PatchMatchType;
+
+  typedef itk::Image<bool, 2> BoolImageType;
+
+  /** Compute the nearest neighbor field of the next frame. */
+  void ComputeFrame(TImage* const frame);
+
+  /** Forget the previous frame, so that the next frame starts from a random field (after a cut). */
+  void Reset()
+  {
+    this->NNField = NNFieldType::New();
+    this->NumberOfFrames = 0;
+  }
+
+  /** Set the image of valid patch centers, which is shared by all of the frames. If none is
+    * set, every fully defined patch is valid. */
+  void SetValidPatchCentersImage(BoolImageType* const validPatchCentersImage)
+  {
+    this->ValidPatchCentersImage = validPatchCentersImage;
+  }
+
+  /** Set the pixels at which to compute the NN field of every frame. If none are set, the whole
+    * internal region is. */
+  void SetTargetPixels(const std::vector<itk::Index<2> >& targetPixels)
+  {
+    this->TargetPixels = targetPixels;
+  }
+
+  /** Set the patch radius. */
+  void SetPatchRadius(const unsigned int patchRadius)
+  {
+    this->PatchRadius = patchRadius;
+  }
+
+  /** Set the number of iterations of a frame that starts from a random field. */
+  void SetFirstFrameIterations(const unsigned int firstFrameIterations)
+  {
+    this->FirstFrameIterations = firstFrameIterations;
+  }
+
+  /** Set the number of iterations of a frame that starts from the field of the previous frame. */
+  void SetFrameIterations(const unsigned int frameIterations)
+  {
+    this->FrameIterations = frameIterations;
+  }
+
+  /** Set the radius of the first random search window of a frame that starts from the field of
+    * the previous frame. Zero (the default) uses a quarter of the larger side of the frame. */
+  void SetWarmStartSearchRadius(const unsigned int warmStartSearchRadius)
+  {
+    this->WarmStartSearchRadius = warmStartSearchRadius;
+  }
+
+  /** Set the pool on which every frame runs. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the tile size of the tiled engine (see PatchMatch::SetTileSize). */
+  void SetTileSize(const unsigned int tileSize)
+  {
+    this->TileSize = tileSize;
+  }
+
+  /** Set if propagation candidates are scored incrementally (see Propagator::SetIncremental). */
+  void SetIncremental(const bool incremental)
+  {
+    this->Incremental = incremental;
+  }
+
+  /** Set if the results are truly randomized. This should only be false for testing purposes. */
+  void SetRandom(const bool random)
+  {
+    this->Random = random;
+  }
+
+  /** Get the nearest neighbor field of the last frame. */
+  NNFieldType* GetNNField()
+  {
+    return this->NNField;
+  }
+
+  /** Get the number of frames computed since the start (or the last Reset()). */
+  unsigned int GetNumberOfFrames() const
+  {
+    return this->NumberOfFrames;
+  }
+
+  /** Get if the last frame started from the field of the previous frame. */
+  bool GetLastFrameWasWarmStarted() const
+  {
+    return this->LastFrameWasWarmStarted;
+  }
+
+private:
+  /** The valid patch centers of every frame. */
+  BoolImageType* ValidPatchCentersImage = nullptr;
+
+  /** The pixels at which to compute the NN field of every frame. */
+  std::vector<itk::Index<2> > TargetPixels;
+
+  /** The radius of patches to compare. (Patch side length = 2*radius + 1)*/
+  unsigned int PatchRadius = 5;
+
+  /** The number of iterations of a frame that starts from a random field. */
+  unsigned int FirstFrameIterations = 5;
+
+  /** The number of iterations of a frame that starts from the field of the previous frame. */
+  unsigned int FrameIterations = 2;
+
+  /** The radius of the first random search window of a warm started frame, or zero for a quarter of the frame. */
+  unsigned int WarmStartSearchRadius = 0;
+
+  /** The pool on which every frame runs. */
+  ThreadPool* Pool = nullptr;
+
+  /** The tile size of the tiled engine. */
+  unsigned int TileSize = 0;
+
+  /** A flag indicating whether propagation candidates are scored incrementally. */
+  bool Incremental = false;
+
+  /** Determine if the result should be randomized. */
+  bool Random = true;
+
+  /** The number of frames computed since the start (or the last Reset()). */
+  unsigned int NumberOfFrames = 0;
+
+  /** A flag indicating whether the last frame started from the field of the previous frame. */
+  bool LastFrameWasWarmStarted = false;
+
+  /** The nearest neighbor field of the last frame. */
+  typename NNFieldType::Pointer NNField = NNFieldType::New();
+};
+
+#include "VideoPatchMatch.hpp"
+
+#endif
@@ -0,0 +1,107 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef VideoPatchMatch_HPP
+#define VideoPatchMatch_HPP
+
+#include "VideoPatchMatch.h"
+
+// STL
+#include <algorithm>
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// Custom
+#include "PatchMatchHelpers.h"
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TNNField>
+void VideoPatchMatch<TImage, TPatchDistanceFunctor, TNNField>::ComputeFrame(TImage* const frame)
+{
+  assert(frame);
+  assert(this->PatchRadius > 0);
+
+  const itk::ImageRegion<2> frameRegion = frame->GetLargestPossibleRegion();
+
+  // Without a valid patch centers image, every fully defined patch of the frame is valid
+  BoolImageType::Pointer validPatchCentersImage = this->ValidPatchCentersImage;
+  if(!validPatchCentersImage)
+  {
+    validPatchCentersImage = BoolImageType::New();
+    validPatchCentersImage->SetRegions(frameRegion);
+    validPatchCentersImage->Allocate();
+    validPatchCentersImage->FillBuffer(true);
+  }
+
+  TPatchDistanceFunctor patchDistanceFunctor;
+  patchDistanceFunctor.SetImage(frame);
+
+  PropagatorType propagationFunctor;
+  propagationFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  propagationFunctor.SetPatchRadius(this->PatchRadius);
+  propagationFunctor.SetThreadPool(this->Pool);
+  propagationFunctor.SetIncremental(this->Incremental);
+
+  RandomSearchType randomSearchFunctor;
+  randomSearchFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  randomSearchFunctor.SetPatchRadius(this->PatchRadius);
+  randomSearchFunctor.SetImage(frame);
+  randomSearchFunctor.SetThreadPool(this->Pool);
+  randomSearchFunctor.SetRandom(this->Random);
+
+  PatchMatchType patchMatch;
+  patchMatch.SetImage(frame);
+  patchMatch.SetPatchRadius(this->PatchRadius);
+  patchMatch.SetPropagationFunctor(&propagationFunctor);
+  patchMatch.SetRandomSearchFunctor(&randomSearchFunctor);
+  patchMatch.SetValidPatchCentersImage(validPatchCentersImage);
+  patchMatch.SetTargetPixels(this->TargetPixels);
+  patchMatch.SetThreadPool(this->Pool);
+  patchMatch.SetTileSize(this->TileSize);
+  patchMatch.SetVerbose(false);
+
+  this->LastFrameWasWarmStarted = this->NumberOfFrames > 0 &&
+                                  this->NNField->GetLargestPossibleRegion() == frameRegion;
+
+  if(this->LastFrameWasWarmStarted)
+  {
+    // The matches of the previous frame are kept, but their scores have to describe the new frame
+    PatchMatchHelpers::RescoreNNField(this->NNField.GetPointer(), &patchDistanceFunctor, this->PatchRadius, this->Pool);
+    patchMatch.SetInitialNNField(this->NNField);
+    patchMatch.SetIterations(this->FrameIterations);
+
+    unsigned int warmStartSearchRadius = this->WarmStartSearchRadius;
+    if(warmStartSearchRadius == 0)
+    {
+      warmStartSearchRadius = std::max<unsigned int>(std::max(frameRegion.GetSize()[0], frameRegion.GetSize()[1]) / 4, 1);
+    }
+    randomSearchFunctor.SetMaximumSearchRadius(warmStartSearchRadius);
+  }
+  else
+  {
+    patchMatch.SetIterations(this->FirstFrameIterations);
+  }
+
+  patchMatch.Compute();
+
+  // The field outlives the PatchMatch object of its frame because it is reference counted
+  this->NNField = patchMatch.GetNNField();
+  this->NumberOfFrames++;
+}
+
+#endif
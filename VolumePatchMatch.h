@@ -0,0 +1,210 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef VolumePatchMatch_H
+#define VolumePatchMatch_H
+
+// ITK
+#include "itkImage.h"
+
+// STL
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+// Custom
+#include "CompactMatch.h"
+#include "PatchMatchHelpers.h"
+#include "ThreadPool.h"
+#include "VectorizedSSD.h"
+
+/** This class computes the nearest neighbor field of a target image of any dimension (e.g. a CT or
+  * MR volume) in a source image of the same dimension. It is PatchMatch with the dimension taken
+  * from TImage:
+  * - Propagation tries the matches of the 2 * Dimension face neighbors, those before a voxel (-1 along
+  *   each axis) in the forward pass and those after it in the backward pass.
+  * - Random search draws from windows of decreasing radius around the match in every dimension.
+  * - The target is processed in cubic blocks, so the voxels of a patch and the matches of their
+  *   neighbors stay in cache. The blocks of a propagation pass run in parallel as a wavefront (the
+  *   blocks whose coordinates have the same sum are independent, see WavefrontTraversal for 2D) and
+  *   every block has its own random stream, so the result does not depend on the number of threads.
+  * The patch distance functor (e.g. VectorizedSSD, which handles any dimension) has to be set to the
+  * images by the caller. TMatch has to store N-dimensional centers (like CompactMatch).
+  *
+  * This is a separate engine rather than PatchMatch with Propagator and RandomSearch templated on the
+  * dimension, because most of what PatchMatch adds is 2D: the mask and the sampling index of the valid
+  * patch centers, the tiles, the wavefront of the propagator, its incremental scoring from patch edges,
+  * the active set, Recompute and the NN field files. The steps themselves do not depend on the dimension
+  * and are shared through PatchMatchHelpers (GetPropagationOffsets, GetPropagatedCenter, TryMatch,
+  * GetRandomPixelInRegion and CheckMatchRange), so both engines propagate and search the same way. */
+template <typename TImage, typename TPatchDistanceFunctor = VectorizedSSD<TImage>,
+          typename TMatch = CompactMatch<int16_t, TImage::ImageDimension> >
+class VolumePatchMatch
+{
+public:
+  static const unsigned int Dimension = TImage::ImageDimension;
+
+  typedef itk::Index<Dimension> IndexType;
+  typedef itk::ImageRegion<Dimension> RegionType;
+
+  /** The type of the nearest neighbor field. */
+  typedef itk::Image<TMatch, Dimension> NNFieldType;
+
+  /** Compute the nearest neighbor field of the target. Throws std::runtime_error if TMatch cannot
+    * store the offsets between the target and the source (see CompactMatch::CanStoreOffsets). */
+  void Compute();
+
+  /** Get the nearest neighbor field of the last Compute(). The voxels whose patches are not inside of
+    * the target keep a default match. */
+  NNFieldType* GetOutput()
+  {
+    return this->Output;
+  }
+
+  /** Set the image that the matches are taken from. */
+  void SetSourceImage(TImage* const sourceImage)
+  {
+    this->SourceImage = sourceImage;
+  }
+
+  /** Set the image whose patches are matched. */
+  void SetTargetImage(TImage* const targetImage)
+  {
+    this->TargetImage = targetImage;
+  }
+
+  /** Set the functor that compares a patch of the source image (first) to one of the target image (second). */
+  void SetPatchDistanceFunctor(TPatchDistanceFunctor* const patchDistanceFunctor)
+  {
+    this->PatchDistanceFunctor = patchDistanceFunctor;
+  }
+
+  void SetPatchRadius(const unsigned int patchRadius)
+  {
+    this->PatchRadius = patchRadius;
+  }
+
+  void SetIterations(const unsigned int iterations)
+  {
+    this->Iterations = iterations;
+  }
+
+  /** Set the pool to run on. Without one, everything runs on the calling thread. */
+  void SetThreadPool(ThreadPool* const threadPool)
+  {
+    this->Pool = threadPool;
+  }
+
+  /** Set the side length of the blocks that the target is processed in. */
+  void SetBlockSize(const unsigned int blockSize)
+  {
+    this->BlockSize = blockSize;
+  }
+
+  /** Set if the results are truly randomized. This should only be false for testing purposes. */
+  void SetRandom(const bool random)
+  {
+    this->Seed = random ? static_cast<unsigned int>(time(NULL)) : 0;
+    this->NumberOfSearchPasses = 0;
+  }
+
+private:
+  /** Split 'internalRegion' into blocks and sort them into waves. */
+  void CreateBlocks(const RegionType& internalRegion);
+
+  /** Give every voxel of the internal region of the target a random match. */
+  void RandomlyInitializeNNField();
+
+  /** Propagate the matches of the face neighbors in the given direction, one wave of blocks after the other. */
+  void Propagate(const bool forward);
+
+  /** Try the matches of the neighbors of 'targetPixel' at 'propagationOffsets' (see
+    * PatchMatchHelpers::GetPropagationOffsets). */
+  void PropagatePixel(const IndexType& targetPixel, const std::vector<itk::Offset<Dimension> >& propagationOffsets);
+
+  /** Look for better matches of every voxel in windows of decreasing radius around its match. */
+  void RandomSearch();
+
+  /** Replace 'match' (of 'targetPixel') by the patch at 'center' if it is better (see
+    * PatchMatchHelpers::TryMatch). The current match is not evaluated again. */
+  void TryMatch(const IndexType& targetPixel, const RegionType& targetRegion, const IndexType& center,
+                TMatch& match) const;
+
+  /** Call 'processPixel(pixel)' for the voxels of 'block' in raster order, or in the reverse order. */
+  template <typename TProcessPixel>
+  static void ForEachPixelInBlock(const RegionType& block, const bool forward, TProcessPixel processPixel);
+
+  /** Call 'processBlock(blockId)' for the blocks [firstBlockId, lastBlockId) on the pool. */
+  template <typename TProcessBlock>
+  void ForEachBlock(const size_t firstBlockId, const size_t lastBlockId, TProcessBlock processBlock) const;
+
+  /** Get the voxels of the source image whose patches are inside of it. */
+  RegionType GetSourceInternalRegion() const
+  {
+    return PatchMatchHelpers::GetInternalRegion(this->SourceImage->GetLargestPossibleRegion(), this->PatchRadius);
+  }
+
+  /** Create the generator of random stream 'streamId' of the current sampling pass. */
+  PatchMatchHelpers::RandomGeneratorType CreateRandomGenerator(const unsigned int streamId) const
+  {
+    return PatchMatchHelpers::CreateRandomGenerator(this->Seed, this->NumberOfSearchPasses, streamId);
+  }
+
+  /** The image that the matches are taken from. */
+  TImage* SourceImage = nullptr;
+
+  /** The image whose patches are matched. */
+  TImage* TargetImage = nullptr;
+
+  /** The functor used to compare patches. */
+  TPatchDistanceFunctor* PatchDistanceFunctor = nullptr;
+
+  /** The nearest neighbor field. */
+  typename NNFieldType::Pointer Output = NNFieldType::New();
+
+  /** The voxels of the target whose patches are inside of it. */
+  RegionType TargetInternalRegion;
+
+  /** The blocks of the internal region of the target, sorted by wave. */
+  std::vector<RegionType> Blocks;
+
+  /** The blocks of wave i are Blocks[WaveStarts[i]] to Blocks[WaveStarts[i + 1] - 1]. */
+  std::vector<size_t> WaveStarts;
+
+  /** The radius of the patches. */
+  unsigned int PatchRadius = 3;
+
+  /** The number of iterations of propagation and random search. */
+  unsigned int Iterations = 5;
+
+  /** The pool to run on. */
+  ThreadPool* Pool = nullptr;
+
+  /** The side length of the blocks. 16^3 voxels (with their matches and patches) fit in the L2 cache. */
+  unsigned int BlockSize = 16;
+
+  /** The seed of the random streams. */
+  unsigned int Seed = static_cast<unsigned int>(time(NULL));
+
+  /** The number of sampling passes so far (the initialization and every random search). */
+  unsigned int NumberOfSearchPasses = 0;
+};
+
+#include "VolumePatchMatch.hpp"
+
+#endif
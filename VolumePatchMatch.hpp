@@ -0,0 +1,286 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef VolumePatchMatch_HPP
+#define VolumePatchMatch_HPP
+
+#include "VolumePatchMatch.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::Compute()
+{
+  assert(this->SourceImage);
+  assert(this->TargetImage);
+  assert(this->PatchDistanceFunctor);
+  assert(this->BlockSize > 0);
+
+  PatchMatchHelpers::CheckMatchRange<TMatch>(this->SourceImage->GetLargestPossibleRegion(),
+                                             this->TargetImage->GetLargestPossibleRegion());
+
+  this->TargetInternalRegion = PatchMatchHelpers::GetInternalRegion(this->TargetImage->GetLargestPossibleRegion(),
+                                                                    this->PatchRadius);
+  CreateBlocks(this->TargetInternalRegion);
+
+  this->Output->SetRegions(this->TargetImage->GetLargestPossibleRegion());
+  this->Output->Allocate();
+  this->Output->FillBuffer(TMatch());
+
+  if(GetSourceInternalRegion().GetNumberOfPixels() == 0)
+  {
+    return; // There are no patches to match to
+  }
+
+  RandomlyInitializeNNField();
+
+  for(unsigned int iteration = 0; iteration < this->Iterations; ++iteration)
+  {
+    Propagate(iteration % 2 == 0);
+    RandomSearch();
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::CreateBlocks(const RegionType& internalRegion)
+{
+  this->Blocks.clear();
+  this->WaveStarts.assign(1, 0);
+  if(internalRegion.GetNumberOfPixels() == 0)
+  {
+    return;
+  }
+
+  // The blocks in raster order, with the wave (the sum of the block coordinates) of each
+  itk::Size<Dimension> numberOfBlocks;
+  size_t totalNumberOfBlocks = 1;
+  size_t numberOfWaves = 1;
+  for(unsigned int dimension = 0; dimension < Dimension; ++dimension)
+  {
+    numberOfBlocks[dimension] = (internalRegion.GetSize()[dimension] + this->BlockSize - 1) / this->BlockSize;
+    totalNumberOfBlocks *= numberOfBlocks[dimension];
+    numberOfWaves += numberOfBlocks[dimension] - 1;
+  }
+
+  std::vector<RegionType> blocks(totalNumberOfBlocks);
+  std::vector<size_t> blockWaves(totalNumberOfBlocks);
+  this->WaveStarts.assign(numberOfWaves + 1, 0);
+  for(size_t blockId = 0; blockId < totalNumberOfBlocks; ++blockId)
+  {
+    IndexType blockCorner;
+    itk::Size<Dimension> blockSize;
+    size_t remainder = blockId;
+    blockWaves[blockId] = 0;
+    for(unsigned int dimension = 0; dimension < Dimension; ++dimension)
+    {
+      size_t blockCoordinate = remainder % numberOfBlocks[dimension];
+      remainder /= numberOfBlocks[dimension];
+      blockWaves[blockId] += blockCoordinate;
+
+      itk::SizeValueType offset = blockCoordinate * this->BlockSize;
+      blockCorner[dimension] = internalRegion.GetIndex()[dimension] + static_cast<itk::IndexValueType>(offset);
+      blockSize[dimension] = std::min<itk::SizeValueType>(this->BlockSize, internalRegion.GetSize()[dimension] - offset);
+    }
+    blocks[blockId] = RegionType(blockCorner, blockSize);
+    this->WaveStarts[blockWaves[blockId] + 1]++;
+  }
+
+  // Sort the blocks by wave with a counting sort
+  for(size_t wave = 0; wave < numberOfWaves; ++wave)
+  {
+    this->WaveStarts[wave + 1] += this->WaveStarts[wave];
+  }
+
+  this->Blocks.resize(totalNumberOfBlocks);
+  std::vector<size_t> waveFill(this->WaveStarts.begin(), this->WaveStarts.end() - 1);
+  for(size_t blockId = 0; blockId < totalNumberOfBlocks; ++blockId)
+  {
+    this->Blocks[waveFill[blockWaves[blockId]]++] = blocks[blockId];
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::RandomlyInitializeNNField()
+{
+  const RegionType sourceInternalRegion = GetSourceInternalRegion();
+
+  this->NumberOfSearchPasses++;
+
+  ForEachBlock(0, this->Blocks.size(), [this, &sourceInternalRegion](const size_t blockId)
+  {
+    PatchMatchHelpers::RandomGeneratorType randomGenerator = CreateRandomGenerator(blockId);
+
+    ForEachPixelInBlock(this->Blocks[blockId], true, [this, &sourceInternalRegion, &randomGenerator](const IndexType& targetPixel)
+    {
+      IndexType randomCenter = PatchMatchHelpers::GetRandomPixelInRegion(sourceInternalRegion, randomGenerator);
+
+      TMatch match;
+      match.SetCenter(targetPixel, randomCenter, this->PatchRadius);
+      match.SetScore(PatchMatchHelpers::BoundedDistance(this->PatchDistanceFunctor,
+                                                        PatchMatchHelpers::GetPatchRegion(randomCenter, this->PatchRadius),
+                                                        PatchMatchHelpers::GetPatchRegion(targetPixel, this->PatchRadius),
+                                                        std::numeric_limits<float>::infinity()));
+      this->Output->SetPixel(targetPixel, match);
+    });
+  });
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::Propagate(const bool forward)
+{
+  const std::vector<itk::Offset<Dimension> > propagationOffsets = PatchMatchHelpers::GetPropagationOffsets<Dimension>(forward);
+
+  // A block only reads the blocks of the previous wave (in the direction of the pass), so the blocks
+  // of a wave are independent
+  const size_t numberOfWaves = this->WaveStarts.size() - 1;
+  for(size_t waveCounter = 0; waveCounter < numberOfWaves; ++waveCounter)
+  {
+    size_t wave = forward ? waveCounter : numberOfWaves - 1 - waveCounter;
+    ForEachBlock(this->WaveStarts[wave], this->WaveStarts[wave + 1], [this, forward, &propagationOffsets](const size_t blockId)
+    {
+      ForEachPixelInBlock(this->Blocks[blockId], forward, [this, &propagationOffsets](const IndexType& targetPixel)
+      {
+        PropagatePixel(targetPixel, propagationOffsets);
+      });
+    });
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+PropagatePixel(const IndexType& targetPixel, const std::vector<itk::Offset<Dimension> >& propagationOffsets)
+{
+  const RegionType sourceInternalRegion = GetSourceInternalRegion();
+  const RegionType targetRegion = PatchMatchHelpers::GetPatchRegion(targetPixel, this->PatchRadius);
+
+  TMatch match = this->Output->GetPixel(targetPixel);
+  for(size_t propagationOffsetId = 0; propagationOffsetId < propagationOffsets.size(); ++propagationOffsetId)
+  {
+    const IndexType neighbor = targetPixel + propagationOffsets[propagationOffsetId];
+    if(!this->TargetInternalRegion.IsInside(neighbor))
+    {
+      continue;
+    }
+
+    const IndexType potentialMatchPixel =
+      PatchMatchHelpers::GetPropagatedCenter(this->Output->GetPixel(neighbor).GetCenter(neighbor),
+                                             propagationOffsets[propagationOffsetId]);
+    if(sourceInternalRegion.IsInside(potentialMatchPixel))
+    {
+      TryMatch(targetPixel, targetRegion, potentialMatchPixel, match);
+    }
+  }
+  this->Output->SetPixel(targetPixel, match);
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::RandomSearch()
+{
+  const RegionType sourceInternalRegion = GetSourceInternalRegion();
+
+  // The maximum (first) search radius, as prescribed in PatchMatch paper section 3.2
+  unsigned int initialRadius = 0;
+  for(unsigned int dimension = 0; dimension < Dimension; ++dimension)
+  {
+    initialRadius = std::max<unsigned int>(initialRadius, sourceInternalRegion.GetSize()[dimension]);
+  }
+
+  this->NumberOfSearchPasses++;
+
+  // Every voxel is searched independently, so all of the blocks can run at once
+  ForEachBlock(0, this->Blocks.size(), [this, &sourceInternalRegion, initialRadius](const size_t blockId)
+  {
+    PatchMatchHelpers::RandomGeneratorType randomGenerator = CreateRandomGenerator(blockId);
+
+    ForEachPixelInBlock(this->Blocks[blockId], true,
+                        [this, &sourceInternalRegion, initialRadius, &randomGenerator](const IndexType& targetPixel)
+    {
+      const RegionType targetRegion = PatchMatchHelpers::GetPatchRegion(targetPixel, this->PatchRadius);
+      TMatch match = this->Output->GetPixel(targetPixel);
+      const IndexType searchCenter = match.GetCenter(targetPixel);
+
+      // Search an exponentially smaller window each time through the loop
+      for(unsigned int radius = initialRadius; radius > this->PatchRadius; radius /= 2)
+      {
+        RegionType searchRegion = PatchMatchHelpers::GetPatchRegion(searchCenter, radius);
+        searchRegion.Crop(sourceInternalRegion);
+
+        TryMatch(targetPixel, targetRegion, PatchMatchHelpers::GetRandomPixelInRegion(searchRegion, randomGenerator), match);
+      }
+      this->Output->SetPixel(targetPixel, match);
+    });
+  });
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+TryMatch(const IndexType& targetPixel, const RegionType& targetRegion, const IndexType& center, TMatch& match) const
+{
+  // The current match cannot beat itself
+  if(match.GetCenter(targetPixel) != center)
+  {
+    PatchMatchHelpers::TryMatch(this->PatchDistanceFunctor, targetPixel, targetRegion, center, this->PatchRadius, match);
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+template <typename TProcessPixel>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+ForEachPixelInBlock(const RegionType& block, const bool forward, TProcessPixel processPixel)
+{
+  const size_t numberOfPixels = block.GetNumberOfPixels();
+  for(size_t pixelCounter = 0; pixelCounter < numberOfPixels; ++pixelCounter)
+  {
+    size_t remainder = forward ? pixelCounter : numberOfPixels - 1 - pixelCounter;
+
+    IndexType pixel;
+    for(unsigned int dimension = 0; dimension < Dimension; ++dimension)
+    {
+      pixel[dimension] = block.GetIndex()[dimension] + static_cast<itk::IndexValueType>(remainder % block.GetSize()[dimension]);
+      remainder /= block.GetSize()[dimension];
+    }
+
+    processPixel(pixel);
+  }
+}
+
+template <typename TImage, typename TPatchDistanceFunctor, typename TMatch>
+template <typename TProcessBlock>
+void VolumePatchMatch<TImage, TPatchDistanceFunctor, TMatch>::
+ForEachBlock(const size_t firstBlockId, const size_t lastBlockId, TProcessBlock processBlock) const
+{
+  if(this->Pool)
+  {
+    this->Pool->ParallelFor(lastBlockId - firstBlockId, [firstBlockId, &processBlock](const size_t blockCounter)
+    {
+      processBlock(firstBlockId + blockCounter);
+    });
+  }
+  else
+  {
+    for(size_t blockId = firstBlockId; blockId < lastBlockId; ++blockId)
+    {
+      processBlock(blockId);
+    }
+  }
+}
+
+#endif
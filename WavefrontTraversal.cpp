@@ -0,0 +1,58 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "WavefrontTraversal.h"
+
+// STL
+#include <cassert>
+
+WavefrontTraversal::WavefrontTraversal(const std::vector<itk::Index<2> >& targetPixels, const itk::ImageRegion<2>& region,
+                                       const unsigned int blockSize)
+{
+  assert(blockSize > 0);
+
+  const itk::Index<2> origin = region.GetIndex();
+  this->NumberOfBlocksX = (region.GetSize()[0] + blockSize - 1) / blockSize;
+  this->NumberOfBlocksY = (region.GetSize()[1] + blockSize - 1) / blockSize;
+  const size_t numberOfBlocks = static_cast<size_t>(this->NumberOfBlocksX) * this->NumberOfBlocksY;
+
+  // Bucket the target pixels by block with a stable counting sort
+  std::vector<size_t> pixelBlockIds(targetPixels.size());
+  this->BlockStarts.assign(numberOfBlocks + 1, 0);
+  for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
+  {
+    const itk::Index<2>& targetPixel = targetPixels[targetPixelId];
+    assert(region.IsInside(targetPixel));
+    size_t blockX = (targetPixel[0] - origin[0]) / blockSize;
+    size_t blockY = (targetPixel[1] - origin[1]) / blockSize;
+    pixelBlockIds[targetPixelId] = blockY * this->NumberOfBlocksX + blockX;
+    this->BlockStarts[pixelBlockIds[targetPixelId] + 1]++;
+  }
+
+  for(size_t blockId = 0; blockId < numberOfBlocks; ++blockId)
+  {
+    this->BlockStarts[blockId + 1] += this->BlockStarts[blockId];
+  }
+
+  this->BlockPixels.resize(targetPixels.size());
+  std::vector<size_t> blockFill(this->BlockStarts.begin(), this->BlockStarts.end() - 1);
+  for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
+  {
+    this->BlockPixels[blockFill[pixelBlockIds[targetPixelId]]++] = targetPixels[targetPixelId];
+  }
+}
@@ -0,0 +1,111 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef WavefrontTraversal_H
+#define WavefrontTraversal_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// STL
+#include <algorithm>
+#include <vector>
+
+// Custom
+#include "ThreadPool.h"
+
+/** The parallel traversal of a propagation pass. The target pixels are put into square blocks.
+  * Because a pixel only reads its neighbors to the left and above (forward) or to the right and
+  * below (backward), blocks on the same anti-diagonal (of blocks) are independent and are processed
+  * in parallel, one anti-diagonal (wave) after the other. Within a block the pixels are visited in
+  * the order of the serial traversal, so the result is identical to it. */
+class WavefrontTraversal
+{
+public:
+  /** Put 'targetPixels', which have to be inside of 'region', into blocks of 'blockSize' pixels on a
+    * side. Inside of a block the pixels keep their order. */
+  WavefrontTraversal(const std::vector<itk::Index<2> >& targetPixels, const itk::ImageRegion<2>& region,
+                     const unsigned int blockSize);
+
+  size_t GetNumberOfBlocks() const
+  {
+    return this->BlockStarts.size() - 1;
+  }
+
+  /** Call 'processPixel(pixel, blockId)' for every target pixel, in the forward or backward order,
+    * on the threads of 'pool'. Calls with the same block id are never concurrent, so per block
+    * counters can be kept without locks. */
+  template <typename TProcessPixel>
+  void Traverse(const bool forward, ThreadPool* const pool, TProcessPixel processPixel) const
+  {
+    if(GetNumberOfBlocks() == 0)
+    {
+      return;
+    }
+
+    // Block (x,y) depends on blocks (x-1,y) and (x,y-1) in the forward pass and on (x+1,y)
+    // and (x,y+1) in the backward pass, so the waves (anti-diagonals of blocks) are run in order.
+    const unsigned int numberOfWaves = this->NumberOfBlocksX + this->NumberOfBlocksY - 1;
+    for(unsigned int waveCounter = 0; waveCounter < numberOfWaves; ++waveCounter)
+    {
+      unsigned int wave = forward ? waveCounter : numberOfWaves - 1 - waveCounter;
+
+      unsigned int firstBlockX = (wave >= this->NumberOfBlocksY) ? wave - this->NumberOfBlocksY + 1 : 0;
+      unsigned int lastBlockX = std::min(wave, this->NumberOfBlocksX - 1);
+
+      auto processBlock = [&](const size_t waveBlockId)
+      {
+        size_t blockX = firstBlockX + waveBlockId;
+        size_t blockId = (wave - blockX) * this->NumberOfBlocksX + blockX;
+
+        const size_t blockStart = this->BlockStarts[blockId];
+        const size_t blockEnd = this->BlockStarts[blockId + 1];
+        for(size_t blockPixelId = blockStart; blockPixelId < blockEnd; ++blockPixelId)
+        {
+          size_t pixelId = forward ? blockPixelId : blockEnd - 1 - (blockPixelId - blockStart);
+          processPixel(this->BlockPixels[pixelId], blockId);
+        }
+      };
+
+      if(pool)
+      {
+        pool->ParallelFor(lastBlockX - firstBlockX + 1, processBlock);
+      }
+      else
+      {
+        for(size_t waveBlockId = 0; waveBlockId <= lastBlockX - firstBlockX; ++waveBlockId)
+        {
+          processBlock(waveBlockId);
+        }
+      }
+    }
+  }
+
+private:
+  /** The number of blocks in each row and column. */
+  unsigned int NumberOfBlocksX = 0;
+  unsigned int NumberOfBlocksY = 0;
+
+  /** The target pixels, block by block. */
+  std::vector<itk::Index<2> > BlockPixels;
+
+  /** The pixels of block i are BlockPixels[BlockStarts[i]] to BlockPixels[BlockStarts[i + 1] - 1]. */
+  std::vector<size_t> BlockStarts;
+};
+
+#endif